@@ -0,0 +1,70 @@
+#!/bin/bash
+# Copyright (c) Huawei Technologies Co., Ltd. 2020-2021. All rights reserved.
+# gazelle is licensed under the Mulan PSL v2.
+# You can use this software according to the terms and conditions of the Mulan PSL v2.
+# You may obtain a copy of Mulan PSL v2 at:
+#     http://license.coscl.org.cn/MulanPSL2
+# THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+# PURPOSE.
+# See the Mulan PSL v2 for more details.
+
+# run example server and client in one process over lstack net_ring port, report benchmark result of each api
+
+BENCH_DIR=$(
+    cd $(dirname $0)/
+    pwd
+)
+
+EXAMPLE=${EXAMPLE:-${BENCH_DIR}/../../build/examples/example}
+LSTACK_LIB=${LSTACK_LIB:-/usr/lib64/liblstack.so}
+LSTACK_CONF=${LSTACK_CONF:-${BENCH_DIR}/lstack_loopback.conf}
+RUNTIME=${RUNTIME:-10}
+PKTLEN=${PKTLEN:-1024}
+THREAD_NUM=${THREAD_NUM:-1}
+CONNECT_NUM=${CONNECT_NUM:-1}
+MODELS=${MODELS:-"mum mud"}
+APIS=${APIS:-"readwrite recvsend readvwritev recvsendmsg"}
+
+usage()
+{
+    echo "Usage: bash loopback_bench.sh"
+    echo "Environment:"
+    echo "  EXAMPLE       example binary, default ${EXAMPLE}"
+    echo "  LSTACK_LIB    lstack library, default ${LSTACK_LIB}"
+    echo "  LSTACK_CONF   lstack config with net_ring vdev, default ${LSTACK_CONF}"
+    echo "  RUNTIME       seconds of each case, default ${RUNTIME}"
+    echo "  PKTLEN        packet length, default ${PKTLEN}"
+    echo "  THREAD_NUM    client and mum server thread number, default ${THREAD_NUM}"
+    echo "  CONNECT_NUM   connection number of each client thread, default ${CONNECT_NUM}"
+    echo "  MODELS        server models, default \"${MODELS}\""
+    echo "  APIS          apis, default \"${APIS}\""
+}
+
+if [ "$1" = "-h" ] || [ "$1" = "--help" ]; then
+    usage
+    exit 0
+fi
+
+if [ ! -x "${EXAMPLE}" ] || [ ! -f "${LSTACK_LIB}" ] || [ ! -f "${LSTACK_CONF}" ]; then
+    usage
+    exit 1
+fi
+
+host_addr=$(grep "^host_addr" ${LSTACK_CONF} | awk -F '"' '{print $2}')
+
+ret=0
+for model in ${MODELS}; do
+    for api in ${APIS}; do
+        echo "==== model: ${model} api: ${api} ===="
+        LSTACK_CONF_PATH=${LSTACK_CONF} GAZELLE_BIND_PROCNAME=$(basename ${EXAMPLE}) LD_PRELOAD=${LSTACK_LIB} \
+            ${EXAMPLE} --ringpmd --ip ${host_addr} --model ${model} --api ${api} --pktlen ${PKTLEN} \
+            --threadnum ${THREAD_NUM} --connectnum ${CONNECT_NUM} --runtime ${RUNTIME} | sed -n '/\[benchmark result\]/,$p'
+        if [ ${PIPESTATUS[0]} -ne 0 ]; then
+            echo "model: ${model} api: ${api} failed"
+            ret=1
+        fi
+    done
+done
+
+exit ${ret}
@@ -39,6 +39,8 @@ struct ClientHandler
 {
     int32_t fd;                 ///< socket file descriptor
     uint32_t msg_idx;           ///< the start charactors index of message
+    uint64_t send_time;         ///< the time of last message sent in nanoseconds
+    uint64_t latency;           ///< the round trip time of last message in nanoseconds
 };
 
 
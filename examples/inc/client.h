@@ -31,6 +31,9 @@ struct ClientUnit
     struct epoll_event *epevs;          ///< the epoll events
     uint32_t curr_connect;              ///< current connection number
     uint64_t send_bytes;                ///< total send bytes
+    uint64_t recv_pkts;                 ///< total answers received
+    uint64_t *latency_hist;             ///< the round trip latency histogram
+    pthread_t tid;                      ///< the client thread, its cpu time counts in benchmark
     in_addr_t ip;                       ///< server ip
     in_addr_t groupip;                  ///< server groupip
     uint16_t port;                      ///< server port
@@ -53,6 +56,7 @@ struct Client
 {
     struct ClientUnit *uints;           ///< the server mum unit
     bool debug;                         ///< if we print the debug information
+    uint64_t begin_time;                ///< the begin time in nanoseconds
 };
 
 
@@ -75,6 +79,14 @@ void client_debug_print(const char *ch_str, const char *act_str, in_addr_t ip, u
  */
 void client_info_print(struct Client *client);
 
+/**
+ * @brief the client prints benchmark result
+ * The client prints throughput, cpu time of client threads per packet and latency percentiles since it started.
+ * @param client            the client information
+ * @param params            the parameters pointer
+ */
+void client_bench_print(struct Client *client, struct ProgramParams *params);
+
 /**
  * @brief the single thread, client try to connect to server, register to epoll
  * The single thread, client try to connect to server, register to epoll.
@@ -34,6 +34,7 @@
 #define PARAM_DEFAULT_EPOLLCREATE   ("ec")                  ///< default method of epoll_create
 #define PARAM_DEFAULT_ACCEPT        ("ac")                  ///< default method of accept method
 #define PARAM_DEFAULT_GROUPIP       ("0.0.0.0")             ///< default group IP>
+#define PARAM_DEFAULT_RUNTIME       (0)                     ///< default run time, 0 means run forever
 
 
 enum {
@@ -71,6 +72,8 @@ enum {
     PARAM_NUM_ACCEPT = 'C',
 #define PARAM_NAME_GROUPIP          ("groupip")             ///< name of parameter group ip
     PARAM_NUM_GROUPIP = 'g',
+#define PARAM_NAME_RUNTIME          ("runtime")             ///< name of parameter run time
+    PARAM_NUM_RUNTIME = 'T',
 };
 
 #define NO_ARGUMENT             0                           ///< options takes no arguments
@@ -110,6 +113,7 @@ struct ProgramParams {
     char*               accept;             ///< accept connections method
     bool                ringpmd;            ///< if we use ring PMD or not
     char*               groupip;            ///< group IP address>
+    uint32_t            runtime;            ///< the seconds client runs before printing benchmark result
 };
 
 /**
@@ -23,6 +23,7 @@
 #include <inttypes.h>
 #include <unistd.h>
 #include <ctype.h>
+#include <time.h>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -107,6 +108,11 @@
 
 #define SOCKET_UNIX_DOMAIN_FILE             "unix_domain_file"  ///< socket unix domain file
 
+#define LATENCY_HIST_SUB_BITS               (4)                 ///< linear sub buckets bits of each power of two
+#define LATENCY_HIST_SUB_NUM                (1 << LATENCY_HIST_SUB_BITS)    ///< linear sub buckets of each power of two
+#define LATENCY_HIST_MAX_BITS               (40)                ///< latency over 2^40 ns falls in the last bucket
+#define LATENCY_HIST_SIZE                   ((LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1) * LATENCY_HIST_SUB_NUM)
+
 
 /**
  * @brief create the socket and listen
@@ -141,5 +147,31 @@ int32_t create_socket_and_connect(int32_t *socket_fd, in_addr_t ip, in_addr_t gr
  */
 int32_t set_socket_unblock(int32_t socket_fd);
 
+/**
+ * @brief get the time in nanoseconds
+ * This function gets the time of specify clock in nanoseconds.
+ * @param clock_id      the clock id, such as CLOCK_MONOTONIC or CLOCK_PROCESS_CPUTIME_ID
+ * @return              the time in nanoseconds
+ */
+uint64_t get_time_ns(clockid_t clock_id);
+
+/**
+ * @brief record the latency
+ * This function records the latency into the log-linear histogram.
+ * @param hist          the histogram with LATENCY_HIST_SIZE buckets
+ * @param latency       the latency in nanoseconds
+ */
+void latency_hist_record(uint64_t *hist, uint64_t latency);
+
+/**
+ * @brief get the latency percentile
+ * This function gets the highest latency of the bucket that percent of samples fall in or below.
+ * @param hist          the histogram with LATENCY_HIST_SIZE buckets
+ * @param total         the number of samples
+ * @param percent       the percent in range of 0 - 100
+ * @return              the latency in nanoseconds
+ */
+uint64_t latency_hist_percentile(const uint64_t *hist, uint64_t total, double percent);
+
 
 #endif // __EXAMPLES_UTILITIES_H__
@@ -15,9 +15,20 @@
 #include "server.h"
 #include "client.h"
 
+#define LOOPBACK_SERVER_READY_SEC   (1)     ///< wait server listen before client connect in loopback
+
+
 static struct ProgramParams prog_params;
 
 
+// run server in loopback, client connects to it through the ring PMD of the same lstack
+static void *loopback_server_run(void *arg)
+{
+    server_create_and_run((struct ProgramParams *)arg);
+    return NULL;
+}
+
+
 int32_t main(int argc, char *argv[])
 {
     int32_t ret = PROGRAM_OK;
@@ -29,7 +40,15 @@ int32_t main(int argc, char *argv[])
     }
     program_params_print(&prog_params);
 
-    if (strcmp(prog_params.as, "server") == 0) {
+    if (prog_params.ringpmd == true) {
+        pthread_t server_tid;
+        if (pthread_create(&server_tid, NULL, loopback_server_run, &prog_params) != 0) {
+            PRINT_ERROR("can't create loopback server thread %d! ", errno);
+            return PROGRAM_FAULT;
+        }
+        sleep(LOOPBACK_SERVER_READY_SEC);
+        ret = client_create_and_run(&prog_params);
+    } else if (strcmp(prog_params.as, "server") == 0) {
         server_create_and_run(&prog_params);
     } else {
         client_create_and_run(&prog_params);
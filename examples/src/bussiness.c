@@ -249,6 +249,7 @@ int32_t client_ask(struct ClientHandler *client_handler, uint32_t pktlen, const
             continue;
         }
     }
+    client_handler->send_time = get_time_ns(CLOCK_MONOTONIC);
 
     free(buffer_in);
     free(buffer_out);
@@ -286,6 +287,7 @@ int32_t client_chkans(struct ClientHandler *client_handler, uint32_t pktlen, boo
             continue;
         }
     }
+    client_handler->latency = get_time_ns(CLOCK_MONOTONIC) - client_handler->send_time;
 
     if (client_bussiness(buffer_out, buffer_in, length, verify, &(client_handler->msg_idx)) < 0) {
         PRINT_ERROR("message verify fault! ");
@@ -316,6 +318,7 @@ int32_t client_chkans(struct ClientHandler *client_handler, uint32_t pktlen, boo
             continue;
         }
     }
+    client_handler->send_time = get_time_ns(CLOCK_MONOTONIC);
 
     free(buffer_in);
     free(buffer_out);
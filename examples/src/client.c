@@ -14,6 +14,9 @@
 #include "client.h"
 
 
+#define BENCH_LABEL_LEN     32                  // the length of benchmark result label
+
+
 static pthread_mutex_t client_debug_mutex;      // the client mutex for printf
 
 
@@ -84,6 +87,58 @@ void client_info_print(struct Client *client)
     }
 }
 
+// the client prints benchmark result
+void client_bench_print(struct Client *client, struct ProgramParams *params)
+{
+    const double percents[] = {50, 90, 99, 99.9, 99.99};
+    uint64_t time_sub = get_time_ns(CLOCK_MONOTONIC) - client->begin_time;
+    uint64_t *latency_hist = (uint64_t *)calloc(LATENCY_HIST_SIZE, sizeof(uint64_t));
+    uint64_t recv_pkts = 0;
+    uint64_t send_bytes = 0;
+    uint64_t cpu_sub = 0;
+    uint32_t curr_connect = 0;
+    clockid_t cpu_clock;
+
+    if (latency_hist == NULL) {
+        return;
+    }
+
+    struct ClientUnit *curr_uint = client->uints;
+    while (curr_uint != NULL && curr_uint->latency_hist != NULL) {
+        curr_connect += curr_uint->curr_connect;
+        recv_pkts += curr_uint->recv_pkts;
+        send_bytes += curr_uint->send_bytes;
+        // only client threads, stack threads of the same process busy poll and the server may run here too
+        if (pthread_getcpuclockid(curr_uint->tid, &cpu_clock) == 0) {
+            cpu_sub += get_time_ns(cpu_clock);
+        }
+        for (uint32_t i = 0; i < LATENCY_HIST_SIZE; ++i) {
+            latency_hist[i] += curr_uint->latency_hist[i];
+        }
+        curr_uint = curr_uint->next;
+    }
+
+    double seconds = (double)time_sub / 1000000000;
+    printf("\n[benchmark result]: \n\n");
+    printf("--> [api]:                      %s \n", params->api);
+    printf("--> [packet length]:            %u \n", params->pktlen);
+    printf("--> [connect num]:              %u \n", curr_connect);
+    printf("--> [time]:                     %.3f s \n", seconds);
+    printf("--> [requests]:                 %"PRIu64" \n", recv_pkts);
+    printf("--> [throughput]:               %.3f Kpps, %.3f MB/s \n", (double)recv_pkts / seconds / 1000,
+           (double)send_bytes / seconds / (1024 * 1024));
+    printf("--> [client cpu per packet]:    %.3f us \n", recv_pkts ? (double)cpu_sub / recv_pkts / 1000 : 0);
+    for (uint32_t i = 0; i < sizeof(percents) / sizeof(percents[0]); ++i) {
+        char label[BENCH_LABEL_LEN];
+        sprintf_s(label, sizeof(label), "[latency p%g]:", percents[i]);
+        printf("--> %-28s%.3f us \n", label,
+               (double)latency_hist_percentile(latency_hist, recv_pkts, percents[i]) / 1000);
+    }
+    printf("\n");
+
+    free(latency_hist);
+}
+
 // the single thread, client try to connect to server, register to epoll
 int32_t client_thread_try_connect(struct ClientHandler *client_handler, int32_t epoll_fd, in_addr_t ip, in_addr_t groupip, uint16_t port, uint16_t sport, const char *domain, const char *api)
 {
@@ -286,6 +341,9 @@ int32_t clithd_proc_epevs(struct ClientUnit *client_unit)
                 }
                 client_debug_print("client unit", "close", client_unit->ip, client_unit->port, client_unit->debug);
             } else {
+                struct ClientHandler *client_handler = (struct ClientHandler *)curr_epev->data.ptr;
+                ++(client_unit->recv_pkts);
+                latency_hist_record(client_unit->latency_hist, client_handler->latency);
                 client_unit->send_bytes += client_unit->pktlen;
                 client_debug_print("client unit", "receive", client_unit->ip, client_unit->port, client_unit->debug);
             }
@@ -332,17 +390,22 @@ int32_t client_create_and_run(struct ProgramParams *params)
 
     client->uints = client_unit;
     client->debug = params->debug;
+    client->begin_time = get_time_ns(CLOCK_MONOTONIC);
 
     for (uint32_t i = 0; i < thread_num; ++i) {
         client_unit->handlers = (struct ClientHandler *)malloc(connect_num * sizeof(struct ClientHandler));
         for (uint32_t j = 0; j < connect_num; ++j) {
             client_unit->handlers[j].fd = -1;
             client_unit->handlers[j].msg_idx = 0;
+            client_unit->handlers[j].send_time = 0;
+            client_unit->handlers[j].latency = 0;
         }
         client_unit->epfd = -1;
         client_unit->epevs = (struct epoll_event *)malloc(CLIENT_EPOLL_SIZE_MAX * sizeof(struct epoll_event));
         client_unit->curr_connect = 0;
         client_unit->send_bytes = 0;
+        client_unit->recv_pkts = 0;
+        client_unit->latency_hist = (uint64_t *)calloc(LATENCY_HIST_SIZE, sizeof(uint64_t));
         client_unit->ip = inet_addr(params->ip);
         client_unit->groupip = inet_addr(params->groupip);
         client_unit->port = htons(params->port);
@@ -361,6 +424,7 @@ int32_t client_create_and_run(struct ProgramParams *params)
             PRINT_ERROR("client can't create thread of poisx %d! ", errno);
             return PROGRAM_FAULT;
         }
+        client_unit->tid = tids[i];
         client_unit = client_unit->next;
     }
 
@@ -369,6 +433,11 @@ int32_t client_create_and_run(struct ProgramParams *params)
     }
     while (true) {
         client_info_print(client);
+        if (params->runtime > 0 && get_time_ns(CLOCK_MONOTONIC) - client->begin_time >=
+            (uint64_t)params->runtime * 1000000000) {
+            client_bench_print(client, params);
+            break;
+        }
     }
 
     pthread_mutex_destroy(&client_debug_mutex);
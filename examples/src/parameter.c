@@ -33,6 +33,7 @@ const char prog_short_opts[] = \
     "E"         // epollcreate
     "C"         // accept
     "g:"        // group address
+    "T:"        // run time
     ;
 
 // program long options
@@ -55,6 +56,7 @@ const struct ProgramOption prog_long_opts[] = \
     {PARAM_NAME_EPOLLCREATE, REQUIRED_ARGUMETN, NULL, PARAM_NUM_EPOLLCREATE},
     {PARAM_NAME_ACCEPT, REQUIRED_ARGUMETN, NULL, PARAM_NUM_ACCEPT},
     {PARAM_NAME_GROUPIP, REQUIRED_ARGUMETN, NULL, PARAM_NUM_GROUPIP},
+    {PARAM_NAME_RUNTIME, REQUIRED_ARGUMETN, NULL, PARAM_NUM_RUNTIME},
 };
 
 
@@ -214,6 +216,18 @@ void program_param_parse_groupip(struct ProgramParams *params)
     }
 }
 
+// set `runtime` parameter
+void program_param_parse_runtime(struct ProgramParams *params)
+{
+    int32_t runtime_arg = strtol(optarg, NULL, 0);
+    if (runtime_arg >= 0) {
+        params->runtime = (uint32_t)runtime_arg;
+    } else {
+        PRINT_ERROR("illigal argument -- %s \n", optarg);
+        exit(PROGRAM_ABORT);
+    }
+}
+
 // initialize the parameters
 void program_params_init(struct ProgramParams *params)
 {
@@ -233,6 +247,7 @@ void program_params_init(struct ProgramParams *params)
     params->epollcreate = PARAM_DEFAULT_EPOLLCREATE;
     params->accept = PARAM_DEFAULT_ACCEPT;
     params->groupip = PARAM_DEFAULT_GROUPIP;
+    params->runtime = PARAM_DEFAULT_RUNTIME;
 }
 
 // print program helps
@@ -263,11 +278,13 @@ void program_params_help(void)
     printf("    recvfrom: just use `recvfrom`, used by the server to receive group messages. \n");
     printf("-P, --pktlen [????]: set packet length in range of %d - %d. \n", MESSAGE_PKTLEN_MIN, MESSAGE_PKTLEN_MAX);
     printf("-v, --verify: set to verifying the message packet. \n");
-    printf("-r, --ringpmd: set to use ringpmd. \n");
+    printf("-r, --ringpmd: set to use ringpmd, server and client run in one process and loop back. \n");
     printf("-d, --debug: set to print the debug information. \n");
     printf("-h, --help: see helps. \n");
     printf("-E, --epollcreate [ec | ec1]: epoll_create method. \n");
     printf("-C, --accept [ac | ac4]: accept method. \n");
+    printf("-T, --runtime [???]: set the seconds client runs, then print benchmark result and exit. "
+           "0 runs forever. \n");
     printf("\n");
 }
 
@@ -334,6 +351,9 @@ int32_t program_params_parse(struct ProgramParams *params, uint32_t argc, char *
 	    case (PARAM_NUM_GROUPIP):
 	        program_param_parse_groupip(params);
 		break;
+            case (PARAM_NUM_RUNTIME):
+                program_param_parse_runtime(params);
+                break;
             case (PARAM_NUM_HELP):
                 program_params_help();
                 return PROGRAM_ABORT;
@@ -404,5 +424,8 @@ void program_params_print(struct ProgramParams *params)
     printf("--> [debug]:                    %s \n", (params->debug == true) ? "on" : "off");
     printf("--> [epoll create]:             %s \n", params->epollcreate);
     printf("--> [accept]:                   %s \n", params->accept);
+    if (params->runtime > 0) {
+        printf("--> [runtime]:                  %u s \n", params->runtime);
+    }
     printf("\n");
 }
@@ -342,6 +342,11 @@ int32_t sermud_create_and_run(struct ProgramParams *params)
         printf("[program informations]: \n\n");
     }
     while (true) {
+        // client prints informations when server and client loop back in one process
+        if (params->ringpmd == true) {
+            sleep(1);
+            continue;
+        }
         sermud_info_print(server_mud);
     }
 
@@ -600,6 +605,11 @@ int32_t sermum_create_and_run(struct ProgramParams *params)
         printf("[program informations]: \n\n");
     }
     while (true) {
+        // client prints informations when server and client loop back in one process
+        if (params->ringpmd == true) {
+            sleep(1);
+            continue;
+        }
         sermum_info_print(server_mum);
     }
 
@@ -198,3 +198,60 @@ int32_t set_socket_unblock(int32_t socket_fd)
 
     return 0;
 }
+
+// get the time in nanoseconds
+uint64_t get_time_ns(clockid_t clock_id)
+{
+    struct timespec ts;
+    clock_gettime(clock_id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// get the bucket of latency, each power of two is split into LATENCY_HIST_SUB_NUM linear buckets
+static uint32_t latency_hist_bucket(uint64_t latency)
+{
+    if (latency < LATENCY_HIST_SUB_NUM) {
+        return (uint32_t)latency;
+    }
+
+    uint32_t msb = 63 - (uint32_t)__builtin_clzll(latency);
+    if (msb >= LATENCY_HIST_MAX_BITS) {
+        return LATENCY_HIST_SIZE - 1;
+    }
+
+    uint32_t shift = msb - LATENCY_HIST_SUB_BITS;
+    return (shift + 1) * LATENCY_HIST_SUB_NUM + (uint32_t)(latency >> shift) - LATENCY_HIST_SUB_NUM;
+}
+
+// record the latency
+void latency_hist_record(uint64_t *hist, uint64_t latency)
+{
+    hist[latency_hist_bucket(latency)]++;
+}
+
+// get the latency percentile
+uint64_t latency_hist_percentile(const uint64_t *hist, uint64_t total, double percent)
+{
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)((double)total * percent / 100 + 0.5);
+    rank = (rank == 0) ? 1 : rank;
+
+    uint64_t count = 0;
+    uint32_t bucket = 0;
+    for (; bucket < LATENCY_HIST_SIZE - 1; ++bucket) {
+        count += hist[bucket];
+        if (count >= rank) {
+            break;
+        }
+    }
+
+    if (bucket < LATENCY_HIST_SUB_NUM) {
+        return bucket;
+    }
+    uint32_t shift = bucket / LATENCY_HIST_SUB_NUM - 1;
+    uint64_t sub = bucket % LATENCY_HIST_SUB_NUM + LATENCY_HIST_SUB_NUM;
+    return ((sub + 1) << shift) - 1;
+}
@@ -165,8 +165,9 @@ static __rte_always_inline uint32_t gazelle_ring_sp_enqueue(struct rte_ring *r,
     uint32_t head = __atomic_load_n(&r->cons.head, __ATOMIC_ACQUIRE);
     uint32_t tail = r->cons.tail;
 
-    uint32_t entries = r->capacity + tail - head;
-    if (n > entries) {
+    /* capacity may have been lowered below the objects still queued */
+    uint32_t used = head - tail;
+    if (used >= r->capacity || n > r->capacity - used) {
         return 0;
     }
 
@@ -217,6 +218,18 @@ static __rte_always_inline uint32_t gazelle_ring_read(struct rte_ring *r, void *
     return n;
 }
 
+/* replace the last n objects read by gazelle_ring_read, must be called before gazelle_ring_read_over */
+static __rte_always_inline void gazelle_ring_read_replace(struct rte_ring *r, void **obj_table, uint32_t n)
+{
+    __rte_ring_enqueue_elems(r, r->prod.head - n, obj_table, sizeof(void *), n);
+}
+
+/* undo the last n objects read by gazelle_ring_read, must be called before gazelle_ring_read_over */
+static __rte_always_inline void gazelle_ring_read_cancel(struct rte_ring *r, uint32_t n)
+{
+    r->prod.head -= n;
+}
+
 static __rte_always_inline void gazelle_ring_read_over(struct rte_ring *r)
 {
     __atomic_store_n(&r->prod.tail, r->prod.head, __ATOMIC_RELEASE);
@@ -227,6 +240,12 @@ static __rte_always_inline uint32_t gazelle_ring_readover_count(struct rte_ring
     rte_smp_rmb();
     return r->prod.tail - r->cons.tail;
 }
+/* objects read by gazelle_ring_read but not read over yet */
+static __rte_always_inline uint32_t gazelle_ring_read_pending(const struct rte_ring *r)
+{
+    return r->prod.head - r->prod.tail;
+}
+
 static __rte_always_inline uint32_t gazelle_ring_readable_count(const struct rte_ring *r)
 {
     rte_smp_rmb();
@@ -240,6 +259,40 @@ static __rte_always_inline uint32_t gazelle_ring_count(const struct rte_ring *r)
 }
 static __rte_always_inline uint32_t gazelle_ring_free_count(const struct rte_ring *r)
 {
-    return r->capacity - gazelle_ring_count(r);
+    uint32_t count = gazelle_ring_count(r);
+    return (count >= r->capacity) ? 0 : r->capacity - count;
+}
+
+/* usable size of the ring, up to the size it was created with. called by the enqueue thread,
+   objects over a lowered capacity stay queued and are consumed as usual */
+static __rte_always_inline void gazelle_ring_set_capacity(struct rte_ring *r, uint32_t capacity)
+{
+    __atomic_store_n(&r->capacity, RTE_MIN(capacity, r->mask), __ATOMIC_RELAXED);
+}
+
+/* ring size to carry bytes of one rtt twice over, power of 2 in [min, max] */
+static inline uint32_t gazelle_ring_bdp_size(uint32_t bytes, uint32_t elapsed_ms, uint32_t rtt_us,
+    uint32_t min, uint32_t max)
+{
+    /* 1000us per ms */
+    uint64_t bdp = (uint64_t)bytes * rtt_us / ((uint64_t)elapsed_ms * 1000);
+    uint64_t mbufs = (bdp + MBUF_MAX_DATA_LEN - 1) / MBUF_MAX_DATA_LEN * 2;
+
+    if (mbufs <= min) {
+        return min;
+    }
+    if (mbufs >= max) {
+        return max;
+    }
+    return RTE_MIN(rte_align32pow2((uint32_t)mbufs), max);
+}
+
+/* grow at once, shrink by half only when far below, so bursty flows don't flap */
+static inline uint32_t gazelle_ring_next_size(uint32_t cur, uint32_t size)
+{
+    if (size > cur) {
+        return size;
+    }
+    return (size <= cur / 4) ? cur / 2 : cur;
 }
 #endif
@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sched.h>
 
 #include "gazelle_dfx_msg.h"
 
@@ -60,3 +61,61 @@ int write_specied_len(int fd, const char *buf, size_t target_size)
 
     return 0;
 }
+
+static uint64_t gazelle_latency_bucket_max(uint32_t bucket)
+{
+    if (bucket < GAZELLE_LATENCY_SUB_NUM) {
+        return bucket;
+    }
+
+    uint32_t shift = bucket / GAZELLE_LATENCY_SUB_NUM - 1;
+    uint64_t sub = bucket % GAZELLE_LATENCY_SUB_NUM + GAZELLE_LATENCY_SUB_NUM;
+    return ((sub + 1) << shift) - 1;
+}
+
+uint64_t gazelle_latency_percentile(const uint64_t *hist, uint64_t pkts, double percent)
+{
+    if (pkts == 0) {
+        return 0;
+    }
+
+    /* rank of the target pkt, at least the first one */
+    uint64_t rank = (uint64_t)((double)pkts * percent / 100.0 + 0.5);
+    rank = (rank == 0) ? 1 : rank;
+
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < GAZELLE_LATENCY_BUCKETS; i++) {
+        count += hist[i];
+        if (count >= rank) {
+            return gazelle_latency_bucket_max(i);
+        }
+    }
+
+    return gazelle_latency_bucket_max(GAZELLE_LATENCY_BUCKETS - 1);
+}
+
+void gazelle_latency_merge(uint64_t *dst, const uint64_t *src)
+{
+    for (uint32_t i = 0; i < GAZELLE_LATENCY_BUCKETS; i++) {
+        dst[i] += src[i];
+    }
+}
+
+int gazelle_stat_page_read(const struct gazelle_stack_stat_page *page, struct gazelle_stack_stat_data *data)
+{
+    for (uint32_t i = 0; i < GAZELLE_STAT_SHM_READ_RETRY; i++) {
+        uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1) != 0) {
+            sched_yield();
+            continue;
+        }
+
+        (void)memcpy(data, (const void *)&page->data, sizeof(*data));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
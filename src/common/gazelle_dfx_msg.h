@@ -67,6 +67,10 @@ struct gazelle_stack_stat {
     uint64_t tx_drop;
     uint64_t tx;
     uint64_t tx_prepare_fail;
+    /* mbufs held by connections of the stack, see conn_mbuf_quota */
+    uint64_t conn_mbuf_cnt;
+    uint64_t conn_mbuf_peak;
+    uint64_t read_lwip_quota;
 };
 
 struct gazelle_wakeup_stat {
@@ -75,6 +79,7 @@ struct gazelle_wakeup_stat {
     uint64_t app_write_cnt;
     uint64_t app_read_cnt;
     uint64_t read_null;
+    uint64_t app_write_quota;
 };
 
 struct gazelle_stat_pkts {
@@ -169,6 +174,8 @@ struct gazelle_stat_lstack_conn_info {
     uint32_t events;
     uint32_t epoll_events;
     uint32_t eventlist;
+    uint32_t mbuf_cnt;
+    uint32_t mbuf_peak;
 };
 
 struct gazelle_stat_lstack_conn {
@@ -177,11 +184,49 @@ struct gazelle_stat_lstack_conn {
     struct gazelle_stat_lstack_conn_info conn_list[GAZELLE_LSTACK_MAX_CONN];
 };
 
+/* log-linear latency histogram in us. values below GAZELLE_LATENCY_SUB_NUM have own bucket, every power of two
+   above is split into GAZELLE_LATENCY_SUB_NUM linear buckets, so relative error is below 1/GAZELLE_LATENCY_SUB_NUM.
+   latency over 2^GAZELLE_LATENCY_MAX_BITS us fall into the last bucket. */
+#define GAZELLE_LATENCY_SUB_BITS         4
+#define GAZELLE_LATENCY_SUB_NUM          (1 << GAZELLE_LATENCY_SUB_BITS)
+#define GAZELLE_LATENCY_MAX_BITS         32
+#define GAZELLE_LATENCY_BUCKETS          ((GAZELLE_LATENCY_MAX_BITS - GAZELLE_LATENCY_SUB_BITS + 1) * \
+                                          GAZELLE_LATENCY_SUB_NUM)
+
+static inline uint32_t gazelle_latency_bucket(uint64_t latency)
+{
+    if (latency < GAZELLE_LATENCY_SUB_NUM) {
+        return (uint32_t)latency;
+    }
+
+    uint32_t msb = 63 - (uint32_t)__builtin_clzll(latency);
+    if (msb >= GAZELLE_LATENCY_MAX_BITS) {
+        return GAZELLE_LATENCY_BUCKETS - 1;
+    }
+
+    uint32_t shift = msb - GAZELLE_LATENCY_SUB_BITS;
+    return (shift + 1) * GAZELLE_LATENCY_SUB_NUM + (uint32_t)(latency >> shift) - GAZELLE_LATENCY_SUB_NUM;
+}
+
+/* readers copy histograms without lock and merge by add buckets.
+ * histogram written by one thread only, e.g. stack thread or forward core */
+static inline void gazelle_latency_record(uint64_t *hist, uint64_t latency)
+{
+    hist[gazelle_latency_bucket(latency)]++;
+}
+
+/* histogram written by several threads, e.g. app threads reading from one stack */
+static inline void gazelle_latency_record_shared(uint64_t *hist, uint64_t latency)
+{
+    (void)__atomic_fetch_add(&hist[gazelle_latency_bucket(latency)], 1, __ATOMIC_RELAXED);
+}
+
 struct stack_latency {
     uint64_t latency_max;
     uint64_t latency_min;
     uint64_t latency_pkts;
     uint64_t latency_total;
+    uint64_t latency_hist[GAZELLE_LATENCY_BUCKETS];
 };
 
 struct gazelle_stack_latency {
@@ -240,6 +285,58 @@ struct gazelle_stack_dfx_data {
     } data;
 };
 
+/*
+ * stat shm: lstack stack threads publish their counters into a file under GAZELLE_RUN_DIR,
+ * readers map it and copy pages out without sending any request to lstack.
+ * each page is guarded by a seqlock, seq is odd while its stack thread is updating data.
+ */
+#define GAZELLE_STAT_SHM_MAGIC          0x47535453    /* "GSTS" */
+#define GAZELLE_STAT_SHM_VERSION        2
+#define GAZELLE_STAT_SHM_PUBLISH_US     100000
+#define GAZELLE_STAT_SHM_READ_RETRY     1000
+#define GAZELLE_STAT_SHM_ALIGN          64
+
+struct gazelle_stack_stat_data {
+    uint32_t tid;
+    int32_t loglevel;
+    struct gazelle_stat_low_power_info low_power_info;
+    struct gazelle_stat_pkts pkts;
+    struct gazelle_stat_lstack_snmp snmp;
+    struct gazelle_stack_aggregate_stats aggregate_stats;
+};
+
+struct gazelle_stack_stat_page {
+    uint32_t seq;
+    struct gazelle_stack_stat_data data;
+} __attribute__((aligned(GAZELLE_STAT_SHM_ALIGN)));
+
+struct gazelle_stat_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t stack_num;
+    /* sizeof(struct gazelle_stack_stat_page) of the writer, readers refuse a different layout */
+    uint32_t page_size;
+    struct gazelle_stack_stat_page pages[];
+};
+
+static inline size_t gazelle_stat_shm_size(uint32_t stack_num)
+{
+    return sizeof(struct gazelle_stat_shm) + (size_t)stack_num * sizeof(struct gazelle_stack_stat_page);
+}
+
+/* only the owner stack thread writes a page, so seq needs no atomic rmw */
+static inline void gazelle_stat_page_write_begin(struct gazelle_stack_stat_page *page)
+{
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void gazelle_stat_page_write_end(struct gazelle_stack_stat_page *page)
+{
+    __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+}
+
 struct gazelle_stat_forward_table_info {
     uint32_t tid;
     uint32_t protocol;
@@ -270,6 +367,13 @@ struct gazelle_stat_msg_request {
     } data;
 };
 
+/* highest latency(us) of the bucket that percent(0~100) of pkts fall in or below */
+uint64_t gazelle_latency_percentile(const uint64_t *hist, uint64_t pkts, double percent);
+void gazelle_latency_merge(uint64_t *dst, const uint64_t *src);
+
+/* copy a consistent snapshot of page, return -1 if writer kept it busy for all retries */
+int gazelle_stat_page_read(const struct gazelle_stack_stat_page *page, struct gazelle_stack_stat_data *data);
+
 int write_specied_len(int fd, const char *buf, size_t target_size);
 int read_specied_len(int fd, char *buf, size_t target_size);
 
@@ -51,6 +51,13 @@
 #define RXTX_NB_MBUF_DEFAULT        (MBUF_COUNT_PER_CONN * TCP_CONN_COUNT)
 #define STACK_THREAD_DEFAULT        4
 #define STACK_NIC_READ_DEFAULT      128
+#define STACK_GRO_FLOW_NUM_DEFAULT  64
+#define STACK_GRO_FLOW_NUM_MAX      4096
+#define STACK_GRO_FLUSH_US_DEFAULT  50
+#define STACK_GRO_FLUSH_US_MAX      10000
+#define STACK_REBALANCE_MS_DEFAULT  0
+#define STACK_REBALANCE_MS_MAX      60000
+#define CONN_MBUF_QUOTA_DEFAULT     0
 
 #define MBUF_MAX_DATA_LEN           1460
 
@@ -67,6 +74,8 @@
 #define GAZELLE_MAX_INSTANCE_NUM    GAZELLE_CLIENT_NUM
 
 #define GAZELLE_MAX_BOND_NUM        2
+/* ltran forward cores, each one polls a part of nic queues */
+#define GAZELLE_MAX_FORWARD_CORES   8
 #define GAZELLE_PACKET_READ_SIZE    32
 
 #define GAZELLE_MAX_STACK_NUM       128
@@ -76,7 +85,8 @@
 #define GAZELLE_MAX_CONN_NUM        (GAZELLE_MAX_STACK_NUM * (20000 + 2000))
 
 #define GAZELLE_MAX_STACK_HTABLE_SIZE       32
-#define GAZELLE_MAX_CONN_HTABLE_SIZE        2048
+/* initial buckets of ltran conn htable, it grows with conn num */
+#define GAZELLE_CONN_HTABLE_INIT_SIZE       256
 #define GAZELLE_MAX_TCP_SOCK_HTABLE_SIZE    256
 
 #define GAZELLE_MAX_STACK_ARRAY_SIZE    GAZELLE_CLIENT_NUM
@@ -84,12 +94,15 @@
 #define GAZELLE_REG_SOCK_PATHNAME       "/var/run/gazelle/gazelle_client.sock"
 #define GAZELLE_REG_SOCK_FILENAME       "gazelle_client.sock"
 #define GAZELLE_SOCK_FILENAME_MAXLEN    128
+#define GAZELLE_STAT_SHM_FILENAME       "gazelle_stat.shm"
 
 #define GAZELLE_RUN_DIR                  "/var/run/gazelle/"
 #define GAZELLE_PRIMARY_START_PATH       "/var/run/gazelle/gazelle_primary"
 #define GAZELLE_FILE_PERMISSION          0700
 
 #define SEND_TIME_WAIT_NS 20000
+/* max time of tx pkts cached in stack before sent to nic */
+#define SEND_PKTS_CACHE_TIMEOUT_US 50
 #define SECOND_NSECOND 1000000000
 
 #define LSTACK_SEND_THREAD_NAME "lstack_send"
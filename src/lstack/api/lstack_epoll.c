@@ -13,6 +13,7 @@
 #include <string.h>
 #include <securec.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <time.h>
 #include <poll.h>
 #include <stdatomic.h>
@@ -37,7 +38,6 @@
 #include "posix/lstack_epoll.h"
 
 #define EPOLL_KERNEL_INTERVAL   10 /* ms */
-#define SEC_TO_NSEC             1000000000
 #define SEC_TO_MSEC             1000
 #define MSEC_TO_NSEC            1000000
 #define POLL_KERNEL_EVENTS      32
@@ -48,30 +48,34 @@ static void change_epollfd_kernel_thread(struct wakeup_poll *wakeup, struct prot
 
 void add_sock_event(struct lwip_sock *sock, uint32_t event)
 {
+    /* lwip raises EPOLLOUT when acks free its send queue, refresh conn_mbuf_quota accounting first */
+    if (event == EPOLLOUT) {
+        sock_mbuf_update(sock);
+    }
+
     struct wakeup_poll *wakeup = sock->wakeup;
     if (wakeup == NULL || wakeup->type == WAKEUP_CLOSE || (event & sock->epoll_events) == 0) {
         return;
     }
 
-    if (wakeup->type == WAKEUP_EPOLL) {
-        pthread_spin_lock(&wakeup->event_list_lock);
-
-        /* app thread have read/write, event is outdated */
-        if (event == EPOLLIN && sock->conn->state != NETCONN_LISTEN && !NETCONN_IS_DATAIN(sock)) {
-            pthread_spin_unlock(&wakeup->event_list_lock);
-            return;
-        }
-        if (event == EPOLLOUT && !NETCONN_IS_OUTIDLE(sock)) {
-            pthread_spin_unlock(&wakeup->event_list_lock);
-            return;
-        }
+    /* poll keeps ready socks in event_list too, so it needn't check every fd */
+    pthread_spin_lock(&wakeup->event_list_lock);
 
-        sock->events |= (event == EPOLLERR) ? (EPOLLIN | EPOLLERR) : (event & sock->epoll_events);
-        if (list_is_null(&sock->event_list)) {
-            list_add_node(&wakeup->event_list, &sock->event_list);
-        }
+    /* app thread have read/write, event is outdated */
+    if (event == EPOLLIN && sock->conn->state != NETCONN_LISTEN && !NETCONN_IS_DATAIN(sock)) {
         pthread_spin_unlock(&wakeup->event_list_lock);
+        return;
     }
+    if (event == EPOLLOUT && !NETCONN_IS_OUTIDLE(sock)) {
+        pthread_spin_unlock(&wakeup->event_list_lock);
+        return;
+    }
+
+    sock->events |= (event == EPOLLERR) ? (EPOLLIN | EPOLLERR) : (event & sock->epoll_events);
+    if (list_is_null(&sock->event_list)) {
+        list_add_node(&wakeup->event_list, &sock->event_list);
+    }
+    pthread_spin_unlock(&wakeup->event_list_lock);
 
     struct protocol_stack *stack = sock->stack;
     if (list_is_null(&wakeup->wakeup_list[stack->stack_idx])) {
@@ -97,10 +101,13 @@ void wakeup_stack_epoll(struct protocol_stack *stack)
 
         struct wakeup_poll *wakeup = container_of((node - stack->stack_idx), struct wakeup_poll, wakeup_list);
 
-        if (__atomic_load_n(&wakeup->in_wait, __ATOMIC_ACQUIRE)) {
-            __atomic_store_n(&wakeup->in_wait, false, __ATOMIC_RELEASE);
-            rte_mb();
-            pthread_mutex_unlock(&wakeup->wait);
+        /* app thread awake or already signalled by other stack, no syscall */
+        if (__atomic_load_n(&wakeup->in_wait, __ATOMIC_ACQUIRE) &&
+            __atomic_exchange_n(&wakeup->in_wait, false, __ATOMIC_ACQ_REL)) {
+            uint64_t val = 1;
+            if (posix_api->write_fn(wakeup->eventfd, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+                LSTACK_LOG(ERR, LSTACK, "write eventfd=%d errno=%d\n", wakeup->eventfd, errno);
+            }
             stack->stats.wakeup_events++;
         }
 
@@ -108,12 +115,18 @@ void wakeup_stack_epoll(struct protocol_stack *stack)
     }
 }
 
+/* listen_shadow connections are accepted into the queue shared by the shadow listeners */
+static inline bool sock_is_acceptin(struct lwip_sock *sock)
+{
+    return NETCONN_IS_ACCEPTIN(sock) || stack_accept_queue_count(sock->conn->socket) != 0;
+}
+
 static uint32_t update_events(struct lwip_sock *sock)
 {
     uint32_t event = 0;
 
     if (sock->epoll_events & EPOLLIN) {
-        if (NETCONN_IS_DATAIN(sock) || NETCONN_IS_ACCEPTIN(sock)) {
+        if (NETCONN_IS_DATAIN(sock) || sock_is_acceptin(sock)) {
             event |= EPOLLIN;
         }
     }
@@ -136,7 +149,7 @@ static void raise_pending_events(struct wakeup_poll *wakeup, struct lwip_sock *s
 {
     uint32_t event = 0;
 
-    if (NETCONN_IS_DATAIN(sock) || NETCONN_IS_ACCEPTIN(sock)) {
+    if (NETCONN_IS_DATAIN(sock) || sock_is_acceptin(sock)) {
         event |= EPOLLIN;
     }
 
@@ -154,8 +167,7 @@ static void raise_pending_events(struct wakeup_poll *wakeup, struct lwip_sock *s
 
     if (event) {
         sock->events = event;
-        if (wakeup->type == WAKEUP_EPOLL && (sock->events & sock->epoll_events) &&
-            list_is_null(&sock->event_list)) {
+        if ((sock->events & sock->epoll_events) && list_is_null(&sock->event_list)) {
             list_add_node(&wakeup->event_list, &sock->event_list);
         }
     }
@@ -186,12 +198,13 @@ int32_t lstack_do_epoll_create(int32_t fd)
         init_list_node_null(&wakeup->wakeup_list[i]);
     }
 
-    if (pthread_mutex_init(&wakeup->wait, NULL) != 0) {
+    wakeup->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup->eventfd < 0) {
+        LSTACK_LOG(ERR, LSTACK, "eventfd failed errno=%d\n", errno);
         posix_api->close_fn(fd);
         free(wakeup);
         GAZELLE_RETURN(EINVAL);
     }
-    pthread_mutex_trylock(&wakeup->wait);
     __atomic_store_n(&wakeup->in_wait, false, __ATOMIC_RELEASE);
 
     struct protocol_stack_group *stack_group = get_protocol_stack_group();
@@ -260,7 +273,7 @@ int32_t lstack_epoll_close(int32_t fd)
     list_del_node_null(&wakeup->poll_list);
     pthread_spin_unlock(&stack_group->poll_list_lock);
 
-    pthread_mutex_destroy(&wakeup->wait);
+    posix_api->close_fn(wakeup->eventfd);
 
     free(wakeup);
     sock->wakeup = NULL;
@@ -402,26 +415,36 @@ static int32_t epoll_lwip_event(struct wakeup_poll *wakeup, struct epoll_event *
     return event_num;
 }
 
-static int32_t poll_lwip_event(struct pollfd *fds, nfds_t nfds)
+/* only socks in event_list are checked. poll is level triggered, sock stays in list until it is not ready */
+static int32_t poll_lwip_event(struct wakeup_poll *wakeup, struct pollfd *fds, nfds_t nfds)
 {
     int32_t event_num = 0;
+    struct list_node *node, *temp;
 
-    for (uint32_t i = 0; i < nfds; i++) {
-        /* sock->listen_next pointerto next stack listen */
-        int32_t fd = fds[i].fd;
-        struct lwip_sock *sock = get_socket_by_fd(fd);
-        while (sock && sock->conn) {
-            uint32_t events = update_events(sock);
-            if (events) {
-                fds[i].revents = events;
-                event_num++;
-                break;
-            }
+    pthread_spin_lock(&wakeup->event_list_lock);
 
-            sock = sock->listen_next;
+    list_for_each_safe(node, temp, &wakeup->event_list) {
+        struct lwip_sock *sock = container_of(node, struct lwip_sock, event_list);
+        uint32_t index = sock->ep_data.u32;
+
+        /* app thread have read/write, event is outdated */
+        uint32_t events = (sock->conn != NULL) ? update_events(sock) : 0;
+        if (events == 0 || index >= nfds) {
+            sock->events = 0;
+            list_del_node_null(&sock->event_list);
+            continue;
+        }
+
+        /* listen socks of every stack share one pollfd */
+        if (fds[index].revents == 0) {
+            event_num++;
         }
+        fds[index].revents |= events;
     }
 
+    pthread_spin_unlock(&wakeup->event_list_lock);
+
+    wakeup->stat.app_events += event_num;
     return event_num;
 }
 
@@ -452,13 +475,44 @@ static void epoll_bind_statck(struct wakeup_poll *wakeup)
     }
 }
 
-static void ms_to_timespec(struct timespec *timespec, int32_t timeout)
+static int64_t get_ms_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * SEC_TO_MSEC + now.tv_nsec / MSEC_TO_NSEC;
+}
+
+static int32_t left_timeout(int64_t end_ms)
 {
-    clock_gettime(CLOCK_REALTIME, timespec);
-    timespec->tv_sec += timeout / SEC_TO_MSEC;
-    timespec->tv_nsec += (timeout % SEC_TO_MSEC) * MSEC_TO_NSEC;
-    timespec->tv_sec += timespec->tv_nsec / SEC_TO_NSEC;
-    timespec->tv_nsec = timespec->tv_nsec % SEC_TO_NSEC;
+    int64_t left = end_ms - get_ms_now();
+    return (left > 0) ? (int32_t)left : 0;
+}
+
+/* sleep until stack thread write eventfd or kernel fds ready. kernel epollfd is pollable,
+   so kernel fds wake app directly instead of go through kernel event thread.
+   return 0 when timeout */
+static int32_t wakeup_wait(struct wakeup_poll *wakeup, int32_t timeout)
+{
+    struct pollfd fds[2] = {
+        { .fd = wakeup->eventfd, .events = POLLIN },
+        { .fd = wakeup->epollfd, .events = POLLIN },
+    };
+
+    int32_t ret = posix_api->poll_fn(fds, 2, timeout);
+    if (ret <= 0) {
+        /* EINTR same as mutex lock return, app get zero event */
+        return 0;
+    }
+
+    if (fds[0].revents & POLLIN) {
+        uint64_t val;
+        (void)posix_api->read_fn(wakeup->eventfd, &val, sizeof(val));
+    }
+    if (fds[1].revents & POLLIN) {
+        __atomic_store_n(&wakeup->have_kernel_event, true, __ATOMIC_RELEASE);
+    }
+
+    return ret;
 }
 
 int32_t lstack_epoll_wait(int32_t epfd, struct epoll_event* events, int32_t maxevents, int32_t timeout)
@@ -472,6 +526,7 @@ int32_t lstack_epoll_wait(int32_t epfd, struct epoll_event* events, int32_t maxe
     int32_t kernel_num = 0;
     int32_t lwip_num = 0;
     int32_t ret = 0;
+    int64_t end_ms = (timeout > 0) ? get_ms_now() + timeout : 0;
 
     if (get_global_cfg_params()->app_bind_numa) {
         epoll_bind_statck(sock->wakeup);
@@ -497,14 +552,8 @@ int32_t lstack_epoll_wait(int32_t epfd, struct epoll_event* events, int32_t maxe
             break;
         }
 
-        if (timeout < 0) {
-            ret = pthread_mutex_lock(&wakeup->wait);
-        } else {
-            struct timespec epoll_time;
-            ms_to_timespec(&epoll_time, timeout);
-            ret = pthread_mutex_timedlock(&wakeup->wait, &epoll_time);
-        }
-    } while (ret == 0);
+        ret = wakeup_wait(wakeup, (timeout < 0) ? -1 : left_timeout(end_ms));
+    } while (ret > 0);
 
     __atomic_store_n(&wakeup->in_wait, false, __ATOMIC_RELEASE);
     return lwip_num + kernel_num;
@@ -512,10 +561,10 @@ int32_t lstack_epoll_wait(int32_t epfd, struct epoll_event* events, int32_t maxe
 
 static int32_t init_poll_wakeup_data(struct wakeup_poll *wakeup)
 {
-    if (pthread_mutex_init(&wakeup->wait, NULL) != 0) {
+    wakeup->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup->eventfd < 0) {
         GAZELLE_RETURN(EINVAL);
     }
-    pthread_mutex_trylock(&wakeup->wait);
     __atomic_store_n(&wakeup->in_wait, false, __ATOMIC_RELEASE);
 
     for (uint32_t i = 0; i < PROTOCOL_STACK_MAX; i++) {
@@ -524,15 +573,21 @@ static int32_t init_poll_wakeup_data(struct wakeup_poll *wakeup)
 
     wakeup->epollfd = posix_api->epoll_create_fn(POLL_KERNEL_EVENTS);
     if (wakeup->epollfd < 0) {
+        posix_api->close_fn(wakeup->eventfd);
         GAZELLE_RETURN(EINVAL);
     }
 
     wakeup->type = WAKEUP_POLL;
+    init_list_node(&wakeup->event_list);
+    pthread_spin_init(&wakeup->event_list_lock, PTHREAD_PROCESS_PRIVATE);
 
     wakeup->last_fds = calloc(POLL_KERNEL_EVENTS, sizeof(struct pollfd));
     if (wakeup->last_fds == NULL) {
         GAZELLE_RETURN(EINVAL);
     }
+    for (uint32_t i = 0; i < POLL_KERNEL_EVENTS; i++) {
+        wakeup->last_fds[i].fd = -1;
+    }
     wakeup->last_max_nfds = POLL_KERNEL_EVENTS;
 
     wakeup->events = calloc(POLL_KERNEL_EVENTS, sizeof(struct epoll_event));
@@ -560,13 +615,18 @@ static int32_t init_poll_wakeup_data(struct wakeup_poll *wakeup)
 
 static void resize_kernel_poll(struct wakeup_poll *wakeup, nfds_t nfds)
 {
-    if (wakeup->last_fds) {
-        free(wakeup->last_fds);
+    /* registered fds are kept, they are compared with new fds in poll_init */
+    struct pollfd *last_fds = realloc(wakeup->last_fds, nfds * sizeof(struct pollfd));
+    if (last_fds == NULL) {
+        LSTACK_LOG(ERR, LSTACK, "realloc failed errno=%d\n", errno);
+        return;
     }
-    wakeup->last_fds = calloc(nfds, sizeof(struct pollfd));
-    if (wakeup->last_fds == NULL) {
-        LSTACK_LOG(ERR, LSTACK, "calloc failed errno=%d\n", errno);
+    for (nfds_t i = wakeup->last_max_nfds; i < nfds; i++) {
+        last_fds[i].fd = -1;
+        last_fds[i].events = 0;
+        last_fds[i].revents = 0;
     }
+    wakeup->last_fds = last_fds;
 
     if (wakeup->events) {
         free(wakeup->events);
@@ -609,44 +669,90 @@ static void update_kernel_poll(struct wakeup_poll *wakeup, uint32_t index, struc
     }
 }
 
+static inline bool poll_fd_cached(struct wakeup_poll *wakeup, const struct pollfd *fds, uint32_t index,
+    bool sock_closed)
+{
+    if (index >= wakeup->last_nfds || fds[index].fd != wakeup->last_fds[index].fd ||
+        fds[index].events != wakeup->last_fds[index].events) {
+        return false;
+    }
+
+    /* fd close then socket may get same fd. */
+    if (sock_closed) {
+        struct lwip_sock *sock = get_socket_by_fd(fds[index].fd);
+        if (sock != NULL && sock->wakeup == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void poll_unregister_sock(struct wakeup_poll *wakeup, int32_t fd)
+{
+    struct lwip_sock *sock = get_socket_by_fd(fd);
+
+    while (sock && sock->wakeup == wakeup) {
+        sock->epoll_events = 0;
+        pthread_spin_lock(&wakeup->event_list_lock);
+        sock->events = 0;
+        list_del_node_null(&sock->event_list);
+        pthread_spin_unlock(&wakeup->event_list_lock);
+        sock = sock->listen_next;
+    }
+}
+
+/* fds same as last call are skipped, only changed fds are registered again */
 static void poll_init(struct wakeup_poll *wakeup, struct pollfd *fds, nfds_t nfds)
 {
     int32_t stack_count[PROTOCOL_STACK_MAX] = {0};
     int32_t poll_change = 0;
+    bool sock_closed = __atomic_exchange_n(&wakeup->poll_sock_closed, false, __ATOMIC_ACQ_REL);
 
-    /* poll fds num more, recalloc fds size */
+    /* poll fds num more, realloc fds size */
     if (nfds > wakeup->last_max_nfds) {
         resize_kernel_poll(wakeup, nfds);
         poll_change = 1;
     }
+    if (nfds > wakeup->last_max_nfds) {
+        nfds = wakeup->last_max_nfds;
+    }
 
-    if (nfds < wakeup->last_nfds) {
-        poll_change = 1;
+    /* unregister first, fd moved to other index is registered again below */
+    for (uint32_t i = 0; i < wakeup->last_nfds; i++) {
+        if (i < nfds && poll_fd_cached(wakeup, fds, i, sock_closed)) {
+            continue;
+        }
+        if (wakeup->last_fds[i].fd >= 0) {
+            poll_unregister_sock(wakeup, wakeup->last_fds[i].fd);
+        }
+        if (i >= nfds) {
+            update_kernel_poll(wakeup, i, NULL);
+            wakeup->last_fds[i].fd = -1;
+            poll_change = 1;
+        }
     }
 
     for (uint32_t i = 0; i < nfds; i++) {
-        int32_t fd = fds[i].fd;
         fds[i].revents = 0;
+        if (poll_fd_cached(wakeup, fds, i, sock_closed)) {
+            continue;
+        }
+
+        int32_t fd = fds[i].fd;
         struct lwip_sock *sock = get_socket_by_fd(fd);
+        poll_change = 1;
 
-        if (fd == wakeup->last_fds[i].fd && fds[i].events == wakeup->last_fds[i].events) {
-            /* fd close then socket may get same fd. */
-            if (sock == NULL || sock->wakeup != NULL) {
-                continue;
-            }
-        }
+        bool kernel_fd = (sock == NULL || sock->conn == NULL || CONN_TYPE_HAS_HOST(sock->conn));
+        update_kernel_poll(wakeup, i, kernel_fd ? (fds + i) : NULL);
         wakeup->last_fds[i].fd = fd;
         wakeup->last_fds[i].events = fds[i].events;
-        poll_change = 1;
-
-        if (sock == NULL || sock->conn == NULL || CONN_TYPE_HAS_HOST(sock->conn)) {
-            update_kernel_poll(wakeup, i, fds + i);
-        }
 
         while (sock && sock->conn) {
             sock->epoll_events = fds[i].events | POLLERR;
+            sock->ep_data.u32 = i;
             sock->wakeup = wakeup;
             stack_count[sock->stack->stack_idx]++;
+            raise_pending_events(wakeup, sock);
             sock = sock->listen_next;
         }
     }
@@ -681,10 +787,11 @@ int32_t lstack_poll(struct pollfd *fds, nfds_t nfds, int32_t timeout)
     int32_t kernel_num = 0;
     int32_t lwip_num = 0;
     int32_t ret;
+    int64_t end_ms = (timeout > 0) ? get_ms_now() + timeout : 0;
 
     do {
         __atomic_store_n(&wakeup->in_wait, true, __ATOMIC_RELEASE);
-        lwip_num = poll_lwip_event(fds, nfds);
+        lwip_num = poll_lwip_event(wakeup, fds, nfds);
 
         if (__atomic_load_n(&wakeup->have_kernel_event, __ATOMIC_ACQUIRE)) {
             kernel_num = posix_api->epoll_wait_fn(wakeup->epollfd, wakeup->events, nfds, 0);
@@ -705,14 +812,8 @@ int32_t lstack_poll(struct pollfd *fds, nfds_t nfds, int32_t timeout)
             break;
         }
 
-        if (timeout < 0) {
-            ret = pthread_mutex_lock(&wakeup->wait);
-        } else {
-            struct timespec epoll_time;
-            ms_to_timespec(&epoll_time, timeout);
-            ret = pthread_mutex_timedlock(&wakeup->wait, &epoll_time);
-        }
-    } while (ret == 0);
+        ret = wakeup_wait(wakeup, (timeout < 0) ? -1 : left_timeout(end_ms));
+    } while (ret > 0);
 
     __atomic_store_n(&wakeup->in_wait, false, __ATOMIC_RELEASE);
     return lwip_num + kernel_num;
@@ -39,6 +39,7 @@
 #include "lstack_protocol_stack.h"
 #include "gazelle_base_func.h"
 #include "lstack_thread_rpc.h"
+#include "lstack_localaddr.h"
 
 #ifndef SOCK_TYPE_MASK
 #define SOCK_TYPE_MASK 0xf
@@ -238,16 +239,12 @@ static int32_t do_bind(int32_t s, const struct sockaddr *name, socklen_t namelen
     }
 }
 
-bool is_dst_ip_localhost(const struct sockaddr *addr)
+static bool is_dst_ip_localhost_slow(const struct sockaddr_in *servaddr)
 {
-    struct sockaddr_in *servaddr = (struct sockaddr_in *) addr;
     char *line = NULL;
     char *p;
     size_t linel = 0;
     int linenum = 0;
-    if (get_global_cfg_params()->host_addr.addr == servaddr->sin_addr.s_addr) {
-        return true;
-    }
 
     FILE *ifh = fopen("/proc/net/dev", "r");
     if (ifh == NULL) {
@@ -292,6 +289,34 @@ bool is_dst_ip_localhost(const struct sockaddr *addr)
     return false;
 }
 
+bool is_dst_ip_localhost(const struct sockaddr *addr)
+{
+    struct sockaddr_in *servaddr = (struct sockaddr_in *) addr;
+    if (get_global_cfg_params()->host_addr.addr == servaddr->sin_addr.s_addr) {
+        return true;
+    }
+
+    enum local_addr_state state = local_addr_lookup(servaddr->sin_addr.s_addr);
+    if (state != LOCAL_ADDR_UNKNOWN) {
+        return state == LOCAL_ADDR_HIT;
+    }
+    return is_dst_ip_localhost_slow(servaddr);
+}
+
+/* listen rings only exist with sockmap, their lifetime is owned by lwip so they are looked up each time */
+static bool is_same_node_listen(const struct sockaddr *name)
+{
+    if (!get_global_cfg_params()->use_sockmap) {
+        return false;
+    }
+
+    char listen_ring_name[RING_NAME_LEN];
+    int remote_port = htons(((struct sockaddr_in *)name)->sin_port);
+    snprintf_s(listen_ring_name, sizeof(listen_ring_name), sizeof(listen_ring_name) - 1,
+        "listen_rx_ring_%d", remote_port);
+    return rte_ring_lookup(listen_ring_name) != NULL;
+}
+
 static int32_t do_connect(int32_t s, const struct sockaddr *name, socklen_t namelen)
 {
     if (name == NULL) {
@@ -313,11 +338,7 @@ static int32_t do_connect(int32_t s, const struct sockaddr *name, socklen_t name
     }
 
     int32_t ret = 0;
-    char listen_ring_name[RING_NAME_LEN];
-    int remote_port = htons(((struct sockaddr_in *)name)->sin_port);
-    snprintf_s(listen_ring_name, sizeof(listen_ring_name), sizeof(listen_ring_name) - 1,
-        "listen_rx_ring_%d", remote_port);
-    if (is_dst_ip_localhost(name) && rte_ring_lookup(listen_ring_name) == NULL) {
+    if (is_dst_ip_localhost(name) && !is_same_node_listen(name)) {
         ret = posix_api->connect_fn(s, name, namelen);
         SET_CONN_TYPE_HOST(sock->conn);
     } else {
@@ -412,7 +433,7 @@ static inline int32_t do_setsockopt(int32_t s, int32_t level, int32_t optname, c
         return ret;
     }
 
-    return rpc_call_setsockopt(s, level, optname, optval, optlen);
+    return stack_broadcast_setsockopt(s, level, optname, optval, optlen);
 }
 
 static inline int32_t do_socket(int32_t domain, int32_t type, int32_t protocol)
@@ -461,6 +482,46 @@ static inline ssize_t do_read(int32_t s, void *mem, size_t len)
     return posix_api->read_fn(s, mem, len);
 }
 
+ssize_t gazelle_recv_zcopy(int32_t fd, struct iovec *iov, int32_t *iovcnt)
+{
+    struct lwip_sock *sock = NULL;
+    if (select_path(fd, &sock) != PATH_LWIP) {
+        GAZELLE_RETURN(EOPNOTSUPP);
+    }
+
+    return read_stack_zcopy(fd, iov, iovcnt);
+}
+
+int32_t gazelle_recv_zcopy_release(int32_t fd)
+{
+    struct lwip_sock *sock = NULL;
+    if (select_path(fd, &sock) != PATH_LWIP) {
+        GAZELLE_RETURN(EOPNOTSUPP);
+    }
+
+    return read_stack_zcopy_release(fd);
+}
+
+ssize_t gazelle_send_zcopy(int32_t fd, struct iovec *iov, int32_t *iovcnt)
+{
+    struct lwip_sock *sock = NULL;
+    if (select_path(fd, &sock) != PATH_LWIP) {
+        GAZELLE_RETURN(EOPNOTSUPP);
+    }
+
+    return write_stack_zcopy(fd, iov, iovcnt);
+}
+
+ssize_t gazelle_send_zcopy_commit(int32_t fd, size_t len)
+{
+    struct lwip_sock *sock = NULL;
+    if (select_path(fd, &sock) != PATH_LWIP) {
+        GAZELLE_RETURN(EOPNOTSUPP);
+    }
+
+    return write_stack_zcopy_commit(fd, len);
+}
+
 static inline ssize_t do_readv(int32_t s, const struct iovec *iov, int iovcnt)
 {
     struct lwip_sock *sock = NULL;
@@ -56,14 +56,19 @@ static int32_t parse_dpdk_args(void);
 static int32_t parse_gateway_addr(void);
 static int32_t parse_kni_switch(void);
 static int32_t parse_listen_shadow(void);
+static int32_t parse_stack_rebalance_ms(void);
 static int32_t parse_main_thread_affinity(void);
 static int32_t parse_unix_prefix(void);
 static int32_t parse_read_connect_number(void);
 static int32_t parse_rpc_number(void);
 static int32_t parse_nic_read_number(void);
+static int32_t parse_gro_flow_num(void);
+static int32_t parse_gro_flush_us(void);
 static int32_t parse_tcp_conn_count(void);
 static int32_t parse_mbuf_count_per_conn(void);
+static int32_t parse_conn_mbuf_quota(void);
 static int32_t parse_send_ring_size(void);
+static int32_t parse_send_ring_size_max(void);
 static int32_t parse_expand_send_ring(void);
 static int32_t parse_num_process(void);
 static int32_t parse_process_numa(void);
@@ -112,16 +117,21 @@ static struct config_vector_t g_config_tbl[] = {
     { "low_power_mode", parse_low_power_mode },
     { "kni_switch",     parse_kni_switch },
     { "listen_shadow",  parse_listen_shadow },
+    { "stack_rebalance_ms", parse_stack_rebalance_ms },
     { "app_bind_numa",  parse_app_bind_numa },
     { "app_exclude_cpus",   parse_app_exclude_cpus },
     { "main_thread_affinity",  parse_main_thread_affinity },
     { "unix_prefix",    parse_unix_prefix },
     { "tcp_conn_count", parse_tcp_conn_count },
     { "mbuf_count_per_conn", parse_mbuf_count_per_conn },
+    { "conn_mbuf_quota", parse_conn_mbuf_quota },
     { "read_connect_number", parse_read_connect_number },
     { "rpc_number", parse_rpc_number },
     { "nic_read_number", parse_nic_read_number },
+    { "gro_flow_num", parse_gro_flow_num },
+    { "gro_flush_us", parse_gro_flush_us },
     { "send_ring_size", parse_send_ring_size },
+    { "send_ring_size_max", parse_send_ring_size_max },
     { "expand_send_ring", parse_expand_send_ring },
     { "num_process",  parse_num_process },
     { "process_numa", parse_process_numa },
@@ -812,7 +822,7 @@ static int32_t parse_low_power_mode(void)
     g_config_params.lpm_rx_pkts = LSTACK_LPM_RX_PKTS;
     g_config_params.lpm_pkts_in_detect = LSTACK_LPM_PKTS_IN_DETECT;
 
-    PARSE_ARG(g_config_params.low_power_mod, "low_power_mode", 0, 0, 1, ret);
+    PARSE_ARG(g_config_params.low_power_mod, "low_power_mode", 0, 0, LSTACK_LPM_MODE_INTR, ret);
     return ret;
 }
 
@@ -838,6 +848,24 @@ static int32_t parse_send_ring_size(void)
     return ret;
 }
 
+/* parsed after send_ring_size */
+static int32_t parse_send_ring_size_max(void)
+{
+    int32_t ret;
+    PARSE_ARG(g_config_params.send_ring_size_max, "send_ring_size_max", 0, 0, SOCK_SEND_RING_SIZE_MAX, ret);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (g_config_params.send_ring_size_max != 0 &&
+        g_config_params.send_ring_size_max < g_config_params.send_ring_size) {
+        LSTACK_PRE_LOG(LSTACK_ERR, "cfg send_ring_size_max %u is less than send_ring_size %u.\n",
+            g_config_params.send_ring_size_max, g_config_params.send_ring_size);
+        return -EINVAL;
+    }
+    return 0;
+}
+
 static int32_t parse_expand_send_ring(void)
 {
     int32_t ret;
@@ -853,6 +881,13 @@ static int32_t parse_mbuf_count_per_conn(void)
     return ret;
 }
 
+static int32_t parse_conn_mbuf_quota(void)
+{
+    int32_t ret;
+    PARSE_ARG(g_config_params.conn_mbuf_quota, "conn_mbuf_quota", CONN_MBUF_QUOTA_DEFAULT, 0, INT32_MAX, ret);
+    return ret;
+}
+
 static int32_t parse_read_connect_number(void)
 {
     int32_t ret;
@@ -877,6 +912,22 @@ static int32_t parse_nic_read_number(void)
     return ret;
 }
 
+static int32_t parse_gro_flow_num(void)
+{
+    int32_t ret;
+    PARSE_ARG(g_config_params.gro_flow_num, "gro_flow_num",
+              STACK_GRO_FLOW_NUM_DEFAULT, 0, STACK_GRO_FLOW_NUM_MAX, ret);
+    return ret;
+}
+
+static int32_t parse_gro_flush_us(void)
+{
+    int32_t ret;
+    PARSE_ARG(g_config_params.gro_flush_us, "gro_flush_us",
+              STACK_GRO_FLUSH_US_DEFAULT, 0, STACK_GRO_FLUSH_US_MAX, ret);
+    return ret;
+}
+
 static int32_t parse_listen_shadow(void)
 {
     int32_t ret;
@@ -884,6 +935,14 @@ static int32_t parse_listen_shadow(void)
     return ret;
 }
 
+static int32_t parse_stack_rebalance_ms(void)
+{
+    int32_t ret;
+    PARSE_ARG(g_config_params.stack_rebalance_ms, "stack_rebalance_ms",
+              STACK_REBALANCE_MS_DEFAULT, 0, STACK_REBALANCE_MS_MAX, ret);
+    return ret;
+}
+
 static int32_t parse_main_thread_affinity(void)
 {
     int32_t ret;
@@ -998,6 +1057,19 @@ static int32_t parse_unix_prefix(void)
         }
     }
 
+    /* stat shm lives beside the unix socket, gazellectl finds both by the same unix_prefix */
+    ret = strncpy_s(g_config_params.stat_shm_filename, sizeof(g_config_params.stat_shm_filename),
+        g_config_params.unix_socket_filename, strlen(g_config_params.unix_socket_filename) + 1);
+    if (ret != EOK) {
+        return ret;
+    }
+
+    ret = strncat_s(g_config_params.stat_shm_filename, sizeof(g_config_params.stat_shm_filename),
+        GAZELLE_STAT_SHM_FILENAME, strlen(GAZELLE_STAT_SHM_FILENAME) + 1);
+    if (ret != EOK) {
+        return ret;
+    }
+
     ret = strncat_s(g_config_params.unix_socket_filename, sizeof(g_config_params.unix_socket_filename),
             GAZELLE_REG_SOCK_FILENAME, strlen(GAZELLE_REG_SOCK_FILENAME) + 1);
     if (ret != EOK) {
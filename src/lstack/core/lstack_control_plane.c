@@ -470,6 +470,7 @@ void control_fd_close(void)
 	    if (ret == -1) {
             LSTACK_LOG(ERR, LSTACK, "unlink failed, just skip it\n");
 	    }
+        stack_stat_shm_uninit();
     }
 }
 
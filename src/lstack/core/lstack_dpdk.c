@@ -260,6 +260,12 @@ int32_t create_shared_ring(struct protocol_stack *stack)
 {
     lockless_queue_init(&stack->rpc_queue);
 
+    stack->send_pending_ring = create_ring("SEND_PENDING", SOCK_SEND_PENDING_RING_SIZE, RING_F_SC_DEQ,
+        stack->queue_id);
+    if (stack->send_pending_ring == NULL) {
+        return -1;
+    }
+
     if (use_ltran()) {
         stack->rx_ring = create_ring("RING_RX", VDEV_RX_QUEUE_SZ, RING_F_SP_ENQ | RING_F_SC_DEQ, stack->queue_id);
         if (stack->rx_ring == NULL) {
@@ -327,6 +333,32 @@ inline uint16_t get_port_id(void)
     return port_id;
 }
 
+/* net_ring port has no fixed mac, use the configured one. tx queue loops back to rx queue,
+   so server and client in one process can run without nic */
+static int32_t ethdev_vdev_port_id(uint8_t *mac)
+{
+    struct rte_eth_dev_info dev_info;
+    int32_t nr_eth_dev = rte_eth_dev_count_avail();
+
+    for (int32_t port_id = 0; port_id < nr_eth_dev; port_id++) {
+        if (rte_eth_dev_info_get(port_id, &dev_info) != 0 || strcmp(dev_info.driver_name, "net_ring") != 0) {
+            continue;
+        }
+
+        int32_t ret = rte_eth_dev_default_mac_addr_set(port_id, (struct rte_ether_addr *)mac);
+        if (ret != 0) {
+            LSTACK_LOG(ERR, LSTACK, "port %d set mac failed ret=%d\n", port_id, ret);
+            continue;
+        }
+
+        LSTACK_LOG(INFO, LSTACK, "use ring port %d\n", port_id);
+        return port_id;
+    }
+
+    LSTACK_LOG(ERR, LSTACK, "No NIC is matched\n");
+    return -EINVAL;
+}
+
 static int32_t ethdev_port_id(uint8_t *mac)
 {
     int32_t port_id;
@@ -344,8 +376,7 @@ static int32_t ethdev_port_id(uint8_t *mac)
     }
 
     if (port_id >= nr_eth_dev) {
-        LSTACK_LOG(ERR, LSTACK, "No NIC is matched\n");
-        return -EINVAL;
+        return ethdev_vdev_port_id(mac);
     }
 
     return port_id;
@@ -365,6 +396,10 @@ static struct eth_params *alloc_eth_params(uint16_t port_id, uint16_t nb_queues)
     eth_params->conf.link_speeds = ETH_LINK_SPEED_AUTONEG;
     eth_params->conf.txmode.mq_mode = ETH_MQ_TX_NONE;
     eth_params->conf.rxmode.mq_mode = ETH_MQ_RX_NONE;
+    /* rx queue interrupt lets an idle stack sleep, see stack_intr_init */
+    if (get_global_cfg_params()->low_power_mod == LSTACK_LPM_MODE_INTR && !get_global_cfg_params()->tuple_filter) {
+        eth_params->conf.intr_conf.rxq = 1;
+    }
 
     return eth_params;
 }
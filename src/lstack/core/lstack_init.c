@@ -46,6 +46,7 @@
 #include "posix/lstack_unistd.h"
 #include "gazelle_base_func.h"
 #include "lstack_protocol_stack.h"
+#include "lstack_localaddr.h"
 
 #define LSTACK_PRELOAD_ENV_SYS      "LD_PRELOAD"
 #define LSTACK_SO_NAME              "liblstack.so"
@@ -182,6 +183,8 @@ static int32_t check_preload_bind_proc(void)
 __attribute__((destructor)) void gazelle_network_exit(void)
 {
     if (posix_api != NULL && !posix_api->ues_posix) {
+        /* stacks are all running once posix api switched to lstack */
+        stack_group_tx_flush();
         lwip_exit();
     }
 
@@ -373,6 +376,11 @@ __attribute__((constructor)) void gazelle_network_init(void)
         set_kni_ip_mac();
     }
 
+    /* connect() falls back to scanning interfaces if the cache is unavailable */
+    if (local_addr_init() != 0) {
+        LSTACK_LOG(WARNING, LSTACK, "local_addr_init failed\n");
+    }
+
     if (set_process_start_flag() != 0) {
         LSTACK_EXIT(1, "set_process_start_flag failed\n");
     }
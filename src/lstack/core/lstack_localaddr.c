@@ -0,0 +1,305 @@
+/*
+* Copyright (c) Huawei Technologies Co., Ltd. 2020-2021. All rights reserved.
+* gazelle is licensed under the Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*     http://license.coscl.org.cn/MulanPSL2
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+* PURPOSE.
+* See the Mulan PSL v2 for more details.
+*/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <securec.h>
+
+#include <rte_pause.h>
+#include <lwip/posix_api.h>
+
+#include "lstack_log.h"
+#include "lstack_localaddr.h"
+
+#define LOCAL_ADDR_BUF_LEN 8192
+
+/* written only by the netlink thread, read lock free by connect() through the seq counter */
+struct local_addr_table {
+    volatile uint32_t seq;
+    bool ready;
+    bool overflow;
+    uint32_t num;
+    uint32_t addr[LOCAL_ADDR_MAX_NUM];
+};
+
+static struct local_addr_table g_local_addr = {0};
+static uint32_t g_dump_seq = 0;
+/* a dump spans several recv buffers, remember whether any part of it was interrupted */
+static bool g_dump_intr = false;
+
+static inline void local_addr_write_begin(void)
+{
+    __atomic_store_n(&g_local_addr.seq, g_local_addr.seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void local_addr_write_end(void)
+{
+    __atomic_store_n(&g_local_addr.seq, g_local_addr.seq + 1, __ATOMIC_RELEASE);
+}
+
+static void local_addr_add(uint32_t addr)
+{
+    for (uint32_t i = 0; i < g_local_addr.num; i++) {
+        if (g_local_addr.addr[i] == addr) {
+            return;
+        }
+    }
+
+    if (g_local_addr.num == LOCAL_ADDR_MAX_NUM) {
+        if (!g_local_addr.overflow) {
+            LSTACK_LOG(WARNING, LSTACK, "local addr num exceed %d, misses fall back to slow lookup\n",
+                LOCAL_ADDR_MAX_NUM);
+        }
+        __atomic_store_n(&g_local_addr.overflow, true, __ATOMIC_RELAXED);
+        return;
+    }
+
+    __atomic_store_n(&g_local_addr.addr[g_local_addr.num], addr, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_local_addr.num, g_local_addr.num + 1, __ATOMIC_RELAXED);
+}
+
+static void local_addr_del(uint32_t addr)
+{
+    for (uint32_t i = 0; i < g_local_addr.num; i++) {
+        if (g_local_addr.addr[i] == addr) {
+            uint32_t last = g_local_addr.num - 1;
+            __atomic_store_n(&g_local_addr.addr[i], g_local_addr.addr[last], __ATOMIC_RELAXED);
+            __atomic_store_n(&g_local_addr.num, last, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+static enum local_addr_state local_addr_search(uint32_t addr)
+{
+    if (!__atomic_load_n(&g_local_addr.ready, __ATOMIC_RELAXED)) {
+        return LOCAL_ADDR_UNKNOWN;
+    }
+
+    uint32_t num = __atomic_load_n(&g_local_addr.num, __ATOMIC_RELAXED);
+    for (uint32_t i = 0; i < num && i < LOCAL_ADDR_MAX_NUM; i++) {
+        if (__atomic_load_n(&g_local_addr.addr[i], __ATOMIC_RELAXED) == addr) {
+            return LOCAL_ADDR_HIT;
+        }
+    }
+
+    return __atomic_load_n(&g_local_addr.overflow, __ATOMIC_RELAXED) ? LOCAL_ADDR_UNKNOWN : LOCAL_ADDR_MISS;
+}
+
+enum local_addr_state local_addr_lookup(uint32_t addr)
+{
+    enum local_addr_state state;
+    uint32_t seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&g_local_addr.seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1) == 0) {
+            state = local_addr_search(addr);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&g_local_addr.seq, __ATOMIC_RELAXED) == seq) {
+                return state;
+            }
+        }
+        rte_pause();
+    }
+}
+
+static int32_t local_addr_request_dump(int32_t fd)
+{
+    struct {
+        struct nlmsghdr nh;
+        struct ifaddrmsg ifa;
+    } req;
+    struct sockaddr_nl kernel;
+
+    (void)memset_s(&req, sizeof(req), 0, sizeof(req));
+    (void)memset_s(&kernel, sizeof(kernel), 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+    req.nh.nlmsg_type = RTM_GETADDR;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nlmsg_seq = ++g_dump_seq;
+    g_dump_intr = false;
+    req.ifa.ifa_family = AF_INET;
+
+    if (posix_api->send_to(fd, &req, req.nh.nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) < 0) {
+        LSTACK_LOG(ERR, LSTACK, "send RTM_GETADDR failed errno=%d\n", errno);
+        return -1;
+    }
+    return 0;
+}
+
+/* notifications may have been lost or raced with the dump, drop the table and rebuild it */
+static void local_addr_resync(int32_t fd)
+{
+    local_addr_write_begin();
+    __atomic_store_n(&g_local_addr.ready, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_local_addr.overflow, false, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_local_addr.num, 0, __ATOMIC_RELAXED);
+    local_addr_write_end();
+
+    (void)local_addr_request_dump(fd);
+}
+
+static void local_addr_handle_ifaddr(struct nlmsghdr *nh)
+{
+    struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+    if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)) || ifa->ifa_family != AF_INET) {
+        return;
+    }
+
+    uint32_t addr = 0;
+    bool found = false;
+    int32_t len = IFA_PAYLOAD(nh);
+    for (struct rtattr *rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (RTA_PAYLOAD(rta) < sizeof(addr)) {
+            continue;
+        }
+        /* IFA_LOCAL is the local side of a point-to-point link, prefer it over the peer IFA_ADDRESS */
+        if (rta->rta_type == IFA_LOCAL) {
+            (void)memcpy_s(&addr, sizeof(addr), RTA_DATA(rta), sizeof(addr));
+            found = true;
+            break;
+        }
+        if (rta->rta_type == IFA_ADDRESS) {
+            (void)memcpy_s(&addr, sizeof(addr), RTA_DATA(rta), sizeof(addr));
+            found = true;
+        }
+    }
+    if (!found) {
+        return;
+    }
+
+    local_addr_write_begin();
+    if (nh->nlmsg_type == RTM_NEWADDR) {
+        local_addr_add(addr);
+    } else {
+        local_addr_del(addr);
+    }
+    local_addr_write_end();
+}
+
+static void local_addr_handle_buf(int32_t fd, char *buf, int32_t len)
+{
+    bool dump_done = false;
+
+    for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+        /* notifications carry seq 0, dump replies echo the request seq */
+        bool is_dump = nh->nlmsg_seq == g_dump_seq;
+        if (is_dump && (nh->nlmsg_flags & NLM_F_DUMP_INTR)) {
+            g_dump_intr = true;
+        }
+
+        switch (nh->nlmsg_type) {
+            case RTM_NEWADDR:
+            case RTM_DELADDR:
+                local_addr_handle_ifaddr(nh);
+                break;
+            case NLMSG_DONE:
+                dump_done = is_dump;
+                break;
+            case NLMSG_ERROR:
+                LSTACK_LOG(ERR, LSTACK, "netlink error seq=%u\n", nh->nlmsg_seq);
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (!dump_done) {
+        return;
+    }
+    if (g_dump_intr) {
+        local_addr_resync(fd);
+        return;
+    }
+
+    local_addr_write_begin();
+    __atomic_store_n(&g_local_addr.ready, true, __ATOMIC_RELAXED);
+    local_addr_write_end();
+    LSTACK_LOG(INFO, LSTACK, "local addr cache ready, num=%u\n", g_local_addr.num);
+}
+
+static void *local_addr_thread(void *arg)
+{
+    int32_t fd = (int32_t)(intptr_t)arg;
+    uint32_t buf[LOCAL_ADDR_BUF_LEN / sizeof(uint32_t)];
+
+    for (;;) {
+        ssize_t len = posix_api->recv_fn(fd, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS) {
+                local_addr_resync(fd);
+                continue;
+            }
+            LSTACK_LOG(ERR, LSTACK, "netlink recv failed errno=%d, local addr cache disabled\n", errno);
+            break;
+        }
+
+        local_addr_handle_buf(fd, (char *)buf, (int32_t)len);
+    }
+
+    local_addr_write_begin();
+    __atomic_store_n(&g_local_addr.ready, false, __ATOMIC_RELAXED);
+    local_addr_write_end();
+    posix_api->close_fn(fd);
+    return NULL;
+}
+
+int32_t local_addr_init(void)
+{
+    struct sockaddr_nl local;
+    pthread_t tid;
+
+    int32_t fd = posix_api->socket_fn(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        LSTACK_LOG(ERR, LSTACK, "create netlink socket failed errno=%d\n", errno);
+        return -1;
+    }
+
+    (void)memset_s(&local, sizeof(local), 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_IPV4_IFADDR;
+    if (posix_api->bind_fn(fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        LSTACK_LOG(ERR, LSTACK, "bind netlink socket failed errno=%d\n", errno);
+        posix_api->close_fn(fd);
+        return -1;
+    }
+
+    /* subscribe first and dump after, so no change is missed between them */
+    if (local_addr_request_dump(fd) != 0) {
+        posix_api->close_fn(fd);
+        return -1;
+    }
+
+    int32_t ret = pthread_create(&tid, NULL, local_addr_thread, (void *)(intptr_t)fd);
+    if (ret != 0) {
+        LSTACK_LOG(ERR, LSTACK, "pthread_create failed ret=%d\n", ret);
+        posix_api->close_fn(fd);
+        return -1;
+    }
+    ret = pthread_setname_np(tid, LOCAL_ADDR_THREAD_NAME);
+    if (ret != 0) {
+        LSTACK_LOG(ERR, LSTACK, "pthread_setname_np failed ret=%d\n", ret);
+    }
+
+    return 0;
+}
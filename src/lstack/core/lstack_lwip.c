@@ -25,6 +25,7 @@
 #include <securec.h>
 #include <rte_errno.h>
 #include <rte_malloc.h>
+#include <rte_cycles.h>
 
 #include "gazelle_base_func.h"
 #include "lstack_ethdev.h"
@@ -167,6 +168,182 @@ static bool replenish_send_idlembuf(struct protocol_stack *stack, struct lwip_so
     return false;
 }
 
+/* mbufs held by one connection, indexed by fd. only written by the stack thread of the sock */
+struct sock_mbuf_stat {
+    uint32_t rx;    /* recvmbox, recv_ring and ooseq */
+    uint32_t tx;    /* lwip unsent and unacked */
+    uint32_t peak;
+};
+static struct sock_mbuf_stat g_sock_mbuf[GAZELLE_LSTACK_MAX_CONN];
+
+static inline struct sock_mbuf_stat *get_sock_mbuf_stat(const struct lwip_sock *sock)
+{
+    if (sock->conn == NULL || sock->conn->socket < 0 || sock->conn->socket >= GAZELLE_LSTACK_MAX_CONN) {
+        return NULL;
+    }
+    return &g_sock_mbuf[sock->conn->socket];
+}
+
+static uint32_t sock_rx_mbufs(const struct lwip_sock *sock)
+{
+    uint32_t cnt = gazelle_ring_count(sock->recv_ring);
+
+    if (sock->conn->recvmbox != NULL) {
+        cnt += rte_ring_count(sock->conn->recvmbox->ring);
+    }
+#if TCP_QUEUE_OOSEQ
+    if (!NETCONN_IS_UDP(sock) && sock->conn->pcb.tcp != NULL) {
+        for (struct tcp_seg *seg = sock->conn->pcb.tcp->ooseq; seg != NULL; seg = seg->next) {
+            cnt += pbuf_clen(seg->p);
+        }
+    }
+#endif
+    return cnt;
+}
+
+void sock_mbuf_update(struct lwip_sock *sock)
+{
+    struct sock_mbuf_stat *stat = get_sock_mbuf_stat(sock);
+    if (stat == NULL || sock->stack == NULL || sock->recv_ring == NULL) {
+        return;
+    }
+
+    uint32_t rx = sock_rx_mbufs(sock);
+    uint32_t tx = (NETCONN_IS_UDP(sock) || sock->conn->pcb.tcp == NULL) ? 0 : sock->conn->pcb.tcp->snd_queuelen;
+    struct gazelle_stack_stat *stats = &sock->stack->stats;
+
+    stats->conn_mbuf_cnt = stats->conn_mbuf_cnt + rx + tx - stat->rx - stat->tx;
+    stats->conn_mbuf_peak = LWIP_MAX(stats->conn_mbuf_peak, stats->conn_mbuf_cnt);
+    stat->peak = LWIP_MAX(stat->peak, rx + tx);
+    __atomic_store_n(&stat->rx, rx, __ATOMIC_RELAXED);
+    __atomic_store_n(&stat->tx, tx, __ATOMIC_RELAXED);
+}
+
+/* a direction is limited only while it holds mbufs itself, so one direction never starves the other */
+bool sock_mbuf_tx_limited(struct lwip_sock *sock)
+{
+    uint32_t quota = get_global_cfg_params()->conn_mbuf_quota;
+    struct sock_mbuf_stat *stat = get_sock_mbuf_stat(sock);
+    if (quota == 0 || stat == NULL || sock->send_ring == NULL) {
+        return false;
+    }
+
+    uint32_t tx = gazelle_ring_readover_count(sock->send_ring) + __atomic_load_n(&stat->tx, __ATOMIC_RELAXED);
+    return tx != 0 && tx + __atomic_load_n(&stat->rx, __ATOMIC_RELAXED) >= quota;
+}
+
+/* sock->conn may be gone already, go by fd */
+static void sock_mbuf_clean(struct lwip_sock *sock, int32_t fd)
+{
+    if (fd < 0 || fd >= GAZELLE_LSTACK_MAX_CONN) {
+        return;
+    }
+
+    struct sock_mbuf_stat *stat = &g_sock_mbuf[fd];
+    sock->stack->stats.conn_mbuf_cnt -= stat->rx + stat->tx;
+    (void)memset_s(stat, sizeof(*stat), 0, sizeof(*stat));
+}
+
+/* send_ring_size_max: acked and received bytes of a tcp conn since update_ms, rtt measured in us.
+   send_mbufs: mbufs charged to stack send_ring_mbufs, idle ones over a lowered capacity until released */
+struct sock_ring_bdp {
+    uint32_t update_ms;
+    uint32_t lastack;
+    uint32_t rcv_nxt;
+    uint32_t rtt_seq;
+    uint64_t rtt_stamp;
+    uint32_t srtt_us;
+    uint32_t send_mbufs;
+};
+static struct sock_ring_bdp g_sock_bdp[GAZELLE_LSTACK_MAX_CONN];
+
+/* one rtt sample in flight: stamp snd_nxt when the stack sees unacked data, sample when lastack covers it.
+   lwip srtt counts in 500ms slow timer ticks, too coarse for the lan rtt of dpdk.
+   the ack is seen on the next send or recv of the sock, so a sample is an upper bound */
+static void sock_rtt_update(struct sock_ring_bdp *bdp, const struct tcp_pcb *pcb)
+{
+    uint64_t now = get_current_time();
+
+    if (bdp->rtt_stamp != 0 && TCP_SEQ_GEQ(pcb->lastack, bdp->rtt_seq)) {
+        uint32_t rtt = (uint32_t)LWIP_MIN(now - bdp->rtt_stamp, UINT32_MAX);
+        /* srtt += (rtt - srtt) / 8, as rfc6298 */
+        bdp->srtt_us = (bdp->srtt_us == 0) ? rtt : (uint32_t)(((uint64_t)bdp->srtt_us * 7 + rtt) / 8);
+        bdp->rtt_stamp = 0;
+    }
+
+    if (bdp->rtt_stamp == 0 && pcb->snd_nxt != pcb->lastack) {
+        bdp->rtt_seq = pcb->snd_nxt;
+        bdp->rtt_stamp = now;
+    }
+}
+
+/* the send ring of all socks of a stack preallocate at most half of its mbuf pool */
+static inline uint32_t stack_send_ring_budget(void)
+{
+    struct cfg_params *cfg = get_global_cfg_params();
+    uint64_t pool = (uint64_t)cfg->mbuf_count_per_conn * cfg->tcp_conn_count / get_protocol_stack_group()->stack_num;
+    return (uint32_t)LWIP_MIN(pool / 2, UINT32_MAX);
+}
+
+static void sock_ring_resize(struct lwip_sock *sock)
+{
+    uint32_t send_max = get_global_cfg_params()->send_ring_size_max;
+    if (send_max == 0 || sock->stack == NULL || sock->recv_ring == NULL || sock->send_ring == NULL ||
+        NETCONN_IS_UDP(sock) || sock->conn->pcb.tcp == NULL) {
+        return;
+    }
+    int32_t fd = sock->conn->socket;
+    if (fd < 0 || fd >= GAZELLE_LSTACK_MAX_CONN) {
+        return;
+    }
+
+    struct tcp_pcb *pcb = sock->conn->pcb.tcp;
+    struct sock_ring_bdp *bdp = &g_sock_bdp[fd];
+    sock_rtt_update(bdp, pcb);
+
+    uint32_t now = sys_now();
+    uint32_t elapsed = now - bdp->update_ms;
+    if (bdp->update_ms != 0 && elapsed < SOCK_RING_RESIZE_MS) {
+        return;
+    }
+
+    uint32_t acked = pcb->lastack - bdp->lastack;
+    uint32_t rcvd = pcb->rcv_nxt - bdp->rcv_nxt;
+    bool first = (bdp->update_ms == 0);
+    bdp->update_ms = now;
+    bdp->lastack = pcb->lastack;
+    bdp->rcv_nxt = pcb->rcv_nxt;
+    if (first) {
+        return;
+    }
+
+    /* conn only receiving has no sample, take a lan rtt */
+    uint32_t rtt_us = (bdp->srtt_us == 0) ? SOCK_RING_RTT_DEFAULT_US : bdp->srtt_us;
+
+    uint32_t cur = sock->recv_ring->capacity + 1;
+    uint32_t size = gazelle_ring_bdp_size(rcvd, elapsed, rtt_us, SOCK_RING_SIZE_MIN, SOCK_RECV_RING_SIZE);
+    uint32_t next = gazelle_ring_next_size(cur, size);
+    if (next != cur) {
+        gazelle_ring_set_capacity(sock->recv_ring, next - 1);
+    }
+
+    struct protocol_stack *stack = sock->stack;
+    cur = sock->send_ring->capacity + 1;
+    size = gazelle_ring_bdp_size(acked, elapsed, rtt_us, SOCK_RING_SIZE_MIN, send_max);
+    next = gazelle_ring_next_size(cur, size);
+    if (next > cur && stack->send_ring_mbufs - bdp->send_mbufs + next > stack_send_ring_budget()) {
+        next = cur;
+    }
+    if (next != cur) {
+        gazelle_ring_set_capacity(sock->send_ring, next - 1);
+    }
+
+    /* idle mbufs over a lowered capacity stay preallocated until the app writes into them */
+    uint32_t send_mbufs = LWIP_MAX(next, gazelle_ring_count(sock->send_ring));
+    stack->send_ring_mbufs = stack->send_ring_mbufs - bdp->send_mbufs + send_mbufs;
+    bdp->send_mbufs = send_mbufs;
+}
+
 void gazelle_init_sock(int32_t fd)
 {
     static _Atomic uint32_t name_tick = 0;
@@ -185,16 +362,29 @@ void gazelle_init_sock(int32_t fd)
         return;
     }
 
+    /* send_ring_size_max: created at max size, only the usable capacity changes later */
+    uint32_t send_ring_size = get_global_cfg_params()->send_ring_size;
+    uint32_t send_ring_size_max = get_global_cfg_params()->send_ring_size_max;
     sock->send_ring = create_ring("sock_send",
-        get_global_cfg_params()->send_ring_size,
+        (send_ring_size_max == 0) ? send_ring_size : rte_align32pow2(send_ring_size_max),
         RING_F_SP_ENQ | RING_F_SC_DEQ,
         atomic_fetch_add(&name_tick, 1));
     if (sock->send_ring == NULL) {
         LSTACK_LOG(ERR, LSTACK, "sock_send create failed. errno: %d.\n", rte_errno);
         return;
     }
+    if (fd >= 0 && fd < GAZELLE_LSTACK_MAX_CONN) {
+        (void)memset_s(&g_sock_mbuf[fd], sizeof(g_sock_mbuf[fd]), 0, sizeof(g_sock_mbuf[fd]));
+        (void)memset_s(&g_sock_bdp[fd], sizeof(g_sock_bdp[fd]), 0, sizeof(g_sock_bdp[fd]));
+    }
+    if (send_ring_size_max != 0) {
+        gazelle_ring_set_capacity(sock->send_ring, send_ring_size - 1);
+        if (fd >= 0 && fd < GAZELLE_LSTACK_MAX_CONN) {
+            g_sock_bdp[fd].send_mbufs = sock->send_ring->capacity + 1;
+            stack->send_ring_mbufs += g_sock_bdp[fd].send_mbufs;
+        }
+    }
     (void)replenish_send_idlembuf(stack, sock);
-
     sock->stack = stack;
     init_list_node_null(&sock->recv_list);
     init_list_node_null(&sock->event_list);
@@ -207,13 +397,22 @@ void gazelle_clean_sock(int32_t fd)
         return;
     }
 
-    if (sock->wakeup && sock->wakeup->type == WAKEUP_EPOLL) {
+    if (sock->wakeup && sock->wakeup->type != WAKEUP_CLOSE) {
         pthread_spin_lock(&sock->wakeup->event_list_lock);
         list_del_node_null(&sock->event_list);
         pthread_spin_unlock(&sock->wakeup->event_list_lock);
+        /* fd may be reused by new sock, poll checks its cached fds again */
+        if (sock->wakeup->type == WAKEUP_POLL) {
+            __atomic_store_n(&sock->wakeup->poll_sock_closed, true, __ATOMIC_RELEASE);
+        }
     }
 
     sock->stack->conn_num--;
+    sock_mbuf_clean(sock, fd);
+    if (fd >= 0 && fd < GAZELLE_LSTACK_MAX_CONN) {
+        sock->stack->send_ring_mbufs -= g_sock_bdp[fd].send_mbufs;
+        g_sock_bdp[fd].send_mbufs = 0;
+    }
 
     reset_sock_data(sock);
 
@@ -375,81 +574,99 @@ static ssize_t do_app_write(struct pbuf *pbufs[], void *buf, size_t len, uint32_
     return send_len;
 }
 
-static inline ssize_t app_direct_write(struct protocol_stack *stack, struct lwip_sock *sock, void *buf,
-    size_t len, uint32_t write_num)
+static inline uint16_t app_pbuf_fill(struct pbuf *pbuf, const char *buf, size_t len)
 {
-    if (write_num == 0) {
-        return 0;
-    }
-    struct pbuf **pbufs = (struct pbuf **)malloc(write_num * sizeof(struct pbuf *));
-    if (pbufs == NULL) {
-        return 0;
+    uint16_t copy_len = (len > MBUF_MAX_DATA_LEN) ? MBUF_MAX_DATA_LEN : (uint16_t)len;
+
+    if (get_global_cfg_params()->expand_send_ring) {
+        pbuf_take(pbuf, buf, copy_len);
+    } else {
+        rte_memcpy((char *)pbuf->payload, buf, copy_len);
     }
+    pbuf->tot_len = pbuf->len = copy_len;
+    return copy_len;
+}
 
-    /* first pbuf get from send_ring. and malloc pbufs attach to first pbuf */
-    if (rte_pktmbuf_alloc_bulk(stack->rxtx_pktmbuf_pool, (struct rte_mbuf **)&pbufs[1], write_num - 1) != 0) {
-        stack->stats.tx_allocmbuf_fail++;
-        free(pbufs);
-        return 0;
+#define APP_DIRECT_WRITE_BATCH 64
+/* alloc pbufs from mempool in batches and chain them, no malloc for large write.
+ * chain is private until caller links it, return len written and chain is empty if 0 */
+static ssize_t app_direct_chain(struct protocol_stack *stack, const char *buf, size_t len,
+    struct pbuf **first, struct pbuf **last)
+{
+    struct rte_mbuf *mbufs[APP_DIRECT_WRITE_BATCH];
+    struct pbuf *pbuf = NULL;
+    size_t send_len = 0;
+
+    *first = NULL;
+    *last = NULL;
+    while (send_len < len) {
+        uint32_t num = (len - send_len + MBUF_MAX_DATA_LEN - 1) / MBUF_MAX_DATA_LEN;
+        num = LWIP_MIN(num, APP_DIRECT_WRITE_BATCH);
+        if (rte_pktmbuf_alloc_bulk(stack->rxtx_pktmbuf_pool, mbufs, num) != 0) {
+            stack->stats.tx_allocmbuf_fail++;
+            break;
+        }
+
+        for (uint32_t i = 0; i < num; i++) {
+            if (i + 1 < num) {
+                rte_prefetch0(mbuf_to_pbuf(mbufs[i + 1]));
+            }
+            rte_prefetch0(buf + send_len + MBUF_MAX_DATA_LEN);
+            pbuf = init_mbuf_to_pbuf(mbufs[i], PBUF_TRANSPORT, MBUF_MAX_DATA_LEN, PBUF_RAM);
+            send_len += app_pbuf_fill(pbuf, buf + send_len, len - send_len);
+            if (*first == NULL) {
+                *first = pbuf;
+            } else {
+                (*last)->next = pbuf;
+            }
+            *last = pbuf;
+        }
     }
 
-    (void)gazelle_ring_read(sock->send_ring, (void **)&pbufs[0], 1);
+    return (ssize_t)send_len;
+}
+
+static inline ssize_t app_direct_write(struct protocol_stack *stack, struct lwip_sock *sock, void *buf,
+    size_t len, uint32_t write_num)
+{
+    struct pbuf *head = NULL;
+    struct pbuf *first = NULL;
+    struct pbuf *last = NULL;
 
-    uint32_t i = 1;
-    for (; i < write_num - 1; i++) {
-        rte_prefetch0(mbuf_to_pbuf((void *)pbufs[i + 1]));
-        pbufs[i] = init_mbuf_to_pbuf((struct rte_mbuf *)pbufs[i], PBUF_TRANSPORT, MBUF_MAX_DATA_LEN, PBUF_RAM);
-        pbufs[i - 1]->next = pbufs[i];
+    if (write_num == 0) {
+        return 0;
     }
-    pbufs[i] = init_mbuf_to_pbuf((struct rte_mbuf *)pbufs[i], PBUF_TRANSPORT, MBUF_MAX_DATA_LEN, PBUF_RAM);
-    pbufs[i - 1]->next = pbufs[i];
 
-    ssize_t send_len = do_app_write(pbufs, buf, len, write_num);
+    /* first pbuf get from send_ring. and pbufs alloc from mempool attach to first pbuf */
+    (void)gazelle_ring_read(sock->send_ring, (void **)&head, 1);
+    ssize_t send_len = app_pbuf_fill(head, buf, len);
+    send_len += app_direct_chain(stack, (char *)buf + send_len, len - send_len, &first, &last);
 
+    head->next = first;
+    head->last = (last != NULL) ? last : head;
     gazelle_ring_read_over(sock->send_ring);
 
-    pbufs[0]->last = pbufs[write_num - 1];
     sock->remain_len = 0;
-    free(pbufs);
     return send_len;
 }
 
 static inline ssize_t app_direct_attach(struct protocol_stack *stack, struct pbuf *attach_pbuf, void *buf,
     size_t len, uint32_t write_num)
 {
+    struct pbuf *first = NULL;
+    struct pbuf *last = NULL;
+
     if (write_num == 0) {
         return 0;
     }
-    struct pbuf **pbufs = (struct pbuf **)malloc(write_num * sizeof(struct pbuf *));
-    if (pbufs == NULL) {
-        return 0;
-    }
 
-    /* first pbuf get from send_ring. and malloc pbufs attach to first pbuf */
-    if (rte_pktmbuf_alloc_bulk(stack->rxtx_pktmbuf_pool, (struct rte_mbuf **)pbufs, write_num) != 0) {
-        stack->stats.tx_allocmbuf_fail++;
-        free(pbufs);
+    ssize_t send_len = app_direct_chain(stack, buf, len, &first, &last);
+    if (send_len == 0) {
         return 0;
     }
 
-    pbufs[0] = init_mbuf_to_pbuf((struct rte_mbuf *)pbufs[0], PBUF_TRANSPORT, MBUF_MAX_DATA_LEN, PBUF_RAM);
-    uint32_t i = 1;
-    for (; i < write_num - 1; i++) {
-        rte_prefetch0(mbuf_to_pbuf((void *)pbufs[i + 1]));
-        pbufs[i] = init_mbuf_to_pbuf((struct rte_mbuf *)pbufs[i], PBUF_TRANSPORT, MBUF_MAX_DATA_LEN, PBUF_RAM);
-        pbufs[i - 1]->next = pbufs[i];
-    }
-    if (write_num > 1) {
-        pbufs[i] = init_mbuf_to_pbuf((struct rte_mbuf *)pbufs[i], PBUF_TRANSPORT, MBUF_MAX_DATA_LEN, PBUF_RAM);
-        pbufs[i - 1]->next = pbufs[i];
-    }
-
-    ssize_t send_len = do_app_write(pbufs, buf, len, write_num);
-
-    attach_pbuf->last->next = pbufs[0];
-    attach_pbuf->last = pbufs[write_num - 1];
-
-    free(pbufs);
+    attach_pbuf->last->next = first;
+    attach_pbuf->last = last;
     return send_len;
 }
 
@@ -481,7 +698,7 @@ static inline struct pbuf *gazelle_ring_readlast(struct rte_ring *r)
     struct pbuf *last_pbuf = NULL;
     volatile uint32_t tail = __atomic_load_n(&r->cons.tail, __ATOMIC_ACQUIRE);
     uint32_t last = r->prod.tail - 1;
-    if (last + 1 == tail || last + 1 - tail > r->capacity) {
+    if (last + 1 == tail || last + 1 - tail > r->mask) {
         return NULL;
     }
     
@@ -549,6 +766,8 @@ int sem_timedwait_nsecs(sem_t *sem)
     return sem_timedwait(sem, &ts);
 }
 
+static inline void sock_send_pending(struct lwip_sock *sock);
+
 ssize_t write_stack_data(struct lwip_sock *sock, const void *buf, size_t len,
                          const struct sockaddr *addr, socklen_t addrlen)
 {
@@ -561,6 +780,22 @@ ssize_t write_stack_data(struct lwip_sock *sock, const void *buf, size_t len,
         return 0;
     }
 
+    /* pbufs lent by write_stack_zcopy must be committed first */
+    if (gazelle_ring_read_pending(sock->send_ring) > 0) {
+        GAZELLE_RETURN(EBUSY);
+    }
+
+    /* tx count may be stale until stack sees the acks, queue sock so stack refreshes it */
+    if (sock_mbuf_tx_limited(sock)) {
+        if (sock->wakeup) {
+            sock->wakeup->stat.app_write_quota++;
+        }
+        if (!NETCONN_IS_UDP(sock)) {
+            sock_send_pending(sock);
+        }
+        GAZELLE_RETURN(EAGAIN);
+    }
+
     ssize_t send_len = 0;
 
     /* merge data into last pbuf */
@@ -669,6 +904,8 @@ static inline bool do_lwip_send(struct protocol_stack *stack, int32_t fd, struct
     } else {
         (void)lwip_send(fd, sock, UINT16_MAX, flags);
     }
+    sock_mbuf_update(sock);
+    sock_ring_resize(sock);
 
     return replenish_send_ring(stack, sock);
 }
@@ -728,6 +965,7 @@ ssize_t read_lwip_data(struct lwip_sock *sock, int32_t flags, u8_t apiflags)
     }
 
     free_recv_ring_readover(sock->recv_ring);
+    sock_ring_resize(sock);
 
     uint32_t free_count = gazelle_ring_free_count(sock->recv_ring);
     if (free_count == 0) {
@@ -736,6 +974,19 @@ ssize_t read_lwip_data(struct lwip_sock *sock, int32_t flags, u8_t apiflags)
 
     uint32_t data_count = rte_ring_count(sock->conn->recvmbox->ring);
     uint32_t read_num = LWIP_MIN(free_count, data_count);
+
+    /* taking pbufs from recvmbox reopens the window by as much, so peer can fill the quota at most.
+       over it, the window shrinks until app reads. a sock with empty recv_ring is never limited */
+    uint32_t quota = get_global_cfg_params()->conn_mbuf_quota;
+    struct sock_mbuf_stat *stat = get_sock_mbuf_stat(sock);
+    if (quota != 0 && stat != NULL && gazelle_ring_count(sock->recv_ring) != 0) {
+        uint32_t used = sock_rx_mbufs(sock) + stat->tx;
+        if (used >= quota) {
+            sock->stack->stats.read_lwip_quota++;
+            GAZELLE_RETURN(EAGAIN);
+        }
+        read_num = LWIP_MIN(read_num, quota - used);
+    }
     struct pbuf *pbufs[SOCK_RECV_RING_SIZE];
     uint32_t read_count = 0;
     ssize_t recv_len = 0;
@@ -782,6 +1033,7 @@ ssize_t read_lwip_data(struct lwip_sock *sock, int32_t flags, u8_t apiflags)
     }
 
     sock->stack->stats.read_lwip_cnt += read_count;
+    sock_mbuf_update(sock);
     if (recv_len == 0) {
         GAZELLE_RETURN(EAGAIN);
     }
@@ -838,9 +1090,30 @@ ssize_t recvmsg_from_stack(int32_t s, struct msghdr *message, int32_t flags)
     return buflen;
 }
 
+/* tcp sock: call_num is the send pending flag, sock is queued to send_pending_ring only when it turns to 1 */
+static inline void sock_send_pending(struct lwip_sock *sock)
+{
+    if (__atomic_exchange_n(&sock->call_num, 1, __ATOMIC_SEQ_CST) != 0) {
+        return;
+    }
+
+    if (rte_ring_mp_enqueue(sock->stack->send_pending_ring, sock) != 0) {
+        __atomic_store_n(&sock->call_num, 0, __ATOMIC_RELEASE);
+        LSTACK_LOG(ERR, LSTACK, "send_pending_ring full\n");
+        return;
+    }
+
+    stack_intr_doorbell(sock->stack);
+}
+
 static inline void notice_stack_send(struct lwip_sock *sock, int32_t fd, int32_t len, int32_t flags)
 {
-    // 2: call_num >= 2, don't need add new rpc send
+    if (!NETCONN_IS_UDP(sock)) {
+        sock_send_pending(sock);
+        return;
+    }
+
+    /* udp rpc carries len of datagram. 2: call_num >= 2, don't need add new rpc send */
     if (__atomic_load_n(&sock->call_num, __ATOMIC_ACQUIRE) < 2) {
         while (rpc_call_send(fd, NULL, len, flags) < 0) {
             usleep(1000); // 1000: wait 1ms to exec again
@@ -850,6 +1123,39 @@ static inline void notice_stack_send(struct lwip_sock *sock, int32_t fd, int32_t
     }
 }
 
+void send_stack_list(struct protocol_stack *stack, uint32_t send_max)
+{
+    struct lwip_sock *socks[DPDK_PKT_BURST_SIZE];
+    uint32_t pending = rte_ring_count(stack->send_pending_ring);
+    uint32_t num;
+
+    /* socks queued again in this sweep are sent in next loop */
+    pending = LWIP_MIN(pending, send_max);
+    while (pending > 0) {
+        num = rte_ring_sc_dequeue_burst(stack->send_pending_ring, (void **)socks,
+            LWIP_MIN(pending, DPDK_PKT_BURST_SIZE), NULL);
+        if (num == 0) {
+            break;
+        }
+        pending -= num;
+
+        for (uint32_t i = 0; i < num; i++) {
+            struct lwip_sock *sock = socks[i];
+            /* fd is closed or reused by other stack after sock queued */
+            if (sock->stack != stack || sock->conn == NULL) {
+                continue;
+            }
+
+            /* clear before send, so data written after lwip_send queues sock again */
+            __atomic_store_n(&sock->call_num, 0, __ATOMIC_SEQ_CST);
+            bool replenish_again = do_lwip_send(stack, sock->conn->socket, sock, 0, 0);
+            if (NETCONN_IS_DATAOUT(sock) || replenish_again) {
+                sock_send_pending(sock);
+            }
+        }
+    }
+}
+
 static inline void del_data_in_event(struct lwip_sock *sock)
 {
     pthread_spin_lock(&sock->wakeup->event_list_lock);
@@ -1056,6 +1362,11 @@ ssize_t read_stack_data(int32_t fd, void *buf, size_t len, int32_t flags, struct
         return gazelle_same_node_ring_recv(sock, buf, len, flags);
     }
 
+    /* pbufs lent by read_stack_zcopy must be released first */
+    if (sock->recv_lastdata == NULL && gazelle_ring_read_pending(sock->recv_ring) > 0) {
+        GAZELLE_RETURN(EBUSY);
+    }
+
     while (recv_left > 0) {
         if (sock->recv_lastdata) {
             pbuf = sock->recv_lastdata;
@@ -1107,6 +1418,176 @@ ssize_t read_stack_data(int32_t fd, void *buf, size_t len, int32_t flags, struct
     return recvd;
 }
 
+/* lend whole pbufs in recv_ring to app. pbufs stay in recv_ring until read_stack_zcopy_release,
+ * so recv_ring free count still limits read_lwip_data */
+ssize_t read_stack_zcopy(int32_t fd, struct iovec *iov, int32_t *iovcnt)
+{
+    struct pbuf *pbuf = NULL;
+    ssize_t recvd = 0;
+    int32_t seg_num = 0;
+    bool too_big = false;
+    struct lwip_sock *sock = get_socket_by_fd(fd);
+    bool latency_enable = get_protocol_stack_group()->latency_start;
+
+    if (iov == NULL || iovcnt == NULL || *iovcnt <= 0) {
+        GAZELLE_RETURN(EINVAL);
+    }
+
+    if (sock->same_node_rx_ring != NULL) {
+        GAZELLE_RETURN(EOPNOTSUPP);
+    }
+
+    /* pbuf partly copied by read_stack_data can't be lent */
+    if (sock->recv_lastdata != NULL) {
+        GAZELLE_RETURN(EBUSY);
+    }
+
+    if (sock->errevent > 0 && !NETCONN_IS_DATAIN(sock)) {
+        *iovcnt = 0;
+        return 0;
+    }
+
+    thread_bind_stack(sock);
+
+    while (seg_num < *iovcnt) {
+        if (gazelle_ring_read(sock->recv_ring, (void **)&pbuf, 1) != 1) {
+            break;
+        }
+
+        if (seg_num + pbuf_clen(pbuf) > *iovcnt) {
+            gazelle_ring_read_cancel(sock->recv_ring, 1);
+            too_big = (seg_num == 0);
+            break;
+        }
+
+        for (struct pbuf *seg = pbuf; seg != NULL; seg = seg->next) {
+            iov[seg_num].iov_base = seg->payload;
+            iov[seg_num].iov_len = seg->len;
+            seg_num++;
+        }
+        recvd += pbuf->tot_len;
+
+        if (sock->wakeup) {
+            sock->wakeup->stat.app_read_cnt += 1;
+        }
+        if (latency_enable) {
+            calculate_lstack_latency(&sock->stack->latency, pbuf, GAZELLE_LATENCY_READ);
+        }
+    }
+
+    if (sock->wakeup && sock->wakeup->type == WAKEUP_EPOLL && (sock->events & EPOLLIN)) {
+        del_data_in_event(sock);
+    }
+
+    *iovcnt = seg_num;
+    if (too_big) {
+        GAZELLE_RETURN(EMSGSIZE);
+    }
+    if (recvd == 0) {
+        if (sock->wakeup) {
+            sock->wakeup->stat.read_null++;
+        }
+        GAZELLE_RETURN(EAGAIN);
+    }
+    return recvd;
+}
+
+/* give back all pbufs lent by read_stack_zcopy, stack thread free them in read_lwip_data */
+int32_t read_stack_zcopy_release(int32_t fd)
+{
+    struct lwip_sock *sock = get_socket_by_fd(fd);
+
+    /* read pending is kept by recv_lastdata, nothing lent */
+    if (sock->recv_lastdata != NULL) {
+        return 0;
+    }
+
+    gazelle_ring_read_over(sock->recv_ring);
+    return 0;
+}
+
+/* lend idle pbufs in send_ring to app, app builds data in them directly. pbufs are read from send_ring
+ * but not read over, so stack thread can't see them until write_stack_zcopy_commit */
+ssize_t write_stack_zcopy(int32_t fd, struct iovec *iov, int32_t *iovcnt)
+{
+    struct pbuf *pbuf = NULL;
+    int32_t seg_num = 0;
+    struct lwip_sock *sock = get_socket_by_fd(fd);
+
+    if (iov == NULL || iovcnt == NULL || *iovcnt <= 0) {
+        GAZELLE_RETURN(EINVAL);
+    }
+
+    if (sock->same_node_tx_ring != NULL || NETCONN_IS_UDP(sock)) {
+        GAZELLE_RETURN(EOPNOTSUPP);
+    }
+
+    if (sock->errevent > 0) {
+        GAZELLE_RETURN(ENOTCONN);
+    }
+
+    if (sock->stack == NULL || gazelle_ring_read_pending(sock->send_ring) > 0) {
+        GAZELLE_RETURN(EBUSY);
+    }
+
+    thread_bind_stack(sock);
+
+    while (seg_num < *iovcnt) {
+        if (gazelle_ring_read(sock->send_ring, (void **)&pbuf, 1) != 1) {
+            break;
+        }
+        iov[seg_num].iov_base = pbuf->payload;
+        iov[seg_num].iov_len = MBUF_MAX_DATA_LEN;
+        seg_num++;
+    }
+
+    *iovcnt = seg_num;
+    if (seg_num == 0) {
+        if (!get_global_cfg_params()->expand_send_ring) {
+            sem_timedwait_nsecs(&sock->snd_ring_sem);
+        }
+        GAZELLE_RETURN(EAGAIN);
+    }
+    return (ssize_t)seg_num * MBUF_MAX_DATA_LEN;
+}
+
+/* send first len bytes of pbufs lent by write_stack_zcopy, pbufs not used go back to send_ring */
+ssize_t write_stack_zcopy_commit(int32_t fd, size_t len)
+{
+    struct pbuf *pbuf = NULL;
+    struct lwip_sock *sock = get_socket_by_fd(fd);
+    uint32_t lent = gazelle_ring_read_pending(sock->send_ring);
+    uint32_t used = (len + MBUF_MAX_DATA_LEN - 1) / MBUF_MAX_DATA_LEN;
+    size_t left = len;
+
+    if (used > lent) {
+        GAZELLE_RETURN(EINVAL);
+    }
+
+    /* read lent pbufs again, they are read in the same order */
+    gazelle_ring_read_cancel(sock->send_ring, lent);
+    for (uint32_t i = 0; i < used; i++) {
+        (void)gazelle_ring_read(sock->send_ring, (void **)&pbuf, 1);
+        pbuf->tot_len = pbuf->len = (left > MBUF_MAX_DATA_LEN) ? MBUF_MAX_DATA_LEN : (uint16_t)left;
+        left -= pbuf->len;
+    }
+    if (used == 0) {
+        return 0;
+    }
+    gazelle_ring_read_over(sock->send_ring);
+
+    sock->remain_len = MBUF_MAX_DATA_LEN - pbuf->len;
+    if (sock->wakeup) {
+        sock->wakeup->stat.app_write_cnt += used;
+    }
+    if (sock->wakeup && sock->wakeup->type == WAKEUP_EPOLL && (sock->events & EPOLLOUT)) {
+        del_data_out_event(sock);
+    }
+
+    notice_stack_send(sock, fd, len, 0);
+    return (ssize_t)len;
+}
+
 void add_recv_list(int32_t fd)
 {
     struct lwip_sock *sock = get_socket_by_fd(fd);
@@ -1131,6 +1612,23 @@ void read_same_node_recv_list(struct protocol_stack *stack)
     }
 }
 
+/* same_node_recv_list holds every sockmap sock, only those with data in rx ring are pending */
+bool same_node_recv_pending(struct protocol_stack *stack)
+{
+    struct list_node *list = &(stack->same_node_recv_list);
+    struct list_node *node, *temp;
+    struct lwip_sock *sock;
+
+    list_for_each_safe(node, temp, list) {
+        sock = container_of(node, struct lwip_sock, recv_list);
+
+        if (sock->same_node_rx_ring != NULL && same_node_ring_count(sock)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void read_recv_list(struct protocol_stack *stack, uint32_t max_num)
 {
     struct list_node *list = &(stack->recv_list);
@@ -1222,6 +1720,10 @@ static void copy_pcb_to_conn(struct gazelle_stat_lstack_conn_info *conn, const s
             conn->epoll_events = sock->epoll_events;
             conn->eventlist = !list_is_null(&sock->event_list);
         }
+        if (netconn->socket >= 0 && netconn->socket < GAZELLE_LSTACK_MAX_CONN) {
+            conn->mbuf_cnt = g_sock_mbuf[netconn->socket].rx + g_sock_mbuf[netconn->socket].tx;
+            conn->mbuf_peak = g_sock_mbuf[netconn->socket].peak;
+        }
     }
 }
 
@@ -1300,10 +1802,15 @@ void create_shadow_fd(struct rpc_msg *msg)
 
     clone_lwip_socket_opt(clone_sock, sock);
 
-    while (sock->listen_next) {
-        sock = sock->listen_next;
-    }
-    sock->listen_next = clone_sock;
+    /* stacks append their shadow fds in parallel when created by rpc batch */
+    struct lwip_sock *tail = NULL;
+    do {
+        while (sock->listen_next) {
+            sock = sock->listen_next;
+        }
+        tail = NULL;
+    } while (!__atomic_compare_exchange_n(&sock->listen_next, &tail, clone_sock, false,
+        __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
 
     int32_t ret = lwip_bind(clone_fd, addr, addr_len);
     if (ret < 0) {
@@ -1377,7 +1884,7 @@ void get_lwip_connnum(struct rpc_msg *msg)
     msg->result = conn_num;
 }
 
-static uint32_t get_list_count(struct list_node *list)
+uint32_t get_list_count(struct list_node *list)
 {
     struct list_node *node, *temp;
     uint32_t count = 0;
@@ -1435,6 +1942,22 @@ void netif_poll(struct netif *netif)
     }
 }
 
+/* rings of netif_poll are filled by other processes, which can not ring doorbell of this stack */
+bool netif_poll_pending(void)
+{
+    for (struct tcp_pcb *pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+        if (pcb->client_rx_ring != NULL && rte_ring_count(pcb->client_rx_ring) != 0) {
+            return true;
+        }
+    }
+    for (struct tcp_pcb_listen *pcbl = tcp_listen_pcbs.listen_pcbs; pcbl != NULL; pcbl = pcbl->next) {
+        if (pcbl->listen_rx_ring != NULL && rte_ring_count(pcbl->listen_rx_ring) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /* processes on same node handshake packet use this function */
 err_t netif_loop_output(struct netif *netif, struct pbuf *p)
 {
@@ -12,8 +12,14 @@
 #define _GNU_SOURCE
 #include <pthread.h>
 #include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include <rte_kni.h>
+#include <rte_interrupts.h>
+#include <rte_errno.h>
+#include <rte_pause.h>
 
 #include <lwip/sockets.h>
 #include <lwip/tcpip.h>
@@ -39,9 +45,17 @@
 #include "lstack_protocol_stack.h"
 
 #define KERNEL_EVENT_100us              100
+#define STACK_TX_FLUSH_WAIT_US          100000
 
 static PER_THREAD struct protocol_stack *g_stack_p = NULL;
 static struct protocol_stack_group g_stack_group = {0};
+/* indexed by every shadow listen fd of one listen fd, all pointing to the same queue */
+static struct accept_queue *g_accept_queues[GAZELLE_LSTACK_MAX_CONN];
+static struct sockaddr_in g_accept_addrs[GAZELLE_LSTACK_MAX_CONN];
+/* app threads using g_accept_queues[fd], close frees the queue after they leave */
+static uint32_t g_accept_users[GAZELLE_LSTACK_MAX_CONN];
+/* stack_tx_flush done by stack threads, exit waits for it at most STACK_TX_FLUSH_WAIT_US */
+static uint32_t g_tx_flush_done;
 
 void set_init_fail(void);
 bool get_init_fail(void);
@@ -81,25 +95,35 @@ struct protocol_stack_group *get_protocol_stack_group(void)
     return &g_stack_group;
 }
 
-int get_min_conn_stack(struct protocol_stack_group *stack_group)
+/* with stack_rebalance_ms, busy poll ratio first and conn_num breaks ties, otherwise conn_num only */
+static inline bool stack_less_loaded(const struct protocol_stack *a, const struct protocol_stack *b)
+{
+    if (get_global_cfg_params()->stack_rebalance_ms != 0 && a->load != b->load) {
+        return a->load < b->load;
+    }
+    return a->conn_num < b->conn_num;
+}
+
+static struct protocol_stack *get_min_load_stack(struct protocol_stack_group *stack_group, bool send_thread)
 {
-    int min_conn_stk_idx = 0;
-    int min_conn_num = GAZELLE_MAX_CLIENTS;
+    struct protocol_stack *min_stack = NULL;
+
     for (int i = 0; i < stack_group->stack_num; i++) {
         struct protocol_stack* stack = stack_group->stacks[i];
-        if (get_global_cfg_params()->seperate_send_recv) {
-            if (!stack->is_send_thread && stack->conn_num < min_conn_num) {
-                min_conn_stk_idx = i;
-                min_conn_num = stack->conn_num;
-            }
-        } else {
-            if (stack->conn_num < min_conn_num) {
-                min_conn_stk_idx = i;
-                min_conn_num = stack->conn_num;
-            }
+        if (get_global_cfg_params()->seperate_send_recv && stack->is_send_thread != send_thread) {
+            continue;
+        }
+        if (min_stack == NULL || stack_less_loaded(stack, min_stack)) {
+            min_stack = stack;
         }
     }
-    return min_conn_stk_idx;
+    return min_stack;
+}
+
+int get_min_conn_stack(struct protocol_stack_group *stack_group)
+{
+    struct protocol_stack *stack = get_min_load_stack(stack_group, false);
+    return (stack == NULL) ? 0 : stack->stack_idx;
 }
 
 struct protocol_stack *get_protocol_stack(void)
@@ -120,47 +144,51 @@ struct protocol_stack *get_protocol_stack_by_fd(int32_t fd)
 struct protocol_stack *get_bind_protocol_stack(void)
 {
     static PER_THREAD struct protocol_stack *bind_stack = NULL;
+    static PER_THREAD uint32_t bind_check_ms = 0;
+    struct cfg_params *cfg = get_global_cfg_params();
+    struct protocol_stack_group *stack_group = get_protocol_stack_group();
+    /* close listen shadow, per app communication thread select only one stack */
+    bool exclusive = !cfg->tuple_filter && !cfg->listen_shadow;
 
-    /* same app communication thread bind same stack */
+    /* same app communication thread bind same stack, re-checked every stack_rebalance_ms */
     if (bind_stack) {
-        bind_stack->conn_num++;
-        return bind_stack;
+        if (exclusive || cfg->stack_rebalance_ms == 0 || sys_now() - bind_check_ms < cfg->stack_rebalance_ms) {
+            bind_stack->conn_num++;
+            return bind_stack;
+        }
     }
+    bind_check_ms = sys_now();
 
-    struct protocol_stack_group *stack_group = get_protocol_stack_group();
-    uint16_t index = 0;
-    int min_conn_num = GAZELLE_MAX_CLIENTS;
-
-    /* close listen shadow, per app communication thread select only one stack */
-    if (!get_global_cfg_params()->tuple_filter && !get_global_cfg_params()->listen_shadow) {
+    if (exclusive) {
         static _Atomic uint16_t stack_index = 0;
-        index = atomic_fetch_add(&stack_index, 1);
+        uint16_t index = atomic_fetch_add(&stack_index, 1);
         if (index >= stack_group->stack_num) {
             LSTACK_LOG(ERR, LSTACK, "thread =%hu larger than stack num = %hu\n", index, stack_group->stack_num);
             return NULL;
         }
-    } else {
-        pthread_spin_lock(&stack_group->socket_lock);
-        for (uint16_t i = 0; i < stack_group->stack_num; i++) {
-            struct protocol_stack* stack = stack_group->stacks[i];
-            if (get_global_cfg_params()->seperate_send_recv) {
-                if (stack->is_send_thread && stack->conn_num < min_conn_num) {
-                    index = i;
-                    min_conn_num = stack->conn_num;
-                }
-            } else {
-                if (stack->conn_num < min_conn_num) {
-                    index = i;
-                    min_conn_num = stack->conn_num;
-                }
-            }
-        }
+        stack_group->stacks[index]->conn_num++;
+        bind_stack = stack_group->stacks[index];
+        return bind_stack;
     }
 
-    stack_group->stacks[index]->conn_num++;
-    bind_stack = stack_group->stacks[index];
+    pthread_spin_lock(&stack_group->socket_lock);
+    struct protocol_stack *stack = get_min_load_stack(stack_group, true);
+    if (stack == NULL) {
+        stack = stack_group->stacks[0];
+    }
+    if (bind_stack != NULL && stack != bind_stack) {
+        /* only move when clearly busier, established socks stay where they are and new ones follow */
+        if (bind_stack->load <= stack->load + STACK_REBIND_LOAD_GAP) {
+            stack = bind_stack;
+        } else {
+            LSTACK_LOG(INFO, LSTACK, "tid %ld rebind stack %u load %u -> stack %u load %u\n", get_stack_tid(),
+                bind_stack->stack_idx, bind_stack->load, stack->stack_idx, stack->load);
+        }
+    }
+    stack->conn_num++;
+    bind_stack = stack;
     pthread_spin_unlock(&stack_group->socket_lock);
-    return stack_group->stacks[index];
+    return stack;
 }
 
 static uint32_t get_protocol_traffic(struct protocol_stack *stack)
@@ -216,6 +244,128 @@ void low_power_idling(struct protocol_stack *stack)
     }
 }
 
+/* called by producers after queueing work for the stack, wake it only when it sleeps in stack_intr_idling */
+void stack_intr_doorbell(struct protocol_stack *stack)
+{
+    if (stack->intr_doorbell < 0) {
+        return;
+    }
+
+    /* pairs with the fence in stack_intr_idling: either stack sees the new work or we see intr_wait */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&stack->intr_wait, __ATOMIC_ACQUIRE) &&
+        __atomic_exchange_n(&stack->intr_wait, false, __ATOMIC_ACQ_REL)) {
+        uint64_t val = 1;
+        if (posix_api->write_fn(stack->intr_doorbell, &val, sizeof(val)) < 0 && errno != EAGAIN) {
+            LSTACK_LOG(ERR, LSTACK, "write doorbell=%d errno=%d\n", stack->intr_doorbell, errno);
+        }
+    }
+}
+
+void rpc_queue_doorbell(lockless_queue *queue)
+{
+    stack_intr_doorbell(container_of(queue, struct protocol_stack, rpc_queue));
+}
+
+/* recv_list holds socks with data left in recvmbox, they are moved to recv_ring when app frees ring space,
+   so stack must not sleep on them. sockmap rings are filled by other processes without doorbell, they are
+   checked here and picked up within LSTACK_LPM_INTR_WAIT_MS otherwise */
+static bool stack_have_pending_work(struct protocol_stack *stack)
+{
+    return !lockless_queue_empty(&stack->rpc_queue) ||
+        rte_ring_count(stack->send_pending_ring) != 0 ||
+        stack->wakeup_list.next != &stack->wakeup_list ||
+        stack->recv_list.next != &stack->recv_list ||
+        __atomic_load_n(&stack->kernel_event_num, __ATOMIC_ACQUIRE) > 0 ||
+        (get_global_cfg_params()->use_sockmap && (netif_poll_pending() || same_node_recv_pending(stack)));
+}
+
+/* rx interrupt and doorbell are added to the per thread epoll of dpdk, must be called in stack thread.
+   on failure stack keeps low_power_mode 1 behaviour */
+static void stack_intr_init(struct protocol_stack *stack)
+{
+    static PER_THREAD struct rte_epoll_event doorbell_event;
+    int32_t ret;
+
+    if (get_global_cfg_params()->low_power_mod != LSTACK_LPM_MODE_INTR) {
+        return;
+    }
+    if (use_ltran() || get_global_cfg_params()->tuple_filter) {
+        LSTACK_LOG(WARNING, LSTACK, "stack_%02hu low_power_mode 2 unsupported with ltran or tuple_filter\n",
+            stack->queue_id);
+        return;
+    }
+
+    ret = rte_eth_dev_rx_intr_ctl_q(stack->port_id, stack->queue_id, RTE_EPOLL_PER_THREAD, RTE_INTR_EVENT_ADD, NULL);
+    if (ret != 0) {
+        LSTACK_LOG(WARNING, LSTACK, "stack_%02hu rx intr unsupported ret=%d\n", stack->queue_id, ret);
+        return;
+    }
+
+    int32_t fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        LSTACK_LOG(ERR, LSTACK, "eventfd failed errno=%d\n", errno);
+        return;
+    }
+
+    doorbell_event.epdata.event = EPOLLIN;
+    ret = rte_epoll_ctl(RTE_EPOLL_PER_THREAD, EPOLL_CTL_ADD, fd, &doorbell_event);
+    if (ret != 0) {
+        LSTACK_LOG(ERR, LSTACK, "rte_epoll_ctl doorbell failed ret=%d\n", ret);
+        posix_api->close_fn(fd);
+        return;
+    }
+
+    stack->intr_idle_thres = LSTACK_LPM_INTR_IDLE_MIN;
+    stack->intr_doorbell = fd;
+    LSTACK_LOG(INFO, LSTACK, "stack_%02hu rx intr mode enabled\n", stack->queue_id);
+}
+
+/* poll while busy, after intr_idle_thres empty loops sleep until rx interrupt, doorbell or lwip timer.
+   intr_idle_thres follows arrival gap: woken soon after sleeping means polling is cheaper, grow it;
+   sleep timed out means traffic is sparse, shrink it */
+static void stack_intr_idling(struct protocol_stack *stack, int32_t rx_pkts)
+{
+    if (rx_pkts > 0 || stack_have_pending_work(stack)) {
+        stack->intr_idle_loops = 0;
+        return;
+    }
+    if (++stack->intr_idle_loops < stack->intr_idle_thres) {
+        return;
+    }
+    stack->intr_idle_loops = 0;
+
+    rte_eth_dev_rx_intr_enable(stack->port_id, stack->queue_id);
+    __atomic_store_n(&stack->intr_wait, true, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    /* work queued before intr_wait was visible did not ring doorbell; pkts arrived before intr enable
+       may not raise interrupt */
+    if (stack_have_pending_work(stack) || rte_eth_rx_queue_count(stack->port_id, stack->queue_id) > 0) {
+        __atomic_store_n(&stack->intr_wait, false, __ATOMIC_RELEASE);
+        rte_eth_dev_rx_intr_disable(stack->port_id, stack->queue_id);
+        return;
+    }
+
+    struct rte_epoll_event events[2];
+    uint64_t start = get_current_time();
+    stack->low_power = true;
+    int32_t n = rte_epoll_wait(RTE_EPOLL_PER_THREAD, events, 2, LSTACK_LPM_INTR_WAIT_MS);
+    stack->low_power = false;
+    uint64_t slept_us = get_current_time() - start;
+
+    __atomic_store_n(&stack->intr_wait, false, __ATOMIC_RELEASE);
+    rte_eth_dev_rx_intr_disable(stack->port_id, stack->queue_id);
+
+    uint64_t val;
+    (void)posix_api->read_fn(stack->intr_doorbell, &val, sizeof(val));
+
+    if (n > 0 && slept_us < LSTACK_LPM_INTR_SHORT_US) {
+        stack->intr_idle_thres = RTE_MIN(stack->intr_idle_thres << 1, LSTACK_LPM_INTR_IDLE_MAX);
+    } else if (n == 0) {
+        stack->intr_idle_thres = RTE_MAX(stack->intr_idle_thres >> 1, LSTACK_LPM_INTR_IDLE_MIN);
+    }
+}
+
 static int32_t create_thread(void *arg, char *thread_name, stack_thread_func func)
 {
     /* thread may run slow, if arg is temp var maybe have relese */
@@ -272,6 +422,9 @@ static void* gazelle_kernelevent_thread(void *arg)
 
     for (;;) {
         stack->kernel_event_num = posix_api->epoll_wait_fn(stack->epollfd, stack->kernel_events, KERNEL_EPOLL_MAX, -1);
+        if (stack->kernel_event_num > 0) {
+            stack_intr_doorbell(stack);
+        }
         while (stack->kernel_event_num > 0) {
             usleep(KERNEL_EVENT_100us);
         }
@@ -286,6 +439,7 @@ static int32_t init_stack_value(struct protocol_stack *stack, void *arg)
     struct protocol_stack_group *stack_group = get_protocol_stack_group();
 
     stack->tid = rte_gettid();
+    stack->intr_doorbell = -1;
     stack->queue_id = t_params->queue_id;
     stack->stack_idx = t_params->idx;
     stack->lwip_stats = &lwip_stats;
@@ -300,6 +454,10 @@ static int32_t init_stack_value(struct protocol_stack *stack, void *arg)
     stack_group->stacks[t_params->idx] = stack;
     set_stack_idx(t_params->idx);
 
+    if (stack_group->stat_shm != NULL && t_params->idx < stack_group->stat_shm->stack_num) {
+        stack->stat_page = &stack_group->stat_shm->pages[t_params->idx];
+    }
+
     stack->epollfd = posix_api->epoll_create_fn(GAZELLE_LSTACK_MAX_CONN);
     if (stack->epollfd < 0) {
         return -1;
@@ -404,6 +562,8 @@ static struct protocol_stack *stack_thread_init(void *arg)
         goto END1;
     }
 
+    stack_intr_init(stack);
+
     return stack;
 /* kernel event thread dont create, stack thread post sem twice */
 END2:
@@ -437,6 +597,207 @@ static void wakeup_kernel_event(struct protocol_stack *stack)
     stack->kernel_event_num = 0;
 }
 
+static int32_t stack_do_accept(int32_t fd, struct sockaddr *addr, socklen_t *addrlen, int32_t flags)
+{
+    int32_t accept_fd = lwip_accept4(fd, addr, addrlen, flags);
+    if (accept_fd < 0) {
+        LSTACK_LOG(ERR, LSTACK, "fd %d ret %d\n", fd, accept_fd);
+        return -1;
+    }
+
+    struct lwip_sock *sock = get_socket(accept_fd);
+    if (sock == NULL || sock->stack == NULL) {
+        lwip_close(accept_fd);
+        gazelle_clean_sock(accept_fd);
+        posix_api->close_fn(accept_fd);
+        LSTACK_LOG(ERR, LSTACK, "fd %d ret %d\n", fd, accept_fd);
+        return -1;
+    }
+
+    sock->stack->conn_num++;
+    if (rte_ring_count(sock->conn->recvmbox->ring)) {
+        add_recv_list(accept_fd);
+    }
+    return accept_fd;
+}
+
+void stack_accept(struct rpc_msg *msg)
+{
+    msg->result = stack_do_accept(msg->args[MSG_ARG_0].i, msg->args[MSG_ARG_1].p, msg->args[MSG_ARG_2].p,
+        msg->args[MSG_ARG_3].i);
+}
+
+static inline struct accept_queue *accept_queue_get(int32_t fd)
+{
+    if (fd < 0 || fd >= GAZELLE_LSTACK_MAX_CONN) {
+        return NULL;
+    }
+    return __atomic_load_n(&g_accept_queues[fd], __ATOMIC_ACQUIRE);
+}
+
+/* app thread side of accept_queue_quiesce, queue returned stays valid until accept_queue_release */
+static struct accept_queue *accept_queue_hold(int32_t fd)
+{
+    if (fd < 0 || fd >= GAZELLE_LSTACK_MAX_CONN) {
+        return NULL;
+    }
+
+    (void)__atomic_fetch_add(&g_accept_users[fd], 1, __ATOMIC_SEQ_CST);
+    struct accept_queue *queue = __atomic_load_n(&g_accept_queues[fd], __ATOMIC_SEQ_CST);
+    if (queue == NULL) {
+        (void)__atomic_fetch_sub(&g_accept_users[fd], 1, __ATOMIC_RELEASE);
+    }
+    return queue;
+}
+
+static inline void accept_queue_release(int32_t fd)
+{
+    (void)__atomic_fetch_sub(&g_accept_users[fd], 1, __ATOMIC_RELEASE);
+}
+
+/* unpublish queue of fd and wait app threads holding it, they never block while holding */
+static void accept_queue_quiesce(int32_t fd)
+{
+    if (fd < 0 || fd >= GAZELLE_LSTACK_MAX_CONN) {
+        return;
+    }
+
+    __atomic_store_n(&g_accept_queues[fd], NULL, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&g_accept_users[fd], __ATOMIC_ACQUIRE) != 0) {
+        rte_pause();
+    }
+}
+
+uint32_t stack_accept_queue_count(int32_t fd)
+{
+    struct accept_queue *queue = accept_queue_hold(fd);
+    if (queue == NULL) {
+        return 0;
+    }
+
+    uint32_t count = rte_ring_count(queue->ring);
+    accept_queue_release(fd);
+    return count;
+}
+
+/* listen backlog caps the accepted connections queued, rest stays in lwip acceptmbox.
+   ACCEPT_QUEUE_SIZE is the ceiling, leaving headroom for stacks racing on the last slots */
+static inline uint32_t accept_queue_backlog(int32_t backlog)
+{
+    uint32_t max = ACCEPT_QUEUE_SIZE - 1 - (uint32_t)get_protocol_stack_group()->stack_num;
+
+    if (backlog <= 0) {
+        return 1;
+    }
+    return ((uint32_t)backlog > max) ? max : (uint32_t)backlog;
+}
+
+static struct accept_queue *accept_queue_create(int32_t fd, int32_t backlog)
+{
+    char name[RING_NAME_LEN];
+    snprintf_s(name, sizeof(name), sizeof(name) - 1, "accept_%d_%d", getpid(), fd);
+
+    struct accept_queue *queue = calloc(1, sizeof(struct accept_queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    /* mp/mc: every shadow listener's stack enqueues, any app thread dequeues */
+    queue->ring = rte_ring_create(name, ACCEPT_QUEUE_SIZE, rte_socket_id(), 0);
+    if (queue->ring == NULL) {
+        LSTACK_LOG(ERR, LSTACK, "cannot create rte_ring %s, errno is %d\n", name, rte_errno);
+        free(queue);
+        return NULL;
+    }
+    queue->listen_fd = fd;
+    queue->backlog = accept_queue_backlog(backlog);
+    return queue;
+}
+
+/* shadow listeners are closed and app threads quiesced, nothing uses the queue any more */
+static void accept_queue_free(struct accept_queue *queue)
+{
+    void *obj = NULL;
+
+    while (rte_ring_mc_dequeue(queue->ring, &obj) == 0) {
+        rpc_call_close((int32_t)(intptr_t)obj);
+    }
+    rte_ring_free(queue->ring);
+    free(queue);
+}
+
+static void stack_accept_queue_add(struct protocol_stack *stack, int32_t fd)
+{
+    if (accept_queue_get(fd) == NULL) {
+        return;
+    }
+    /* not registered, its connections stay in lwip acceptmbox and are taken by the rpc accept path */
+    if (stack->accept_fd_num >= STACK_ACCEPT_LISTEN_MAX) {
+        LSTACK_LOG(WARNING, LSTACK, "stack %u accept queue listen fds exceed %d\n", stack->stack_idx,
+            STACK_ACCEPT_LISTEN_MAX);
+        return;
+    }
+    stack->accept_fds[stack->accept_fd_num++] = fd;
+}
+
+static void stack_accept_queue_del(struct protocol_stack *stack, int32_t fd)
+{
+    for (uint32_t i = 0; i < stack->accept_fd_num; i++) {
+        if (stack->accept_fds[i] == fd) {
+            stack->accept_fds[i] = stack->accept_fds[--stack->accept_fd_num];
+            break;
+        }
+    }
+    if (fd >= 0 && fd < GAZELLE_LSTACK_MAX_CONN) {
+        __atomic_store_n(&g_accept_queues[fd], NULL, __ATOMIC_RELEASE);
+    }
+}
+
+/* accept handshaked connections of this stack's shadow listeners into the queue shared by all of them */
+static void stack_accept_queue_poll(struct protocol_stack *stack)
+{
+    for (uint32_t i = 0; i < stack->accept_fd_num; i++) {
+        int32_t fd = stack->accept_fds[i];
+        struct lwip_sock *sock = get_socket_by_fd(fd);
+        struct accept_queue *queue = accept_queue_get(fd);
+        if (sock == NULL || sock->conn == NULL || queue == NULL) {
+            continue;
+        }
+
+        /* every stack enqueues at most one after checking, backlog leaves headroom for the enqueue */
+        while (NETCONN_IS_ACCEPTIN(sock) &&
+            rte_ring_count(queue->ring) < __atomic_load_n(&queue->backlog, __ATOMIC_RELAXED)) {
+            struct sockaddr_in addr;
+            socklen_t addrlen = sizeof(addr);
+            int32_t accept_fd = stack_do_accept(fd, (struct sockaddr *)&addr, &addrlen, 0);
+            if (accept_fd < 0) {
+                break;
+            }
+            if (accept_fd < GAZELLE_LSTACK_MAX_CONN) {
+                g_accept_addrs[accept_fd] = addr;
+            }
+            (void)rte_ring_mp_enqueue(queue->ring, (void *)(intptr_t)accept_fd);
+        }
+    }
+}
+
+/* busy: loop that got rx pkts or rpc msgs, load is its per mille share in the window, smoothed by ewma */
+static inline void stack_load_update(struct protocol_stack *stack, bool busy)
+{
+    stack->load_loops++;
+    stack->load_busy += busy;
+
+    uint32_t now = sys_now();
+    if (now - stack->load_window_ms < STACK_LOAD_WINDOW_MS) {
+        return;
+    }
+
+    uint32_t ratio = (uint64_t)stack->load_busy * STACK_LOAD_SCALE / stack->load_loops;
+    stack->load = (stack->load * (STACK_LOAD_EWMA_WEIGHT - 1) + ratio) / STACK_LOAD_EWMA_WEIGHT;
+    stack->load_loops = 0;
+    stack->load_busy = 0;
+    stack->load_window_ms = now;
+}
 
 static void* gazelle_stack_thread(void *arg)
 {
@@ -450,6 +811,7 @@ static void* gazelle_stack_thread(void *arg)
     uint32_t read_connect_number = cfg->read_connect_number;
     uint32_t rpc_number = cfg->rpc_number;
     uint32_t nic_read_number = cfg->nic_read_number;
+    bool stack_rebalance = cfg->stack_rebalance_ms != 0;
     uint32_t wakeup_tick = 0;
     struct protocol_stack_group *stack_group = get_protocol_stack_group();
 
@@ -471,9 +833,9 @@ static void* gazelle_stack_thread(void *arg)
     LSTACK_LOG(INFO, LSTACK, "stack_%02hu init success\n", queue_id);
 
     for (;;) {
-        poll_rpc_msg(stack, rpc_number);
+        uint32_t rpc_cnt = poll_rpc_msg(stack, rpc_number);
 
-        gazelle_eth_dev_poll(stack, use_ltran_flag, nic_read_number);
+        int32_t rx_pkts = gazelle_eth_dev_poll(stack, use_ltran_flag, nic_read_number);
 
         if (use_sockmap) {
             netif_poll(&stack->netif);
@@ -483,12 +845,17 @@ static void* gazelle_stack_thread(void *arg)
             }
         }
         read_recv_list(stack, read_connect_number);
+        send_stack_list(stack, read_connect_number);
 
         if ((wakeup_tick & 0xf) == 0) {
             wakeup_kernel_event(stack);
             wakeup_stack_epoll(stack);
         }
 
+        if ((wakeup_tick & 0xfff) == 0) {
+            stack_stat_publish(stack);
+        }
+
         /* KNI requests are generally low-rate I/Os,
         * so processing KNI requests only in the thread with queue_id No.0 is sufficient. */
         if (kni_switch && !queue_id && !(wakeup_tick & 0xfff)) {
@@ -502,7 +869,20 @@ static void* gazelle_stack_thread(void *arg)
 
         sys_timer_run();
 
-        if (cfg->low_power_mod != 0) {
+        if (stack->accept_fd_num != 0) {
+            stack_accept_queue_poll(stack);
+        }
+
+        if (stack_rebalance) {
+            stack_load_update(stack, rx_pkts > 0 || rpc_cnt > 0);
+        }
+
+        /* nothing cached may wait while the stack idles */
+        (void)stack_send_pkts(stack);
+
+        if (stack->intr_doorbell >= 0) {
+            stack_intr_idling(stack, rx_pkts);
+        } else if (cfg->low_power_mod != 0) {
             low_power_idling(stack);
         }
     }
@@ -563,6 +943,12 @@ int32_t init_protocol_stack(void)
     if (init_protocol_sem() != 0) {
         return -1;
     }
+
+    /* gazellectl falls back to query by unix socket if stat shm is not available */
+    if (!use_ltran() && stack_stat_shm_init() != 0) {
+        LSTACK_LOG(WARNING, LSTACK, "stack_stat_shm_init failed\n");
+    }
+
     int queue_num = get_global_cfg_params()->num_queue;
     struct thread_params *t_params[queue_num];
     int process_index = get_global_cfg_params()->process_idx;
@@ -655,6 +1041,7 @@ void stack_close(struct rpc_msg *msg)
 {
     int32_t fd = msg->args[MSG_ARG_0].i;
 
+    stack_accept_queue_del(get_protocol_stack(), fd);
     msg->result = lwip_close(fd);
     if (msg->result != 0) {
         LSTACK_LOG(ERR, LSTACK, "tid %ld, fd %d failed %ld\n", get_stack_tid(), msg->args[MSG_ARG_0].i, msg->result);
@@ -665,6 +1052,41 @@ void stack_close(struct rpc_msg *msg)
     posix_api->close_fn(fd);
 }
 
+void stack_tx_flush(struct rpc_msg *msg)
+{
+    msg->result = stack_send_pkts(get_protocol_stack());
+    __atomic_fetch_add(&g_tx_flush_done, 1, __ATOMIC_RELEASE);
+}
+
+/* a stopped or blocked stack never serves the rpc, so don't wait for it forever */
+void stack_group_tx_flush(void)
+{
+    struct protocol_stack_group *stack_group = get_protocol_stack_group();
+    struct protocol_stack *cur_stack = get_protocol_stack();
+    uint32_t start = __atomic_load_n(&g_tx_flush_done, __ATOMIC_ACQUIRE);
+    uint32_t call_num = 0;
+
+    for (int32_t i = 0; i < stack_group->stack_num; i++) {
+        struct protocol_stack *stack = stack_group->stacks[i];
+        /* exit called in a stack thread, it can't serve rpc */
+        if (stack == cur_stack) {
+            (void)stack_send_pkts(stack);
+        } else if (rpc_call_tx_flush(stack) == 0) {
+            call_num++;
+        }
+    }
+
+    uint64_t deadline = get_current_time() + STACK_TX_FLUSH_WAIT_US;
+    while (__atomic_load_n(&g_tx_flush_done, __ATOMIC_ACQUIRE) - start < call_num) {
+        if (get_current_time() > deadline) {
+            LSTACK_LOG(WARNING, LSTACK, "tx flush of %u stacks timeout\n",
+                call_num - (__atomic_load_n(&g_tx_flush_done, __ATOMIC_ACQUIRE) - start));
+            break;
+        }
+        rte_pause();
+    }
+}
+
 void stack_bind(struct rpc_msg *msg)
 {
     msg->result = lwip_bind(msg->args[MSG_ARG_0].i, msg->args[MSG_ARG_1].cp, msg->args[MSG_ARG_2].socklen);
@@ -688,34 +1110,10 @@ void stack_listen(struct rpc_msg *msg)
     msg->result = lwip_listen(fd, backlog);
     if (msg->result != 0) {
         LSTACK_LOG(ERR, LSTACK, "tid %ld, fd %d failed %ld\n", get_stack_tid(), msg->args[MSG_ARG_0].i, msg->result);
-    }
-}
-
-void stack_accept(struct rpc_msg *msg)
-{
-    int32_t fd = msg->args[MSG_ARG_0].i;
-    msg->result = -1;
-
-    int32_t accept_fd = lwip_accept4(fd, msg->args[MSG_ARG_1].p, msg->args[MSG_ARG_2].p, msg->args[MSG_ARG_3].i);
-    if (accept_fd < 0) {
-        LSTACK_LOG(ERR, LSTACK, "fd %d ret %d\n", fd, accept_fd);
-        return;
-    }
-
-    struct lwip_sock *sock = get_socket(accept_fd);
-    if (sock == NULL || sock->stack == NULL) {
-        lwip_close(accept_fd);
-        gazelle_clean_sock(accept_fd);
-        posix_api->close_fn(accept_fd);
-        LSTACK_LOG(ERR, LSTACK, "fd %d ret %d\n", fd, accept_fd);
         return;
     }
 
-    msg->result = accept_fd;
-    sock->stack->conn_num++;
-    if (rte_ring_count(sock->conn->recvmbox->ring)) {
-        add_recv_list(accept_fd);
-    }
+    stack_accept_queue_add(get_protocol_stack(), fd);
 }
 
 void stack_connect(struct rpc_msg *msg)
@@ -782,34 +1180,6 @@ void stack_recv(struct rpc_msg *msg)
         msg->args[MSG_ARG_3].i);
 }
 
-/* any protocol stack thread receives arp packet and sync it to other threads so that it can have the arp table */
-void stack_broadcast_arp(struct rte_mbuf *mbuf, struct protocol_stack *cur_stack)
-{
-    struct protocol_stack_group *stack_group = get_protocol_stack_group();
-    struct rte_mbuf *mbuf_copy = NULL;
-    struct protocol_stack *stack = NULL;
-    int32_t ret;
-
-    for (int32_t i = 0; i < stack_group->stack_num; i++) {
-        stack = stack_group->stacks[i];
-        if (cur_stack == stack && use_ltran()) {
-            continue;
-        }
-
-        ret = gazelle_alloc_pktmbuf(stack->rxtx_pktmbuf_pool, &mbuf_copy, 1);
-        if (ret != 0) {
-            stack->stats.rx_allocmbuf_fail++;
-            return;
-        }
-        copy_mbuf(mbuf_copy, mbuf);
-
-        ret = rpc_call_arp(stack, mbuf_copy);
-        if (ret != 0) {
-            return;
-        }
-    }
-}
-
 void stack_broadcast_clean_epoll(struct wakeup_poll *wakeup)
 {
     struct protocol_stack_group *stack_group = get_protocol_stack_group();
@@ -833,6 +1203,7 @@ void stack_clean_epoll(struct rpc_msg *msg)
 int32_t stack_broadcast_close(int32_t fd)
 {
     struct lwip_sock *sock = get_socket(fd);
+    struct accept_queue *queue = accept_queue_get(fd);
     int32_t ret = 0;
 
     if (sock == NULL) {
@@ -844,6 +1215,9 @@ int32_t stack_broadcast_close(int32_t fd)
         if (rpc_call_close(fd)) {
             ret = -1;
         }
+        if (queue != NULL) {
+            accept_queue_quiesce(fd);
+        }
 
         if (sock == NULL || sock->conn == NULL) {
             break;
@@ -851,6 +1225,9 @@ int32_t stack_broadcast_close(int32_t fd)
         fd = sock->conn->socket;
     } while (sock);
 
+    if (queue != NULL) {
+        accept_queue_free(queue);
+    }
     return ret;
 }
 
@@ -882,6 +1259,17 @@ int32_t stack_broadcast_listen(int32_t fd, int32_t backlog)
 
     struct protocol_stack_group *stack_group = get_protocol_stack_group();
     int min_conn_stk_idx = get_min_conn_stack(stack_group);
+    /* without it, accept falls back to picking a shadow listener and accepting by rpc */
+    struct accept_queue *queue = accept_queue_get(fd);
+    if (queue != NULL) {
+        /* listen again only changes backlog */
+        __atomic_store_n(&queue->backlog, accept_queue_backlog(backlog), __ATOMIC_RELAXED);
+    } else if (get_global_cfg_params()->listen_shadow && fd < GAZELLE_LSTACK_MAX_CONN) {
+        queue = accept_queue_create(fd, backlog);
+        if (queue != NULL) {
+            __atomic_store_n(&g_accept_queues[fd], queue, __ATOMIC_RELEASE);
+        }
+    }
 
     for (int32_t i = 0; i < stack_group->stack_num; ++i) {
         stack = stack_group->stacks[i];
@@ -904,6 +1292,10 @@ int32_t stack_broadcast_listen(int32_t fd, int32_t backlog)
             get_socket_by_fd(clone_fd)->conn->is_master_fd = 0;
         }
 
+        if (queue != NULL && clone_fd < GAZELLE_LSTACK_MAX_CONN) {
+            __atomic_store_n(&g_accept_queues[clone_fd], queue, __ATOMIC_RELEASE);
+        }
+
         ret = rpc_call_listen(clone_fd, backlog);
         if (ret < 0) {
             stack_broadcast_close(fd);
@@ -924,7 +1316,7 @@ static struct lwip_sock *get_min_accept_sock(int32_t fd)
             continue;
         }
 
-        if (min_sock == NULL || min_sock->stack->conn_num > sock->stack->conn_num) {
+        if (min_sock == NULL || stack_less_loaded(sock->stack, min_sock->stack)) {
             min_sock = sock;
         }
 
@@ -938,7 +1330,7 @@ static void inline del_accept_in_event(struct lwip_sock *sock)
 {
     pthread_spin_lock(&sock->wakeup->event_list_lock);
 
-    if (!NETCONN_IS_ACCEPTIN(sock)) {
+    if (!NETCONN_IS_ACCEPTIN(sock) && stack_accept_queue_count(sock->conn->socket) == 0) {
         sock->events &= ~EPOLLIN;
         if (sock->events == 0) {
             list_del_node_null(&sock->event_list);
@@ -967,24 +1359,126 @@ int32_t stack_broadcast_bind(int32_t fd, const struct sockaddr *name, socklen_t
         GAZELLE_RETURN(EINVAL);
     }
 
-    ret = rpc_call_bind(fd, name, namelen);
+    /* submit to all stacks first, so that bind and shadow fds are done by stack threads in parallel */
+    struct protocol_stack_group *stack_group = get_protocol_stack_group();
+    struct rpc_batch batches[PROTOCOL_STACK_MAX];
+    ret = 0;
+    for (int32_t i = 0; i < stack_group->stack_num; ++i) {
+        stack = stack_group->stacks[i];
+        rpc_batch_init(&batches[i], stack);
+        if (ret != 0) {
+            continue;
+        }
+        if (stack == cur_stack) {
+            ret = rpc_batch_add_bind(&batches[i], fd, name, namelen);
+        } else {
+            ret = rpc_batch_add_shadow_fd(&batches[i], fd, name, namelen);
+        }
+        if (ret != 0 || rpc_batch_submit(&batches[i]) != 0) {
+            rpc_batch_free(&batches[i]);
+            ret = -1;
+        }
+    }
+
+    for (int32_t i = 0; i < stack_group->stack_num; ++i) {
+        if (batches[i].msg_num == 0) {
+            continue;
+        }
+        (void)rpc_batch_wait(&batches[i]);
+        clone_fd = batches[i].msgs[0]->result;
+        rpc_batch_free(&batches[i]);
+        if (clone_fd < 0 && ret == 0) {
+            ret = clone_fd;
+        }
+    }
+
     if (ret < 0) {
-        close(fd);
-        return ret;
+        stack_broadcast_close(fd);
+    }
+    return ret;
+}
+
+/* shadow fds copied options of fd when they were cloned, options set later must reach them too */
+int32_t stack_broadcast_setsockopt(int32_t fd, int32_t level, int32_t optname, const void *optval, socklen_t optlen)
+{
+    struct lwip_sock *sock = get_socket(fd);
+    if (sock == NULL) {
+        GAZELLE_RETURN(EINVAL);
+    }
+    if (sock->listen_next == NULL) {
+        return rpc_call_setsockopt(fd, level, optname, optval, optlen);
     }
 
+    /* one batch per stack, holding fd and shadow fds owned by that stack */
     struct protocol_stack_group *stack_group = get_protocol_stack_group();
+    struct rpc_batch batches[PROTOCOL_STACK_MAX];
+    int32_t ret = 0;
     for (int32_t i = 0; i < stack_group->stack_num; ++i) {
-        stack = stack_group->stacks[i];
-        if (stack != cur_stack) {
-            clone_fd = rpc_call_shadow_fd(stack, fd, name, namelen);
-            if (clone_fd < 0) {
-                stack_broadcast_close(fd);
-                return clone_fd;
+        rpc_batch_init(&batches[i], stack_group->stacks[i]);
+        if (ret != 0) {
+            continue;
+        }
+        for (struct lwip_sock *shadow = sock; shadow != NULL && ret == 0; shadow = shadow->listen_next) {
+            if (shadow->conn != NULL && shadow->stack == stack_group->stacks[i]) {
+                ret = rpc_batch_add_setsockopt(&batches[i], shadow->conn->socket, level, optname, optval, optlen);
             }
         }
+        if (ret != 0 || rpc_batch_submit(&batches[i]) != 0) {
+            rpc_batch_free(&batches[i]);
+            ret = -1;
+        }
+    }
+
+    for (int32_t i = 0; i < stack_group->stack_num; ++i) {
+        if (batches[i].msg_num == 0) {
+            continue;
+        }
+        (void)rpc_batch_wait(&batches[i]);
+        for (uint32_t j = 0; j < batches[i].msg_num; j++) {
+            if (batches[i].msgs[j]->result != 0 && ret == 0) {
+                ret = batches[i].msgs[j]->result;
+            }
+        }
+        rpc_batch_free(&batches[i]);
+    }
+    return ret;
+}
+
+/* lwip_accept4 ran in the stack thread with no flags, apply them like fcntl does */
+static void accept_queue_set_flags(int32_t fd, int32_t flags)
+{
+    if (flags & SOCK_CLOEXEC) {
+        (void)posix_api->fcntl_fn(fd, F_SETFD, FD_CLOEXEC);
+    }
+    if (flags & SOCK_NONBLOCK) {
+        int32_t fl = posix_api->fcntl_fn(fd, F_GETFL, 0);
+        if (fl >= 0 && posix_api->fcntl_fn(fd, F_SETFL, fl | O_NONBLOCK) == 0) {
+            (void)lwip_fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+        }
     }
-    return 0;
+}
+
+static int32_t accept_queue_pop(struct accept_queue *queue, struct sockaddr *addr, socklen_t *addrlen, int32_t flags)
+{
+    void *obj = NULL;
+
+    if (rte_ring_mc_dequeue(queue->ring, &obj) != 0) {
+        return -1;
+    }
+
+    int32_t accept_fd = (int32_t)(intptr_t)obj;
+    if (addr != NULL && addrlen != NULL) {
+        if (accept_fd < GAZELLE_LSTACK_MAX_CONN) {
+            socklen_t len = (*addrlen < sizeof(struct sockaddr_in)) ? *addrlen : sizeof(struct sockaddr_in);
+            (void)memcpy_s(addr, *addrlen, &g_accept_addrs[accept_fd], len);
+            *addrlen = sizeof(struct sockaddr_in);
+        } else {
+            (void)rpc_call_getpeername(accept_fd, addr, addrlen);
+        }
+    }
+    accept_queue_set_flags(accept_fd, flags);
+
+    return accept_fd;
 }
 
 /* ergodic the protocol stack thread to find the connection, because all threads are listening */
@@ -998,12 +1492,29 @@ int32_t stack_broadcast_accept4(int32_t fd, struct sockaddr *addr, socklen_t *ad
         return -1;
     }
 
-    struct lwip_sock *min_sock = get_min_accept_sock(fd);
+    /* listen_shadow: whichever stack finished the handshake, it is in the shared queue */
+    struct accept_queue *queue = accept_queue_hold(fd);
+    if (queue != NULL) {
+        ret = accept_queue_pop(queue, addr, addrlen, flags);
+        accept_queue_release(fd);
+    }
+
+    /* connections of shadow listeners not registered to the queue */
+    struct lwip_sock *min_sock = NULL;
+    if (ret < 0) {
+        min_sock = get_min_accept_sock(fd);
+    }
     if (min_sock && min_sock->conn) {
         ret = rpc_call_accept(min_sock->conn->socket, addr, addrlen, flags);
     }
 
-    if (min_sock && min_sock->wakeup && min_sock->wakeup->type == WAKEUP_EPOLL) {
+    if (queue != NULL) {
+        for (struct lwip_sock *shadow = sock; shadow != NULL; shadow = shadow->listen_next) {
+            if (shadow->conn && shadow->wakeup && shadow->wakeup->type == WAKEUP_EPOLL) {
+                del_accept_in_event(shadow);
+            }
+        }
+    } else if (min_sock && min_sock->wakeup && min_sock->wakeup->type == WAKEUP_EPOLL) {
         del_accept_in_event(min_sock);
     }
 
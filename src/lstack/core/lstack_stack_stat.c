@@ -11,8 +11,11 @@
 */
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <securec.h>
 #include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
 #include <lwip/api.h>
 
@@ -27,7 +30,9 @@
 #include "lstack_protocol_stack.h"
 #include "posix/lstack_epoll.h"
 #include "lstack_dpdk.h"
+#include "lstack_lwip.h"
 #include "lstack_stack_stat.h"
+#include "gazelle_base_func.h"
 
 #define US_PER_SEC  1000000
 
@@ -67,10 +72,19 @@ void calculate_lstack_latency(struct gazelle_stack_latency *stack_latency, const
     struct stack_latency *latency_stat = (type == GAZELLE_LATENCY_LWIP) ?
         &stack_latency->lwip_latency : &stack_latency->read_latency;
 
-    latency_stat->latency_total += latency;
     latency_stat->latency_max = (latency_stat->latency_max > latency) ? latency_stat->latency_max : latency;
     latency_stat->latency_min = (latency_stat->latency_min < latency) ? latency_stat->latency_min : latency;
-    latency_stat->latency_pkts++;
+
+    /* read latency is recorded by app threads, lwip latency by the stack thread only */
+    if (type == GAZELLE_LATENCY_READ) {
+        (void)__atomic_fetch_add(&latency_stat->latency_total, latency, __ATOMIC_RELAXED);
+        (void)__atomic_fetch_add(&latency_stat->latency_pkts, 1, __ATOMIC_RELAXED);
+        gazelle_latency_record_shared(latency_stat->latency_hist, latency);
+    } else {
+        latency_stat->latency_total += latency;
+        latency_stat->latency_pkts++;
+        gazelle_latency_record(latency_stat->latency_hist, latency);
+    }
 }
 
 void lstack_calculate_aggregate(int type, uint32_t len)
@@ -141,6 +155,7 @@ static void get_wakeup_stat(struct protocol_stack_group *stack_group, struct pro
             stat->app_write_cnt += wakeup->stat.app_write_cnt;
             stat->app_write_rpc += wakeup->stat.app_write_rpc;
             stat->app_read_cnt += wakeup->stat.app_read_cnt;
+            stat->app_write_quota += wakeup->stat.app_write_quota;
         }
     }
 
@@ -176,16 +191,134 @@ static void get_stack_stats(struct gazelle_stack_dfx_data *dfx, struct protocol_
 
     dfx->data.pkts.call_alloc_fail = stack_group->call_alloc_fail;
 
-    int32_t rpc_call_result = rpc_call_msgcnt(stack);
-    dfx->data.pkts.call_msg_cnt = (rpc_call_result < 0) ? 0 : rpc_call_result;
+    /* one round trip to stack thread for all rpc counters */
+    struct rpc_batch batch;
+    rpc_batch_init(&batch, stack);
+    struct rpc_msg *msgcnt_msg = rpc_batch_add(&batch, rpc_msgcnt);
+    struct rpc_msg *mempool_msg = rpc_batch_add(&batch, stack_mempool_size);
+    struct rpc_msg *recvlist_msg = rpc_batch_add(&batch, stack_recvlist_count);
+    if (msgcnt_msg != NULL && mempool_msg != NULL && recvlist_msg != NULL) {
+        mempool_msg->args[MSG_ARG_0].p = stack;
+        recvlist_msg->args[MSG_ARG_0].p = stack;
+        if (rpc_batch_wait(&batch) == 0) {
+            dfx->data.pkts.call_msg_cnt = (msgcnt_msg->result < 0) ? 0 : msgcnt_msg->result;
+            dfx->data.pkts.mempool_freecnt = (mempool_msg->result < 0) ? 0 : mempool_msg->result;
+            dfx->data.pkts.recv_list_cnt = (recvlist_msg->result < 0) ? 0 : recvlist_msg->result;
+        }
+    }
+    rpc_batch_free(&batch);
+
+    dfx->data.pkts.conn_num = stack->conn_num;
+}
 
-    rpc_call_result = rpc_call_mempoolsize(stack);
-    dfx->data.pkts.mempool_freecnt = (rpc_call_result < 0) ? 0 : rpc_call_result;
+int32_t stack_stat_shm_init(void)
+{
+    struct protocol_stack_group *stack_group = get_protocol_stack_group();
+    const char *filename = get_global_cfg_params()->stat_shm_filename;
+    size_t size = gazelle_stat_shm_size(stack_group->stack_num);
 
-    rpc_call_result = rpc_call_recvlistcnt(stack);
-    dfx->data.pkts.recv_list_cnt = (rpc_call_result < 0) ? 0 : rpc_call_result;
+    if (check_and_set_run_dir() != 0) {
+        LSTACK_LOG(ERR, LSTACK, "create %s failed\n", GAZELLE_RUN_DIR);
+        return -1;
+    }
 
-    dfx->data.pkts.conn_num = stack->conn_num;
+    int32_t fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        LSTACK_LOG(ERR, LSTACK, "open %s failed, errno %d\n", filename, errno);
+        return -1;
+    }
+
+    if (ftruncate(fd, (off_t)size) != 0) {
+        LSTACK_LOG(ERR, LSTACK, "ftruncate %s failed, errno %d\n", filename, errno);
+        posix_api->close_fn(fd);
+        (void)unlink(filename);
+        return -1;
+    }
+
+    struct gazelle_stat_shm *shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    posix_api->close_fn(fd);
+    if (shm == MAP_FAILED) {
+        LSTACK_LOG(ERR, LSTACK, "mmap %s failed, errno %d\n", filename, errno);
+        (void)unlink(filename);
+        return -1;
+    }
+
+    /* file is zero filled by ftruncate, all pages start with even seq */
+    shm->version = GAZELLE_STAT_SHM_VERSION;
+    shm->pid = (uint32_t)getpid();
+    shm->stack_num = stack_group->stack_num;
+    shm->page_size = sizeof(struct gazelle_stack_stat_page);
+    /* readers check magic last */
+    __atomic_store_n(&shm->magic, GAZELLE_STAT_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    stack_group->stat_shm = shm;
+    return 0;
+}
+
+void stack_stat_shm_uninit(void)
+{
+    struct protocol_stack_group *stack_group = get_protocol_stack_group();
+
+    if (stack_group->stat_shm == NULL) {
+        return;
+    }
+
+    /* stack threads may still be running, stop them publishing before the pages go away */
+    for (uint16_t i = 0; i < stack_group->stack_num; i++) {
+        if (stack_group->stacks[i] != NULL) {
+            __atomic_store_n(&stack_group->stacks[i]->stat_page, NULL, __ATOMIC_RELEASE);
+        }
+    }
+    if (munmap(stack_group->stat_shm, gazelle_stat_shm_size(stack_group->stack_num)) != 0) {
+        LSTACK_LOG(ERR, LSTACK, "munmap stat shm failed, errno %d\n", errno);
+    }
+    stack_group->stat_shm = NULL;
+
+    if (unlink(get_global_cfg_params()->stat_shm_filename) != 0) {
+        LSTACK_LOG(ERR, LSTACK, "unlink stat shm failed, just skip it\n");
+    }
+}
+
+/* called in stack thread, copies counters into stat shm at most once per GAZELLE_STAT_SHM_PUBLISH_US */
+void stack_stat_publish(struct protocol_stack *stack)
+{
+    struct protocol_stack_group *stack_group = get_protocol_stack_group();
+    struct gazelle_stack_stat_page *page = __atomic_load_n(&stack->stat_page, __ATOMIC_ACQUIRE);
+
+    if (page == NULL) {
+        return;
+    }
+
+    uint64_t now = get_current_time();
+    if (now < stack->stat_publish_time) {
+        return;
+    }
+    stack->stat_publish_time = now + GAZELLE_STAT_SHM_PUBLISH_US;
+
+    gazelle_stat_page_write_begin(page);
+
+    struct gazelle_stack_stat_data *data = &page->data;
+    data->tid = stack->tid;
+    data->loglevel = rte_log_get_level(RTE_LOGTYPE_LSTACK);
+    lstack_get_low_power_info(&data->low_power_info);
+
+    data->pkts.stack_stat = stack->stats;
+    (void)memset_s(&data->pkts.wakeup_stat, sizeof(data->pkts.wakeup_stat), 0, sizeof(data->pkts.wakeup_stat));
+    get_wakeup_stat(stack_group, stack, &data->pkts.wakeup_stat);
+    data->pkts.call_alloc_fail = stack_group->call_alloc_fail;
+    /* in stack thread already, read directly what get_stack_stats asks for by rpc */
+    data->pkts.call_msg_cnt = (uint64_t)lockless_queue_count(&stack->rpc_queue);
+    data->pkts.mempool_freecnt = rte_mempool_avail_count(stack->rxtx_pktmbuf_pool);
+    data->pkts.recv_list_cnt = get_list_count(&stack->recv_list);
+    data->pkts.conn_num = stack->conn_num;
+
+    int32_t ret = memcpy_s(&data->snmp, sizeof(data->snmp), &stack->lwip_stats->mib2, sizeof(stack->lwip_stats->mib2));
+    if (ret != EOK) {
+        LSTACK_LOG(ERR, LSTACK, "memcpy_s err ret=%d \n", ret);
+    }
+    data->aggregate_stats = stack->aggregate_stats;
+
+    gazelle_stat_page_write_end(page);
 }
 
 static void get_stack_dfx_data(struct gazelle_stack_dfx_data *dfx, struct protocol_stack *stack,
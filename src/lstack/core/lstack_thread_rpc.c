@@ -14,6 +14,7 @@
 #include <lwip/sockets.h>
 #include <lwipsock.h>
 #include <rte_mempool.h>
+#include <rte_pause.h>
 
 #include "lstack_log.h"
 #include "lstack_lwip.h"
@@ -38,30 +39,52 @@ static inline __attribute__((always_inline)) struct rpc_msg *get_rpc_msg(struct
     return msg;
 }
 
-static struct rpc_msg *rpc_msg_alloc(struct protocol_stack *stack, rpc_msg_func func)
+static struct rpc_msg_pool *rpc_msg_pool_get(void)
 {
-    struct rpc_msg *msg = NULL;
-
-    if (stack == NULL) {
-        return NULL;
+    if (g_rpc_pool != NULL && g_rpc_pool->rpc_pool != NULL && g_rpc_pool->done_ring != NULL) {
+        return g_rpc_pool;
     }
 
     if (g_rpc_pool == NULL) {
         g_rpc_pool = calloc(1, sizeof(struct rpc_msg_pool));
         if (g_rpc_pool == NULL) {
             LSTACK_LOG(INFO, LSTACK, "g_rpc_pool calloc failed\n");
-            get_protocol_stack_group()->call_alloc_fail++;
             return NULL;
         }
+    }
 
+    if (g_rpc_pool->rpc_pool == NULL) {
         g_rpc_pool->rpc_pool = create_mempool("rpc_pool", RPC_MSG_MAX, sizeof(struct rpc_msg),
             0, rte_gettid());
         if (g_rpc_pool->rpc_pool == NULL) {
-            get_protocol_stack_group()->call_alloc_fail++;
             return NULL;
         }
     }
 
+    /* every batch hold at least two msgs, so done_ring never overflow */
+    if (g_rpc_pool->done_ring == NULL) {
+        g_rpc_pool->done_ring = create_ring("rpc_done", RPC_MSG_MAX, RING_F_SC_DEQ, rte_gettid());
+        if (g_rpc_pool->done_ring == NULL) {
+            return NULL;
+        }
+    }
+
+    return g_rpc_pool;
+}
+
+static struct rpc_msg *rpc_msg_alloc(struct protocol_stack *stack, rpc_msg_func func)
+{
+    struct rpc_msg *msg = NULL;
+
+    if (stack == NULL) {
+        return NULL;
+    }
+
+    if (rpc_msg_pool_get() == NULL) {
+        get_protocol_stack_group()->call_alloc_fail++;
+        return NULL;
+    }
+
     msg = get_rpc_msg(g_rpc_pool);
     if (msg == NULL) {
         get_protocol_stack_group()->call_alloc_fail++;
@@ -91,17 +114,19 @@ static inline __attribute__((always_inline)) int32_t rpc_sync_call(lockless_queu
     return ret;
 }
 
-void poll_rpc_msg(struct protocol_stack *stack, uint32_t max_num)
+uint32_t poll_rpc_msg(struct protocol_stack *stack, uint32_t max_num)
 {
     struct rpc_msg *msg = NULL;
+    uint32_t num = 0;
 
-    while (max_num--) {
+    while (num < max_num) {
         lockless_queue_node *node = lockless_queue_mpsc_pop(&stack->rpc_queue);
         if (node == NULL) {
             break;
         }
 
         msg = container_of(node, struct rpc_msg, queue_node);
+        num++;
 
         if (msg->func) {
             msg->func(msg);
@@ -118,6 +143,8 @@ void poll_rpc_msg(struct protocol_stack *stack, uint32_t max_num)
             }
         }
     }
+
+    return num;
 }
 
 int32_t rpc_call_conntable(struct protocol_stack *stack, void *conn_table, uint32_t max_conn)
@@ -157,7 +184,7 @@ int32_t rpc_call_shadow_fd(struct protocol_stack *stack, int32_t fd, const struc
     return rpc_sync_call(&stack->rpc_queue, msg);
 }
 
-static void rpc_msgcnt(struct rpc_msg *msg)
+void rpc_msgcnt(struct rpc_msg *msg)
 {
     struct protocol_stack *stack = get_protocol_stack();
     msg->result = lockless_queue_count(&stack->rpc_queue);
@@ -205,6 +232,19 @@ int32_t rpc_call_mempoolsize(struct protocol_stack *stack)
     return rpc_sync_call(&stack->rpc_queue, msg);
 }
 
+int32_t rpc_call_tx_flush(struct protocol_stack *stack)
+{
+    struct rpc_msg *msg = rpc_msg_alloc(stack, stack_tx_flush);
+    if (msg == NULL) {
+        return -1;
+    }
+
+    /* async, caller waits for the flush with a deadline */
+    msg->self_release = 0;
+    rpc_call(&stack->rpc_queue, msg);
+    return 0;
+}
+
 int32_t rpc_call_recvlistcnt(struct protocol_stack *stack)
 {
     struct rpc_msg *msg = rpc_msg_alloc(stack, stack_recvlist_count);
@@ -464,3 +504,168 @@ int32_t rpc_call_send(int fd, const void *buf, size_t len, int flags)
 
     return 0;
 }
+
+void rpc_batch_init(struct rpc_batch *batch, struct protocol_stack *stack)
+{
+    batch->stack = stack;
+    batch->done_ring = NULL;
+    batch->completed = false;
+    batch->msg_num = 0;
+}
+
+struct rpc_msg *rpc_batch_add(struct rpc_batch *batch, rpc_msg_func func)
+{
+    /* stack_send is released by stack itself, can't be reaped by batch */
+    if (batch->msg_num == RPC_BATCH_MAX || func == stack_send) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct rpc_msg *msg = rpc_msg_alloc(batch->stack, func);
+    if (msg == NULL) {
+        return NULL;
+    }
+
+    batch->msgs[batch->msg_num++] = msg;
+    return msg;
+}
+
+static int32_t rpc_batch_fd_check(const struct rpc_batch *batch, int32_t fd)
+{
+    if (get_protocol_stack_by_fd(fd) != batch->stack) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+int32_t rpc_batch_add_shadow_fd(struct rpc_batch *batch, int32_t fd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    struct rpc_msg *msg = rpc_batch_add(batch, create_shadow_fd);
+    if (msg == NULL) {
+        return -1;
+    }
+
+    msg->args[MSG_ARG_0].i = fd;
+    msg->args[MSG_ARG_1].cp = addr;
+    msg->args[MSG_ARG_2].socklen = addrlen;
+    return 0;
+}
+
+int32_t rpc_batch_add_bind(struct rpc_batch *batch, int32_t fd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    if (rpc_batch_fd_check(batch, fd) != 0) {
+        return -1;
+    }
+
+    struct rpc_msg *msg = rpc_batch_add(batch, stack_bind);
+    if (msg == NULL) {
+        return -1;
+    }
+
+    msg->args[MSG_ARG_0].i = fd;
+    msg->args[MSG_ARG_1].cp = addr;
+    msg->args[MSG_ARG_2].socklen = addrlen;
+    return 0;
+}
+
+int32_t rpc_batch_add_setsockopt(struct rpc_batch *batch, int fd, int level, int optname, const void *optval,
+    socklen_t optlen)
+{
+    if (rpc_batch_fd_check(batch, fd) != 0) {
+        return -1;
+    }
+
+    struct rpc_msg *msg = rpc_batch_add(batch, stack_setsockopt);
+    if (msg == NULL) {
+        return -1;
+    }
+
+    msg->args[MSG_ARG_0].i = fd;
+    msg->args[MSG_ARG_1].i = level;
+    msg->args[MSG_ARG_2].i = optname;
+    msg->args[MSG_ARG_3].cp = optval;
+    msg->args[MSG_ARG_4].socklen = optlen;
+    return 0;
+}
+
+static void rpc_batch_handle(struct rpc_msg *msg)
+{
+    struct rpc_batch *batch = msg->args[MSG_ARG_0].p;
+    struct protocol_stack *stack = get_protocol_stack();
+
+    for (uint32_t i = 0; i < batch->msg_num; i++) {
+        struct rpc_msg *sub_msg = batch->msgs[i];
+        if (sub_msg->func) {
+            sub_msg->func(sub_msg);
+        } else {
+            stack->stats.call_null++;
+        }
+    }
+
+    if (rte_ring_mp_enqueue(batch->done_ring, batch) != 0) {
+        LSTACK_LOG(ERR, LSTACK, "rpc done ring full\n");
+    }
+}
+
+int32_t rpc_batch_submit(struct rpc_batch *batch)
+{
+    if (batch->msg_num == 0) {
+        batch->completed = true;
+        return 0;
+    }
+
+    struct rpc_msg *msg = rpc_msg_alloc(batch->stack, rpc_batch_handle);
+    if (msg == NULL) {
+        return -1;
+    }
+
+    batch->done_ring = g_rpc_pool->done_ring;
+    batch->completed = false;
+    msg->self_release = 0;
+    msg->args[MSG_ARG_0].p = batch;
+
+    rpc_call(&batch->stack->rpc_queue, msg);
+    return 0;
+}
+
+uint32_t rpc_batch_poll(struct rpc_batch **batches, uint32_t max_num)
+{
+    if (g_rpc_pool == NULL || g_rpc_pool->done_ring == NULL) {
+        return 0;
+    }
+
+    uint32_t num = rte_ring_sc_dequeue_burst(g_rpc_pool->done_ring, (void **)batches, max_num, NULL);
+    for (uint32_t i = 0; i < num; i++) {
+        batches[i]->completed = true;
+    }
+    return num;
+}
+
+/* batches of this thread reaped here are marked completed too, async caller can check batch->completed */
+int32_t rpc_batch_wait(struct rpc_batch *batch)
+{
+    struct rpc_batch *batches[RPC_BATCH_MAX];
+
+    if (!batch->completed && batch->done_ring == NULL) {
+        if (rpc_batch_submit(batch) != 0) {
+            return -1;
+        }
+    }
+
+    while (!batch->completed) {
+        if (rpc_batch_poll(batches, RPC_BATCH_MAX) == 0) {
+            rte_pause();
+        }
+    }
+    return 0;
+}
+
+void rpc_batch_free(struct rpc_batch *batch)
+{
+    for (uint32_t i = 0; i < batch->msg_num; i++) {
+        rpc_msg_free(batch->msgs[i]);
+    }
+    batch->msg_num = 0;
+    batch->done_ring = NULL;
+}
@@ -51,6 +51,13 @@
 #define LSTACK_LPM_PKTS_IN_DETECT_MIN   5
 #define LSTACK_LPM_PKTS_IN_DETECT_MAX   65535
 
+/* low_power_mode=2, idle stack sleeps on nic rx interrupt and rpc doorbell */
+#define LSTACK_LPM_MODE_INTR            2
+#define LSTACK_LPM_INTR_IDLE_MIN        256     /* idle loops before sleeping */
+#define LSTACK_LPM_INTR_IDLE_MAX        65536
+#define LSTACK_LPM_INTR_WAIT_MS         10      /* keep lwip timers running while sleeping */
+#define LSTACK_LPM_INTR_SHORT_US        50      /* woken earlier than this, sleeping cost more than polling */
+
 struct secondary_attach_arg {
     uint8_t socket_num;
     uint64_t socket_size;
@@ -79,9 +86,12 @@ struct cfg_params {
     uint32_t lpm_pkts_in_detect;
     uint32_t tcp_conn_count;
     uint32_t mbuf_count_per_conn;
+    uint32_t conn_mbuf_quota; // 0: no limit
     uint32_t read_connect_number;
     uint32_t rpc_number;
     uint32_t nic_read_number;
+    uint32_t gro_flow_num; // 0: gro off
+    uint32_t gro_flush_us;
     uint8_t use_ltran; // ture:lstack read from nic false:read form ltran
 
     uint16_t num_process;
@@ -95,6 +105,7 @@ struct cfg_params {
 
     bool kni_switch;
     bool listen_shadow; // true:listen in all stack thread. false:listen in one stack thread.
+    uint32_t stack_rebalance_ms; // 0: select stack by conn num, never rebind
     bool app_bind_numa;
     bool main_thread_affinity;
     bool seperate_send_recv;
@@ -102,7 +113,9 @@ struct cfg_params {
     char **dpdk_argv;
     struct secondary_attach_arg sec_attach_arg;
     char unix_socket_filename[NAME_MAX];
+    char stat_shm_filename[NAME_MAX];
     uint16_t send_ring_size;
+    uint16_t send_ring_size_max; // 0: every send_ring keeps send_ring_size
     bool expand_send_ring;
     bool tuple_filter;
     bool use_bond4;
@@ -13,6 +13,8 @@
 #ifndef __GAZELLE_ETHDEV_H__
 #define __GAZELLE_ETHDEV_H__
 
+#include <stdbool.h>
+
 #define INVAILD_PROCESS_IDX 255
 
 enum port_type {
@@ -50,7 +52,10 @@ void kni_handle_rx(uint16_t port_id);
 void delete_user_process_port(uint16_t dst_port, enum port_type type);
 void add_user_process_port(uint16_t dst_port, uint8_t process_idx, enum port_type type);
 void delete_flow_director(uint32_t dst_ip, uint16_t src_port, uint16_t dst_port);
-void config_flow_director(uint16_t queue_id, uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port);
+int32_t config_flow_director(uint16_t queue_id, uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port);
+void config_listen_flow_director(uint8_t process_idx, uint16_t listen_port);
+void delete_listen_flow_director(uint16_t listen_port);
 void netif_poll(struct netif *netif);
+bool netif_poll_pending(void);
 
 #endif /* __GAZELLE_ETHDEV_H__ */
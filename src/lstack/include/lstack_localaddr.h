@@ -0,0 +1,32 @@
+/*
+* Copyright (c) Huawei Technologies Co., Ltd. 2020-2021. All rights reserved.
+* gazelle is licensed under the Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*     http://license.coscl.org.cn/MulanPSL2
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+* PURPOSE.
+* See the Mulan PSL v2 for more details.
+*/
+
+#ifndef _GAZELLE_LOCALADDR_H_
+#define _GAZELLE_LOCALADDR_H_
+
+#include <stdint.h>
+
+#define LOCAL_ADDR_THREAD_NAME "gazelle_laddr"
+#define LOCAL_ADDR_MAX_NUM     64
+
+enum local_addr_state {
+    LOCAL_ADDR_MISS = 0,
+    LOCAL_ADDR_HIT,
+    /* cache not ready (netlink unavailable or resyncing), caller has to check by itself */
+    LOCAL_ADDR_UNKNOWN,
+};
+
+int32_t local_addr_init(void);
+/* addr in network byte order, lock free, safe from any thread */
+enum local_addr_state local_addr_lookup(uint32_t addr);
+
+#endif /* _GAZELLE_LOCALADDR_H_ */
@@ -16,14 +16,16 @@
 #define NETCONN_IS_ACCEPTIN(sock)   (((sock)->conn->acceptmbox != NULL) && !sys_mbox_empty((sock)->conn->acceptmbox))
 #define NETCONN_IS_DATAIN(sock)     ((gazelle_ring_readable_count((sock)->recv_ring) || (sock)->recv_lastdata) || (sock->same_node_rx_ring != NULL && same_node_ring_count(sock)))
 #define NETCONN_IS_DATAOUT(sock)    (gazelle_ring_readover_count((sock)->send_ring) || (sock)->send_lastdata || (sock)->send_pre_del)
-#define NETCONN_IS_OUTIDLE(sock)    gazelle_ring_readable_count((sock)->send_ring)
+#define NETCONN_IS_OUTIDLE(sock)    (gazelle_ring_readable_count((sock)->send_ring) && !sock_mbuf_tx_limited(sock))
 #define NETCONN_IS_UDP(sock)        (NETCONNTYPE_GROUP(netconn_type((sock)->conn)) == NETCONN_UDP)
 
 struct lwip_sock;
 struct rte_mempool;
+struct iovec;
 struct rpc_msg;
 struct rte_mbuf;
 struct protocol_stack;
+struct list_node;
 void create_shadow_fd(struct rpc_msg *msg);
 void gazelle_init_sock(int32_t fd);
 int32_t gazelle_socket(int domain, int type, int protocol);
@@ -33,14 +35,20 @@ void write_lwip_over(struct lwip_sock *sock);
 ssize_t write_stack_data(struct lwip_sock *sock, const void *buf, size_t len,
                          const struct sockaddr *addr, socklen_t addrlen);
 ssize_t read_stack_data(int32_t fd, void *buf, size_t len, int32_t flags, struct sockaddr *addr, socklen_t *addrlen);
+ssize_t read_stack_zcopy(int32_t fd, struct iovec *iov, int32_t *iovcnt);
+int32_t read_stack_zcopy_release(int32_t fd);
+ssize_t write_stack_zcopy(int32_t fd, struct iovec *iov, int32_t *iovcnt);
+ssize_t write_stack_zcopy_commit(int32_t fd, size_t len);
 ssize_t read_lwip_data(struct lwip_sock *sock, int32_t flags, uint8_t apiflags);
 void read_recv_list(struct protocol_stack *stack, uint32_t max_num);
 void read_same_node_recv_list(struct protocol_stack *stack);
+bool same_node_recv_pending(struct protocol_stack *stack);
 void send_stack_list(struct protocol_stack *stack, uint32_t send_max);
 void add_recv_list(int32_t fd);
 void get_lwip_conntable(struct rpc_msg *msg);
 void get_lwip_connnum(struct rpc_msg *msg);
 void stack_recvlist_count(struct rpc_msg *msg);
+uint32_t get_list_count(struct list_node *list);
 void stack_send(struct rpc_msg *msg);
 void app_rpc_write(struct rpc_msg *msg);
 int32_t gazelle_alloc_pktmbuf(struct rte_mempool *pool, struct rte_mbuf **mbufs, uint32_t num);
@@ -51,5 +59,7 @@ ssize_t gazelle_send(int32_t fd, const void *buf, size_t len, int32_t flags,
                      const struct sockaddr *addr, socklen_t addrlen);
 void rpc_replenish(struct rpc_msg *msg);
 void stack_mempool_size(struct rpc_msg *msg);
+void sock_mbuf_update(struct lwip_sock *sock);
+bool sock_mbuf_tx_limited(struct lwip_sock *sock);
 
 #endif
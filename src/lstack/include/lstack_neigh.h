@@ -0,0 +1,36 @@
+/*
+* Copyright (c) Huawei Technologies Co., Ltd. 2020-2021. All rights reserved.
+* gazelle is licensed under the Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*     http://license.coscl.org.cn/MulanPSL2
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+* PURPOSE.
+* See the Mulan PSL v2 for more details.
+*/
+
+#ifndef _GAZELLE_NEIGH_H_
+#define _GAZELLE_NEIGH_H_
+
+#include <stdbool.h>
+#include <lwip/err.h>
+
+/* lwip ARP_MAXAGE is 300s, refresh a while before it so hot entries never expire */
+#define NEIGH_MAX_AGE_MS        300000
+#define NEIGH_REFRESH_MS        240000
+#define NEIGH_REFRESH_RETRY_MS  1000
+#define NEIGH_PROBE_MAX         16
+
+struct rte_mbuf;
+struct netif;
+struct pbuf;
+struct ip4_addr;
+
+/* called once per received arp packet, by whichever stack or thread got it.
+   return true for a request to host_addr, which etharp of the receiving stack must answer */
+bool neigh_arp_input(const struct rte_mbuf *mbuf);
+/* netif->output of every stack, resolves from the shared table and falls back to etharp_output */
+err_t neigh_output(struct netif *netif, struct pbuf *p, const struct ip4_addr *ipaddr);
+
+#endif /* _GAZELLE_NEIGH_H_ */
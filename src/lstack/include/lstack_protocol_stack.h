@@ -29,12 +29,32 @@
 #define SOCK_RECV_FREE_THRES        (32)
 #define SOCK_SEND_RING_SIZE_MAX     (2048)
 #define SOCK_SEND_REPLENISH_THRES   (16)
+/* send_ring_size_max: ring sizes follow rtt * throughput of each conn */
+#define SOCK_RING_SIZE_MIN          (8)
+#define SOCK_RING_RESIZE_MS         (200)
+#define SOCK_RING_RTT_DEFAULT_US    (1000)
+/* power of 2 and larger than GAZELLE_LSTACK_MAX_CONN, a sock is queued once at most */
+#define SOCK_SEND_PENDING_RING_SIZE (32768)
 #define WAKEUP_MAX_NUM              (32)
+#define STACK_LOAD_WINDOW_MS        (100)
+#define STACK_LOAD_SCALE            (1000)
+#define STACK_LOAD_EWMA_WEIGHT      (4)
+/* hysteresis in STACK_LOAD_SCALE, app thread leaves its stack only for a clearly less loaded one */
+#define STACK_REBIND_LOAD_GAP       (200)
+/* listen_shadow: accepted fds of all shadow listeners of one listen fd, ceiling of listen backlog */
+#define ACCEPT_QUEUE_SIZE           (4096)
+#define STACK_ACCEPT_LISTEN_MAX     (16)
 
 struct rte_mempool;
 struct rte_ring;
 struct rte_mbuf;
 
+struct accept_queue {
+    struct rte_ring *ring;
+    int32_t listen_fd;
+    uint32_t backlog;
+};
+
 struct protocol_stack {
     uint32_t tid;
     uint16_t queue_id;
@@ -50,11 +70,18 @@ struct protocol_stack {
     struct rte_ring *tx_ring;
     struct rte_ring *reg_ring;
     struct rte_ring *wakeup_ring;
+    /* tcp socks with data in send_ring, app threads enqueue, stack thread sweeps in send_stack_list */
+    struct rte_ring *send_pending_ring;
     struct reg_ring_msg *reg_buf;
     uint32_t reg_head;
 
     volatile bool low_power;
     bool is_send_thread;
+    /* low_power_mode 2: stack sleeps with intr_wait set, producers write intr_doorbell to wake it */
+    volatile bool intr_wait;
+    int32_t intr_doorbell;
+    uint32_t intr_idle_loops;
+    uint32_t intr_idle_thres;
 
     lockless_queue rpc_queue __rte_cache_aligned;
     char pad __rte_cache_aligned;
@@ -68,17 +95,38 @@ struct protocol_stack {
     struct lstack_dev_ops dev_ops;
     uint32_t rx_ring_used;
     uint32_t tx_ring_used;
+    /* rte_gro ctx, merged pkts stay in it across rx bursts until gro_flush_cycles */
+    void *gro_ctx;
+    uint64_t gro_types;
+    uint64_t gro_flush_cycles;
 
     struct rte_mbuf *pkts[RTE_TEST_RX_DESC_DEFAULT];
+    /* tx pkts cached by netif output, flushed in burst by stack_send_pkts */
+    uint32_t send_cnt;
+    uint64_t send_start_time;
+    struct rte_mbuf *send_pkts[DPDK_PKT_BURST_SIZE];
     struct list_node recv_list;
     struct list_node same_node_recv_list; /* used for same node processes communication */
     struct list_node wakeup_list;
 
     volatile uint16_t conn_num;
+    /* busy poll ratio in STACK_LOAD_SCALE, written by stack thread, read by app threads to pick a stack */
+    volatile uint32_t load;
+    uint32_t load_loops;
+    uint32_t load_busy;
+    uint32_t load_window_ms;
+    /* shadow listen fds whose connections this stack accepts into their accept_queue */
+    int32_t accept_fds[STACK_ACCEPT_LISTEN_MAX];
+    uint32_t accept_fd_num;
+    /* send_ring_size_max: sum of send_ring sizes of its socks, each preallocates that many mbufs */
+    uint32_t send_ring_mbufs;
     struct stats_ *lwip_stats;
     struct gazelle_stack_latency latency;
     struct gazelle_stack_stat stats;
     struct gazelle_stack_aggregate_stats aggregate_stats;
+    /* this stack's page in stat shm, NULL if stat shm is not available */
+    struct gazelle_stack_stat_page *stat_page;
+    uint64_t stat_publish_time;
 };
 
 struct eth_params;
@@ -103,6 +151,7 @@ struct protocol_stack_group {
     /* dfx stats */
     bool latency_start;
     uint64_t call_alloc_fail;
+    struct gazelle_stat_shm *stat_shm;
     pthread_spinlock_t socket_lock;
 };
 
@@ -114,13 +163,11 @@ struct protocol_stack_group *get_protocol_stack_group(void);
 
 int32_t init_protocol_stack(void);
 void bind_to_stack_numa(struct protocol_stack *stack);
+void stack_intr_doorbell(struct protocol_stack *stack);
 int32_t init_dpdk_ethdev(void);
 
 void wait_sem_value(sem_t *sem, int32_t wait_value);
 
-/* any protocol stack thread receives arp packet and sync it to other threads so that it can have the arp table */
-void stack_broadcast_arp(struct rte_mbuf *mbuf, struct protocol_stack *cur_stack);
-
 /* when fd is listenfd, listenfd of all protocol stack thread will be closed */
 int32_t stack_broadcast_close(int32_t fd);
 
@@ -132,14 +179,22 @@ int32_t stack_single_listen(int32_t fd, int32_t backlog);
 int32_t stack_broadcast_bind(int32_t fd, const struct sockaddr *name, socklen_t namelen);
 int32_t stack_single_bind(int32_t fd, const struct sockaddr *name, socklen_t namelen);
 
+/* setsockopt on fd and its shadow fds of other protocol stack threads */
+int32_t stack_broadcast_setsockopt(int32_t fd, int32_t level, int32_t optname, const void *optval, socklen_t optlen);
+
 /* ergodic the protocol stack thread to find the connection, because all threads are listening */
 int32_t stack_broadcast_accept(int32_t fd, struct sockaddr *addr, socklen_t *addrlen);
 int32_t stack_broadcast_accept4(int32_t fd, struct sockaddr *addr, socklen_t *addrlen, int32_t flags);
+/* accepted fds waiting in the shared accept queue of a shadow listen fd */
+uint32_t stack_accept_queue_count(int32_t fd);
 
 struct wakeup_poll;
 void stack_broadcast_clean_epoll(struct wakeup_poll *wakeup);
 
-void stack_send_pkts(struct protocol_stack *stack);
+/* send tx pkts cached by netif output, return pkts sent */
+uint32_t stack_send_pkts(struct protocol_stack *stack);
+/* flush tx pkts cached by every stack, called before exit */
+void stack_group_tx_flush(void);
 
 struct rpc_msg;
 struct thread_params {
@@ -161,5 +216,6 @@ void stack_getsockopt(struct rpc_msg *msg);
 void stack_setsockopt(struct rpc_msg *msg);
 void stack_fcntl(struct rpc_msg *msg);
 void stack_ioctl(struct rpc_msg *msg);
+void stack_tx_flush(struct rpc_msg *msg);
 void kni_handle_tx(struct rte_mbuf *mbuf);
 #endif
@@ -24,6 +24,9 @@ enum GAZELLE_STAT_MODE;
 void calculate_lstack_latency(struct gazelle_stack_latency *stack_latency, const struct pbuf *pbuf,
     enum GAZELLE_LATENCY_TYPE type);
 void stack_stat_init(void);
+int32_t stack_stat_shm_init(void);
+void stack_stat_shm_uninit(void);
+void stack_stat_publish(struct protocol_stack *stack);
 int32_t handle_stack_cmd(int fd, enum GAZELLE_STAT_MODE stat_mode);
 uint64_t get_current_time(void);
 void lstack_get_low_power_info(struct gazelle_stat_low_power_info *low_power_info);
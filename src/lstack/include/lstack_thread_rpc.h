@@ -28,6 +28,7 @@
 
 #define RPC_MSG_MAX            2048
 #define RPC_MSG_MASK           (RPC_MSG_MAX - 1)
+#define RPC_BATCH_MAX          16
 
 struct rpc_msg;
 typedef void (*rpc_msg_func)(struct rpc_msg *msg);
@@ -55,13 +56,25 @@ struct rpc_msg {
 
 struct rpc_msg_pool {
     struct rte_mempool *rpc_pool;
+    /* completed rpc_batch of this thread, enqueued by stack threads */
+    struct rte_ring *done_ring;
+};
+
+/* msgs of a batch are executed by stack thread in one pass, then batch is put into done_ring of sender thread */
+struct rpc_batch {
+    struct protocol_stack *stack;
+    struct rte_ring *done_ring;
+    volatile bool completed;
+    uint32_t msg_num;
+    struct rpc_msg *msgs[RPC_BATCH_MAX];
 };
 
 struct protocol_stack;
 struct rte_mbuf;
 struct wakeup_poll;
 struct lwip_sock;
-void poll_rpc_msg(struct protocol_stack *stack, uint32_t max_num);
+uint32_t poll_rpc_msg(struct protocol_stack *stack, uint32_t max_num);
+void rpc_msgcnt(struct rpc_msg *msg);
 void rpc_call_clean_epoll(struct protocol_stack *stack, struct wakeup_poll *wakeup);
 int32_t rpc_call_msgcnt(struct protocol_stack *stack);
 int32_t rpc_call_shadow_fd(struct protocol_stack *stack, int32_t fd, const struct sockaddr *addr, socklen_t addrlen);
@@ -86,10 +99,27 @@ int32_t rpc_call_fcntl(int fd, int cmd, long val);
 int32_t rpc_call_ioctl(int fd, long cmd, void *argp);
 int32_t rpc_call_replenish(struct protocol_stack *stack, struct lwip_sock *sock);
 int32_t rpc_call_mempoolsize(struct protocol_stack *stack);
+int32_t rpc_call_tx_flush(struct protocol_stack *stack);
+
+/* batch rpc: add msgs, submit once, then reap by rpc_batch_poll or rpc_batch_wait. free msgs by rpc_batch_free */
+void rpc_batch_init(struct rpc_batch *batch, struct protocol_stack *stack);
+struct rpc_msg *rpc_batch_add(struct rpc_batch *batch, rpc_msg_func func);
+int32_t rpc_batch_add_shadow_fd(struct rpc_batch *batch, int32_t fd, const struct sockaddr *addr, socklen_t addrlen);
+/* fd must belong to stack of batch */
+int32_t rpc_batch_add_bind(struct rpc_batch *batch, int32_t fd, const struct sockaddr *addr, socklen_t addrlen);
+int32_t rpc_batch_add_setsockopt(struct rpc_batch *batch, int fd, int level, int optname, const void *optval,
+    socklen_t optlen);
+int32_t rpc_batch_submit(struct rpc_batch *batch);
+uint32_t rpc_batch_poll(struct rpc_batch **batches, uint32_t max_num);
+int32_t rpc_batch_wait(struct rpc_batch *batch);
+void rpc_batch_free(struct rpc_batch *batch);
+
+void rpc_queue_doorbell(lockless_queue *queue);
 
 static inline __attribute__((always_inline)) void rpc_call(lockless_queue *queue, struct rpc_msg *msg)
 {
     lockless_queue_mpsc_push(queue, &msg->queue_node);
+    rpc_queue_doorbell(queue);
 }
 
 static inline __attribute__((always_inline)) void rpc_msg_free(struct rpc_msg *msg)
@@ -16,9 +16,11 @@
 #include <stdbool.h>
 
 struct lstack_dev_ops;
+struct protocol_stack;
 struct gazelle_quintuple;
 enum reg_ring_type;
 void vdev_dev_ops_init(struct lstack_dev_ops *dev_ops);
+int32_t vdev_gro_init(struct protocol_stack *stack);
 int vdev_reg_xmit(enum reg_ring_type type, struct gazelle_quintuple *qtuple);
 
 int recv_pkts_from_other_process(int process_index, void* arg);
@@ -37,7 +37,8 @@ struct protocol_stack;
 struct wakeup_poll {
     /* stack thread read frequently */
     enum wakeup_type type;
-    pthread_mutex_t wait __rte_cache_aligned;
+    /* app thread sleep on eventfd, stack thread write it only when in_wait set */
+    int32_t eventfd __rte_cache_aligned;
     bool in_wait;
     struct list_node wakeup_list[PROTOCOL_STACK_MAX];
     bool have_kernel_event;
@@ -47,11 +48,12 @@ struct wakeup_poll {
     struct protocol_stack *bind_stack;
     struct list_node poll_list;
 
-    /* poll */
+    /* poll: fds registered last call, ready socks are in event_list and ep_data.u32 is index in fds */
     struct pollfd *last_fds;
     nfds_t last_nfds;
     nfds_t last_max_nfds;
     struct epoll_event *events;
+    bool poll_sock_closed;
 
     /* epoll */
     int32_t epollfd; /* epoll kernel fd */
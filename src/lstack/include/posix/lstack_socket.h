@@ -39,6 +39,15 @@ ssize_t lwip_recv(int s, void *mem, size_t len, int flags);
 int lwip_fcntl(int s, int cmd, int val);
 int lwip_ioctl(int s, int cmd, ...);
 
+/* zero copy recv: iov point to payload still owned by gazelle, give back by gazelle_recv_zcopy_release */
+ssize_t gazelle_recv_zcopy(int fd, struct iovec *iov, int *iovcnt);
+int gazelle_recv_zcopy_release(int fd);
+
+/* zero copy send: iov point to idle tx buffers lent by gazelle, app fills them and
+ * gazelle_send_zcopy_commit sends first len bytes. buffers belong to gazelle after commit */
+ssize_t gazelle_send_zcopy(int fd, struct iovec *iov, int *iovcnt);
+ssize_t gazelle_send_zcopy_commit(int fd, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
@@ -12,10 +12,14 @@
 
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <poll.h>
 
 #include <rte_kni.h>
 #include <rte_ethdev.h>
 #include <rte_malloc.h>
+#include <rte_memzone.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
 
 #include <lwip/debug.h>
 #include <lwip/etharp.h>
@@ -38,6 +42,7 @@
 #include "lstack_protocol_stack.h"
 #include "lstack_thread_rpc.h"
 #include "lstack_ethdev.h"
+#include "lstack_neigh.h"
 
 /* FRAME_MTU + 14byte header */
 #define MBUF_MAX_LEN                            1514
@@ -45,14 +50,6 @@
 #define MAX_ACTION_NUM                          2
 #define FULL_MASK                               0xffffffff /* full mask */
 #define EMPTY_MASK                              0x0 /* empty mask */
-#define LSTACK_MBUF_LEN                         64
-#define TRANSFER_TCP_MUBF_LEN                   (LSTACK_MBUF_LEN + 3)
-#define DELETE_FLOWS_PARAMS_NUM                 3
-#define DELETE_FLOWS_PARAMS_LENGTH              30
-#define CREATE_FLOWS_PARAMS_NUM                 6
-#define CREATE_FLOWS_PARAMS_LENGTH              60
-#define ADD_OR_DELETE_LISTEN_PORT_PARAMS_LENGTH 25
-#define ADD_OR_DELETE_LISTEN_PORT_PARAMS_NUM    3
 #define REPLY_LEN                               10
 #define SUCCESS_REPLY                           "success"
 #define ERROR_REPLY                             "error"
@@ -62,7 +59,15 @@
 #define GET_LSTACK_NUM_STRING                   "get_lstack_num"
 
 #define SERVER_PATH                             "/var/run/gazelle/server.socket"
-#define SPLIT_DELIM                             ","
+#define DOORBELL_PATH                           "/var/run/gazelle/doorbell.socket"
+
+/* tuple_filter processes exchange transfer_msg through a ring per process pair in hugepage */
+#define TRANSFER_SHM_NAME                       "lstack_transfer"
+#define TRANSFER_MSG_POOL_NAME                  "lstack_transfer_msg"
+#define TRANSFER_RING_NAME                      "lstack_transfer_%u_%u"
+#define TRANSFER_RING_SIZE                      1024
+#define TRANSFER_MSG_POOL_SIZE                  (8192 - 1)
+#define TRANSFER_REPLY_TIMEOUT_MS               1000
 
 #define UNIX_TCP_PORT_MAX                       65535
 
@@ -71,6 +76,56 @@
 
 static uint8_t g_user_ports[UNIX_TCP_PORT_MAX] = {INVAILD_PROCESS_IDX, };
 static uint8_t g_listen_ports[UNIX_TCP_PORT_MAX] = {INVAILD_PROCESS_IDX, };
+/* queue of connections whose flow rule failed, queue 0 forwards their packets in software */
+static uint16_t g_soft_queues[UNIX_TCP_PORT_MAX] = {0};
+
+void set_init_fail(void);
+
+enum transfer_msg_type {
+    TRANSFER_MSG_ARP,
+    TRANSFER_MSG_TCP,
+    TRANSFER_MSG_CREATE_RULE,
+    TRANSFER_MSG_DELETE_RULE,
+    TRANSFER_MSG_LISTEN_PORT,
+};
+
+struct transfer_msg {
+    enum transfer_msg_type type;
+    uint8_t process_idx;
+    uint8_t is_add;
+    uint16_t queue_id;
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    struct rte_mbuf *mbuf;
+    /* sender waits reply and frees msg, otherwise receiver frees msg.
+       the side losing the race on reply_state frees a msg abandoned by timeout */
+    bool need_reply;
+    uint32_t reply_state;
+};
+
+enum transfer_reply_state {
+    TRANSFER_REPLY_WAIT = 0,
+    TRANSFER_REPLY_DONE,
+    TRANSFER_REPLY_ABANDON,
+};
+
+struct transfer_shm {
+    /* receiver is going to sleep in poll, sender rings doorbell */
+    struct {
+        volatile bool sleeping;
+    } __rte_cache_aligned proc[MAX_PROCESS_NUM];
+};
+
+struct transfer_ctx {
+    struct transfer_shm *shm;
+    struct rte_mempool *msg_pool;
+    struct rte_ring *tx_rings[MAX_PROCESS_NUM]; /* this process -> idx */
+    struct rte_ring *rx_rings[MAX_PROCESS_NUM]; /* idx -> this process */
+    int32_t doorbell_fd;
+};
+static struct transfer_ctx g_transfer = {.doorbell_fd = -1};
 
 void eth_dev_recv(struct rte_mbuf *mbuf, struct protocol_stack *stack)
 {
@@ -139,12 +194,10 @@ int32_t eth_dev_poll(void)
     }
 
     for (uint32_t i = 0; i < nr_pkts; i++) {
-        /* copy arp into other stack */
-        if (!cfg->use_ltran) {
-            struct rte_ether_hdr *ethh = rte_pktmbuf_mtod(stack->pkts[i], struct rte_ether_hdr *);
-            if (unlikely(RTE_BE16(RTE_ETHER_TYPE_ARP) == ethh->ether_type)) {
-                stack_broadcast_arp(stack->pkts[i], stack);
-            }
+        /* publish arp into the shared neighbor table */
+        struct rte_ether_hdr *ethh = rte_pktmbuf_mtod(stack->pkts[i], struct rte_ether_hdr *);
+        if (unlikely(RTE_BE16(RTE_ETHER_TYPE_ARP) == ethh->ether_type)) {
+            neigh_arp_input(stack->pkts[i]);
         }
 
         eth_dev_recv(stack->pkts[i], stack);
@@ -188,7 +241,7 @@ void delete_rule(char* rule_key)
 {
     struct flow_rule *rule = NULL;
     HASH_FIND_STR(g_flow_rules, rule_key, rule);
-    if (rule == NULL) {
+    if (rule != NULL) {
         HASH_DEL(g_flow_rules, rule);
         free(rule);
     }
@@ -200,7 +253,8 @@ void init_listen_and_user_ports(void)
     memset_s(g_listen_ports, sizeof(g_listen_ports), INVAILD_PROCESS_IDX, sizeof(g_listen_ports));
 }
 
-int transfer_pkt_to_other_process(char *buf, int process_index, int write_len, bool need_reply)
+/* only used before dpdk init, packets and flow messages go through transfer rings */
+static int transfer_pkt_to_other_process(char *buf, int process_index, int write_len, bool need_reply)
 {
     /* other process queue_id */
     struct sockaddr_un serun;
@@ -252,6 +306,143 @@ int32_t check_params_from_primary(void)
     return 0;
 }
 
+static int32_t transfer_ipc_init(uint8_t process_idx)
+{
+    struct cfg_params *cfg = get_global_cfg_params();
+    char name[RTE_RING_NAMESIZE];
+    const struct rte_memzone *mz = NULL;
+
+    if (cfg->is_primary) {
+        mz = rte_memzone_reserve(TRANSFER_SHM_NAME, sizeof(struct transfer_shm), rte_socket_id(), 0);
+        g_transfer.msg_pool = rte_mempool_create(TRANSFER_MSG_POOL_NAME, TRANSFER_MSG_POOL_SIZE,
+            sizeof(struct transfer_msg), 0, 0, NULL, NULL, NULL, NULL, rte_socket_id(), 0);
+    } else {
+        mz = rte_memzone_lookup(TRANSFER_SHM_NAME);
+        g_transfer.msg_pool = rte_mempool_lookup(TRANSFER_MSG_POOL_NAME);
+    }
+    if (mz == NULL || g_transfer.msg_pool == NULL) {
+        LSTACK_LOG(ERR, LSTACK, "transfer shm init failed, rte_errno=%d\n", rte_errno);
+        return -1;
+    }
+    g_transfer.shm = mz->addr;
+    if (cfg->is_primary) {
+        memset_s(g_transfer.shm, sizeof(struct transfer_shm), 0, sizeof(struct transfer_shm));
+    }
+
+    /* primary creates rings of all process pairs, secondary only looks up its own */
+    for (uint32_t src = 0; src < cfg->num_process; src++) {
+        for (uint32_t dst = 0; dst < cfg->num_process; dst++) {
+            if (!cfg->is_primary && src != process_idx && dst != process_idx) {
+                continue;
+            }
+            sprintf_s(name, sizeof(name), TRANSFER_RING_NAME, src, dst);
+            struct rte_ring *ring = cfg->is_primary ?
+                rte_ring_create(name, TRANSFER_RING_SIZE, rte_socket_id(), RING_F_SC_DEQ) : rte_ring_lookup(name);
+            if (ring == NULL) {
+                LSTACK_LOG(ERR, LSTACK, "transfer ring %s init failed, rte_errno=%d\n", name, rte_errno);
+                return -1;
+            }
+            if (src == process_idx) {
+                g_transfer.tx_rings[dst] = ring;
+            }
+            if (dst == process_idx) {
+                g_transfer.rx_rings[src] = ring;
+            }
+        }
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    sprintf_s(addr.sun_path, sizeof(addr.sun_path), "%s%u", DOORBELL_PATH, process_idx);
+    int32_t fd = posix_api->socket_fn(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LSTACK_LOG(ERR, LSTACK, "doorbell socket failed errno=%d\n", errno);
+        return -1;
+    }
+    unlink(addr.sun_path);
+    if (posix_api->bind_fn(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        LSTACK_LOG(ERR, LSTACK, "doorbell bind %s failed errno=%d\n", addr.sun_path, errno);
+        posix_api->close_fn(fd);
+        return -1;
+    }
+    g_transfer.doorbell_fd = fd;
+
+    return 0;
+}
+
+static struct transfer_msg *transfer_msg_alloc(enum transfer_msg_type type)
+{
+    struct transfer_msg *msg = NULL;
+
+    if (g_transfer.msg_pool == NULL || rte_mempool_get(g_transfer.msg_pool, (void **)&msg) != 0) {
+        return NULL;
+    }
+
+    memset_s(msg, sizeof(*msg), 0, sizeof(*msg));
+    msg->type = type;
+    return msg;
+}
+
+static void transfer_doorbell(uint8_t dst)
+{
+    /* pairs with the fence in transfer_wait: either receiver sees the msg or we see sleeping */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&g_transfer.shm->proc[dst].sleeping, __ATOMIC_ACQUIRE) ||
+        !__atomic_exchange_n(&g_transfer.shm->proc[dst].sleeping, false, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    sprintf_s(addr.sun_path, sizeof(addr.sun_path), "%s%u", DOORBELL_PATH, dst);
+    char val = 0;
+    if (posix_api->send_to(g_transfer.doorbell_fd, &val, sizeof(val), 0, (struct sockaddr *)&addr, sizeof(addr)) < 0 &&
+        errno != EAGAIN) {
+        LSTACK_LOG(ERR, LSTACK, "doorbell process %u failed errno=%d\n", dst, errno);
+    }
+}
+
+static int32_t transfer_msg_send(uint8_t dst, struct transfer_msg *msg)
+{
+    if (dst >= MAX_PROCESS_NUM || g_transfer.tx_rings[dst] == NULL) {
+        rte_mempool_put(g_transfer.msg_pool, msg);
+        return CONNECT_ERROR;
+    }
+
+    if (rte_ring_mp_enqueue(g_transfer.tx_rings[dst], msg) != 0) {
+        rte_mempool_put(g_transfer.msg_pool, msg);
+        return REPLY_ERROR;
+    }
+
+    transfer_doorbell(dst);
+    return TRANSFER_SUCESS;
+}
+
+/* send and wait receiver handled msg, keeps the old synchronous semantics of flow rule messages */
+static int32_t transfer_msg_call(uint8_t dst, struct transfer_msg *msg)
+{
+    msg->need_reply = true;
+    int32_t ret = transfer_msg_send(dst, msg);
+    if (ret != TRANSFER_SUCESS) {
+        return ret;
+    }
+
+    uint64_t deadline = rte_get_timer_cycles() + rte_get_timer_hz() / MS_PER_S * TRANSFER_REPLY_TIMEOUT_MS;
+    while (__atomic_load_n(&msg->reply_state, __ATOMIC_ACQUIRE) != TRANSFER_REPLY_DONE) {
+        if (rte_get_timer_cycles() > deadline) {
+            /* hand msg over to receiver, it frees msg when handled late */
+            uint32_t expected = TRANSFER_REPLY_WAIT;
+            if (__atomic_compare_exchange_n(&msg->reply_state, &expected, TRANSFER_REPLY_ABANDON, false,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return REPLY_ERROR;
+            }
+            break;
+        }
+        rte_pause();
+    }
+
+    rte_mempool_put(g_transfer.msg_pool, msg);
+    return TRANSFER_SUCESS;
+}
+
 struct rte_flow *create_flow_director(uint16_t port_id, uint16_t queue_id,
                                       uint32_t src_ip, uint32_t dst_ip,
                                       uint16_t src_port, uint16_t dst_port,
@@ -324,15 +515,108 @@ struct rte_flow *create_flow_director(uint16_t port_id, uint16_t queue_id,
     return flow;
 }
 
-void config_flow_director(uint16_t queue_id, uint32_t src_ip,
-                          uint32_t dst_ip, uint16_t src_port, uint16_t dst_port)
+/* syn and later packets to listen_port are spread by nic rss over queues of the listening process.
+   lower priority than the 4 tuple rules of connections */
+static struct rte_flow *create_listen_flow_director(uint16_t port_id, uint8_t process_idx, uint16_t listen_port,
+                                                   struct rte_flow_error *error)
+{
+    struct cfg_params *cfg = get_global_cfg_params();
+    struct rte_flow_attr attr = { .priority = 1, .ingress = 1 };
+    struct rte_flow_item pattern[MAX_PATTERN_NUM];
+    struct rte_flow_action action[MAX_ACTION_NUM];
+    struct rte_flow_item_tcp tcp_spec;
+    struct rte_flow_item_tcp tcp_mask;
+    uint16_t queues[PROTOCOL_STACK_MAX];
+    uint32_t queue_num = 0;
+
+    /* same queues as distribute_pakages picks, only recv threads with seperate_send_recv */
+    for (uint32_t i = 0; i < cfg->num_queue && queue_num < PROTOCOL_STACK_MAX; i++) {
+        if (cfg->seperate_send_recv && (i % 2) != 0) {
+            continue;
+        }
+        queues[queue_num++] = process_idx * cfg->num_queue + i;
+    }
+
+    struct rte_flow_action_rss rss = {
+        .func = RTE_ETH_HASH_FUNCTION_DEFAULT,
+        .level = 0,
+        .types = ETH_RSS_NONFRAG_IPV4_TCP,
+        .queue_num = queue_num,
+        .queue = queues,
+    };
+
+    memset_s(pattern, sizeof(pattern), 0, sizeof(pattern));
+    memset_s(action, sizeof(action), 0, sizeof(action));
+    action[0].type = RTE_FLOW_ACTION_TYPE_RSS;
+    action[0].conf = &rss;
+    action[1].type = RTE_FLOW_ACTION_TYPE_END;
+
+    memset_s(&tcp_spec, sizeof(tcp_spec), 0, sizeof(tcp_spec));
+    memset_s(&tcp_mask, sizeof(tcp_mask), 0, sizeof(tcp_mask));
+    tcp_spec.hdr.dst_port = listen_port;
+    tcp_mask.hdr.dst_port = rte_flow_item_tcp_mask.hdr.dst_port;
+    pattern[0].type = RTE_FLOW_ITEM_TYPE_ETH;
+    pattern[1].type = RTE_FLOW_ITEM_TYPE_IPV4;
+    pattern[2].type = RTE_FLOW_ITEM_TYPE_TCP; // 2: pattern 2 is tcp header
+    pattern[2].spec = &tcp_spec;
+    pattern[2].mask = &tcp_mask;
+    pattern[3].type = RTE_FLOW_ITEM_TYPE_END;
+
+    if (rte_flow_validate(port_id, &attr, pattern, action, error) != 0) {
+        return NULL;
+    }
+    return rte_flow_create(port_id, &attr, pattern, action, error);
+}
+
+/* src_ip and src_port 0 never appear in a connection rule key */
+void config_listen_flow_director(uint8_t process_idx, uint16_t listen_port)
+{
+    char rule_key[RULE_KEY_LEN] = {0};
+    sprintf_s(rule_key, sizeof(rule_key), "%u_%u_%u", 0, 0, listen_port);
+    if (find_rule(rule_key) != NULL) {
+        return;
+    }
+
+    struct rte_flow_error error;
+    struct rte_flow *flow = create_listen_flow_director(get_port_id(), process_idx, listen_port, &error);
+    if (!flow) {
+        /* syn still reaches queue 0 and is distributed in software by g_listen_ports */
+        LSTACK_LOG(WARNING, LSTACK, "listen flow can not be created. process_idx %u, listen_port_ntohs %u, "
+            "type %d. message: %s\n", process_idx, ntohs(listen_port),
+            error.type, error.message ? error.message : "(no stated reason)");
+        return;
+    }
+    __sync_fetch_and_add(&g_flow_num, 1);
+    add_rule(rule_key, flow);
+}
+
+void delete_listen_flow_director(uint16_t listen_port)
+{
+    char rule_key[RULE_KEY_LEN] = {0};
+    sprintf_s(rule_key, sizeof(rule_key), "%u_%u_%u", 0, 0, listen_port);
+    struct flow_rule *fl = find_rule(rule_key);
+    if (fl == NULL) {
+        return;
+    }
+
+    struct rte_flow_error error;
+    if (rte_flow_destroy(get_port_id(), fl->flow, &error) != 0) {
+        LSTACK_LOG(ERR, PORT, "listen flow can't be delete %d message: %s\n",
+            error.type, error.message ? error.message : "(no stated reason)");
+    }
+    delete_rule(rule_key);
+    __sync_fetch_and_sub(&g_flow_num, 1);
+}
+
+int32_t config_flow_director(uint16_t queue_id, uint32_t src_ip,
+                             uint32_t dst_ip, uint16_t src_port, uint16_t dst_port)
 {
     uint16_t port_id = get_port_id();
     char rule_key[RULE_KEY_LEN] = {0};
     sprintf_s(rule_key, sizeof(rule_key), "%u_%u_%u", src_ip, src_port, dst_port);
     struct flow_rule *fl_exist = find_rule(rule_key);
     if (fl_exist != NULL) {
-        return;
+        return 0;
     }
 
     LSTACK_LOG(INFO, LSTACK,
@@ -346,10 +630,11 @@ void config_flow_director(uint16_t queue_id, uint32_t src_ip,
                                "dst_port %u, dst_port_ntohs :%u, type %d. message: %s\n",
             queue_id, src_ip, src_port, dst_port, ntohs(dst_port),
             error.type, error.message ? error.message : "(no stated reason)");
-        return;
+        return -1;
     }
     __sync_fetch_and_add(&g_flow_num, 1);
     add_rule(rule_key, flow);
+    return 0;
 }
 
 void delete_flow_director(uint32_t dst_ip, uint16_t src_port, uint16_t dst_port)
@@ -371,20 +656,21 @@ void delete_flow_director(uint32_t dst_ip, uint16_t src_port, uint16_t dst_port)
     }
 }
 
-/* if process 0, delete directly, else transfer 'dst_ip,src_port,dst_port' to process 0. */
+/* rules are only touched by listen thread of process 0, stack threads queue the delete and go on.
+   connection churn costs stack threads a ring enqueue instead of rte_flow_destroy */
 void transfer_delete_rule_info_to_process0(uint32_t dst_ip, uint16_t src_port, uint16_t dst_port)
 {
-    if (get_global_cfg_params()->is_primary) {
-        delete_flow_director(dst_ip, src_port, dst_port);
-    } else {
-        char process_server_path[DELETE_FLOWS_PARAMS_LENGTH];
-        sprintf_s(process_server_path, DELETE_FLOWS_PARAMS_LENGTH, "%u%s%u%s%u",
-                  dst_ip, SPLIT_DELIM, src_port, SPLIT_DELIM, dst_port);
-        int ret = transfer_pkt_to_other_process(process_server_path, 0, DELETE_FLOWS_PARAMS_LENGTH, false);
-        if(ret != TRANSFER_SUCESS){
-            LSTACK_LOG(ERR, LSTACK, "error. tid %d. dst_ip %u, src_port: %u, dst_port %u\n",
-                                rte_gettid(), dst_ip, src_port, dst_port);
-        }
+    struct transfer_msg *msg = transfer_msg_alloc(TRANSFER_MSG_DELETE_RULE);
+    int ret = REPLY_ERROR;
+    if (msg != NULL) {
+        msg->dst_ip = dst_ip;
+        msg->src_port = src_port;
+        msg->dst_port = dst_port;
+        ret = transfer_msg_send(0, msg);
+    }
+    if (ret != TRANSFER_SUCESS) {
+        LSTACK_LOG(ERR, LSTACK, "error. tid %d. dst_ip %u, src_port: %u, dst_port %u\n",
+                            rte_gettid(), dst_ip, src_port, dst_port);
     }
 }
 
@@ -393,14 +679,19 @@ void transfer_create_rule_info_to_process0(uint16_t queue_id, uint32_t src_ip,
                                            uint32_t dst_ip, uint16_t src_port,
                                            uint16_t dst_port)
 {
-    char process_server_path[CREATE_FLOWS_PARAMS_LENGTH];
-    /* exchage src_ip and dst_ip, src_port and dst_port */
     uint8_t process_idx = get_global_cfg_params()->process_idx;
-    sprintf_s(process_server_path, CREATE_FLOWS_PARAMS_LENGTH, "%u%s%u%s%u%s%u%s%u%s%u",
-              dst_ip, SPLIT_DELIM, src_ip, SPLIT_DELIM,
-              dst_port, SPLIT_DELIM, src_port, SPLIT_DELIM,
-              queue_id, SPLIT_DELIM, process_idx);
-    int ret = transfer_pkt_to_other_process(process_server_path, 0, CREATE_FLOWS_PARAMS_LENGTH, true);
+    struct transfer_msg *msg = transfer_msg_alloc(TRANSFER_MSG_CREATE_RULE);
+    int ret = REPLY_ERROR;
+    if (msg != NULL) {
+        /* exchage src_ip and dst_ip, src_port and dst_port */
+        msg->src_ip = dst_ip;
+        msg->dst_ip = src_ip;
+        msg->src_port = dst_port;
+        msg->dst_port = src_port;
+        msg->queue_id = queue_id;
+        msg->process_idx = process_idx;
+        ret = transfer_msg_call(0, msg);
+    }
     if (ret != TRANSFER_SUCESS) {
         LSTACK_LOG(ERR, LSTACK, "error. tid %d. src_ip %u, dst_ip %u, src_port: %u, dst_port %u,"
                                 "queue_id %u, process_idx %u\n",
@@ -410,52 +701,20 @@ void transfer_create_rule_info_to_process0(uint16_t queue_id, uint32_t src_ip,
 
 void transfer_add_or_delete_listen_port_to_process0(uint16_t listen_port, uint8_t process_idx, uint8_t is_add)
 {
-    char process_server_path[ADD_OR_DELETE_LISTEN_PORT_PARAMS_LENGTH];
-    sprintf_s(process_server_path, ADD_OR_DELETE_LISTEN_PORT_PARAMS_LENGTH,
-              "%u%s%u%s%u", listen_port, SPLIT_DELIM, process_idx, SPLIT_DELIM, is_add);
-    int ret = transfer_pkt_to_other_process(process_server_path, 0, ADD_OR_DELETE_LISTEN_PORT_PARAMS_LENGTH, true);
-    if(ret != TRANSFER_SUCESS) {
+    struct transfer_msg *msg = transfer_msg_alloc(TRANSFER_MSG_LISTEN_PORT);
+    int ret = REPLY_ERROR;
+    if (msg != NULL) {
+        msg->dst_port = listen_port;
+        msg->process_idx = process_idx;
+        msg->is_add = is_add;
+        ret = transfer_msg_call(0, msg);
+    }
+    if (ret != TRANSFER_SUCESS) {
         LSTACK_LOG(ERR, LSTACK, "error. tid %d. listen_port %u, process_idx %u\n",
                    rte_gettid(), listen_port, process_idx);
     }
 }
 
-static int str_to_array(char *args, uint32_t *array, int size)
-{
-    int val;
-    uint16_t cnt = 0;
-    char *elem = NULL;
-    char *next_token = NULL;
-
-    memset_s(array, sizeof(*array) * size, 0, sizeof(*array) * size);
-    elem = strtok_s((char *)args, SPLIT_DELIM, &next_token);
-    while (elem != NULL) {
-        if (cnt >= size) {
-            return -1;
-        }
-        val = atoi(elem);
-        if (val < 0) {
-            return -1;
-        }
-        array[cnt] = (uint32_t)val;
-        cnt++;
-
-        elem = strtok_s(NULL, SPLIT_DELIM, &next_token);
-    }
-
-    return cnt;
-}
-
-void parse_and_delete_rule(char* buf)
-{
-    uint32_t array[DELETE_FLOWS_PARAMS_NUM];
-    str_to_array(buf, array, DELETE_FLOWS_PARAMS_NUM);
-    uint32_t dst_ip = array[0];
-    uint16_t src_port = array[1];
-    uint16_t dst_port = array[2];
-    delete_flow_director(dst_ip, src_port, dst_port);
-}
-
 void add_user_process_port(uint16_t dst_port, uint8_t process_idx, enum port_type type)
 {
     if (type == PORT_LISTEN) {
@@ -474,47 +733,34 @@ void delete_user_process_port(uint16_t dst_port, enum port_type type)
     }
 }
 
-void parse_and_create_rule(char* buf)
-{
-    uint32_t array[CREATE_FLOWS_PARAMS_NUM];
-    str_to_array(buf, array, CREATE_FLOWS_PARAMS_NUM);
-    uint32_t src_ip = array[0];
-    uint32_t dst_ip = array[1];
-    uint16_t src_port = array[2];
-    uint16_t dst_port = array[3];
-    uint16_t queue_id = array[4];
-    uint8_t process_idx = array[5];
-    config_flow_director(queue_id, src_ip, dst_ip, src_port, dst_port);
-    add_user_process_port(dst_port, process_idx, PORT_CONNECT);
-}
-
-void parse_and_add_or_delete_listen_port(char* buf)
-{
-    uint32_t array[ADD_OR_DELETE_LISTEN_PORT_PARAMS_NUM];
-    str_to_array(buf, array, ADD_OR_DELETE_LISTEN_PORT_PARAMS_NUM);
-    uint16_t listen_port = array[0];
-    uint8_t process_idx = array[1];
-    uint8_t is_add = array[2];
-    if (is_add == 1) {
-        add_user_process_port(listen_port, process_idx, PORT_LISTEN);
-    } else {
-        delete_user_process_port(listen_port, PORT_LISTEN);
-    }
-    
-}
-
+/* mbuf goes to kni after this, every process gets its own copy */
 void transfer_arp_to_other_process(struct rte_mbuf *mbuf)
 {
     struct cfg_params *cfgs = get_global_cfg_params();
+    struct protocol_stack *stack = get_protocol_stack();
+
+    for (uint32_t i = 1; i < cfgs->num_process; i++) {
+        if (i == cfgs->process_idx) {
+            continue;
+        }
 
-    for(int i = 1; i < cfgs->num_process; i++){
-        char arp_mbuf[LSTACK_MBUF_LEN] = {0};
-        sprintf_s(arp_mbuf, sizeof(arp_mbuf), "%lu", mbuf);
-        int result = transfer_pkt_to_other_process(arp_mbuf, i, LSTACK_MBUF_LEN, false);
-        if (result == CONNECT_ERROR) {
-            LSTACK_LOG(INFO, LSTACK,"connect process %d failed, ensure the process is started.\n", i);  
-        } else if (result == REPLY_ERROR) {
-            LSTACK_LOG(ERR, LSTACK,"transfer arp pakages to process %d error. %m\n", i);  
+        struct transfer_msg *msg = transfer_msg_alloc(TRANSFER_MSG_ARP);
+        if (msg == NULL) {
+            LSTACK_LOG(ERR, LSTACK, "transfer arp pakages to process %u failed, no msg\n", i);
+            return;
+        }
+        if (gazelle_alloc_pktmbuf(stack->rxtx_pktmbuf_pool, &msg->mbuf, 1) != 0) {
+            stack->stats.rx_allocmbuf_fail++;
+            rte_mempool_put(g_transfer.msg_pool, msg);
+            return;
+        }
+        copy_mbuf(msg->mbuf, mbuf);
+
+        struct rte_mbuf *copy = msg->mbuf;
+        int result = transfer_msg_send(i, msg);
+        if (result != TRANSFER_SUCESS) {
+            rte_pktmbuf_free(copy);
+            LSTACK_LOG(ERR, LSTACK, "transfer arp pakages to process %u error %d\n", i, result);
         }
     }
 }
@@ -530,61 +776,165 @@ void transfer_tcp_to_thread(struct rte_mbuf *mbuf, uint16_t stk_idx)
     }
 }
 
-void parse_arp_and_transefer(char* buf)
+static void transfer_tcp_to_stack(struct rte_mbuf *mbuf, uint16_t queue_id)
 {
-    struct rte_mbuf *mbuf = (struct rte_mbuf *)atoll(buf);
-    struct protocol_stack_group *stack_group = get_protocol_stack_group();
+    uint16_t stk_index = queue_id % get_global_cfg_params()->num_queue;
+    struct protocol_stack *stack = get_protocol_stack_group()->stacks[stk_index];
     struct rte_mbuf *mbuf_copy = NULL;
-    struct protocol_stack *stack = NULL;
-    int32_t ret;
-    for (int32_t i = 0; i < stack_group->stack_num; i++) {
-        stack = stack_group->stacks[i];
-        ret = gazelle_alloc_pktmbuf(stack->rxtx_pktmbuf_pool, &mbuf_copy, 1);
-        while (ret != 0) {
-            ret = gazelle_alloc_pktmbuf(stack->rxtx_pktmbuf_pool, &mbuf_copy, 1);
-            stack->stats.rx_allocmbuf_fail++;
+
+    if (gazelle_alloc_pktmbuf(stack->rxtx_pktmbuf_pool, &mbuf_copy, 1) != 0) {
+        stack->stats.rx_allocmbuf_fail++;
+        return;
+    }
+    copy_mbuf(mbuf_copy, mbuf);
+
+    transfer_tcp_to_thread(mbuf_copy, stk_index);
+}
+
+/* the shared neighbor table only learns from arp, a request to host_addr is answered by etharp of a stack */
+static void arp_input_to_stack(struct rte_mbuf *mbuf, struct protocol_stack *stack)
+{
+    struct rte_mbuf *mbuf_copy = NULL;
+
+    if (gazelle_alloc_pktmbuf(stack->rxtx_pktmbuf_pool, &mbuf_copy, 1) != 0) {
+        stack->stats.rx_allocmbuf_fail++;
+        return;
+    }
+    copy_mbuf(mbuf_copy, mbuf);
+
+    if (rpc_call_arp(stack, mbuf_copy) != 0) {
+        rte_pktmbuf_free(mbuf_copy);
+    }
+}
+
+static void transfer_msg_handle(struct transfer_msg *msg)
+{
+    switch (msg->type) {
+        case TRANSFER_MSG_ARP:
+            if (neigh_arp_input(msg->mbuf)) {
+                arp_input_to_stack(msg->mbuf, get_protocol_stack_group()->stacks[0]);
+            }
+            rte_pktmbuf_free(msg->mbuf);
+            break;
+        case TRANSFER_MSG_TCP:
+            transfer_tcp_to_stack(msg->mbuf, msg->queue_id);
+            rte_pktmbuf_free(msg->mbuf);
+            break;
+        case TRANSFER_MSG_CREATE_RULE:
+            if (config_flow_director(msg->queue_id, msg->src_ip, msg->dst_ip, msg->src_port, msg->dst_port) != 0) {
+                g_soft_queues[msg->dst_port] = msg->queue_id;
+            }
+            add_user_process_port(msg->dst_port, msg->process_idx, PORT_CONNECT);
+            break;
+        case TRANSFER_MSG_DELETE_RULE:
+            delete_flow_director(msg->dst_ip, msg->src_port, msg->dst_port);
+            g_soft_queues[msg->src_port] = 0;
+            break;
+        case TRANSFER_MSG_LISTEN_PORT:
+            if (msg->is_add == 1) {
+                add_user_process_port(msg->dst_port, msg->process_idx, PORT_LISTEN);
+                config_listen_flow_director(msg->process_idx, msg->dst_port);
+            } else {
+                delete_listen_flow_director(msg->dst_port);
+                delete_user_process_port(msg->dst_port, PORT_LISTEN);
+            }
+            break;
+        default:
+            break;
+    }
+
+    uint32_t expected = TRANSFER_REPLY_WAIT;
+    if (msg->need_reply && __atomic_compare_exchange_n(&msg->reply_state, &expected, TRANSFER_REPLY_DONE, false,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    /* no reply wanted, or sender timed out and left msg */
+    rte_mempool_put(g_transfer.msg_pool, msg);
+}
+
+static uint32_t transfer_msg_poll(void)
+{
+    struct transfer_msg *msgs[PACKET_READ_SIZE];
+    uint32_t total = 0;
+
+    for (uint32_t i = 0; i < get_global_cfg_params()->num_process; i++) {
+        uint32_t num = rte_ring_sc_dequeue_burst(g_transfer.rx_rings[i], (void **)msgs, PACKET_READ_SIZE, NULL);
+        for (uint32_t j = 0; j < num; j++) {
+            transfer_msg_handle(msgs[j]);
         }
-        copy_mbuf(mbuf_copy, mbuf);
+        total += num;
+    }
 
-        ret = rpc_call_arp(stack, mbuf_copy);
+    return total;
+}
 
-        while (ret != 0) {
-            rpc_call_arp(stack, mbuf_copy);;
+static bool transfer_msg_pending(void)
+{
+    for (uint32_t i = 0; i < get_global_cfg_params()->num_process; i++) {
+        if (rte_ring_count(g_transfer.rx_rings[i]) != 0) {
+            return true;
         }
     }
+    return false;
 }
 
-void parse_tcp_and_transefer(char* buf)
+/* secondary asks lstack num before its dpdk init, so it still comes by unix stream socket */
+static void transfer_reply_query(int listenfd)
 {
-    char *next_token = NULL;
-    char *elem = strtok_s(buf, SPLIT_DELIM, &next_token);
-    struct rte_mbuf *mbuf = (struct rte_mbuf *) atoll(elem);
-    elem = strtok_s(NULL, SPLIT_DELIM, &next_token);
-    uint16_t queue_id = atoll(elem);
+    char buf[GET_LSTACK_NUM];
+    char reply_buf[REPLY_LEN];
 
-    struct protocol_stack_group *stack_group = get_protocol_stack_group();
-    uint16_t num_queue = get_global_cfg_params()->num_queue;
-    uint16_t stk_index = queue_id % num_queue;
-    struct rte_mbuf *mbuf_copy = NULL;
-    struct protocol_stack *stack = stack_group->stacks[stk_index];
+    int connfd = posix_api->accept_fn(listenfd, NULL, NULL);
+    if (connfd < 0) {
+        return;
+    }
 
-    int32_t ret = gazelle_alloc_pktmbuf(stack->rxtx_pktmbuf_pool, &mbuf_copy, 1);
-    while (ret != 0) {
-        ret = gazelle_alloc_pktmbuf(stack->rxtx_pktmbuf_pool, &mbuf_copy, 1);
-        stack->stats.rx_allocmbuf_fail++;
+    int n = posix_api->read_fn(connfd, buf, sizeof(buf));
+    if (n == GET_LSTACK_NUM) {
+        sprintf_s(reply_buf, sizeof(reply_buf), "%d", get_global_cfg_params()->num_cpu);
+    } else {
+        sprintf_s(reply_buf, sizeof(reply_buf), "%s", ERROR_REPLY);
     }
+    posix_api->write_fn(connfd, reply_buf, REPLY_LEN);
+    posix_api->close_fn(connfd);
+}
 
-    copy_mbuf(mbuf_copy,mbuf);
+/* drain transfer rings in batch, sleep in poll when all rings are empty */
+static void transfer_wait(int listenfd)
+{
+    uint8_t self = get_global_cfg_params()->process_idx;
+    struct pollfd fds[2] = {
+        { .fd = listenfd, .events = POLLIN },
+        { .fd = g_transfer.doorbell_fd, .events = POLLIN },
+    };
+
+    __atomic_store_n(&g_transfer.shm->proc[self].sleeping, true, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (transfer_msg_pending()) {
+        __atomic_store_n(&g_transfer.shm->proc[self].sleeping, false, __ATOMIC_RELEASE);
+        return;
+    }
 
-    transfer_tcp_to_thread(mbuf_copy, stk_index);
+    int32_t ret = posix_api->poll_fn(fds, 2, -1);
+    __atomic_store_n(&g_transfer.shm->proc[self].sleeping, false, __ATOMIC_RELEASE);
+    if (ret <= 0) {
+        return;
+    }
+
+    if (fds[1].revents & POLLIN) {
+        char buf[PACKET_READ_SIZE];
+        while (posix_api->read_fn(g_transfer.doorbell_fd, buf, sizeof(buf)) > 0) {
+        }
+    }
+    if (fds[0].revents & POLLIN) {
+        transfer_reply_query(listenfd);
+    }
 }
 
 int recv_pkts_from_other_process(int process_index, void* arg)
 {
-    struct sockaddr_un serun, cliun;
-    socklen_t cliun_len;
-    int listenfd, connfd, size;
-    char buf[132];
+    struct sockaddr_un serun;
+    int listenfd, size;
     /* socket */
     if ((listenfd = posix_api->socket_fn(AF_UNIX, SOCK_STREAM, 0)) < 0) {
         perror("socket error");
@@ -606,63 +956,53 @@ int recv_pkts_from_other_process(int process_index, void* arg)
         perror("listen error");
         return -1;
     }
+    if (get_global_cfg_params()->tuple_filter && transfer_ipc_init(process_index) != 0) {
+        /* main thread waits sem, then checks init fail */
+        set_init_fail();
+        sem_post((sem_t *)arg);
+        posix_api->close_fn(listenfd);
+        return -1;
+    }
     sem_post((sem_t *)arg);
-    /* block */
-     while(1) {
-        cliun_len = sizeof(cliun);
-        if ((connfd = posix_api->accept_fn(listenfd, (struct sockaddr *)&cliun, &cliun_len)) < 0) {
-            perror("accept error");
-            continue;
-        }
-        while(1) {
-            int n = posix_api->read_fn(connfd, buf, sizeof(buf));
-            if (n < 0) {
-                perror("read error");
-                break;
-            } else if (n == 0) {
-                break;
-            }
 
-            if(n == LSTACK_MBUF_LEN) {
-                /* arp */
-                parse_arp_and_transefer(buf);
-            } else if (n == TRANSFER_TCP_MUBF_LEN) {
-                /* tcp. lstack_mbuf_queue_id */
-                parse_tcp_and_transefer(buf);
-            } else if (n == DELETE_FLOWS_PARAMS_LENGTH) {
-                /* delete rule */
-                parse_and_delete_rule(buf);
-            } else if(n == CREATE_FLOWS_PARAMS_LENGTH) {
-                /* add rule */
-                parse_and_create_rule(buf);
-                char reply_buf[REPLY_LEN];
-                sprintf_s(reply_buf, sizeof(reply_buf), "%s", SUCCESS_REPLY);
-                posix_api->write_fn(connfd, reply_buf, REPLY_LEN);
-            } else if (n == GET_LSTACK_NUM) {
-                char reply_buf[REPLY_LEN];
-                sprintf_s(reply_buf, sizeof(reply_buf), "%d", get_global_cfg_params()->num_cpu);
-                posix_api->write_fn(connfd, reply_buf, REPLY_LEN);
-            } else {
-                /* add port */
-                parse_and_add_or_delete_listen_port(buf);
-                char reply_buf[REPLY_LEN];
-                sprintf_s(reply_buf, sizeof(reply_buf), "%s", SUCCESS_REPLY);
-                posix_api->write_fn(connfd, reply_buf, REPLY_LEN);
-            }
-            
+    while (1) {
+        if (!get_global_cfg_params()->tuple_filter) {
+            transfer_reply_query(listenfd);
+        } else if (transfer_msg_poll() == 0) {
+            transfer_wait(listenfd);
         }
-        posix_api->close_fn(connfd);
     }
     posix_api->close_fn(listenfd);
     return 0;
 }
 
-void concat_mbuf_and_queue_id(struct rte_mbuf *mbuf, uint16_t queue_id,
-                              char* mbuf_and_queue_id, int write_len)
+static int transfer_pkt_to_queue(struct rte_mbuf *mbuf, uint32_t user_process_idx, uint16_t queue_id)
 {
-    sprintf_s(mbuf_and_queue_id, write_len, "%lu%s%u", mbuf, SPLIT_DELIM, queue_id);
+    if (queue_id == 0) {
+        return TRANSFER_CURRENT_THREAD;
+    }
+
+    if (user_process_idx == 0) {
+        transfer_tcp_to_thread(mbuf, queue_id);
+        return TRANSFER_OTHER_THREAD;
+    }
+
+    /* receiver copies mbuf into its stack and frees this one */
+    struct transfer_msg *msg = transfer_msg_alloc(TRANSFER_MSG_TCP);
+    if (msg == NULL) {
+        rte_pktmbuf_free(mbuf);
+        return TRANSFER_OTHER_THREAD;
+    }
+    msg->mbuf = mbuf;
+    msg->queue_id = queue_id;
+    if (transfer_msg_send(user_process_idx, msg) != TRANSFER_SUCESS) {
+        rte_pktmbuf_free(mbuf);
+    }
+    return TRANSFER_OTHER_THREAD;
 }
 
+/* with listen and connection flow rules installed only syn before the rule, connections whose rule
+   failed and non tcp packets reach queue 0 */
 int distribute_pakages(struct rte_mbuf *mbuf)
 {
     struct rte_ipv4_hdr *iph = rte_pktmbuf_mtod_offset(mbuf, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
@@ -696,19 +1036,10 @@ int distribute_pakages(struct rte_mbuf *mbuf)
                 } else {
                     queue_id = user_process_idx * each_process_queue_num + index;
                 }
-                if (queue_id != 0) {
-                    if (user_process_idx == 0) {
-                        transfer_tcp_to_thread(mbuf, queue_id);
-                    } else {
-                        char mbuf_and_queue_id[TRANSFER_TCP_MUBF_LEN];
-                        concat_mbuf_and_queue_id(mbuf, queue_id, mbuf_and_queue_id, TRANSFER_TCP_MUBF_LEN);
-                        transfer_pkt_to_other_process(mbuf_and_queue_id, user_process_idx,
-                            TRANSFER_TCP_MUBF_LEN, false);
-                    }
-                    return TRANSFER_OTHER_THREAD;
-                } else {
-                    return TRANSFER_CURRENT_THREAD;
-                }
+                return transfer_pkt_to_queue(mbuf, user_process_idx, queue_id);
+            } else if (unlikely(g_soft_queues[dst_port] != 0)) {
+                /* nic out of flow rules for this connection */
+                return transfer_pkt_to_queue(mbuf, user_process_idx, g_soft_queues[dst_port]);
             } else {
                 return TRANSFER_CURRENT_THREAD;
             }
@@ -774,11 +1105,14 @@ int32_t gazelle_eth_dev_poll(struct protocol_stack *stack, uint8_t use_ltran_fla
     for (uint32_t i = 0; i < nr_pkts; i++) {
         /* 1 current thread recv; 0 other thread recv; -1 kni recv; */
         int transfer_type = TRANSFER_CURRENT_THREAD;
-        /* copy arp into other stack */
+        /* publish arp into the shared neighbor table */
+        struct rte_ether_hdr *ethh = rte_pktmbuf_mtod(stack->pkts[i], struct rte_ether_hdr *);
+        bool arp_need_reply = false;
+        if (unlikely(RTE_BE16(RTE_ETHER_TYPE_ARP) == ethh->ether_type)) {
+            arp_need_reply = neigh_arp_input(stack->pkts[i]);
+        }
         if (!use_ltran_flag) {
-            struct rte_ether_hdr *ethh = rte_pktmbuf_mtod(stack->pkts[i], struct rte_ether_hdr *);
             if (unlikely(RTE_BE16(RTE_ETHER_TYPE_ARP) == ethh->ether_type)) {
-                stack_broadcast_arp(stack->pkts[i], stack);
 #if DPDK_VERSION_1911
                 if (!rte_is_broadcast_ether_addr(&ethh->d_addr)) {
 #else /* DPDK_VERSION_1911 */
@@ -786,6 +1120,10 @@ int32_t gazelle_eth_dev_poll(struct protocol_stack *stack, uint8_t use_ltran_fla
 #endif /* DPDK_VERSION_1911 */
                     // copy arp into other process
                     transfer_arp_to_other_process(stack->pkts[i]);
+                    /* unicast request or refresh probe to us, etharp of this stack replies */
+                    if (arp_need_reply) {
+                        arp_input_to_stack(stack->pkts[i], stack);
+                    }
                     transfer_type = TRANSFER_KERNEL;
                 }
             } else {
@@ -863,17 +1201,43 @@ static err_t eth_dev_output(struct netif *netif, struct pbuf *pbuf)
         pbuf = pbuf->next;
     }
 
-    uint32_t sent_pkts = stack->dev_ops.tx_xmit(stack, &first_mbuf, 1);
-    stack->stats.tx += sent_pkts;
-    if (sent_pkts < 1) {
-        stack->stats.tx_drop++;
-        rte_pktmbuf_free(first_mbuf);
-        return ERR_MEM;
+    /* cache pkt, send in burst when cache is full, timeout or stack thread loop end */
+    uint64_t now = get_current_time();
+    if (stack->send_cnt == 0) {
+        stack->send_start_time = now;
+    }
+    stack->send_pkts[stack->send_cnt++] = first_mbuf;
+
+    /* pkt is the last of the burst, it is dropped if not all are sent */
+    uint32_t send_num = stack->send_cnt;
+    if (unlikely(send_num >= DPDK_PKT_BURST_SIZE || now - stack->send_start_time >= SEND_PKTS_CACHE_TIMEOUT_US)) {
+        if (stack_send_pkts(stack) < send_num) {
+            return ERR_MEM;
+        }
     }
 
     return ERR_OK;
 }
 
+uint32_t stack_send_pkts(struct protocol_stack *stack)
+{
+    uint32_t send_num = stack->send_cnt;
+    if (send_num == 0) {
+        return 0;
+    }
+    stack->send_cnt = 0;
+
+    uint32_t sent_pkts = stack->dev_ops.tx_xmit(stack, stack->send_pkts, send_num);
+    stack->stats.tx += sent_pkts;
+    if (unlikely(sent_pkts < send_num)) {
+        stack->stats.tx_drop += send_num - sent_pkts;
+        for (uint32_t i = sent_pkts; i < send_num; i++) {
+            rte_pktmbuf_free(stack->send_pkts[i]);
+        }
+    }
+    return sent_pkts;
+}
+
 static err_t eth_dev_init(struct netif *netif)
 {
     struct cfg_params *cfg = get_global_cfg_params();
@@ -882,7 +1246,7 @@ static err_t eth_dev_init(struct netif *netif)
     netif->name[1] = 't';
     netif->flags |= NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_IGMP;
     netif->mtu = FRAME_MTU;
-    netif->output = etharp_output;
+    netif->output = neigh_output;
     netif->linkoutput = eth_dev_output;
 
     int32_t ret;
@@ -903,6 +1267,10 @@ int32_t ethdev_init(struct protocol_stack *stack)
 
     vdev_dev_ops_init(&stack->dev_ops);
 
+    if (!use_ltran() && vdev_gro_init(stack) != 0) {
+        return -1;
+    }
+
     if (use_ltran()) {
         stack->rx_ring_used = 0;
         int32_t ret = fill_mbuf_to_ring(stack->rxtx_pktmbuf_pool, stack->rx_ring, RING_SIZE(VDEV_RX_QUEUE_SZ));
@@ -0,0 +1,233 @@
+/*
+* Copyright (c) Huawei Technologies Co., Ltd. 2020-2021. All rights reserved.
+* gazelle is licensed under the Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*     http://license.coscl.org.cn/MulanPSL2
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+* IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+* PURPOSE.
+* See the Mulan PSL v2 for more details.
+*/
+
+#include <stdbool.h>
+#include <securec.h>
+
+#include <rte_arp.h>
+#include <rte_jhash.h>
+#include <rte_pause.h>
+#include <lwip/sys.h>
+#include <lwip/etharp.h>
+#include <lwip/prot/ethernet.h>
+#include <netif/ethernet.h>
+
+#include "lstack_cfg.h"
+#include "lstack_log.h"
+#include "lstack_lwip.h"
+#include "dpdk_common.h"
+#include "lstack_protocol_stack.h"
+#include "lstack_thread_rpc.h"
+#include "lstack_neigh.h"
+
+/*
+ * one table per process shared by all stacks. readers go through the per entry seq counter without locks,
+ * writers take it by cas. a slot keeps its ip once claimed, so lookups never race with a removal.
+ */
+struct neigh_entry {
+    volatile uint32_t seq;
+    uint32_t ip;
+    struct eth_addr mac;
+    bool valid;
+    /* bit per stack_idx, stacks that have packets queued in their own lwip etharp for this ip */
+    uint32_t waiters;
+    uint32_t update_ms;
+    uint32_t refresh_ms;
+} __rte_cache_aligned;
+
+static struct neigh_entry g_neigh_table[ARP_MAX_ENTRIES];
+
+static struct neigh_entry *neigh_find(uint32_t ip, bool create)
+{
+    uint32_t idx = rte_jhash_1word(ip, 0) & (ARP_MAX_ENTRIES - 1);
+
+    for (uint32_t i = 0; i < NEIGH_PROBE_MAX; i++) {
+        struct neigh_entry *entry = &g_neigh_table[(idx + i) & (ARP_MAX_ENTRIES - 1)];
+        uint32_t cur = __atomic_load_n(&entry->ip, __ATOMIC_ACQUIRE);
+        if (cur == ip) {
+            return entry;
+        }
+        if (cur != 0) {
+            continue;
+        }
+        if (!create) {
+            return NULL;
+        }
+        if (__atomic_compare_exchange_n(&entry->ip, &cur, ip, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ||
+            cur == ip) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+static bool neigh_read(struct neigh_entry *entry, struct eth_addr *mac)
+{
+    uint32_t seq;
+    bool valid;
+
+    for (;;) {
+        seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1) == 0) {
+            valid = entry->valid;
+            *mac = entry->mac;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&entry->seq, __ATOMIC_RELAXED) == seq) {
+                return valid;
+            }
+        }
+        rte_pause();
+    }
+}
+
+static void neigh_write(struct neigh_entry *entry, const struct rte_ether_addr *mac)
+{
+    uint32_t seq;
+
+    for (;;) {
+        seq = __atomic_load_n(&entry->seq, __ATOMIC_RELAXED);
+        if ((seq & 1) == 0 &&
+            __atomic_compare_exchange_n(&entry->seq, &seq, seq + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+        rte_pause();
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    (void)memcpy_s(&entry->mac, sizeof(entry->mac), mac, sizeof(*mac));
+    entry->valid = true;
+    __atomic_store_n(&entry->update_ms, sys_now(), __ATOMIC_RELAXED);
+
+    __atomic_store_n(&entry->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* the arp reply only reaches one stack, hand a copy to the stacks whose lwip etharp is waiting on it */
+static void neigh_wakeup_waiters(struct neigh_entry *entry, const struct rte_mbuf *mbuf)
+{
+    struct protocol_stack_group *stack_group = get_protocol_stack_group();
+    uint32_t waiters = __atomic_exchange_n(&entry->waiters, 0, __ATOMIC_SEQ_CST);
+    struct rte_mbuf *mbuf_copy = NULL;
+
+    while (waiters != 0) {
+        uint32_t idx = __builtin_ctz(waiters);
+        waiters &= waiters - 1;
+        if (idx >= stack_group->stack_num) {
+            continue;
+        }
+
+        struct protocol_stack *stack = stack_group->stacks[idx];
+        if (gazelle_alloc_pktmbuf(stack->rxtx_pktmbuf_pool, &mbuf_copy, 1) != 0) {
+            stack->stats.rx_allocmbuf_fail++;
+            continue;
+        }
+        copy_mbuf(mbuf_copy, (struct rte_mbuf *)mbuf);
+
+        if (rpc_call_arp(stack, mbuf_copy) != 0) {
+            rte_pktmbuf_free(mbuf_copy);
+        }
+    }
+}
+
+bool neigh_arp_input(const struct rte_mbuf *mbuf)
+{
+    if (mbuf->data_len < sizeof(struct rte_ether_hdr) + sizeof(struct rte_arp_hdr)) {
+        return false;
+    }
+
+    const struct rte_arp_hdr *arph = rte_pktmbuf_mtod_offset(mbuf, struct rte_arp_hdr *, sizeof(struct rte_ether_hdr));
+    if (arph->arp_hardware != RTE_BE16(RTE_ARP_HRD_ETHER) || arph->arp_protocol != RTE_BE16(RTE_ETHER_TYPE_IPV4) ||
+        arph->arp_hlen != RTE_ETHER_ADDR_LEN || arph->arp_plen != sizeof(uint32_t)) {
+        return false;
+    }
+
+    uint16_t opcode = rte_be_to_cpu_16(arph->arp_opcode);
+    uint32_t sip = arph->arp_data.arp_sip;
+    bool for_us = (arph->arp_data.arp_tip == get_global_cfg_params()->host_addr.addr);
+    bool need_reply = (opcode == RTE_ARP_OP_REQUEST && for_us);
+    if ((opcode != RTE_ARP_OP_REQUEST && opcode != RTE_ARP_OP_REPLY) || sip == 0) {
+        return need_reply;
+    }
+
+    /* like etharp, only learn new neighbors that talk to us, but keep every known one up to date */
+    struct neigh_entry *entry = neigh_find(sip, for_us || opcode == RTE_ARP_OP_REPLY);
+    if (entry == NULL) {
+        return need_reply;
+    }
+
+    struct eth_addr old;
+    if (neigh_read(entry, &old) && memcmp(&old, &arph->arp_data.arp_sha, sizeof(old)) == 0) {
+        __atomic_store_n(&entry->update_ms, sys_now(), __ATOMIC_RELAXED);
+    } else {
+        neigh_write(entry, &arph->arp_data.arp_sha);
+    }
+
+    neigh_wakeup_waiters(entry, mbuf);
+    return need_reply;
+}
+
+static bool neigh_resolve(struct neigh_entry *entry, struct netif *netif, const ip4_addr_t *nexthop,
+    struct eth_addr *mac)
+{
+    if (!neigh_read(entry, mac)) {
+        return false;
+    }
+
+    uint32_t now = sys_now();
+    uint32_t age = now - __atomic_load_n(&entry->update_ms, __ATOMIC_RELAXED);
+    if (age >= NEIGH_MAX_AGE_MS) {
+        return false;
+    }
+
+    if (age >= NEIGH_REFRESH_MS) {
+        uint32_t last = __atomic_load_n(&entry->refresh_ms, __ATOMIC_RELAXED);
+        if (now - last >= NEIGH_REFRESH_RETRY_MS &&
+            __atomic_compare_exchange_n(&entry->refresh_ms, &last, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            (void)etharp_request(netif, nexthop);
+        }
+    }
+
+    return true;
+}
+
+err_t neigh_output(struct netif *netif, struct pbuf *p, const ip4_addr_t *ipaddr)
+{
+    if (ip4_addr_isbroadcast(ipaddr, netif) || ip4_addr_ismulticast(ipaddr)) {
+        return etharp_output(netif, p, ipaddr);
+    }
+
+    const ip4_addr_t *nexthop = ipaddr;
+    if (!ip4_addr_netcmp(ipaddr, netif_ip4_addr(netif), netif_ip4_netmask(netif)) &&
+        !ip4_addr_islinklocal(ipaddr)) {
+        if (ip4_addr_isany_val(*netif_ip4_gw(netif))) {
+            return etharp_output(netif, p, ipaddr);
+        }
+        nexthop = netif_ip4_gw(netif);
+    }
+
+    struct eth_addr mac;
+    struct neigh_entry *entry = neigh_find(ip4_addr_get_u32(nexthop), false);
+    if (entry != NULL && neigh_resolve(entry, netif, nexthop, &mac)) {
+        return ethernet_output(netif, p, (struct eth_addr *)netif->hwaddr, &mac, ETHTYPE_IP);
+    }
+
+    /* lwip etharp queues p and sends the request, register first so the reply is handed back to this stack */
+    entry = neigh_find(ip4_addr_get_u32(nexthop), true);
+    if (entry != NULL) {
+        __atomic_fetch_or(&entry->waiters, 1U << get_protocol_stack()->stack_idx, __ATOMIC_SEQ_CST);
+        if (neigh_resolve(entry, netif, nexthop, &mac)) {
+            return ethernet_output(netif, p, (struct eth_addr *)netif->hwaddr, &mac, ETHTYPE_IP);
+        }
+    }
+
+    return etharp_output(netif, p, ipaddr);
+}
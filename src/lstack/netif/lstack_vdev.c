@@ -20,6 +20,7 @@
 #include <rte_ethdev.h>
 #include <rte_gro.h>
 #include <rte_net.h>
+#include <rte_cycles.h>
 
 #include "lstack_cfg.h"
 #include "lstack_dpdk.h"
@@ -40,10 +41,8 @@
 #define INUSE_TX_PKTS_WATERMARK         (VDEV_TX_QUEUE_SZ >> 2)
 #define USED_RX_PKTS_WATERMARK          (FREE_RX_QUEUE_SZ >> 2)
 
-#define IPV4_MASK                       (0xf0)
-#define IPV4_VERION                     (0x40)
-
-#define TCP_HDR_LEN(tcp_hdr)            (((tcp_hdr)->data_off & 0xf0) >> 2)
+/* 64KB merged tcp segment / 1460 mss */
+#define GRO_ITEM_PER_FLOW               (44)
 
 static uint32_t ltran_rx_poll(struct protocol_stack *stack, struct rte_mbuf **pkts, uint32_t max_mbuf)
 {
@@ -68,48 +67,104 @@ static uint32_t ltran_rx_poll(struct protocol_stack *stack, struct rte_mbuf **pk
     return rcvd_pkts;
 }
 
+static inline bool vdev_gro_pkt(const struct rte_mbuf *pkt)
+{
+    uint32_t l4_type = pkt->packet_type & RTE_PTYPE_L4_MASK;
+    return l4_type == RTE_PTYPE_L4_TCP || l4_type == RTE_PTYPE_L4_UDP || l4_type == RTE_PTYPE_L4_FRAG;
+}
+
+/* pkts not merged keep their order behind merged pkts of the same flow only if the table is emptied first.
+   rx reads at most max_mbuf minus pkts held in table, so the whole table always fits in pkts */
 static uint32_t vdev_rx_poll(struct protocol_stack *stack, struct rte_mbuf **pkts, uint32_t max_mbuf)
 {
-    struct rte_gro_param gro_param = {
-        .gro_types = RTE_GRO_TCP_IPV4,
-        /* 8*16=128(max) */
-        .max_flow_num = 8,
-        .max_item_per_flow = 16,
-    };
+    struct rte_mbuf *unmerged[DPDK_PKT_BURST_SIZE];
+    struct rte_net_hdr_lens hdr_lens;
+    void *gro_ctx = stack->gro_ctx;
 
-    uint32_t pkt_num = rte_eth_rx_burst(stack->port_id, stack->queue_id, pkts, max_mbuf);
-    if (pkt_num <= 1) {
-        return pkt_num;
+    if (gro_ctx == NULL) {
+        return rte_eth_rx_burst(stack->port_id, stack->queue_id, pkts, max_mbuf);
+    }
+
+    uint32_t held = rte_gro_get_pkt_count(gro_ctx);
+    uint32_t read_max = RTE_MIN(max_mbuf, (uint32_t)DPDK_PKT_BURST_SIZE);
+    read_max = (held < read_max) ? read_max - held : 0;
+
+    uint32_t pkt_num = rte_eth_rx_burst(stack->port_id, stack->queue_id, pkts, read_max);
+    for (uint32_t i = 0; i < pkt_num; i++) {
+        pkts[i]->packet_type = rte_net_get_ptype(pkts[i], &hdr_lens, RTE_PTYPE_L2_MASK | RTE_PTYPE_L3_MASK |
+            RTE_PTYPE_L4_MASK);
+        pkts[i]->l2_len = hdr_lens.l2_len;
+        pkts[i]->l3_len = hdr_lens.l3_len;
+        pkts[i]->l4_len = hdr_lens.l4_len;
     }
 
-    /* skip gro when tcp/ip cksum offloads disable */
-    if (get_protocol_stack_group()->rx_offload == 0) {
+    if (pkt_num > 0) {
+        pkt_num = rte_gro_reassemble(pkts, pkt_num, gro_ctx);
+    }
+
+    /* idle rx or a tcp/udp pkt gro refused (flags, short, ...) that may follow merged data of its flow */
+    bool flush_all = (pkt_num == 0);
+    for (uint32_t i = 0; i < pkt_num && !flush_all; i++) {
+        flush_all = vdev_gro_pkt(pkts[i]);
+    }
+
+    if (rte_gro_get_pkt_count(gro_ctx) == 0) {
         return pkt_num;
     }
 
+    if (!flush_all) {
+        return pkt_num + rte_gro_timeout_flush(gro_ctx, stack->gro_flush_cycles, stack->gro_types,
+            &pkts[pkt_num], max_mbuf - pkt_num);
+    }
+
     for (uint32_t i = 0; i < pkt_num; i++) {
-        struct rte_ether_hdr *ethh = rte_pktmbuf_mtod(pkts[i], struct rte_ether_hdr *);
-        if (unlikely(RTE_BE16(RTE_ETHER_TYPE_IPV4) != ethh->ether_type)) {
-            continue;
-        }
-        pkts[i]->l2_len = sizeof(struct rte_ether_hdr);
+        unmerged[i] = pkts[i];
+    }
+    uint32_t flushed = rte_gro_timeout_flush(gro_ctx, 0, stack->gro_types, pkts, max_mbuf - pkt_num);
+    for (uint32_t i = 0; i < pkt_num; i++) {
+        pkts[flushed + i] = unmerged[i];
+    }
 
-        struct rte_ipv4_hdr *iph = rte_pktmbuf_mtod_offset(pkts[i], struct rte_ipv4_hdr *,
-            sizeof(struct rte_ether_hdr));
-        if (unlikely((iph->version_ihl & IPV4_MASK) != IPV4_VERION)) {
-            continue;
-        }
-        pkts[i]->l3_len = sizeof(struct rte_ipv4_hdr);
+    return flushed + pkt_num;
+}
 
-        struct rte_tcp_hdr *tcp_hdr = rte_pktmbuf_mtod_offset(pkts[i], struct rte_tcp_hdr *,
-            sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
-        pkts[i]->l4_len = TCP_HDR_LEN(tcp_hdr);
+/* tcp merge needs nic verified checksum, merged pkt checksum is not recomputed.
+   udp merges ip fragments, lwip checks the udp checksum of the whole datagram */
+int32_t vdev_gro_init(struct protocol_stack *stack)
+{
+    struct cfg_params *cfg = get_global_cfg_params();
 
-        pkts[i]->packet_type = RTE_PTYPE_L3_IPV4 | RTE_PTYPE_L4_TCP;
+    stack->gro_ctx = NULL;
+    stack->gro_types = 0;
+    if (cfg->gro_flow_num == 0) {
+        return 0;
     }
-    pkt_num =  rte_gro_reassemble_burst(pkts, pkt_num, &gro_param);
 
-    return pkt_num;
+    if (get_protocol_stack_group()->rx_offload & DEV_RX_OFFLOAD_TCP_CKSUM) {
+        stack->gro_types |= RTE_GRO_TCP_IPV4;
+    }
+    if (cfg->udp_enable) {
+        stack->gro_types |= RTE_GRO_UDP_IPV4;
+    }
+    if (stack->gro_types == 0) {
+        return 0;
+    }
+
+    struct rte_gro_param gro_param = {
+        .gro_types = stack->gro_types,
+        .max_flow_num = cfg->gro_flow_num,
+        .max_item_per_flow = GRO_ITEM_PER_FLOW,
+        .socket_id = stack->socket_id,
+    };
+    stack->gro_ctx = rte_gro_ctx_create(&gro_param);
+    if (stack->gro_ctx == NULL) {
+        LSTACK_LOG(ERR, LSTACK, "stack_%02hu rte_gro_ctx_create failed flow_num=%u\n",
+            stack->queue_id, cfg->gro_flow_num);
+        return -1;
+    }
+    stack->gro_flush_cycles = rte_get_tsc_hz() / US_PER_S * cfg->gro_flush_us;
+
+    return 0;
 }
 
 static uint32_t ltran_tx_xmit(struct protocol_stack *stack, struct rte_mbuf **pkts, uint32_t nr_pkts)
@@ -157,13 +212,10 @@ int32_t vdev_reg_xmit(enum reg_ring_type type, struct gazelle_quintuple *qtuple)
     }
 
     if (!use_ltran() && get_global_cfg_params()->tuple_filter) {
+        /* listen ports of all processes go to process 0 listen thread, it installs their flow rules */
         if (type == REG_RING_TCP_LISTEN_CLOSE) {
-            if (get_global_cfg_params()->is_primary) {
-                delete_user_process_port(qtuple->src_port, PORT_LISTEN);
-            } else {
-                transfer_add_or_delete_listen_port_to_process0(qtuple->src_port,
-                    get_global_cfg_params()->process_idx, 0);
-            }
+            transfer_add_or_delete_listen_port_to_process0(qtuple->src_port,
+                get_global_cfg_params()->process_idx, 0);
         }
 
         if (type == REG_RING_TCP_CONNECT_CLOSE) {
@@ -193,12 +245,8 @@ int32_t vdev_reg_xmit(enum reg_ring_type type, struct gazelle_quintuple *qtuple)
         }
 
         if (type == REG_RING_TCP_LISTEN) {
-            if (get_global_cfg_params()->is_primary) {
-                add_user_process_port(qtuple->src_port, get_global_cfg_params()->process_idx, PORT_LISTEN);
-            } else {
-                transfer_add_or_delete_listen_port_to_process0(qtuple->src_port,
-                    get_global_cfg_params()->process_idx, 1);
-            }
+            transfer_add_or_delete_listen_port_to_process0(qtuple->src_port,
+                get_global_cfg_params()->process_idx, 1);
         }
         return 0;
     }
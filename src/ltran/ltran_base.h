@@ -79,6 +79,11 @@
 #define GAZELLE_BOND_QUEUE_MIN                  1
 #define GAZELLE_BOND_QUEUE_MAX                  64
 
+#define GAZELLE_FORWARD_CORES_MIN               1
+#define GAZELLE_FORWARD_CORES_DEFAULT           1
+#define GAZELLE_FORWARD_CTRL_RING_SIZE          4096
+#define GAZELLE_FORWARD_CTRL_RING_NAME_FMT      "forward_ctrl_ring%u"
+
 #define GAZELLE_CLIENT_RING_NAME_FMT            "MProc_Client_%u_mbuf_queue"
 #define GAZELLE_CLIENT_DROP_RING_SIZE           20000
 
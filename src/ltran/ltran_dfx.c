@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <sys/time.h>
+#include <limits.h>
 #include <arpa/inet.h>
 #include <getopt.h>
 #include <errno.h>
@@ -21,6 +22,10 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <securec.h>
 #include <unistd.h>
 #include <rte_log.h>
@@ -46,8 +51,11 @@
 
 #define GAZELLE_CMD_MAX          5
 
-#define GAZELLE_RESULT_LEN       8291
+#define GAZELLE_RESULT_LEN       16384
 #define GAZELLE_MAX_LATENCY_TIME 1800    // max latency time 30mins
+#define GAZELLE_LATENCY_LINE_LEN 128
+#define GAZELLE_LATENCY_TITLE    "                                      pkts        min(us)     max(us)     " \
+                                 "average(us) p50(us)   p90(us)   p99(us)   p99.9(us) p99.99(us)\n"
 
 #define GAZELLE_DECIMAL          10
 
@@ -57,9 +65,15 @@ static struct gazelle_stat_ltran_total g_last_ltran_total;
 static struct gazelle_stat_lstack_total g_last_lstack_total[GAZELLE_MAX_STACK_ARRAY_SIZE];
 
 static bool g_use_ltran = false;
+static const double g_latency_percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
 
 static char* g_unix_prefix;
 
+/* stat shm of lstack, used instead of unix socket for the modes it publishes */
+static struct gazelle_stat_shm *g_stat_shm = NULL;
+static size_t g_stat_shm_size;
+static uint32_t g_stat_shm_index;
+
 /* Use the largest data structure. */
 #define GAZELLE_CMD_RESP_BUFFER_SIZE (sizeof(struct gazelle_stack_dfx_data) / sizeof(char))
 
@@ -254,8 +268,109 @@ END:
     return GAZELLE_ERR;
 }
 
+static bool dfx_stat_shm_support(enum GAZELLE_STAT_MODE stat_mode)
+{
+    /* aggregate is measured between start and stop latency, keep it on the request path */
+    return stat_mode == GAZELLE_STAT_LSTACK_SHOW || stat_mode == GAZELLE_STAT_LSTACK_SHOW_SNMP;
+}
+
+static void dfx_stat_shm_close(void)
+{
+    if (g_stat_shm != NULL) {
+        (void)munmap(g_stat_shm, g_stat_shm_size);
+        g_stat_shm = NULL;
+    }
+}
+
+static bool dfx_stat_shm_valid(const struct gazelle_stat_shm *shm, size_t size)
+{
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != GAZELLE_STAT_SHM_MAGIC ||
+        shm->version != GAZELLE_STAT_SHM_VERSION || shm->page_size != sizeof(struct gazelle_stack_stat_page) ||
+        shm->stack_num == 0 || gazelle_stat_shm_size(shm->stack_num) > size) {
+        return false;
+    }
+
+    /* file left by a dead lstack */
+    if (kill((pid_t)shm->pid, 0) != 0 && errno == ESRCH) {
+        return false;
+    }
+
+    return true;
+}
+
+static int32_t dfx_stat_shm_open(void)
+{
+    char path[PATH_MAX];
+    struct stat st;
+
+    int32_t ret = sprintf_s(path, sizeof(path), "%s%s%s", GAZELLE_RUN_DIR,
+        (g_unix_prefix != NULL) ? g_unix_prefix : "", GAZELLE_STAT_SHM_FILENAME);
+    if (ret < 0) {
+        return GAZELLE_ERR;
+    }
+
+    int32_t fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return GAZELLE_ERR;
+    }
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct gazelle_stat_shm)) {
+        close(fd);
+        return GAZELLE_ERR;
+    }
+
+    void *shm = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        return GAZELLE_ERR;
+    }
+
+    if (!dfx_stat_shm_valid((struct gazelle_stat_shm *)shm, (size_t)st.st_size)) {
+        (void)munmap(shm, (size_t)st.st_size);
+        return GAZELLE_ERR;
+    }
+
+    g_stat_shm = (struct gazelle_stat_shm *)shm;
+    g_stat_shm_size = (size_t)st.st_size;
+    g_stat_shm_index = 0;
+    return GAZELLE_OK;
+}
+
+static int32_t dfx_stat_read_from_shm(char *buf, enum GAZELLE_STAT_MODE mode)
+{
+    struct gazelle_stack_dfx_data *dfx = (struct gazelle_stack_dfx_data *)buf;
+    struct gazelle_stack_stat_data data;
+
+    if (g_stat_shm_index >= g_stat_shm->stack_num) {
+        return GAZELLE_ERR;
+    }
+
+    if (gazelle_stat_page_read(&g_stat_shm->pages[g_stat_shm_index], &data) != 0) {
+        printf("read stat shm failed, stack %u is busy\n", g_stat_shm_index);
+        return GAZELLE_ERR;
+    }
+
+    (void)memset_s(dfx, sizeof(*dfx), 0, sizeof(*dfx));
+    dfx->tid = data.tid;
+    dfx->loglevel = data.loglevel;
+    dfx->low_power_info = data.low_power_info;
+    if (mode == GAZELLE_STAT_LSTACK_SHOW_SNMP) {
+        dfx->data.snmp = data.snmp;
+    } else {
+        dfx->data.pkts = data.pkts;
+    }
+
+    g_stat_shm_index++;
+    dfx->eof = (g_stat_shm_index == g_stat_shm->stack_num) ? 1 : 0;
+    return GAZELLE_OK;
+}
+
 static int32_t dfx_stat_conn_to_ltran(struct gazelle_stat_msg_request *req_msg)
 {
+    if (!g_use_ltran && dfx_stat_shm_support(req_msg->stat_mode) && dfx_stat_shm_open() == GAZELLE_OK) {
+        return GAZELLE_OK;
+    }
+
     int32_t fd = dfx_connect_ltran(g_use_ltran, false);
     if (fd < 0) {
         return fd;
@@ -290,6 +405,11 @@ static int32_t dfx_stat_read_from_ltran(char *buf, uint32_t len, enum GAZELLE_ST
     char *tmp_pbuf = buf;
     int32_t fd = g_unix_fd;
     struct gazelle_dfx_list *dfx = NULL;
+
+    if (g_stat_shm != NULL) {
+        return dfx_stat_read_from_shm(buf, mode);
+    }
+
     dfx = find_dfx_node(mode);
     if (dfx == NULL) {
         close(fd);
@@ -356,12 +476,63 @@ static char* get_loglevel_string(int32_t level)
     }
 }
 
+/* ltran reports statistics of every forward core, sum them into port_list */
+static void gazelle_aggregate_ltran_stat(struct gazelle_stat_ltran_total *stat)
+{
+    if (stat->port_num > GAZELLE_MAX_BOND_NUM) {
+        stat->port_num = GAZELLE_MAX_BOND_NUM;
+    }
+    if (stat->core_num > GAZELLE_MAX_FORWARD_CORES) {
+        stat->core_num = GAZELLE_MAX_FORWARD_CORES;
+    }
+
+    for (uint32_t i = 0; i < stat->port_num; i++) {
+        struct gazelle_stat_ltran_port *port_stat = &stat->port_list[i];
+        (void)memset_s(port_stat, sizeof(*port_stat), 0, sizeof(*port_stat));
+
+        for (uint32_t core = 0; core < stat->core_num; core++) {
+            const struct gazelle_stat_ltran_port *core_stat = &stat->core_list[core][i];
+            port_stat->rx += core_stat->rx;
+            port_stat->tx += core_stat->tx;
+            port_stat->rx_drop += core_stat->rx_drop;
+            port_stat->tx_drop += core_stat->tx_drop;
+            port_stat->rx_bytes += core_stat->rx_bytes;
+            port_stat->tx_bytes += core_stat->tx_bytes;
+            port_stat->kni_pkt += core_stat->kni_pkt;
+            port_stat->arp_pkt += core_stat->arp_pkt;
+            port_stat->tcp_pkt += core_stat->tcp_pkt;
+            port_stat->icmp_pkt += core_stat->icmp_pkt;
+            port_stat->loglevel = core_stat->loglevel;
+            for (uint32_t j = 0; j <= GAZELLE_PACKET_READ_SIZE; j++) {
+                port_stat->rx_iter_arr[j] += core_stat->rx_iter_arr[j];
+            }
+        }
+    }
+}
+
+static void gazelle_print_ltran_stat_core(const struct gazelle_stat_ltran_total *stat, uint32_t port)
+{
+    if (stat->core_num <= 1) {
+        return;
+    }
+
+    for (uint32_t core = 0; core < stat->core_num; core++) {
+        const struct gazelle_stat_ltran_port *core_stat = &stat->core_list[core][port];
+        printf("  forward core %-3u ", core);
+        printf("rx_pkts: %-15"PRIu64" ", core_stat->rx);
+        printf("rx_drop: %-15"PRIu64" ", core_stat->rx_drop);
+        printf("tx_pkts: %-15"PRIu64" ", core_stat->tx);
+        printf("tx_drop: %-15"PRIu64"\n", core_stat->tx_drop);
+    }
+}
+
 static void gazelle_print_ltran_stat_total(void *buf, const struct gazelle_stat_msg_request *req_msg)
 {
     uint32_t i;
     struct gazelle_stat_ltran_total *stat = (struct gazelle_stat_ltran_total *)buf;
 
     (void)req_msg;
+    gazelle_aggregate_ltran_stat(stat);
     printf("Statistics of ltran:\n");
     for (i = 0; i < stat->port_num; i++) {
         struct gazelle_stat_ltran_port *port_stat = &stat->port_list[i];
@@ -377,6 +548,7 @@ static void gazelle_print_ltran_stat_total(void *buf, const struct gazelle_stat_
         printf("arp_pkts: %-15"PRIu64" ", port_stat->arp_pkt);
         printf("tcp_pkts: %-15"PRIu64" ", port_stat->tcp_pkt);
         printf("icmp_pkts: %-15"PRIu64"\n", port_stat->icmp_pkt);
+        gazelle_print_ltran_stat_core(stat, i);
     }
 }
 
@@ -389,6 +561,7 @@ static void gazelle_print_ltran_stat_rate(void *buf, const struct gazelle_stat_m
     struct gazelle_stat_ltran_total *stat = (struct gazelle_stat_ltran_total *)buf;
 
     (void)req_msg;
+    gazelle_aggregate_ltran_stat(stat);
     if (g_ltran_rate_show_flag == GAZELLE_ON) {
         for (i = 0; i < stat->port_num; i++) {
             struct gazelle_stat_ltran_port *port_stat = &stat->port_list[i];
@@ -435,6 +608,19 @@ static void gazelle_print_ltran_start_latency(void *buf, const struct gazelle_st
     (void)sleep((uint32_t)g_wait_reply);
 }
 
+static int32_t sprint_latency_percentile(char *result, size_t max_len, const uint64_t *hist, uint64_t pkts)
+{
+    int32_t pos = 0;
+
+    for (uint32_t i = 0; i < sizeof(g_latency_percentiles) / sizeof(g_latency_percentiles[0]); i++) {
+        pos += sprintf_s(result + pos, max_len - (size_t)pos, "%-9"PRIu64" ",
+            gazelle_latency_percentile(hist, pkts, g_latency_percentiles[i]));
+    }
+    pos += sprintf_s(result + pos, max_len - (size_t)pos, "\n");
+
+    return pos;
+}
+
 static void gazelle_print_ltran_stat_latency(void *buf, const struct gazelle_stat_msg_request *req_msg)
 {
     struct in_addr *ip_addr = (struct in_addr *)buf;
@@ -443,6 +629,8 @@ static void gazelle_print_ltran_stat_latency(void *buf, const struct gazelle_sta
     double total_latency = 0;
     uint64_t max = 0;
     uint64_t min = ~((uint64_t)0);
+    uint64_t total_hist[GAZELLE_LATENCY_BUCKETS] = {0};
+    char percentile[GAZELLE_LATENCY_LINE_LEN] = {0};
     char str_ip[GAZELLE_SUBNET_LENGTH_MAX] = {0};
 
     (void)req_msg;
@@ -450,7 +638,7 @@ static void gazelle_print_ltran_stat_latency(void *buf, const struct gazelle_sta
 
     printf("Statistics of ltran latency:  t0--->t1  \
         (t0:read form nic  t1:into lstask queue  t2:into app queue)\n");
-    printf("                                      pkts        min(us)     max(us)     average(us)\n");
+    printf(GAZELLE_LATENCY_TITLE);
     do {
         if ((stat->eof != 0) || (ret != GAZELLE_OK)) {
             break;
@@ -461,7 +649,9 @@ static void gazelle_print_ltran_stat_latency(void *buf, const struct gazelle_sta
             printf("%-8"PRIu64"    ", stat->latency_pkts);
             printf("%-6"PRIu64"      ", stat->latency_min);
             printf("%-6"PRIu64"      ", stat->latency_max);
-            printf("%-6.2f \n", (double)stat->latency_total / stat->latency_pkts);
+            printf("%-10.2f  ", (double)stat->latency_total / stat->latency_pkts);
+            (void)sprint_latency_percentile(percentile, sizeof(percentile), stat->latency_hist, stat->latency_pkts);
+            printf("%s", percentile);
         } else {
             printf("0\n");
         }
@@ -470,6 +660,7 @@ static void gazelle_print_ltran_stat_latency(void *buf, const struct gazelle_sta
         min = (min < stat->latency_min) ? min : stat->latency_min;
         total_latency += stat->latency_total;
         total_rx += stat->latency_pkts;
+        gazelle_latency_merge(total_hist, stat->latency_hist);
 
         ret |= (uint32_t)read_specied_len(g_unix_fd, (char *)ip_addr, sizeof(*ip_addr));
         ret |= (uint32_t)read_specied_len(g_unix_fd, (char *)stat, sizeof(*stat));
@@ -480,7 +671,9 @@ static void gazelle_print_ltran_stat_latency(void *buf, const struct gazelle_sta
         printf("%-8"PRIu64"    ", total_rx);
         printf("%-6"PRIu64"      ", min);
         printf("%-6"PRIu64"      ", max);
-        printf("%-6.2f \n", total_latency / total_rx);
+        printf("%-10.2f  ", total_latency / total_rx);
+        (void)sprint_latency_percentile(percentile, sizeof(percentile), total_hist, total_rx);
+        printf("%s", percentile);
     } else {
         printf("                          total:      0\n");
     }
@@ -529,6 +722,7 @@ static void gazelle_print_ltran_stat_burst(void *buf, const struct gazelle_stat_
     struct gazelle_stat_ltran_total *stat = (struct gazelle_stat_ltran_total *)buf;
 
     (void)req_msg;
+    gazelle_aggregate_ltran_stat(stat);
     if (g_ltran_rate_show_flag == GAZELLE_ON) {
         for (uint32_t i = 0; i < stat->port_num; i++) {
             struct gazelle_stat_ltran_port *port_stat = &stat->port_list[i];
@@ -613,6 +807,10 @@ static void show_lstack_stats(struct gazelle_stack_dfx_data *lstack_stat)
     printf("call_null: %-18"PRIu64" \n", lstack_stat->data.pkts.stack_stat.call_null);
     printf("send_pkts_fail: %-13"PRIu64" ", lstack_stat->data.pkts.stack_stat.send_pkts_fail);
     printf("mempool_freecnt: %-12"PRIu32" \n", lstack_stat->data.pkts.mempool_freecnt);
+    printf("conn_mbuf: %-18"PRIu64" ", lstack_stat->data.pkts.stack_stat.conn_mbuf_cnt);
+    printf("conn_mbuf_peak: %-13"PRIu64" \n", lstack_stat->data.pkts.stack_stat.conn_mbuf_peak);
+    printf("read_lwip_quota: %-12"PRIu64" ", lstack_stat->data.pkts.stack_stat.read_lwip_quota);
+    printf("app_write_quota: %-12"PRIu64" \n", lstack_stat->data.pkts.wakeup_stat.app_write_quota);
 }
 
 static void gazelle_print_lstack_stat_detail(struct gazelle_stack_dfx_data *lstack_stat,
@@ -620,10 +818,10 @@ static void gazelle_print_lstack_stat_detail(struct gazelle_stack_dfx_data *lsta
 {
     int32_t low_power_info_show = 1;
 
-    (void)req_msg;
     do {
         if (g_use_ltran || low_power_info_show == 0) {
-            int32_t ret = read_specied_len(g_unix_fd, (char *)lstack_stat, sizeof(*lstack_stat));
+            int32_t ret = (g_stat_shm != NULL) ? dfx_stat_read_from_shm((char *)lstack_stat, req_msg->stat_mode) :
+                read_specied_len(g_unix_fd, (char *)lstack_stat, sizeof(*lstack_stat));
             if (ret != GAZELLE_OK) {
                 break;
             }
@@ -668,8 +866,10 @@ static void parse_thread_latency_result(const struct stack_latency *latency, cha
         *pos += sprintf_s(result + *pos, max_len, "%-8"PRIu64"    ", latency->latency_pkts);
         *pos += sprintf_s(result + *pos, max_len, "%-6"PRIu64"      ", latency->latency_min);
         *pos += sprintf_s(result + *pos, max_len, "%-6"PRIu64"      ", latency->latency_max);
-        *pos += sprintf_s(result + *pos, max_len, "%-6.2f \n",
+        *pos += sprintf_s(result + *pos, max_len, "%-10.2f  ",
             (double)latency->latency_total / latency->latency_pkts);
+        *pos += sprint_latency_percentile(result + *pos, max_len - (size_t)*pos, latency->latency_hist,
+            latency->latency_pkts);
     } else {
         *pos += sprintf_s(result + *pos, max_len, "0\n");
     }
@@ -678,6 +878,7 @@ static void parse_thread_latency_result(const struct stack_latency *latency, cha
     record->latency_max = (record->latency_max > latency->latency_max) ? record->latency_max : latency->latency_max;
     record->latency_pkts += latency->latency_pkts;
     record->latency_total += latency->latency_total;
+    gazelle_latency_merge(record->latency_hist, latency->latency_hist);
 }
 
 static void parse_latency_total_result(char *result, size_t max_len, int32_t *pos,
@@ -688,8 +889,11 @@ static void parse_latency_total_result(char *result, size_t max_len, int32_t *po
         *pos += sprintf_s(result + *pos, max_len, "%-8"PRIu64"    ", record->latency_pkts);
         *pos += sprintf_s(result + *pos, max_len, "%-6"PRIu64"      ", record->latency_min);
         *pos += sprintf_s(result + *pos, max_len, "%-6"PRIu64"      ", record->latency_max);
-        *pos += sprintf_s(result + *pos, max_len, "%-6.2f \n\n\n",
+        *pos += sprintf_s(result + *pos, max_len, "%-10.2f  ",
             (double)record->latency_total / record->latency_pkts);
+        *pos += sprint_latency_percentile(result + *pos, max_len - (size_t)*pos, record->latency_hist,
+            record->latency_pkts);
+        *pos += sprintf_s(result + *pos, max_len, "\n\n");
     } else {
         *pos += sprintf_s(result + *pos, max_len, "                          total:      0\n\n\n");
     }
@@ -741,13 +945,11 @@ static void gazelle_print_lstack_stat_latency(void *buf, const struct gazelle_st
 
     printf("Statistics of lstack latency: t0--->t3 \
         (t0:read form nic  t1:into lstask queue  t2:into app queue t3:app read)\n");
-    printf("                                      pkts        min(us)     max(us)     average(us)\n%s",
-        read_result);
+    printf(GAZELLE_LATENCY_TITLE "%s", read_result);
 
     printf("Statistics of lstack latency: t0--->t2 \
         (t0:read form nic  t1:into lstask queue  t2:into app queue t3:app read)\n");
-    printf("                                      pkts        min(us)     max(us)     average(us)\n%s",
-        lwip_result);
+    printf(GAZELLE_LATENCY_TITLE "%s", lwip_result);
 
     free(read_result);
     free(lwip_result);
@@ -911,9 +1113,9 @@ static void gazelle_print_lstack_stat_conn(void *buf, const struct gazelle_stat_
     printf("Active Internet connections (servers and established)\n");
     do {
         printf("\n------ stack tid: %6u ------time=%lu\n", stat->tid, time.tv_sec * 1000000 + time.tv_usec);
-        printf("No.   Proto lwip_recv recv_ring in_send send_ring cwn      rcv_wnd  snd_wnd   snd_buf   snd_nxt"
-            "        lastack        rcv_nxt        events    epoll_ev  evlist fd     Local Address        "
-            "Foreign Address    State\n");
+        printf("No.   Proto lwip_recv recv_ring in_send send_ring mbuf    mbuf_pk cwn      rcv_wnd  snd_wnd   "
+            "snd_buf   snd_nxt        lastack        rcv_nxt        events    epoll_ev  evlist fd     "
+            "Local Address        Foreign Address    State\n");
         uint32_t unread_pkts = 0;
         uint32_t unsend_pkts = 0;
         for (i = 0; i < conn->conn_num && i < GAZELLE_LSTACK_MAX_CONN; i++) {
@@ -922,16 +1124,17 @@ static void gazelle_print_lstack_stat_conn(void *buf, const struct gazelle_stat_
             rip.s_addr = conn_info->rip;
             lip.s_addr = conn_info->lip;
             if ((conn_info->state == GAZELLE_ACTIVE_LIST) || (conn_info->state == GAZELLE_TIME_WAIT_LIST)) {
-                printf("%-6utcp   %-10u%-10u%-8u%-10u%-9d%-9d%-10d%-10d%-15u%-15u%-15u%-10x%-10x%-7d%-7d"
+                printf("%-6utcp   %-10u%-10u%-8u%-10u%-8u%-8u%-9d%-9d%-10d%-10d%-15u%-15u%-15u%-10x%-10x%-7d%-7d"
                     "%s:%hu   %s:%hu  %s\n", i, conn_info->recv_cnt, conn_info->recv_ring_cnt, conn_info->in_send,
-                    conn_info->send_ring_cnt, conn_info->cwn, conn_info->rcv_wnd, conn_info->snd_wnd,
-                    conn_info->snd_buf, conn_info->snd_nxt, conn_info->lastack, conn_info->rcv_nxt, conn_info->events,
-                    conn_info->epoll_events, conn_info->eventlist, conn_info->fd,
+                    conn_info->send_ring_cnt, conn_info->mbuf_cnt, conn_info->mbuf_peak, conn_info->cwn,
+                    conn_info->rcv_wnd, conn_info->snd_wnd, conn_info->snd_buf, conn_info->snd_nxt,
+                    conn_info->lastack, conn_info->rcv_nxt, conn_info->events, conn_info->epoll_events,
+                    conn_info->eventlist, conn_info->fd,
                     inet_ntop(AF_INET, &lip, str_ip, sizeof(str_ip)), conn_info->l_port,
                     inet_ntop(AF_INET, &rip, str_rip, sizeof(str_rip)), conn_info->r_port,
                     tcp_state_to_str(conn_info->tcp_sub_state));
             } else if (conn_info->state == GAZELLE_LISTEN_LIST) {
-                printf("%-6utcp    %-147u%-7d%s:%hu   0.0.0.0:*          LISTEN\n", i, conn_info->recv_cnt,
+                printf("%-6utcp    %-163u%-7d%s:%hu   0.0.0.0:*          LISTEN\n", i, conn_info->recv_cnt,
                     conn_info->fd, inet_ntop(AF_INET, &lip, str_ip, sizeof(str_ip)), conn_info->l_port);
             } else {
                 printf("Got unknow tcp conn::%s:%5hu, state:%u\n",
@@ -1351,6 +1554,7 @@ int32_t dfx_loop(struct gazelle_stat_msg_request *req_msg, int32_t req_msg_num)
             close(g_unix_fd);
             g_unix_fd = -1;
         }
+        dfx_stat_shm_close();
 
         msg_index++;
         if (msg_index >= req_msg_num) {
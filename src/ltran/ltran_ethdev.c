@@ -22,6 +22,7 @@
 #include <rte_ethdev.h>
 #include <rte_errno.h>
 #include <rte_kni.h>
+#include <rte_thash.h>
 #include <syslog.h>
 #include <securec.h>
 
@@ -40,6 +41,19 @@ struct port_info g_port_info[GAZELLE_MAX_BOND_NUM];
 struct rte_mempool *g_pktmbuf_rxpool[GAZELLE_MAX_BOND_NUM];
 struct rte_mempool *g_pktmbuf_txpool[GAZELLE_MAX_BOND_NUM];
 
+#define RSS_HASH_KEY_LEN    40
+static uint8_t g_rss_key[RSS_HASH_KEY_LEN] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+/* reta programmed by ltran, used to find out which rx queue a flow comes from. size 0 means unknown */
+static uint16_t g_rss_reta[ETH_RSS_RETA_SIZE_512];
+static uint16_t g_rss_reta_size = 0;
+static bool g_rss_l4 = false;
+
 /* record bond num, check the num is match or not, or exceed */
 void set_bond_num(const uint32_t bond_num)
 {
@@ -231,6 +245,80 @@ static int32_t ltran_parse_port(void)
     return GAZELLE_OK;
 }
 
+static void eth_params_rss(struct rte_eth_conf *conf, const struct rte_eth_dev_info *dev_info, uint16_t rx_queue_num)
+{
+    uint64_t def_rss_hf = ETH_RSS_IP | ETH_RSS_TCP;
+
+    conf->rxmode.mq_mode = ETH_MQ_RX_NONE;
+    if (rx_queue_num <= 1) {
+        return;
+    }
+
+    uint64_t rss_hf = def_rss_hf & dev_info->flow_type_rss_offloads;
+    if (rss_hf == 0) {
+        LTRAN_WARN("nic not support rss, all pkts come from rx queue 0.\n");
+        return;
+    }
+
+    conf->rxmode.mq_mode = ETH_MQ_RX_RSS;
+    conf->rx_adv_conf.rss_conf.rss_key = g_rss_key;
+    conf->rx_adv_conf.rss_conf.rss_key_len = RSS_HASH_KEY_LEN;
+    conf->rx_adv_conf.rss_conf.rss_hf = rss_hf;
+    g_rss_l4 = ((rss_hf & ETH_RSS_NONFRAG_IPV4_TCP) != 0);
+}
+
+static void ltran_rss_reta_setup(uint16_t port_id, uint16_t rx_queue_num)
+{
+    struct rte_eth_rss_reta_entry64 reta_conf[ETH_RSS_RETA_SIZE_512 / RTE_RETA_GROUP_SIZE] = {0};
+    struct rte_eth_dev_info dev_info;
+
+    if (rx_queue_num <= 1) {
+        return;
+    }
+
+    if (rte_eth_dev_info_get(port_id, &dev_info) != 0) {
+        return;
+    }
+    if (dev_info.reta_size == 0 || dev_info.reta_size > ETH_RSS_RETA_SIZE_512) {
+        LTRAN_WARN("unsupported rss reta size %hu at port %hu.\n", dev_info.reta_size, port_id);
+        return;
+    }
+
+    for (uint16_t i = 0; i < dev_info.reta_size; i++) {
+        reta_conf[i / RTE_RETA_GROUP_SIZE].mask = UINT64_MAX;
+        reta_conf[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE] = i % rx_queue_num;
+    }
+
+    int32_t ret = rte_eth_dev_rss_reta_update(port_id, reta_conf, dev_info.reta_size);
+    if (ret < 0) {
+        LTRAN_WARN("cannot update rss reta at port %hu, ret=%d.\n", port_id, ret);
+        return;
+    }
+
+    for (uint16_t i = 0; i < dev_info.reta_size; i++) {
+        g_rss_reta[i] = i % rx_queue_num;
+    }
+    g_rss_reta_size = dev_info.reta_size;
+}
+
+int32_t ltran_rss_queue_get(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port)
+{
+    union rte_thash_tuple tuple;
+    uint32_t hash;
+
+    if (g_rss_reta_size == 0) {
+        return -1;
+    }
+
+    tuple.v4.src_addr = rte_be_to_cpu_32(src_ip);
+    tuple.v4.dst_addr = rte_be_to_cpu_32(dst_ip);
+    tuple.v4.sport = rte_be_to_cpu_16(src_port);
+    tuple.v4.dport = rte_be_to_cpu_16(dst_port);
+    hash = rte_softrss((uint32_t *)&tuple, g_rss_l4 ? RTE_THASH_V4_L4_LEN : RTE_THASH_V4_L3_LEN, g_rss_key);
+
+    return g_rss_reta[hash % g_rss_reta_size];
+}
+
 static int32_t ltran_single_slave_port_init(uint16_t port_num, struct rte_mempool *pktmbuf_rxpool)
 {
     uint16_t rx_ring_size = GAZELLE_RX_DESC_DEFAULT;
@@ -251,7 +339,7 @@ static int32_t ltran_single_slave_port_init(uint16_t port_num, struct rte_mempoo
     port_conf.txmode.mq_mode = ETH_MQ_TX_NONE;
     port_conf.link_speeds = ETH_LINK_SPEED_AUTONEG;
     eth_params_checksum(&port_conf, &dev_info);
-    port_conf.rxmode.mq_mode = ETH_MQ_RX_NONE;
+    eth_params_rss(&port_conf, &dev_info, rx_queue_num);
 
     struct ltran_config *ltran_config = get_ltran_config();
     ltran_config->dpdk.rx_offload = port_conf.rxmode.offloads;
@@ -370,10 +458,10 @@ static int32_t ltran_bond_port_attr_set(uint16_t port_num, uint16_t bond_port_id
     }
 
     struct rte_eth_conf port_conf = {0};
-    port_conf.rxmode.mq_mode = ETH_MQ_RX_NONE;
     port_conf.txmode.mq_mode = ETH_MQ_TX_NONE;
     port_conf.link_speeds = ETH_LINK_SPEED_AUTONEG;
     eth_params_checksum(&port_conf, &dev_info);
+    eth_params_rss(&port_conf, &dev_info, rx_queue_num);
 
     ret = rte_eth_dev_configure(bond_port_id, rx_queue_num, tx_queue_num, &port_conf);
     if (ret != 0) {
@@ -449,6 +537,7 @@ static int32_t ltran_single_bond_port_init(uint16_t port_num, struct rte_mempool
         LTRAN_ERR("rte_eth_dev_start failed in bond port initialize. errno: %d, port: %hu\n", ret, port_num);
         return GAZELLE_ERR;
     }
+    ltran_rss_reta_setup(bond_port_id, (uint16_t)ltran_config->bond.rx_queue_num);
 
     bond_port[port_num] = bond_port_id;
     return GAZELLE_OK;
@@ -34,5 +34,7 @@ struct rte_mempool** get_pktmbuf_txpool(void);
 struct rte_mempool** get_pktmbuf_rxpool(void);
 
 int32_t ltran_ethdev_init(void);
+/* rx queue of bond port the flow comes from, ip and port in net byte order. return -1 if unknown */
+int32_t ltran_rss_queue_get(uint32_t src_ip, uint32_t dst_ip, uint16_t src_port, uint16_t dst_port);
 
 #endif /* ifndef __GAZELLE_ETHDEV_H__ */
@@ -21,6 +21,7 @@
 #include <rte_prefetch.h>
 #include <rte_cycles.h>
 #include <rte_ring.h>
+#include <rte_errno.h>
 #include <securec.h>
 
 #include "dpdk_common.h"
@@ -39,8 +40,22 @@
 #define POINTER_PER_CACHELINE     (RTE_CACHE_LINE_SIZE / sizeof(void *))
 #define UPSTREAM_LOOP_TIMES 64
 #define UP_ADJUST_THRESH    (GAZELLE_PACKET_READ_SIZE - 1)
+/* zero copy rx is disabled when available mbuf of rx pool is less than 1/4 */
+#define ZERO_COPY_RXPOOL_RESERVE_SHIFT  2
 
 __thread uint16_t g_port_index;
+/* same as get_forward_core_id(), kept here for fast path */
+static __thread uint32_t g_core_index;
+/* pass ltran rx mbuf to lstack directly, fall back to copy when rx pool is short */
+static __thread bool g_rx_zero_copy;
+
+/* reg ring msg passed to the forward core which owns the tcp sock or conn htable */
+struct forward_ctrl_msg {
+    struct gazelle_stack *stack;
+    struct reg_ring_msg msg;
+};
+static struct rte_ring *g_ctrl_ring[GAZELLE_MAX_FORWARD_CORES];
+#define FORWARD_CORE_ALL    GAZELLE_MAX_FORWARD_CORES
 
 static __rte_always_inline struct gazelle_stack *get_kni_stack(void)
 {
@@ -73,6 +88,7 @@ static void calculate_ltran_latency(struct gazelle_stack *stack, const struct rt
         stack->stack_stats.latency_max : latency;
     stack->stack_stats.latency_min = (stack->stack_stats.latency_min < latency) ?
         stack->stack_stats.latency_min : latency;
+    gazelle_latency_record(stack->stack_stats.latency_hist, latency);
 }
 
 static __rte_always_inline void flush_rx_mbuf(struct gazelle_stack *stack, struct rte_mbuf *dst, struct rte_mbuf *src)
@@ -85,18 +101,54 @@ static __rte_always_inline void flush_rx_mbuf(struct gazelle_stack *stack, struc
     rte_pktmbuf_free(src);
 }
 
+static __rte_always_inline void lend_rx_mbuf(struct gazelle_stack *stack, struct rte_mbuf *src)
+{
+    stack->stack_stats.rx_bytes += src->data_len;
+    if (get_start_latency_flag() == GAZELLE_ON) {
+        calculate_ltran_latency(stack, src);
+    }
+}
+
+/* idle mbufs read from rx_ring are replaced by ltran mbufs, lstack frees them back to ltran rx pool after use */
+static __rte_always_inline void lend_rx_mbufs_over(struct gazelle_stack *stack, struct rte_mbuf **free_buf,
+    struct rte_mbuf **lend_buf, uint32_t cnt)
+{
+    gazelle_ring_read_replace(stack->rx_ring, (void **)lend_buf, cnt);
+    rte_pktmbuf_free_bulk(free_buf, cnt);
+}
+
+static __rte_always_inline bool rx_zero_copy_available(void)
+{
+    if (get_ltran_config()->dpdk.zero_copy != GAZELLE_ON) {
+        return false;
+    }
+
+    /* keep enough mbuf for nic rx, mbufs lent to lstack may be held long time by recv ring */
+    struct rte_mempool *rxpool = get_pktmbuf_rxpool()[g_port_index];
+    return rte_mempool_avail_count(rxpool) > (get_ltran_config()->rx_mbuf_pool_size >> ZERO_COPY_RXPOOL_RESERVE_SHIFT);
+}
+
 static __rte_always_inline void backup_bufs_enque_rx_ring(struct gazelle_stack *stack)
 {
     uint32_t free_cnt, index, flush_cnt;
     uint32_t backup_size = BACKUP_MBUF_SIZE;
     struct rte_mbuf *free_buf[RING_MAX_SIZE];
+    struct rte_mbuf *lend_buf[RING_MAX_SIZE];
 
     flush_cnt = (stack->backup_pkt_cnt < RING_MAX_SIZE) ? stack->backup_pkt_cnt : RING_MAX_SIZE;
     free_cnt = gazelle_ring_read(stack->rx_ring, (void **)free_buf, flush_cnt);
 
     for (uint32_t j = 0; j < free_cnt; j++) {
         index = (stack->backup_start + j) % backup_size;
-        flush_rx_mbuf(stack, free_buf[j], stack->backup_pkt_buf[index]);
+        if (g_rx_zero_copy) {
+            lend_buf[j] = stack->backup_pkt_buf[index];
+            lend_rx_mbuf(stack, lend_buf[j]);
+        } else {
+            flush_rx_mbuf(stack, free_buf[j], stack->backup_pkt_buf[index]);
+        }
+    }
+    if (g_rx_zero_copy && free_cnt > 0) {
+        lend_rx_mbufs_over(stack, free_buf, lend_buf, free_cnt);
     }
 
     stack->stack_stats.rx += free_cnt;
@@ -129,15 +181,27 @@ static __rte_always_inline void pktbufs_move_to_backup_bufs(struct gazelle_stack
     }
 }
 
-static __rte_always_inline uint32_t pkt_bufs_enque_rx_ring(struct gazelle_stack *stack)
+static __rte_always_inline uint32_t pkt_bufs_enque_rx_ring(struct gazelle_stack *stack,
+    struct gazelle_rx_stage *rx_stage)
 {
     uint32_t free_cnt, j;
-    struct rte_mbuf **cl_buffer = stack->pkt_buf;
+    struct rte_mbuf **cl_buffer = rx_stage->pkt_buf;
     struct rte_mbuf *free_buf[GAZELLE_PACKET_READ_SIZE];
 
-    free_cnt = gazelle_ring_read(stack->rx_ring, (void **)free_buf, stack->pkt_cnt);
+    free_cnt = gazelle_ring_read(stack->rx_ring, (void **)free_buf, rx_stage->pkt_cnt);
     stack->stack_stats.rx += free_cnt;
 
+    if (g_rx_zero_copy) {
+        if (likely(free_cnt != 0)) {
+            for (j = 0; j < free_cnt; j++) {
+                lend_rx_mbuf(stack, cl_buffer[j]);
+            }
+            lend_rx_mbufs_over(stack, free_buf, cl_buffer, free_cnt);
+            gazelle_ring_read_over(stack->rx_ring);
+        }
+        return free_cnt;
+    }
+
     /* this prefetch and copy code, only 50~60 instruction, but never spend less than 70 cycle.
         even if we enlarge the PREFETCH_OFFSET, I think it because memory&cache problem. */
 #define COPY_PREFETCH_OFFSET        2
@@ -193,42 +257,63 @@ static __rte_always_inline uint32_t pkt_bufs_enque_rx_ring(struct gazelle_stack
     return free_cnt;
 }
 
+static __rte_always_inline void flush_kni_ring(struct gazelle_stack *stack, struct gazelle_rx_stage *rx_stage)
+{
+    /* kni is shared by forward cores */
+    rte_spinlock_lock(&stack->rx_lock);
+    // if fail, free mbuf inside
+    kni_process_tx(rx_stage->pkt_buf, rx_stage->pkt_cnt);
+    rte_spinlock_unlock(&stack->rx_lock);
+    get_statistics()->port_stats[g_port_index].kni_pkt += rx_stage->pkt_cnt;
+    rx_stage->pkt_cnt = 0;
+}
+
 static __rte_always_inline void flush_rx_ring(struct gazelle_stack *stack)
 {
+    struct gazelle_rx_stage *rx_stage = &stack->rx_stage[g_core_index];
+
+    if (rx_stage->pkt_cnt == 0 && stack->backup_pkt_cnt == 0) {
+        return;
+    }
+
     if (unlikely(stack == get_kni_stack())) {
-        // if fail, free mbuf inside
-        kni_process_tx(stack->pkt_buf, stack->pkt_cnt);
-        get_statistics()->port_stats[g_port_index].kni_pkt += stack->pkt_cnt;
-        stack->pkt_cnt = 0;
+        flush_kni_ring(stack, rx_stage);
         return;
     }
 
+    /* rx_ring is single producer, forward cores flush into it in turn */
+    rte_spinlock_lock(&stack->rx_lock);
+
     /* first flush backup mbuf pointer avoid packet disorder */
     if (unlikely(stack->backup_pkt_cnt > 0)) {
         backup_bufs_enque_rx_ring(stack);
         /* backup can't clear. mbuf into backup */
         if (stack->backup_pkt_cnt > 0) {
-            pktbufs_move_to_backup_bufs(stack, stack->pkt_buf, stack->pkt_cnt);
-            stack->pkt_cnt = 0;
+            pktbufs_move_to_backup_bufs(stack, rx_stage->pkt_buf, rx_stage->pkt_cnt);
+            rx_stage->pkt_cnt = 0;
+            rte_spinlock_unlock(&stack->rx_lock);
             return;
         }
     }
 
-    uint32_t flush_cnt = pkt_bufs_enque_rx_ring(stack);
+    uint32_t flush_cnt = pkt_bufs_enque_rx_ring(stack, rx_stage);
     /* cant't flush mbuf into backup */
-    if (unlikely(flush_cnt < stack->pkt_cnt)) {
-        pktbufs_move_to_backup_bufs(stack, &(stack->pkt_buf[flush_cnt]), stack->pkt_cnt - flush_cnt);
+    if (unlikely(flush_cnt < rx_stage->pkt_cnt)) {
+        pktbufs_move_to_backup_bufs(stack, &(rx_stage->pkt_buf[flush_cnt]), rx_stage->pkt_cnt - flush_cnt);
     }
-    stack->pkt_cnt = 0;
+    rx_stage->pkt_cnt = 0;
+    rte_spinlock_unlock(&stack->rx_lock);
 }
 
 static __rte_always_inline void enqueue_rx_packet(struct gazelle_stack* stack, struct rte_mbuf *buf)
 {
-    stack->pkt_buf[stack->pkt_cnt++] = buf;
-    if (unlikely(stack->pkt_cnt >= GAZELLE_PACKET_READ_SIZE)) {
-        rte_prefetch0(&stack->pkt_buf[0 * POINTER_PER_CACHELINE]);
-        rte_prefetch0(&stack->pkt_buf[1 * POINTER_PER_CACHELINE]);
-        rte_prefetch0(&stack->pkt_buf[2 * POINTER_PER_CACHELINE]);
+    struct gazelle_rx_stage *rx_stage = &stack->rx_stage[g_core_index];
+
+    rx_stage->pkt_buf[rx_stage->pkt_cnt++] = buf;
+    if (unlikely(rx_stage->pkt_cnt >= GAZELLE_PACKET_READ_SIZE)) {
+        rte_prefetch0(&rx_stage->pkt_buf[0 * POINTER_PER_CACHELINE]);
+        rte_prefetch0(&rx_stage->pkt_buf[1 * POINTER_PER_CACHELINE]);
+        rte_prefetch0(&rx_stage->pkt_buf[2 * POINTER_PER_CACHELINE]);
         rte_prefetch0(stack->rx_ring);
         rte_prefetch0(&stack->rx_ring->prod.tail);
         rte_prefetch0(&stack->rx_ring->prod.head);
@@ -340,7 +425,7 @@ static __rte_always_inline void arp_handle(struct rte_mbuf *m)
 
     get_statistics()->port_stats[g_port_index].arp_pkt++;
 
-    /* arp pkt forward to every lwip stack */
+    /* arp pkt forward to one lwip stack per instance, lstack shares the neighbor table among its stacks */
     struct gazelle_instance_mgr *mgr = get_instance_mgr();
     for (uint32_t i = 0; i < GAZELLE_MAX_INSTANCE_NUM; i++) {
         struct gazelle_instance *instance = mgr->instances[i];
@@ -359,6 +444,7 @@ static __rte_always_inline void arp_handle(struct rte_mbuf *m)
                 copy_mbuf(m_copy, m);
                 // send and free m_copy in enqueue_rx_packet
                 enqueue_rx_packet(stack_array[j], m_copy);
+                break;
             }
         }
     }
@@ -500,32 +586,141 @@ static void tcp_hash_table_modify(struct gazelle_stack *stack, const struct reg_
     }
 }
 
+int32_t forward_ctrl_ring_init(void)
+{
+    char name[RTE_RING_NAMESIZE];
+    uint32_t core_num = get_ltran_config()->dpdk.forward_cores;
+
+    for (uint32_t i = 0; i < core_num; i++) {
+        int32_t ret = snprintf_s(name, sizeof(name), sizeof(name) - 1, GAZELLE_FORWARD_CTRL_RING_NAME_FMT, i);
+        if (ret < 0) {
+            return GAZELLE_ERR;
+        }
+
+        /* multi forward cores enqueue, only the owner core dequeue */
+        g_ctrl_ring[i] = rte_ring_create_elem(name, sizeof(struct forward_ctrl_msg), GAZELLE_FORWARD_CTRL_RING_SIZE,
+            (int32_t)rte_socket_id(), RING_F_SC_DEQ);
+        if (g_ctrl_ring[i] == NULL) {
+            LTRAN_ERR("create %s failed. rte_errno: %d\n", name, rte_errno);
+            return GAZELLE_ERR;
+        }
+    }
+    return GAZELLE_OK;
+}
+
+/* reg_ring and tx_ring of stack are handled by one forward core */
+static __rte_always_inline uint32_t stack_forward_core(const struct gazelle_stack *stack)
+{
+    return stack->tid % get_ltran_config()->dpdk.forward_cores;
+}
+
+/* conn belongs to the forward core polling the rx queue which nic puts conn pkts into */
+static uint32_t conn_forward_core(const struct gazelle_quintuple *qtuple)
+{
+    uint32_t core_num = get_ltran_config()->dpdk.forward_cores;
+    if (core_num == 1) {
+        return 0;
+    }
+
+    int32_t queue_id = ltran_rss_queue_get(qtuple->src_ip, qtuple->dst_ip, qtuple->src_port, qtuple->dst_port);
+    if (queue_id < 0) {
+        /* rss reta is unknown, every core keeps the conn */
+        return FORWARD_CORE_ALL;
+    }
+    return (uint32_t)queue_id % core_num;
+}
+
+static void forward_ctrl_msg_send(uint32_t core_id, struct gazelle_stack *stack, const struct reg_ring_msg *msg)
+{
+    struct forward_ctrl_msg ctrl_msg = {
+        .stack = stack,
+        .msg = *msg,
+    };
+
+    if (rte_ring_mp_enqueue_elem(g_ctrl_ring[core_id], &ctrl_msg, sizeof(ctrl_msg)) != 0) {
+        LTRAN_ERR("forward core %u ctrl ring full, drop reg msg type %d\n", core_id, msg->type);
+    }
+}
+
+static void forward_ctrl_msg_dispatch(struct gazelle_stack *stack, const struct reg_ring_msg *msg)
+{
+    uint32_t core_num = get_ltran_config()->dpdk.forward_cores;
+    uint32_t core_id = FORWARD_CORE_ALL;
+    struct gazelle_quintuple transfer_qtuple;
+
+    /* listen socks are replicated to every core */
+    if (msg->type == REG_RING_TCP_CONNECT || msg->type == REG_RING_TCP_CONNECT_CLOSE) {
+        msg_to_quintuple(&transfer_qtuple, msg);
+        core_id = conn_forward_core(&transfer_qtuple);
+    }
+
+    if (core_id != FORWARD_CORE_ALL) {
+        forward_ctrl_msg_send(core_id, stack, msg);
+        return;
+    }
+
+    for (uint32_t i = 0; i < core_num; i++) {
+        forward_ctrl_msg_send(i, stack, msg);
+    }
+}
+
+static __rte_always_inline bool forward_ctrl_ring_available(void)
+{
+    uint32_t core_num = get_ltran_config()->dpdk.forward_cores;
+
+    /* every forward core enqueues one batch at most at the same time */
+    for (uint32_t i = 0; i < core_num; i++) {
+        if (rte_ring_free_count(g_ctrl_ring[i]) < PACKET_READ_SIZE * core_num) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static __rte_always_inline void tcp_hash_table_handle(struct gazelle_stack *stack)
 {
     void *pkts[PACKET_READ_SIZE];
-    struct gazelle_tcp_sock_htable *sock_htable = gazelle_get_tcp_sock_htable();
 
     if (gazelle_ring_readable_count(stack->reg_ring) == 0) {
         return;
     }
 
-    if (pthread_mutex_trylock(&sock_htable->mlock) != 0) {
+    if (!forward_ctrl_ring_available()) {
         return;
     }
 
     uint32_t num = gazelle_ring_read(stack->reg_ring, pkts, PACKET_READ_SIZE);
 
     for (uint32_t i = 0; i < num; i++) {
-        tcp_hash_table_modify(stack, pkts[i]);
+        forward_ctrl_msg_dispatch(stack, pkts[i]);
         pkts[i] = NULL;
     }
 
     gazelle_ring_read_over(stack->reg_ring);
-    if (pthread_mutex_unlock(&sock_htable->mlock) != 0) {
-        LTRAN_WARN("write tcp_htable: unlock failed, errno %d\n", errno);
-    }
 }
 
+static __rte_always_inline void forward_ctrl_ring_handle(void)
+{
+    struct forward_ctrl_msg ctrl_msgs[PACKET_READ_SIZE];
+    struct rte_ring *ctrl_ring = g_ctrl_ring[g_core_index];
+    uint32_t num;
+
+    if (rte_ring_count(ctrl_ring) == 0) {
+        return;
+    }
+
+    /* forward core is the only writer of its htables, readers in other threads never block it */
+    do {
+        num = rte_ring_sc_dequeue_burst_elem(ctrl_ring, ctrl_msgs, sizeof(struct forward_ctrl_msg),
+            PACKET_READ_SIZE, NULL);
+        for (uint32_t i = 0; i < num; i++) {
+            /* stack memory is kept until every forward core loops twice after instance logout */
+            if (INSTANCE_IS_ON(ctrl_msgs[i].stack)) {
+                tcp_hash_table_modify(ctrl_msgs[i].stack, &ctrl_msgs[i].msg);
+            }
+        }
+    } while (num == PACKET_READ_SIZE);
+}
 
 static __rte_always_inline void flush_all_stack(void)
 {
@@ -542,23 +737,87 @@ static __rte_always_inline void flush_all_stack(void)
         stack_array = instance->stack_array;
         for (uint32_t j = 0; j < instance->stack_cnt; j++) {
             if (stack_array[j] != NULL && INSTANCE_IS_ON(stack_array[j])) {
-                tcp_hash_table_handle(stack_array[j]);
+                if (stack_forward_core(stack_array[j]) == g_core_index) {
+                    tcp_hash_table_handle(stack_array[j]);
+                }
                 flush_rx_ring(stack_array[j]);
             }
         }
     }
+
+    forward_ctrl_ring_handle();
 }
 
-#define FWD_PREFETCH_OFFSET_ALREADY (FWD_PREFETCH_OFFSET * 2)
 #define FWD_PREFETCH_OFFSET    2
-static __rte_always_inline void upstream_forward_loop(uint32_t port_id, uint32_t queue_id)
+static __rte_always_inline bool pkt_to_tcp_quintuple(struct rte_mbuf *m, struct gazelle_quintuple *quintuple)
+{
+    const int32_t ipv4_version_offset = 4;
+    const int32_t ipv4_version = 4;
+    struct rte_ipv4_hdr *iph = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+
+    if (((iph->version_ihl & 0xf0) >> ipv4_version_offset) != ipv4_version || iph->next_proto_id != IPPROTO_TCP) {
+        return false;
+    }
+
+    struct rte_tcp_hdr *tcp_hdr = rte_pktmbuf_mtod_offset(m, struct rte_tcp_hdr *, sizeof(struct rte_ether_hdr) +
+        sizeof(struct rte_ipv4_hdr));
+    quintuple->dst_ip = iph->dst_addr;
+    quintuple->src_ip = iph->src_addr;
+    quintuple->dst_port = tcp_hdr->dst_port;
+    quintuple->src_port = tcp_hdr->src_port;
+    quintuple->protocol = 0;
+    return true;
+}
+
+/* lookup conns of the whole burst at once, pkts miss conn table go through upstream_forward_one */
+static __rte_always_inline void upstream_forward_burst(struct rte_mbuf **buf, uint16_t rx_count)
 {
+    struct gazelle_quintuple quintuples[GAZELLE_PACKET_READ_SIZE];
+    struct gazelle_tcp_conn *conns[GAZELLE_PACKET_READ_SIZE];
+    uint16_t tcp_index[GAZELLE_PACKET_READ_SIZE];
+    uint16_t tcp_cnt = 0;
     uint16_t i;
+    uint16_t j;
+
+    /* Prefetch first packets */
+    for (i = 0; i < FWD_PREFETCH_OFFSET && i < rx_count; i++) {
+        rte_prefetch0(rte_pktmbuf_mtod(buf[i], void *));
+    }
+
+    for (i = 0; i < rx_count; i++) {
+        if (i + FWD_PREFETCH_OFFSET < rx_count) {
+            rte_prefetch0(rte_pktmbuf_mtod(buf[i + FWD_PREFETCH_OFFSET], void *));
+        }
+        if (pkt_to_tcp_quintuple(buf[i], &quintuples[tcp_cnt])) {
+            tcp_index[tcp_cnt++] = i;
+        }
+    }
+
+    gazelle_conn_get_bulk(gazelle_get_tcp_conn_htable(), quintuples, tcp_cnt, conns);
+
+    for (i = 0, j = 0; i < rx_count; i++) {
+        if (j < tcp_cnt && tcp_index[j] == i) {
+            struct gazelle_tcp_conn *tcp_conn = conns[j++];
+            if (likely(tcp_conn != NULL)) {
+                // conn already established
+                get_statistics()->port_stats[g_port_index].rx_bytes += buf[i]->data_len;
+                get_statistics()->port_stats[g_port_index].tcp_pkt++;
+                enqueue_rx_packet(tcp_conn->stack, buf[i]);
+                continue;
+            }
+        }
+        upstream_forward_one(buf[i]);
+    }
+}
+
+static __rte_always_inline void upstream_forward_loop(uint32_t port_id, uint32_t queue_id)
+{
     uint16_t rx_count;
     uint32_t loop_cnt;
     uint64_t time_stamp = 0;
 
     struct rte_mbuf *buf[GAZELLE_PACKET_READ_SIZE] __rte_cache_aligned;
+    g_rx_zero_copy = rx_zero_copy_available();
     for (loop_cnt = 0; loop_cnt < UPSTREAM_LOOP_TIMES; loop_cnt++) {
         if (get_start_latency_flag() == GAZELLE_ON) {
             time_stamp = get_current_time();
@@ -573,39 +832,7 @@ static __rte_always_inline void upstream_forward_loop(uint32_t port_id, uint32_t
         get_statistics()->port_stats[g_port_index].rx_iter_arr[rx_count]++;
         get_statistics()->port_stats[g_port_index].rx += rx_count;
 
-        if (unlikely(rx_count < FWD_PREFETCH_OFFSET_ALREADY)) {
-            for (i = 0; i < rx_count; i++) {
-                upstream_forward_one(buf[i]);
-            }
-            break;
-        }
-
-        /* Prefetch first packets */
-        for (i = 0; i < FWD_PREFETCH_OFFSET; i++) {
-            rte_prefetch0(buf[i]);
-        }
-
-        for (i = 0; i < FWD_PREFETCH_OFFSET; i++) {
-            rte_prefetch0(rte_pktmbuf_mtod(buf[i], void *));
-            rte_prefetch0(buf[i + FWD_PREFETCH_OFFSET]);
-        }
-
-        /* Prefetch and forward already prefetched packets */
-        for (i = 0; i < (rx_count - FWD_PREFETCH_OFFSET_ALREADY); i++) {
-            rte_prefetch0(rte_pktmbuf_mtod(buf[i + FWD_PREFETCH_OFFSET], void *));
-            rte_prefetch0(buf[i + FWD_PREFETCH_OFFSET_ALREADY]);
-            upstream_forward_one(buf[i]);
-        }
-
-        for (; i < (rx_count - FWD_PREFETCH_OFFSET); i++) {
-            rte_prefetch0(rte_pktmbuf_mtod(buf[i + FWD_PREFETCH_OFFSET], void *));
-            upstream_forward_one(buf[i]);
-        }
-
-        /* Forward remaining prefetched packets */
-        for (; i < rx_count; i++) {
-            upstream_forward_one(buf[i]);
-        }
+        upstream_forward_burst(buf, rx_count);
 
         if (rx_count < UP_ADJUST_THRESH) {
             break;
@@ -616,37 +843,37 @@ static __rte_always_inline void upstream_forward_loop(uint32_t port_id, uint32_t
     flush_all_stack();
 }
 
-void upstream_forward(const uint16_t *port)
+void upstream_forward(const struct forward_arg *arg)
 {
-    g_port_index = *port;
+    g_port_index = arg->port_index;
+    g_core_index = arg->core_id;
+    set_forward_core_id(arg->core_id);
     uint32_t queue_id;
     uint32_t queue_num = get_ltran_config()->bond.rx_queue_num;
+    uint32_t core_num = get_ltran_config()->dpdk.forward_cores;
     uint32_t port_id = get_bond_port()[g_port_index];
     unsigned long now_time;
-    unsigned long last_time = get_current_time();
-    unsigned long aging_conn_last_time = last_time;
+    unsigned long aging_conn_last_time = get_current_time();
     calibrate_time();
 
     while (get_ltran_stop_flag() != GAZELLE_TRUE) {
-        for (queue_id = 0; queue_id < queue_num; queue_id++) {
+        /* rx queue q is polled by forward core q % core_num */
+        for (queue_id = g_core_index; queue_id < queue_num; queue_id += core_num) {
             upstream_forward_loop(port_id, queue_id);
         }
 
         if (get_ltran_config()->dpdk.kni_switch == GAZELLE_ON) {
             flush_rx_ring(get_kni_stack());
-            rte_kni_handle_request(get_gazelle_kni());
+            if (g_core_index == 0) {
+                rte_kni_handle_request(get_gazelle_kni());
+            }
         }
 
         now_time = get_current_time();
         if (now_time - aging_conn_last_time > GAZELLE_CONN_INTERVAL) {
             gazelle_delete_aging_conn(gazelle_get_tcp_conn_htable());
-            aging_conn_last_time = now_time;
-        }
-
-        if (now_time - last_time > get_ltran_config()->tcp_conn.tcp_conn_scan_interval) {
-            gazelle_detect_conn_logout(gazelle_get_tcp_conn_htable());
             gazelle_detect_sock_logout(gazelle_get_tcp_sock_htable());
-            last_time = now_time;
+            aging_conn_last_time = now_time;
         }
 
         set_rx_loop_count();
@@ -655,6 +882,36 @@ void upstream_forward(const uint16_t *port)
     LTRAN_DEBUG("ltran rx loop stop.\n");
 }
 
+/* lstack mbufs are sent to nic directly. every segment holds one more reference, so the mbuf returns to
+ * lstack pool only after both lstack and nic driver free it. */
+static __rte_always_inline uint32_t hold_tx_mbufs(struct gazelle_stack *stack, struct rte_mbuf **used_pkts,
+    struct rte_mbuf **dst_bufs, uint32_t used_cnt, uint64_t *tx_bytes)
+{
+    uint32_t hold_cnt = 0;
+
+    for (uint32_t i = 0; i < used_cnt; i++) {
+        struct rte_mbuf *m = used_pkts[i];
+#ifdef RTE_LIBRTE_MBUF_DEBUG
+        /* mbuf comes from lstack, check it before nic touch it */
+        const char *reason = NULL;
+        if (unlikely(rte_mbuf_check(m, 1, &reason) != 0)) {
+            LTRAN_ERR("invalid tx mbuf from stack %u: %s\n", stack->tid, reason);
+            stack->stack_stats.tx_drop++;
+            continue;
+        }
+#endif
+
+        for (struct rte_mbuf *seg = m; seg != NULL; seg = seg->next) {
+            rte_mbuf_refcnt_update(seg, 1);
+        }
+        dst_bufs[hold_cnt++] = m;
+        *tx_bytes += m->pkt_len;
+        stack->stack_stats.tx_bytes += m->pkt_len;
+    }
+
+    return hold_cnt;
+}
+
 static __rte_always_inline void downstream_forward_one(struct gazelle_stack *stack, uint32_t port_id, uint32_t queue_id)
 {
     int32_t ret;
@@ -671,6 +928,12 @@ static __rte_always_inline void downstream_forward_one(struct gazelle_stack *sta
     stack->stack_stats.tx += used_cnt;
 
     struct rte_mbuf *dst_bufs[GAZELLE_PACKET_READ_SIZE];
+    if (get_ltran_config()->dpdk.zero_copy == GAZELLE_ON) {
+        used_cnt = hold_tx_mbufs(stack, used_pkts, dst_bufs, used_cnt, &tx_bytes);
+        gazelle_ring_read_over(stack->tx_ring);
+        goto send;
+    }
+
     ret = rte_pktmbuf_alloc_bulk(pktmbuf_txpool[g_port_index], dst_bufs, used_cnt);
     if (ret != 0) {
         /* free pkts that not have be sent. */
@@ -687,6 +950,8 @@ static __rte_always_inline void downstream_forward_one(struct gazelle_stack *sta
     }
     gazelle_ring_read_over(stack->tx_ring);
 
+send:
+
     /* send packets anyway. */
     tx_pkts = 0;
 
@@ -720,27 +985,32 @@ static __rte_always_inline void downstream_forward_loop(uint32_t port_id, uint32
 
         stack_array = instance->stack_array;
         for (uint32_t j = 0; j < instance->stack_cnt; j++) {
-            if (stack_array[j] != NULL && INSTANCE_IS_ON(stack_array[j])) {
+            if (stack_array[j] != NULL && INSTANCE_IS_ON(stack_array[j]) &&
+                stack_forward_core(stack_array[j]) == g_core_index) {
                 downstream_forward_one(stack_array[j], port_id, queue_id);
             }
         }
     }
 }
 
-int32_t downstream_forward(uint16_t *port)
+int32_t downstream_forward(const struct forward_arg *arg)
 {
-    g_port_index = *port;
+    g_port_index = arg->port_index;
+    g_core_index = arg->core_id;
+    set_forward_core_id(arg->core_id);
     uint32_t port_id = get_bond_port()[g_port_index];
     uint32_t queue_num = get_ltran_config()->bond.tx_queue_num;
+    uint32_t core_num = get_ltran_config()->dpdk.forward_cores;
 
     while (get_ltran_stop_flag() != GAZELLE_TRUE) {
-        /* kni rx means read from kni and send to nic */
+        /* kni rx means read from kni and send to nic, kni_process_rx sends by tx queue 0 */
         if (get_ltran_config()->dpdk.kni_switch == GAZELLE_ON &&
-            get_kni_started()) {
+            get_kni_started() && g_core_index == 0) {
             kni_process_rx(g_port_index);
         }
 
-        for (uint32_t queue_id = 0; queue_id < queue_num; queue_id++) {
+        /* tx queue q is used by forward core q % core_num */
+        for (uint32_t queue_id = g_core_index; queue_id < queue_num; queue_id += core_num) {
             downstream_forward_loop(port_id, queue_id);
         }
         /* avoid control_thread free memory when we visit tx_ring */
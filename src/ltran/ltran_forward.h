@@ -13,7 +13,13 @@
 #ifndef __GAZELLE_FORWORD_H__
 #define __GAZELLE_FORWORD_H__
 
-void upstream_forward(const uint16_t *port);
-int32_t downstream_forward(uint16_t *port);
+struct forward_arg {
+    uint16_t port_index;
+    uint32_t core_id;
+};
+
+void upstream_forward(const struct forward_arg *arg);
+int32_t downstream_forward(const struct forward_arg *arg);
+int32_t forward_ctrl_ring_init(void);
 
 #endif /* ifndef __GAZELLE_FORWORD_H__ */
@@ -31,8 +31,14 @@
 #include "gazelle_base_func.h"
 #include "ltran_instance.h"
 
-volatile unsigned long g_tx_loop_count __rte_cache_aligned;
-volatile unsigned long g_rx_loop_count __rte_cache_aligned;
+/* every forward core counts its own loops, cache aligned to avoid false sharing between cores */
+struct forward_loop_count {
+    volatile unsigned long count;
+} __rte_cache_aligned;
+
+static struct forward_loop_count g_tx_loop_count[GAZELLE_MAX_FORWARD_CORES];
+static struct forward_loop_count g_rx_loop_count[GAZELLE_MAX_FORWARD_CORES];
+static __thread uint32_t g_forward_core_id;
 
 struct gazelle_instance_mgr *g_instance_mgr = NULL;
 
@@ -40,24 +46,34 @@ static void gazelle_set_instance_null_by_pid(struct gazelle_instance_mgr *mgr, u
 static void handle_stack_logout(struct gazelle_instance *instance, const struct gazelle_stack *stack);
 static int32_t simple_response(int32_t fd, enum response_type type);
 
+void set_forward_core_id(uint32_t core_id)
+{
+    g_forward_core_id = core_id;
+}
+
+uint32_t get_forward_core_id(void)
+{
+    return g_forward_core_id;
+}
+
 void set_tx_loop_count(void)
 {
-    g_tx_loop_count++;
+    g_tx_loop_count[g_forward_core_id].count++;
 }
 
-unsigned long get_tx_loop_count(void)
+unsigned long get_tx_loop_count(uint32_t core_id)
 {
-    return g_tx_loop_count;
+    return g_tx_loop_count[core_id].count;
 }
 
 void set_rx_loop_count(void)
 {
-    g_rx_loop_count++;
+    g_rx_loop_count[g_forward_core_id].count++;
 }
 
-unsigned long get_rx_loop_count(void)
+unsigned long get_rx_loop_count(uint32_t core_id)
 {
-    return g_rx_loop_count;
+    return g_rx_loop_count[core_id].count;
 }
 
 struct gazelle_instance_mgr *get_instance_mgr(void)
@@ -625,12 +641,21 @@ END:
 
 static inline void wait_forward_done(void)
 {
-    /* wait tx_loop_count and rx_loop_count change to avoid free using memory */
-    unsigned long tmp_rx_loop_count = get_rx_loop_count();
-    unsigned long tmp_tx_loop_count = get_tx_loop_count();
-    while ((tmp_tx_loop_count == get_tx_loop_count()) ||
-           (tmp_rx_loop_count == get_rx_loop_count())) {
-        continue;
+    uint32_t core_num = get_ltran_config()->dpdk.forward_cores;
+    unsigned long tmp_rx_loop_count[GAZELLE_MAX_FORWARD_CORES];
+    unsigned long tmp_tx_loop_count[GAZELLE_MAX_FORWARD_CORES];
+
+    for (uint32_t i = 0; i < core_num; i++) {
+        tmp_rx_loop_count[i] = get_rx_loop_count(i);
+        tmp_tx_loop_count[i] = get_tx_loop_count(i);
+    }
+
+    /* wait tx_loop_count and rx_loop_count of every forward core change to avoid free using memory */
+    for (uint32_t i = 0; i < core_num; i++) {
+        while ((tmp_tx_loop_count[i] == get_tx_loop_count(i)) ||
+               (tmp_rx_loop_count[i] == get_rx_loop_count(i))) {
+            continue;
+        }
     }
 }
 
@@ -699,6 +724,9 @@ void handle_instance_logout(uint32_t pid)
     gazelle_set_instance_null_by_pid(instance_mgr, pid);
     rte_mb();
     wait_forward_done();
+    /* reg ring msg of this instance may have been passed to other forward cores in the last loop,
+       wait one more loop to make sure they are handled */
+    wait_forward_done();
     rte_mb();
 
     switch (instance->reg_state) {
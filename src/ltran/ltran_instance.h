@@ -65,11 +65,15 @@ struct gazelle_instance_mgr {
 #define INSTANCE_REG_TICK_INIT_VAL  (0)
 int32_t *instance_cur_tick_init_val(void);
 
+/* index of the forward core which current thread works for, 0 for non-forward threads */
+void set_forward_core_id(uint32_t core_id);
+uint32_t get_forward_core_id(void);
+
 void set_tx_loop_count(void);
-unsigned long get_tx_loop_count(void);
+unsigned long get_tx_loop_count(uint32_t core_id);
 
 void set_rx_loop_count(void);
-unsigned long get_rx_loop_count(void);
+unsigned long get_rx_loop_count(uint32_t core_id);
 
 void set_instance_mgr(struct gazelle_instance_mgr *instance);
 struct gazelle_instance_mgr *get_instance_mgr(void);
@@ -38,6 +38,8 @@
 #define PARAM_BOND_PORTS                "bond_ports"
 #define PARAM_BOND_MTU                  "bond_mtu"
 #define PARAM_KNI_SWITCH                "kni_switch"
+#define PARAM_FORWARD_ZERO_COPY         "forward_zero_copy"
+#define PARAM_FORWARD_CORES             "forward_cores"
 #define PARAM_BOND_TX_QUEUE_NUM         "bond_tx_queue_num"
 #define PARAM_BOND_RX_QUEUE_NUM         "bond_rx_queue_num"
 #define PARAM_BOND_MACS                 "bond_macs"
@@ -512,6 +514,52 @@ static int32_t parse_kni_switch(const config_t *config, const char *key, struct
     return GAZELLE_OK;
 }
 
+static int32_t parse_forward_zero_copy(const config_t *config, const char *key, struct ltran_config *ltran_config)
+{
+    int32_t ret;
+    int32_t zero_copy = GAZELLE_OFF;
+    ret = config_lookup_int(config, key, &zero_copy);
+    if (ret == 0) {
+        ltran_config->dpdk.zero_copy = GAZELLE_OFF;
+        return GAZELLE_OK;
+    }
+
+    if ((zero_copy != GAZELLE_ON) && (zero_copy != GAZELLE_OFF)) {
+        gazelle_set_errno(GAZELLE_ERANGE);
+        return GAZELLE_ERR;
+    }
+
+    ltran_config->dpdk.zero_copy = zero_copy;
+    return GAZELLE_OK;
+}
+
+static int32_t parse_forward_cores(const config_t *config, const char *key, struct ltran_config *ltran_config)
+{
+    int32_t ret;
+    int32_t forward_cores = GAZELLE_FORWARD_CORES_DEFAULT;
+    ret = config_lookup_int(config, key, &forward_cores);
+    if (ret == 0) {
+        forward_cores = GAZELLE_FORWARD_CORES_DEFAULT;
+    }
+
+    if ((forward_cores < GAZELLE_FORWARD_CORES_MIN) || (forward_cores > GAZELLE_MAX_FORWARD_CORES)) {
+        gazelle_set_errno(GAZELLE_ERANGE);
+        syslog(LOG_ERR, "Err: forward_cores out of range: %d ~ %d.\n", GAZELLE_FORWARD_CORES_MIN,
+            GAZELLE_MAX_FORWARD_CORES);
+        return GAZELLE_ERR;
+    }
+    ltran_config->dpdk.forward_cores = (uint32_t)forward_cores;
+
+    /* every forward core owns at least one rx queue and one tx queue of bond port */
+    if (ltran_config->bond.rx_queue_num < (uint32_t)forward_cores) {
+        ltran_config->bond.rx_queue_num = (uint32_t)forward_cores;
+    }
+    if (ltran_config->bond.tx_queue_num < (uint32_t)forward_cores) {
+        ltran_config->bond.tx_queue_num = (uint32_t)forward_cores;
+    }
+    return GAZELLE_OK;
+}
+
 static int32_t parse_tcp_conn_scan_interval(const config_t *config, const char *key, struct ltran_config *ltran_config)
 {
     int32_t ret;
@@ -654,8 +702,10 @@ struct param_parser g_param_parse_tbl[] = {
     {PARAM_BOND_MACS,               parse_bond_macs},
     {PARAM_BOND_RX_QUEUE_NUM,       parse_bond_rx_queue_num},
     {PARAM_BOND_TX_QUEUE_NUM,       parse_bond_tx_queue_num},
+    {PARAM_FORWARD_CORES,           parse_forward_cores},
     {PARAM_TCP_CONN_SCAN_INTERVAL,  parse_tcp_conn_scan_interval},
     {PARAM_KNI_SWITCH,              parse_kni_switch},
+    {PARAM_FORWARD_ZERO_COPY,       parse_forward_zero_copy},
     {PARAM_UNIX_PREFIX,             parse_unix_prefix},
     {PARAM_RX_MBUF_POOL_SIZE,       parse_rx_mbuf_pool_size},
     {PARAM_TX_MBUF_POOL_SIZE,       parse_tx_mbuf_pool_size},
@@ -24,6 +24,8 @@ struct ltran_config {
         char **dpdk_argv;
         int32_t dpdk_argc;
         int32_t kni_switch;
+        int32_t zero_copy;
+        uint32_t forward_cores;
         uint64_t rx_offload;
         uint64_t tx_offload;
     } dpdk;
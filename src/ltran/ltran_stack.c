@@ -132,6 +132,7 @@ struct gazelle_stack *gazelle_stack_add_by_tid(struct gazelle_stack_htable *stac
     stack->tid = tid;
     stack->instance_reg_tick = INSTANCE_REG_TICK_INIT_VAL;
     stack->instance_cur_tick = instance_cur_tick_init_val();
+    rte_spinlock_init(&stack->rx_lock);
 
     hlist_add_head(&stack->stack_node, &stack_hbucket->chain);
     stack_htable->cur_stack_num++;
@@ -148,7 +149,7 @@ void gazelle_stack_del_by_tid(struct gazelle_stack_htable *stack_htable, uint32_
     struct hlist_head *head = NULL;
     uint32_t backup_size;
     uint32_t index;
-    uint32_t i;
+    uint32_t i, j;
 
     stack_hbucket = gazelle_stack_hbucket_get_by_tid(stack_htable, tid);
     if (stack_hbucket == NULL) {
@@ -168,9 +169,12 @@ void gazelle_stack_del_by_tid(struct gazelle_stack_htable *stack_htable, uint32_
 
     backup_size = PACKET_READ_SIZE * BACKUP_SIZE_FACTOR;
     /* free mubfs used by lstack */
-    for (i = 0; i < stack->pkt_cnt; i++) {
-        if (stack->pkt_buf[i] != NULL) {
-            rte_pktmbuf_free(stack->pkt_buf[i]);
+    for (j = 0; j < GAZELLE_MAX_FORWARD_CORES; j++) {
+        struct gazelle_rx_stage *rx_stage = &stack->rx_stage[j];
+        for (i = 0; i < rx_stage->pkt_cnt; i++) {
+            if (rx_stage->pkt_buf[i] != NULL) {
+                rte_pktmbuf_free(rx_stage->pkt_buf[i]);
+            }
         }
     }
     for (i = 0; i < stack->backup_pkt_cnt; i++) {
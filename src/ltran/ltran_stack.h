@@ -14,12 +14,19 @@
 #define __GAZELLE_STACK_H__
 
 #include <lwip/hlist.h>
+#include <rte_spinlock.h>
 
 #include "ltran_stat.h"
 
 struct rte_ring;
 struct rte_mbuf;
 
+/* rx pkts of one forward core, flushed into rx_ring in batch */
+struct gazelle_rx_stage {
+    struct rte_mbuf *pkt_buf[PACKET_READ_SIZE];
+    uint32_t pkt_cnt;
+};
+
 struct gazelle_stack {
     // key
     int32_t index;
@@ -33,8 +40,9 @@ struct gazelle_stack {
     struct rte_ring *reg_ring;
     struct rte_ring *tx_ring;
     struct rte_ring *rx_ring;
-    struct rte_mbuf *pkt_buf[PACKET_READ_SIZE];
-    uint32_t pkt_cnt;
+    struct gazelle_rx_stage rx_stage[GAZELLE_MAX_FORWARD_CORES];
+    /* rx_ring, backup_pkt_buf and rx stats are shared by forward cores */
+    rte_spinlock_t rx_lock;
     struct rte_mbuf *backup_pkt_buf[PACKET_READ_SIZE * BACKUP_SIZE_FACTOR];
     uint32_t backup_pkt_cnt;
     uint32_t backup_start;
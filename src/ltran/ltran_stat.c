@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <arpa/inet.h>
 #include <rte_ring.h>
+#include <securec.h>
 
 #include "ltran_tcp_sock.h"
 #include "ltran_tcp_conn.h"
@@ -25,6 +26,7 @@
 #include "ltran_timer.h"
 #include "ltran_ethdev.h"
 #include "ltran_base.h"
+#include "ltran_param.h"
 #include "ltran_stack.h"
 #include "dpdk_common.h"
 #include "ltran_forward.h"
@@ -39,7 +41,8 @@
 static uint64_t g_start_time_stamp = 0;
 static int32_t g_start_latency = GAZELLE_OFF;
 volatile int32_t g_ltran_stop_flag = GAZELLE_FALSE;
-static struct statistics g_statistics;
+/* every forward core updates its own statistics, gazellectl aggregates them */
+static struct statistics g_statistics[GAZELLE_MAX_FORWARD_CORES];
 
 uint64_t get_start_time_stamp(void)
 {
@@ -70,6 +73,9 @@ void set_start_latency_flag(int32_t flag)
                 stack_array[j]->stack_stats.latency_max = 0;
                 stack_array[j]->stack_stats.latency_pkts = 0;
                 stack_array[j]->stack_stats.latency_total = 0;
+                (void)memset_s(stack_array[j]->stack_stats.latency_hist,
+                    sizeof(stack_array[j]->stack_stats.latency_hist), 0,
+                    sizeof(stack_array[j]->stack_stats.latency_hist));
             }
         }
     }
@@ -95,34 +101,49 @@ int32_t get_ltran_stop_flag(void)
 
 struct statistics* get_statistics(void)
 {
-    return &g_statistics;
+    return &g_statistics[get_forward_core_id()];
 }
 
-static int32_t gazelle_filling_ltran_stat_total(struct gazelle_stat_ltran_total *stat,
-    const struct statistics *total_stat, uint32_t port_num)
+struct statistics *get_statistics_by_core(uint32_t core_id)
 {
-    if ((stat == NULL) || (total_stat == NULL)) {
+    return &g_statistics[core_id];
+}
+
+static void gazelle_filling_ltran_stat_port(struct gazelle_stat_ltran_port *port_stat,
+    const struct gazelle_stat_ltran_port *total_stat)
+{
+    port_stat->tx = total_stat->tx;
+    port_stat->rx = total_stat->rx;
+    port_stat->tx_bytes = total_stat->tx_bytes;
+    port_stat->rx_bytes = total_stat->rx_bytes;
+    port_stat->kni_pkt = total_stat->kni_pkt;
+    port_stat->tx_drop = total_stat->tx_drop;
+    port_stat->arp_pkt = total_stat->arp_pkt;
+    port_stat->icmp_pkt = total_stat->icmp_pkt;
+    port_stat->loglevel = rte_log_get_level(RTE_LOGTYPE_LTRAN);
+    port_stat->tcp_pkt = total_stat->tcp_pkt;
+
+    for (int32_t j = 0; j <= GAZELLE_PACKET_READ_SIZE; j++) {
+        port_stat->rx_iter_arr[j] = total_stat->rx_iter_arr[j];
+    }
+}
+
+static int32_t gazelle_filling_ltran_stat_total(struct gazelle_stat_ltran_total *stat, uint32_t port_num,
+    uint32_t core_num)
+{
+    if ((stat == NULL) || (port_num > GAZELLE_MAX_BOND_NUM) || (core_num > GAZELLE_MAX_FORWARD_CORES)) {
         return GAZELLE_ERR;
     }
 
-    for (uint32_t i = 0; i < port_num; i++) {
-        stat->port_list[i].tx = total_stat->port_stats[i].tx;
-        stat->port_list[i].rx = total_stat->port_stats[i].rx;
-        stat->port_list[i].tx_bytes = total_stat->port_stats[i].tx_bytes;
-        stat->port_list[i].rx_bytes = total_stat->port_stats[i].rx_bytes;
-        stat->port_list[i].kni_pkt = total_stat->port_stats[i].kni_pkt;
-        stat->port_list[i].tx_drop = total_stat->port_stats[i].tx_drop;
-        stat->port_list[i].arp_pkt = total_stat->port_stats[i].arp_pkt;
-        stat->port_list[i].icmp_pkt = total_stat->port_stats[i].icmp_pkt;
-        stat->port_list[i].loglevel = rte_log_get_level(RTE_LOGTYPE_LTRAN);
-        stat->port_list[i].tcp_pkt = total_stat->port_stats[i].tcp_pkt;
-
-        for (int32_t j = 0; j <= GAZELLE_PACKET_READ_SIZE; j++) {
-            stat->port_list[i].rx_iter_arr[j] = total_stat->port_stats[i].rx_iter_arr[j];
+    for (uint32_t core = 0; core < core_num; core++) {
+        const struct statistics *total_stat = get_statistics_by_core(core);
+        for (uint32_t i = 0; i < port_num; i++) {
+            gazelle_filling_ltran_stat_port(&stat->core_list[core][i], &total_stat->port_stats[i]);
         }
     }
 
     stat->port_num = port_num;
+    stat->core_num = core_num;
     return GAZELLE_OK;
 }
 
@@ -190,6 +211,8 @@ static int32_t gazelle_filling_lstack_stat_total(struct gazelle_stat_lstack_tota
     stat->backup_mbuf_cnt = stack->backup_pkt_cnt;
     stat->latency_pkts = stack->stack_stats.latency_pkts;
     stat->latency_total = stack->stack_stats.latency_total;
+    (void)memcpy_s(stat->latency_hist, sizeof(stat->latency_hist), stack->stack_stats.latency_hist,
+        sizeof(stack->stack_stats.latency_hist));
     stat->reg_ring_cnt = gazelle_ring_readable_count(stack->reg_ring);
     stat->rx_ring_cnt = gazelle_ring_readover_count(stack->rx_ring);
     stat->tx_ring_cnt = gazelle_ring_readable_count(stack->tx_ring);
@@ -201,8 +224,8 @@ void handle_resp_ltran_total(int32_t fd)
 {
     int32_t ret;
     uint32_t bond_num = get_bond_num();
-    struct gazelle_stat_ltran_total stat;
-    ret = gazelle_filling_ltran_stat_total(&stat, get_statistics(), bond_num);
+    struct gazelle_stat_ltran_total stat = {0};
+    ret = gazelle_filling_ltran_stat_total(&stat, bond_num, get_ltran_config()->dpdk.forward_cores);
     if (ret != GAZELLE_OK) {
         LTRAN_ERR("filling ltran stat total failed. ret=%d\n", ret);
         return;
@@ -211,23 +234,55 @@ void handle_resp_ltran_total(int32_t fd)
     (void)write_specied_len(fd, (char *)&stat, sizeof(struct gazelle_stat_ltran_total));
 }
 
+/* listen socks are same in every forward core, but conns of them are counted separately */
+static void ltran_sock_conn_num_add(struct gazelle_stat_forward_table *forward_table, uint32_t core_id)
+{
+    struct gazelle_tcp_sock *tcp_sock = NULL;
+    struct hlist_node *node = NULL;
+    struct hlist_head *head = NULL;
+    struct gazelle_tcp_sock_htable *sock_htable = gazelle_get_tcp_sock_htable_by_core(core_id);
+    uint32_t conn_num = (forward_table->conn_num < GAZELLE_LSTACK_MAX_CONN) ?
+        forward_table->conn_num : GAZELLE_LSTACK_MAX_CONN;
+
+    if (gazelle_sock_htable_read_begin(sock_htable) != 0) {
+        LTRAN_ERR("read tcp_sock_htable: lock failed, errno %d\n", errno);
+        return;
+    }
+
+    for (int32_t i = 0; i < GAZELLE_MAX_TCP_SOCK_HTABLE_SIZE; i++) {
+        head = &sock_htable->array[i].chain;
+        gazelle_sock_hlist_for_each(tcp_sock, node, head) {
+            for (uint32_t j = 0; j < conn_num; j++) {
+                struct gazelle_stat_forward_table_info *info = &forward_table->conn_list[j];
+                if (info->dst_ip == tcp_sock->ip && info->tid == tcp_sock->tid &&
+                    info->dst_port == ntohs(tcp_sock->port)) {
+                    info->conn_num += tcp_sock->tcp_con_num;
+                    break;
+                }
+            }
+        }
+    }
+
+    gazelle_sock_htable_read_end(sock_htable);
+}
+
 void handle_resp_ltran_sock(int32_t fd)
 {
     struct gazelle_tcp_sock *tcp_sock = NULL;
     struct hlist_node *node = NULL;
     struct hlist_head *head = NULL;
-    struct gazelle_tcp_sock_htable *sock_htable = gazelle_get_tcp_sock_htable();
+    struct gazelle_tcp_sock_htable *sock_htable = gazelle_get_tcp_sock_htable_by_core(0);
     struct gazelle_stat_forward_table forward_table = {0};
     int32_t index = 0;
 
-    if (pthread_mutex_lock(&sock_htable->mlock) != 0) {
+    if (gazelle_sock_htable_read_begin(sock_htable) != 0) {
         LTRAN_ERR("read tcp_sock_htable: lock failed, errno %d\n", errno);
         return;
     }
 
     for (int32_t i = 0; i < GAZELLE_MAX_TCP_SOCK_HTABLE_SIZE; i++) {
         head = &sock_htable->array[i].chain;
-        hlist_for_each_entry(tcp_sock, node, head, tcp_sock_node) {
+        gazelle_sock_hlist_for_each(tcp_sock, node, head) {
             if (index < GAZELLE_LSTACK_MAX_CONN) {
                 forward_table.conn_list[index].dst_ip = tcp_sock->ip;
                 forward_table.conn_list[index].tid = tcp_sock->tid;
@@ -240,47 +295,53 @@ void handle_resp_ltran_sock(int32_t fd)
     }
     forward_table.conn_num = (uint32_t)index;
 
-    if (pthread_mutex_unlock(&sock_htable->mlock) != 0) {
-        LTRAN_WARN("read tcp_sock_htable: unlock failed, errno %d.\n", errno);
+    gazelle_sock_htable_read_end(sock_htable);
+
+    for (uint32_t core = 1; core < get_ltran_config()->dpdk.forward_cores; core++) {
+        ltran_sock_conn_num_add(&forward_table, core);
     }
     (void)write_specied_len(fd, (char *)&forward_table, sizeof(struct gazelle_stat_forward_table));
 }
 
-void handle_resp_ltran_conn(int32_t fd)
+static int32_t ltran_conn_table_fill(struct gazelle_stat_forward_table *forward_table, int32_t index,
+    uint32_t core_id)
 {
-    struct hlist_node *node = NULL;
-    struct hlist_head *head = NULL;
-    struct gazelle_tcp_conn_htable *conn_htable = gazelle_get_tcp_conn_htable();
-    struct gazelle_tcp_sock_htable *sock_htable = gazelle_get_tcp_sock_htable();
-    struct gazelle_stat_forward_table forward_table = {0};
+    struct gazelle_tcp_conn_htable *conn_htable = gazelle_get_tcp_conn_htable_by_core(core_id);
     struct gazelle_tcp_conn *conn = NULL;
-    int32_t index = 0;
+    uint32_t pos = 0;
 
-    if (pthread_mutex_lock(&sock_htable->mlock) != 0) {
-        LTRAN_ERR("read tcp_conn_htable: lock failed, errno %d.\n", errno);
-        return;
+    if (conn_htable == NULL || gazelle_conn_htable_read_begin(conn_htable) != 0) {
+        return index;
     }
 
-    for (int32_t i = 0; i < GAZELLE_MAX_CONN_HTABLE_SIZE; i++) {
-        head = &conn_htable->array[i].chain;
-        hlist_for_each_entry(conn, node, head, conn_node) {
-            if (index < GAZELLE_LSTACK_MAX_CONN) {
-                forward_table.conn_list[index].protocol = conn->quintuple.protocol;
-                forward_table.conn_list[index].tid = conn->tid;
-                forward_table.conn_list[index].dst_ip = conn->quintuple.dst_ip;
-                forward_table.conn_list[index].src_ip = conn->quintuple.src_ip;
-                forward_table.conn_list[index].dst_port = ntohs(conn->quintuple.dst_port);
-                forward_table.conn_list[index].src_port = ntohs(conn->quintuple.src_port);
-            }
-            /* show detail info in range and show total num */
-            index++;
+    /* conns stay in slab chunks until htable destroy, bucket arrays stay until read end */
+    while ((conn = gazelle_conn_htable_next(conn_htable, &pos)) != NULL) {
+        if (index < GAZELLE_LSTACK_MAX_CONN) {
+            forward_table->conn_list[index].protocol = conn->quintuple.protocol;
+            forward_table->conn_list[index].tid = conn->tid;
+            forward_table->conn_list[index].dst_ip = conn->quintuple.dst_ip;
+            forward_table->conn_list[index].src_ip = conn->quintuple.src_ip;
+            forward_table->conn_list[index].dst_port = ntohs(conn->quintuple.dst_port);
+            forward_table->conn_list[index].src_port = ntohs(conn->quintuple.src_port);
         }
+        /* show detail info in range and show total num */
+        index++;
     }
-    forward_table.conn_num = (uint32_t)index;
 
-    if (pthread_mutex_unlock(&sock_htable->mlock) != 0) {
-        LTRAN_WARN("read tcp_conn_htable: unlock failed, errno %d.\n", errno);
+    gazelle_conn_htable_read_end(conn_htable);
+    return index;
+}
+
+void handle_resp_ltran_conn(int32_t fd)
+{
+    struct gazelle_stat_forward_table forward_table = {0};
+    int32_t index = 0;
+
+    for (uint32_t core = 0; core < get_ltran_config()->dpdk.forward_cores; core++) {
+        index = ltran_conn_table_fill(&forward_table, index, core);
     }
+    forward_table.conn_num = (uint32_t)index;
+
     (void)write_specied_len(fd, (char *)&forward_table, sizeof(struct gazelle_stat_forward_table));
 }
 
@@ -18,6 +18,7 @@
 #include <rte_common.h>
 
 #include "gazelle_opt.h"
+#include "gazelle_dfx_msg.h"
 
 /*
  * When doing reads from the NIC or the client queues,
@@ -98,6 +99,7 @@ struct gazelle_stat_lstack_total {
     uint64_t latency_pkts;
     uint64_t latency_min;
     uint64_t latency_max;
+    uint64_t latency_hist[GAZELLE_LATENCY_BUCKETS];
     uint32_t backup_mbuf_cnt;
     uint32_t tx_ring_cnt;
     uint32_t rx_ring_cnt;
@@ -112,7 +114,10 @@ struct statistics {
 /* ltran statistics structure */
 struct gazelle_stat_ltran_total {
     uint32_t port_num;
+    uint32_t core_num;
+    /* sum of core_list, aggregated by gazellectl */
     struct gazelle_stat_ltran_port port_list[GAZELLE_MAX_PORT_NUM];
+    struct gazelle_stat_ltran_port core_list[GAZELLE_MAX_FORWARD_CORES][GAZELLE_MAX_BOND_NUM];
 };
 
 struct gazelle_stat_ltran_ip {
@@ -141,7 +146,9 @@ uint64_t get_start_time_stamp(void);
 void set_start_latency_flag(int32_t flag);
 void set_ltran_stop_flag(int32_t flag);
 int32_t get_ltran_stop_flag(void);
+/* statistics of the forward core current thread works for */
 struct statistics *get_statistics(void);
+struct statistics *get_statistics_by_core(uint32_t core_id);
 
 struct gazelle_stat_msg_request;
 void handle_resp_ltran_latency(int32_t fd);
@@ -10,85 +10,350 @@
 * See the Mulan PSL v2 for more details.
 */
 
+#include <stdlib.h>
 #include <securec.h>
 
 #include <rte_malloc.h>
+#include <rte_prefetch.h>
 
 #include "ltran_jhash.h"
+#include "ltran_base.h"
 #include "ltran_instance.h"
 #include "ltran_tcp_conn.h"
+#include "gazelle_base_func.h"
 
-struct gazelle_tcp_conn_htable *g_tcp_conn_htable = NULL;
+/* each forward core owns one conn htable, conns are partitioned by nic rss queue */
+static struct gazelle_tcp_conn_htable *g_tcp_conn_htable[GAZELLE_MAX_FORWARD_CORES] = {NULL};
 struct gazelle_tcp_conn_htable *gazelle_get_tcp_conn_htable(void)
 {
-    return g_tcp_conn_htable;
+    return g_tcp_conn_htable[get_forward_core_id()];
 }
 
 void gazelle_set_tcp_conn_htable(struct gazelle_tcp_conn_htable *htable)
 {
-    g_tcp_conn_htable = htable;
+    g_tcp_conn_htable[get_forward_core_id()] = htable;
+}
+
+struct gazelle_tcp_conn_htable *gazelle_get_tcp_conn_htable_by_core(uint32_t core_id)
+{
+    return g_tcp_conn_htable[core_id];
+}
+
+void gazelle_set_tcp_conn_htable_by_core(uint32_t core_id, struct gazelle_tcp_conn_htable *htable)
+{
+    g_tcp_conn_htable[core_id] = htable;
+}
+
+static __rte_always_inline struct gazelle_tcp_conn *conn_slab_entry(const struct gazelle_tcp_conn_htable *conn_htable,
+    uint32_t idx)
+{
+    idx--;
+    return &conn_htable->chunks[idx >> GAZELLE_CONN_SLAB_CHUNK_SHIFT][idx & GAZELLE_CONN_SLAB_CHUNK_MASK];
+}
+
+static __rte_always_inline bool conn_slot_used(uint32_t idx)
+{
+    return idx != GAZELLE_CONN_SLOT_EMPTY && idx != GAZELLE_CONN_SLOT_DELETED;
+}
+
+static __rte_always_inline uint32_t conn_hash(const struct gazelle_quintuple *quintuple)
+{
+    return tuple_hash_fn(quintuple->src_ip, quintuple->src_port, quintuple->dst_ip, quintuple->dst_port);
+}
+
+static __rte_always_inline uint16_t conn_sig(uint32_t hash)
+{
+    return (uint16_t)(hash >> 16); /* 16: bucket is selected by low bits, sig use high bits */
+}
+
+static struct gazelle_tcp_conn *conn_slab_alloc(struct gazelle_tcp_conn_htable *conn_htable)
+{
+    struct gazelle_tcp_conn *conn = NULL;
+
+    if (conn_htable->free_head == 0) {
+        if (conn_htable->chunk_num == conn_htable->chunk_max) {
+            return NULL;
+        }
+
+        struct gazelle_tcp_conn *chunk = rte_malloc(NULL, sizeof(struct gazelle_tcp_conn) *
+            GAZELLE_CONN_SLAB_CHUNK_SIZE, RTE_CACHE_LINE_SIZE);
+        if (chunk == NULL) {
+            return NULL;
+        }
+
+        uint32_t base = conn_htable->chunk_num << GAZELLE_CONN_SLAB_CHUNK_SHIFT;
+        for (uint32_t i = GAZELLE_CONN_SLAB_CHUNK_SIZE; i > 0; i--) {
+            chunk[i - 1].slab_idx = base + i;
+            chunk[i - 1].free_next = conn_htable->free_head;
+            conn_htable->free_head = base + i;
+        }
+        conn_htable->chunks[conn_htable->chunk_num++] = chunk;
+    }
+
+    conn = conn_slab_entry(conn_htable, conn_htable->free_head);
+    conn_htable->free_head = conn->free_next;
+    return conn;
+}
+
+static void conn_slab_free(struct gazelle_tcp_conn_htable *conn_htable, struct gazelle_tcp_conn *conn)
+{
+    conn->free_next = conn_htable->free_head;
+    conn_htable->free_head = conn->slab_idx;
+}
+
+static int32_t conn_slot_insert(struct gazelle_tcp_conn_hbucket *buckets, uint32_t bucket_mask,
+    struct gazelle_tcp_conn *conn, bool *reuse_deleted)
+{
+    uint32_t bucket_idx = conn->hash & bucket_mask;
+
+    for (uint32_t n = 0; n <= bucket_mask; n++) {
+        struct gazelle_tcp_conn_hbucket *bucket = &buckets[bucket_idx];
+        for (uint32_t i = 0; i < GAZELLE_CONN_BUCKET_ENTRIES; i++) {
+            if (conn_slot_used(bucket->idx[i])) {
+                continue;
+            }
+            *reuse_deleted = (bucket->idx[i] == GAZELLE_CONN_SLOT_DELETED);
+            bucket->idx[i] = conn->slab_idx;
+            bucket->sig[i] = conn_sig(conn->hash);
+            conn->slot = bucket_idx * GAZELLE_CONN_BUCKET_ENTRIES + i;
+            return 0;
+        }
+        bucket_idx = (bucket_idx + 1) & bucket_mask;
+    }
+
+    return -1;
+}
+
+static struct gazelle_tcp_conn_hbucket *conn_buckets_alloc(uint32_t bucket_num)
+{
+    size_t size = sizeof(struct gazelle_tcp_conn_hbucket) * bucket_num;
+    struct gazelle_tcp_conn_hbucket *buckets = rte_malloc(NULL, size, RTE_CACHE_LINE_SIZE);
+    if (buckets == NULL) {
+        return NULL;
+    }
+
+    (void)memset_s(buckets, size, 0, size);
+    return buckets;
+}
+
+static int32_t conn_htable_rehash(struct gazelle_tcp_conn_htable *conn_htable, uint32_t bucket_num)
+{
+    struct gazelle_tcp_conn_hbucket *buckets = conn_buckets_alloc(bucket_num);
+    struct gazelle_tcp_conn_retired *retired = malloc(sizeof(struct gazelle_tcp_conn_retired));
+    uint32_t slot_num = (conn_htable->bucket_mask + 1) * GAZELLE_CONN_BUCKET_ENTRIES;
+    bool reuse_deleted;
+
+    if (buckets == NULL || retired == NULL) {
+        rte_free(buckets);
+        free(retired);
+        return -1;
+    }
+
+    for (uint32_t slot = 0; slot < slot_num; slot++) {
+        uint32_t idx = conn_htable->buckets[slot / GAZELLE_CONN_BUCKET_ENTRIES].idx[slot % GAZELLE_CONN_BUCKET_ENTRIES];
+        if (conn_slot_used(idx)) {
+            (void)conn_slot_insert(buckets, bucket_num - 1, conn_slab_entry(conn_htable, idx), &reuse_deleted);
+        }
+    }
+
+    /* bucket_mask never shrinks and is stored after buckets, a reader loading mask first
+     * indexes either array within bounds */
+    retired->buckets = conn_htable->buckets;
+    __atomic_store_n(&conn_htable->buckets, buckets, __ATOMIC_RELEASE);
+    __atomic_store_n(&conn_htable->bucket_mask, bucket_num - 1, __ATOMIC_RELEASE);
+    conn_htable->deleted_num = 0;
+
+    /* readers entered from now on can't see the old buckets */
+    retired->retire_epoch = conn_htable->epoch;
+    __atomic_store_n(&conn_htable->epoch, retired->retire_epoch + 1, __ATOMIC_RELEASE);
+    list_add_node(&conn_htable->retire_list, &retired->node);
+    gazelle_conn_htable_reclaim(conn_htable);
+    return 0;
+}
+
+void gazelle_conn_htable_reclaim(struct gazelle_tcp_conn_htable *conn_htable)
+{
+    struct gazelle_tcp_conn_retired *retired = NULL;
+    struct list_node *node = NULL;
+    struct list_node *temp = NULL;
+    uint64_t reader_epoch;
+
+    if (conn_htable->retire_list.next == &conn_htable->retire_list) {
+        return;
+    }
+
+    /* pairs with fence in gazelle_conn_htable_read_begin: either reader_epoch is seen here,
+     * or reader sees the new buckets */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    reader_epoch = __atomic_load_n(&conn_htable->reader_epoch, __ATOMIC_ACQUIRE);
+
+    list_for_each_safe(node, temp, &conn_htable->retire_list) {
+        retired = container_of(node, struct gazelle_tcp_conn_retired, node);
+        if (reader_epoch != 0 && reader_epoch <= retired->retire_epoch) {
+            continue;
+        }
+        list_del_node_null(node);
+        rte_free(retired->buckets);
+        free(retired);
+    }
+}
+
+int32_t gazelle_conn_htable_read_begin(struct gazelle_tcp_conn_htable *conn_htable)
+{
+    if (pthread_mutex_lock(&conn_htable->reader_lock) != 0) {
+        return -1;
+    }
+
+    __atomic_store_n(&conn_htable->reader_epoch, __atomic_load_n(&conn_htable->epoch, __ATOMIC_ACQUIRE),
+        __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return 0;
+}
+
+void gazelle_conn_htable_read_end(struct gazelle_tcp_conn_htable *conn_htable)
+{
+    __atomic_store_n(&conn_htable->reader_epoch, 0, __ATOMIC_RELEASE);
+    (void)pthread_mutex_unlock(&conn_htable->reader_lock);
+}
+
+/* keep load factor (used + deleted slots) under 3/4. double buckets when used slots exceed 1/2, otherwise
+ * rehash in place to clean deleted slots. the old buckets keep working if rehash fail. */
+static void conn_htable_expand(struct gazelle_tcp_conn_htable *conn_htable)
+{
+    uint32_t bucket_num = conn_htable->bucket_mask + 1;
+    uint64_t slot_num = (uint64_t)bucket_num * GAZELLE_CONN_BUCKET_ENTRIES;
+    uint64_t used = (uint64_t)conn_htable->cur_conn_num + 1;
+
+    if ((used + conn_htable->deleted_num) * 4 <= slot_num * 3) { /* 4, 3: load factor 3/4 */
+        return;
+    }
+
+    if (used * 2 > slot_num) { /* 2: used slots exceed 1/2 */
+        bucket_num <<= 1;
+    }
+    (void)conn_htable_rehash(conn_htable, bucket_num);
 }
 
 struct gazelle_tcp_conn_htable *gazelle_tcp_conn_htable_create(uint32_t max_conn_num)
 {
     struct gazelle_tcp_conn_htable *conn_htable = NULL;
-    uint32_t i;
 
     conn_htable = rte_malloc(NULL, sizeof(struct gazelle_tcp_conn_htable), RTE_CACHE_LINE_SIZE);
     if (conn_htable == NULL) {
         return NULL;
     }
 
-    for (i = 0; i < GAZELLE_MAX_CONN_HTABLE_SIZE; i++) {
-        INIT_HLIST_HEAD(&conn_htable->array[i].chain);
-        conn_htable->array[i].chain_size = 0;
+    if (pthread_mutex_init(&conn_htable->reader_lock, NULL) != 0) {
+        rte_free(conn_htable);
+        return NULL;
     }
+    /* reader_epoch 0 means no reader */
+    conn_htable->reader_epoch = 0;
+    conn_htable->epoch = 1;
+    init_list_node(&conn_htable->retire_list);
+
     conn_htable->cur_conn_num = 0;
     conn_htable->max_conn_num = max_conn_num;
+    conn_htable->deleted_num = 0;
+    conn_htable->bucket_mask = GAZELLE_CONN_HTABLE_INIT_SIZE - 1;
+    conn_htable->chunk_num = 0;
+    conn_htable->chunk_max = (max_conn_num + GAZELLE_CONN_SLAB_CHUNK_MASK) >> GAZELLE_CONN_SLAB_CHUNK_SHIFT;
+    conn_htable->free_head = 0;
+    gazelle_timer_wheel_init(&conn_htable->aging_wheel);
+
+    conn_htable->chunks = rte_malloc(NULL, sizeof(struct gazelle_tcp_conn *) * conn_htable->chunk_max, 0);
+    conn_htable->buckets = conn_buckets_alloc(GAZELLE_CONN_HTABLE_INIT_SIZE);
+    if (conn_htable->chunks == NULL || conn_htable->buckets == NULL) {
+        rte_free(conn_htable->chunks);
+        rte_free(conn_htable->buckets);
+        (void)pthread_mutex_destroy(&conn_htable->reader_lock);
+        rte_free(conn_htable);
+        return NULL;
+    }
 
     return conn_htable;
 }
 
-void gazelle_tcp_conn_htable_destroy(void)
+static void tcp_conn_htable_destroy(struct gazelle_tcp_conn_htable *conn_htable)
 {
-    struct hlist_node *node = NULL;
-    struct gazelle_tcp_conn *conn = NULL;
-    uint32_t i;
-    struct gazelle_tcp_conn_htable *conn_htable = g_tcp_conn_htable;
+    struct gazelle_tcp_conn_retired *retired = NULL;
+    struct list_node *node = NULL;
+    struct list_node *temp = NULL;
 
     if (conn_htable == NULL) {
         return;
     }
+    (void)pthread_mutex_destroy(&conn_htable->reader_lock);
 
-    for (i = 0; i < GAZELLE_MAX_CONN_HTABLE_SIZE; i++) {
-        node = conn_htable->array[i].chain.first;
-        while (node != NULL) {
-            conn = hlist_entry(node, typeof(*conn), conn_node);
-            node = node->next;
-            hlist_del_init(&conn->conn_node);
-            rte_free(conn);
-        }
+    list_for_each_safe(node, temp, &conn_htable->retire_list) {
+        retired = container_of(node, struct gazelle_tcp_conn_retired, node);
+        list_del_node_null(node);
+        rte_free(retired->buckets);
+        free(retired);
     }
 
-    g_tcp_conn_htable = NULL;
+    for (uint32_t i = 0; i < conn_htable->chunk_num; i++) {
+        rte_free(conn_htable->chunks[i]);
+    }
+    rte_free(conn_htable->chunks);
+    rte_free(conn_htable->buckets);
     rte_free(conn_htable);
 }
 
-struct gazelle_tcp_conn_hbucket *gazelle_conn_hbucket_get(struct gazelle_tcp_conn_htable *conn_htable,
-    const struct gazelle_quintuple *quintuple)
+void gazelle_tcp_conn_htable_destroy(void)
 {
-    uint32_t index;
-    index = tuple_hash_fn(quintuple->src_ip, quintuple->src_port, quintuple->dst_ip, quintuple->dst_port) %
-                           GAZELLE_MAX_CONN_HTABLE_SIZE;
-    return &conn_htable->array[index];
+    for (uint32_t i = 0; i < GAZELLE_MAX_FORWARD_CORES; i++) {
+        tcp_conn_htable_destroy(g_tcp_conn_htable[i]);
+        g_tcp_conn_htable[i] = NULL;
+    }
+}
+
+static __rte_always_inline struct gazelle_tcp_conn *conn_lookup(const struct gazelle_tcp_conn_htable *conn_htable,
+    const struct gazelle_quintuple *quintuple, uint32_t hash, bool check_instance)
+{
+    uint32_t bucket_mask = conn_htable->bucket_mask;
+    uint32_t bucket_idx = hash & bucket_mask;
+    uint16_t sig = conn_sig(hash);
+
+    /* conn is placed before the first bucket with empty slot in probe sequence */
+    for (uint32_t n = 0; n <= bucket_mask; n++) {
+        const struct gazelle_tcp_conn_hbucket *bucket = &conn_htable->buckets[bucket_idx];
+        bool has_empty = false;
+
+        for (uint32_t i = 0; i < GAZELLE_CONN_BUCKET_ENTRIES; i++) {
+            uint32_t idx = bucket->idx[i];
+            if (idx == GAZELLE_CONN_SLOT_EMPTY) {
+                has_empty = true;
+                continue;
+            }
+            if (idx == GAZELLE_CONN_SLOT_DELETED || bucket->sig[i] != sig) {
+                continue;
+            }
+
+            struct gazelle_tcp_conn *conn = conn_slab_entry(conn_htable, idx);
+            if (check_instance && !INSTANCE_IS_ON(conn)) {
+                continue;
+            }
+            if (memcmp(&conn->quintuple, quintuple, sizeof(struct gazelle_quintuple)) == 0) {
+                return conn;
+            }
+        }
+
+        if (has_empty) {
+            break;
+        }
+        bucket_idx = (bucket_idx + 1) & bucket_mask;
+    }
+
+    return NULL;
 }
 
 struct gazelle_tcp_conn *gazelle_conn_add_by_quintuple(struct gazelle_tcp_conn_htable *conn_htable,
     struct gazelle_quintuple *quintuple)
 {
     int32_t ret;
-    struct gazelle_tcp_conn_hbucket *conn_hbucket = NULL;
     struct gazelle_tcp_conn *conn = NULL;
+    bool reuse_deleted = false;
 
     /* avoid reinit */
     conn = gazelle_conn_get_by_quintuple(conn_htable, quintuple);
@@ -100,29 +365,34 @@ struct gazelle_tcp_conn *gazelle_conn_add_by_quintuple(struct gazelle_tcp_conn_h
         return NULL;
     }
 
-    conn_hbucket = gazelle_conn_hbucket_get(conn_htable, quintuple);
-    if (conn_hbucket == NULL) {
-        return NULL;
-    }
-
-    conn = rte_malloc(NULL, sizeof(struct gazelle_tcp_conn), RTE_CACHE_LINE_SIZE);
+    conn = conn_slab_alloc(conn_htable);
     if (conn == NULL) {
         return NULL;
     }
 
     ret = memcpy_s(&conn->quintuple, sizeof(struct gazelle_quintuple), quintuple, sizeof(*quintuple));
     if (ret != 0) {
-        rte_free(conn);
+        conn_slab_free(conn_htable, conn);
+        return NULL;
+    }
+
+    conn->hash = conn_hash(quintuple);
+    conn_htable_expand(conn_htable);
+    if (conn_slot_insert(conn_htable->buckets, conn_htable->bucket_mask, conn, &reuse_deleted) != 0) {
+        conn_slab_free(conn_htable, conn);
         return NULL;
     }
+    if (reuse_deleted) {
+        conn_htable->deleted_num--;
+    }
 
     conn->instance_reg_tick = INSTANCE_REG_TICK_INIT_VAL;
     conn->instance_cur_tick = instance_cur_tick_init_val();
     conn->sock = NULL;
-
-    hlist_add_head(&conn->conn_node, &conn_hbucket->chain);
+    conn->conn_timeout = GAZELLE_CONN_TIMEOUT;
+    gazelle_timer_init(&conn->aging_timer);
+    gazelle_timer_add(&conn_htable->aging_wheel, &conn->aging_timer, GAZELLE_CONN_TIMEOUT);
     conn_htable->cur_conn_num++;
-    conn_hbucket->chain_size++;
 
     return conn;
 }
@@ -130,54 +400,94 @@ struct gazelle_tcp_conn *gazelle_conn_add_by_quintuple(struct gazelle_tcp_conn_h
 struct gazelle_tcp_conn *gazelle_conn_get_by_quintuple(struct gazelle_tcp_conn_htable *conn_htable,
     struct gazelle_quintuple *quintuple)
 {
-    struct gazelle_tcp_conn *conn = NULL;
-    struct gazelle_tcp_conn_hbucket *conn_hbucket = NULL;
-    struct hlist_node *node = NULL;
-    struct hlist_head *head = NULL;
+    return conn_lookup(conn_htable, quintuple, conn_hash(quintuple), true);
+}
 
-    conn_hbucket = gazelle_conn_hbucket_get(conn_htable, quintuple);
-    if (conn_hbucket == NULL) {
-        return NULL;
-    }
+void gazelle_conn_get_bulk(struct gazelle_tcp_conn_htable *conn_htable, const struct gazelle_quintuple *quintuples,
+    uint32_t num, struct gazelle_tcp_conn **conns)
+{
+    uint32_t hash[GAZELLE_PACKET_READ_SIZE];
+    uint32_t bucket_mask = conn_htable->bucket_mask;
 
-    head = &conn_hbucket->chain;
-    hlist_for_each_entry(conn, node, head, conn_node) {
-        if (!INSTANCE_IS_ON(conn)) {
-            continue;
+    while (num > 0) {
+        uint32_t cnt = (num < GAZELLE_PACKET_READ_SIZE) ? num : GAZELLE_PACKET_READ_SIZE;
+
+        /* hash all keys first, so bucket cache miss of the burst overlap */
+        for (uint32_t i = 0; i < cnt; i++) {
+            hash[i] = conn_hash(&quintuples[i]);
+            rte_prefetch0(&conn_htable->buckets[hash[i] & bucket_mask]);
         }
-        if (memcmp(&conn->quintuple, quintuple, sizeof(struct gazelle_quintuple)) == 0) {
-            return conn;
+
+        /* prefetch conns whose sig match in home bucket */
+        for (uint32_t i = 0; i < cnt; i++) {
+            const struct gazelle_tcp_conn_hbucket *bucket = &conn_htable->buckets[hash[i] & bucket_mask];
+            uint16_t sig = conn_sig(hash[i]);
+            for (uint32_t j = 0; j < GAZELLE_CONN_BUCKET_ENTRIES; j++) {
+                if (bucket->sig[j] == sig && conn_slot_used(bucket->idx[j])) {
+                    rte_prefetch0(conn_slab_entry(conn_htable, bucket->idx[j]));
+                }
+            }
+        }
+
+        for (uint32_t i = 0; i < cnt; i++) {
+            conns[i] = conn_lookup(conn_htable, &quintuples[i], hash[i], true);
         }
+
+        quintuples += cnt;
+        conns += cnt;
+        num -= cnt;
     }
-    return NULL;
 }
 
-void gazelle_conn_del_by_quintuple(struct gazelle_tcp_conn_htable *conn_htable, struct gazelle_quintuple *quintuple)
+void gazelle_conn_del(struct gazelle_tcp_conn_htable *conn_htable, struct gazelle_tcp_conn *conn)
 {
-    struct gazelle_tcp_conn *conn = NULL;
-    struct gazelle_tcp_conn_hbucket *conn_hbucket = NULL;
-    struct hlist_node *node = NULL;
-    struct hlist_head *head = NULL;
+    struct gazelle_tcp_conn_hbucket *bucket = &conn_htable->buckets[conn->slot / GAZELLE_CONN_BUCKET_ENTRIES];
+    bool has_empty = false;
 
-    conn_hbucket = gazelle_conn_hbucket_get(conn_htable, quintuple);
-    if (conn_hbucket == NULL) {
-        return;
-    }
-
-    head = &conn_hbucket->chain;
-    hlist_for_each_entry(conn, node, head, conn_node) {
-        if (memcmp(&conn->quintuple, quintuple, sizeof(struct gazelle_quintuple)) == 0) {
+    for (uint32_t i = 0; i < GAZELLE_CONN_BUCKET_ENTRIES; i++) {
+        if (bucket->idx[i] == GAZELLE_CONN_SLOT_EMPTY) {
+            has_empty = true;
             break;
         }
     }
 
+    /* probe already stop at this bucket if it has empty slot, so no need to leave a deleted mark */
+    if (has_empty) {
+        bucket->idx[conn->slot % GAZELLE_CONN_BUCKET_ENTRIES] = GAZELLE_CONN_SLOT_EMPTY;
+    } else {
+        bucket->idx[conn->slot % GAZELLE_CONN_BUCKET_ENTRIES] = GAZELLE_CONN_SLOT_DELETED;
+        conn_htable->deleted_num++;
+    }
+
+    gazelle_timer_del(&conn->aging_timer);
+    conn_slab_free(conn_htable, conn);
+    conn_htable->cur_conn_num--;
+}
+
+void gazelle_conn_del_by_quintuple(struct gazelle_tcp_conn_htable *conn_htable, struct gazelle_quintuple *quintuple)
+{
+    struct gazelle_tcp_conn *conn = conn_lookup(conn_htable, quintuple, conn_hash(quintuple), false);
     if (conn == NULL) {
         return;
     }
 
-    hlist_del_init(&conn->conn_node);
-    rte_free(conn);
-    conn_htable->cur_conn_num--;
-    conn_hbucket->chain_size--;
+    gazelle_conn_del(conn_htable, conn);
 }
 
+struct gazelle_tcp_conn *gazelle_conn_htable_next(const struct gazelle_tcp_conn_htable *conn_htable, uint32_t *pos)
+{
+    /* mask first, see conn_htable_rehash */
+    uint32_t slot_num = (__atomic_load_n(&conn_htable->bucket_mask, __ATOMIC_ACQUIRE) + 1) *
+        GAZELLE_CONN_BUCKET_ENTRIES;
+    const struct gazelle_tcp_conn_hbucket *buckets = __atomic_load_n(&conn_htable->buckets, __ATOMIC_ACQUIRE);
+
+    while (*pos < slot_num) {
+        uint32_t idx = buckets[*pos / GAZELLE_CONN_BUCKET_ENTRIES].idx[*pos % GAZELLE_CONN_BUCKET_ENTRIES];
+        (*pos)++;
+        if (conn_slot_used(idx)) {
+            return conn_slab_entry(conn_htable, idx);
+        }
+    }
+
+    return NULL;
+}
@@ -13,12 +13,15 @@
 #ifndef __GAZELLE_TCP_CONN_H__
 #define __GAZELLE_TCP_CONN_H__
 
-#include <lwip/hlist.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <rte_common.h>
+#include <lwip/list.h>
 #include <lwip/reg_sock.h>
 
 #include "gazelle_opt.h"
+#include "ltran_timer.h"
 
 struct gazelle_tcp_conn {
     uint32_t tid;
@@ -31,37 +34,94 @@ struct gazelle_tcp_conn {
     int32_t instance_reg_tick;
 
     // tcp_handle create conn when pkt match socktable. when pkt don't accept and timout expire, del conn.
-    // ltran_tcp_conn.h define interval and times
+    // ltran_base.h define interval and times. -1 means conn is confirmed by lstack and never ages
     int16_t conn_timeout;
+    /* armed GAZELLE_CONN_TIMEOUT ticks when conn added, then rearmed for instance logout check */
+    struct gazelle_timer aging_timer;
 
-    struct hlist_node conn_node;
+    /* htable private: hash of quintuple, slot in buckets, index in slab and next free index in slab */
+    uint32_t hash;
+    uint32_t slot;
+    uint32_t slab_idx;
+    uint32_t free_next;
 };
 
+#define GAZELLE_CONN_BUCKET_ENTRIES         8
+/* idx of bucket entry is slab index + 1, 0 means empty */
+#define GAZELLE_CONN_SLOT_EMPTY             0
+#define GAZELLE_CONN_SLOT_DELETED           UINT32_MAX
+#define GAZELLE_CONN_SLAB_CHUNK_SHIFT       12
+#define GAZELLE_CONN_SLAB_CHUNK_SIZE        (1U << GAZELLE_CONN_SLAB_CHUNK_SHIFT)
+#define GAZELLE_CONN_SLAB_CHUNK_MASK        (GAZELLE_CONN_SLAB_CHUNK_SIZE - 1)
+
+/* one bucket is one cacheline, sig is compared before touching the conn */
 struct gazelle_tcp_conn_hbucket {
-    uint32_t chain_size;
-    struct hlist_head chain;
+    uint16_t sig[GAZELLE_CONN_BUCKET_ENTRIES];
+    uint32_t idx[GAZELLE_CONN_BUCKET_ENTRIES];
+} __rte_cache_aligned;
+
+/* bucket array replaced by rehash, freed after readers entered before retire_epoch leave */
+struct gazelle_tcp_conn_retired {
+    struct list_node node;
+    uint64_t retire_epoch;
+    struct gazelle_tcp_conn_hbucket *buckets;
 };
 
+/* open addressing htable, probes buckets linearly. it is rehashed when load factor exceed 3/4.
+ * forward core is the only writer. readers of other threads follow the epoch scheme of
+ * gazelle_tcp_sock_htable, old bucket arrays are kept in retire_list until no reader can hold them. */
 struct gazelle_tcp_conn_htable {
+    pthread_mutex_t reader_lock;
+    volatile uint64_t reader_epoch;
+    volatile uint64_t epoch;
+    struct list_node retire_list;
+
     uint32_t cur_conn_num;
     uint32_t max_conn_num;
-    struct gazelle_tcp_conn_hbucket array[GAZELLE_MAX_CONN_HTABLE_SIZE];
+    uint32_t deleted_num;
+    uint32_t bucket_mask;
+    struct gazelle_tcp_conn_hbucket *buckets;
+
+    /* conns are allocated from slab chunks, chunks are freed when htable destroy */
+    uint32_t chunk_num;
+    uint32_t chunk_max;
+    uint32_t free_head;
+    struct gazelle_tcp_conn **chunks;
+
+    /* ticked by gazelle_delete_aging_conn */
+    struct gazelle_timer_wheel aging_wheel;
 };
 
+/* htable of the forward core current thread works for */
 struct gazelle_tcp_conn_htable *gazelle_get_tcp_conn_htable(void);
 void gazelle_set_tcp_conn_htable(struct gazelle_tcp_conn_htable *htable);
+struct gazelle_tcp_conn_htable *gazelle_get_tcp_conn_htable_by_core(uint32_t core_id);
+void gazelle_set_tcp_conn_htable_by_core(uint32_t core_id, struct gazelle_tcp_conn_htable *htable);
 
 
 struct gazelle_tcp_conn_htable *gazelle_tcp_conn_htable_create(uint32_t max_conn_num);
+/* destroy htables of all forward cores */
 void gazelle_tcp_conn_htable_destroy(void);
 
-struct gazelle_tcp_conn_hbucket *gazelle_conn_hbucket_get(struct gazelle_tcp_conn_htable *conn_htable,
-    const struct gazelle_quintuple *quintuple);
 struct gazelle_tcp_conn *gazelle_conn_add_by_quintuple(struct gazelle_tcp_conn_htable *conn_htable,
     struct gazelle_quintuple *quintuple);
 struct gazelle_tcp_conn *gazelle_conn_get_by_quintuple(struct gazelle_tcp_conn_htable *conn_htable,
     struct gazelle_quintuple *quintuple);
+/* lookup a burst of quintuples, conns[i] is NULL when quintuples[i] miss */
+void gazelle_conn_get_bulk(struct gazelle_tcp_conn_htable *conn_htable, const struct gazelle_quintuple *quintuples,
+    uint32_t num, struct gazelle_tcp_conn **conns);
 
 void gazelle_conn_del_by_quintuple(struct gazelle_tcp_conn_htable *conn_htable, struct gazelle_quintuple *quintuple);
+void gazelle_conn_del(struct gazelle_tcp_conn_htable *conn_htable, struct gazelle_tcp_conn *conn);
+
+/* free retired bucket arrays no reader holds, called by forward core */
+void gazelle_conn_htable_reclaim(struct gazelle_tcp_conn_htable *conn_htable);
+/* read side of threads other than forward core, bucket arrays seen between begin and end stay valid */
+int32_t gazelle_conn_htable_read_begin(struct gazelle_tcp_conn_htable *conn_htable);
+void gazelle_conn_htable_read_end(struct gazelle_tcp_conn_htable *conn_htable);
+
+/* iterate conns from *pos between read_begin and read_end, return NULL at the end.
+ * conn returned can be deleted during iteration and shown stale at most */
+struct gazelle_tcp_conn *gazelle_conn_htable_next(const struct gazelle_tcp_conn_htable *conn_htable, uint32_t *pos);
 
 #endif
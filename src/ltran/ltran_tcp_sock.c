@@ -21,15 +21,26 @@
 #include "gazelle_base_func.h"
 #include "ltran_tcp_sock.h"
 
-struct gazelle_tcp_sock_htable *g_tcp_sock_htable = NULL;
+/* listen socks are replicated to the sock htable of every forward core */
+static struct gazelle_tcp_sock_htable *g_tcp_sock_htable[GAZELLE_MAX_FORWARD_CORES] = {NULL};
 struct gazelle_tcp_sock_htable *gazelle_get_tcp_sock_htable(void)
 {
-    return g_tcp_sock_htable;
+    return g_tcp_sock_htable[get_forward_core_id()];
 }
 
 void gazelle_set_tcp_sock_htable(struct gazelle_tcp_sock_htable *htable)
 {
-    g_tcp_sock_htable = htable;
+    g_tcp_sock_htable[get_forward_core_id()] = htable;
+}
+
+struct gazelle_tcp_sock_htable *gazelle_get_tcp_sock_htable_by_core(uint32_t core_id)
+{
+    return g_tcp_sock_htable[core_id];
+}
+
+void gazelle_set_tcp_sock_htable_by_core(uint32_t core_id, struct gazelle_tcp_sock_htable *htable)
+{
+    g_tcp_sock_htable[core_id] = htable;
 }
 
 static struct gazelle_tcp_sock_hbucket *gazelle_hbucket_get_by_ipport(struct gazelle_tcp_sock_htable *tcp_sock_htable,
@@ -45,10 +56,14 @@ struct gazelle_tcp_sock_htable *gazelle_tcp_sock_htable_create(uint32_t max_tcp_
         return NULL;
     }
 
-    if (pthread_mutex_init(&tcp_sock_htable->mlock, NULL) != 0) {
+    if (pthread_mutex_init(&tcp_sock_htable->reader_lock, NULL) != 0) {
         free(tcp_sock_htable);
         return NULL;
     }
+    /* reader_epoch 0 means no reader */
+    tcp_sock_htable->reader_epoch = 0;
+    tcp_sock_htable->epoch = 1;
+    init_list_node(&tcp_sock_htable->retire_list);
 
     for (i = 0; i < GAZELLE_MAX_TCP_SOCK_HTABLE_SIZE; i++) {
         INIT_HLIST_HEAD(&tcp_sock_htable->array[i].chain);
@@ -56,21 +71,29 @@ struct gazelle_tcp_sock_htable *gazelle_tcp_sock_htable_create(uint32_t max_tcp_
     }
     tcp_sock_htable->cur_tcp_sock_num = 0;
     tcp_sock_htable->max_tcp_sock_num = max_tcp_sock_num;
+    gazelle_timer_wheel_init(&tcp_sock_htable->logout_wheel);
 
     return tcp_sock_htable;
 }
 
-void gazelle_tcp_sock_htable_destroy(void)
+static void tcp_sock_htable_destroy(struct gazelle_tcp_sock_htable *tcp_sock_htable)
 {
     struct gazelle_tcp_sock *tcp_sock = NULL;
     struct hlist_node *node = NULL;
-    struct gazelle_tcp_sock_htable *tcp_sock_htable = g_tcp_sock_htable;
+    struct list_node *retire_node = NULL;
+    struct list_node *temp = NULL;
     uint32_t i;
 
     if (tcp_sock_htable == NULL) {
         return;
     }
-    (void)pthread_mutex_destroy(&tcp_sock_htable->mlock);
+    (void)pthread_mutex_destroy(&tcp_sock_htable->reader_lock);
+
+    list_for_each_safe(retire_node, temp, &tcp_sock_htable->retire_list) {
+        tcp_sock = container_of(retire_node, struct gazelle_tcp_sock, retire_node);
+        list_del_node_null(retire_node);
+        free(tcp_sock);
+    }
 
     for (i = 0; i < GAZELLE_MAX_TCP_SOCK_HTABLE_SIZE; i++) {
         node = tcp_sock_htable->array[i].chain.first;
@@ -82,7 +105,15 @@ void gazelle_tcp_sock_htable_destroy(void)
         }
     }
 
-    GAZELLE_FREE(g_tcp_sock_htable);
+    free(tcp_sock_htable);
+}
+
+void gazelle_tcp_sock_htable_destroy(void)
+{
+    for (uint32_t i = 0; i < GAZELLE_MAX_FORWARD_CORES; i++) {
+        tcp_sock_htable_destroy(g_tcp_sock_htable[i]);
+        g_tcp_sock_htable[i] = NULL;
+    }
 }
 
 static struct gazelle_tcp_sock_hbucket *gazelle_hbucket_get_by_ipport(struct gazelle_tcp_sock_htable *tcp_sock_htable,
@@ -92,26 +123,47 @@ static struct gazelle_tcp_sock_hbucket *gazelle_hbucket_get_by_ipport(struct gaz
     return &tcp_sock_htable->array[index];
 }
 
+/* sock is visible to readers only after every field is written */
+static void tcp_sock_hlist_publish(struct gazelle_tcp_sock *tcp_sock, struct hlist_head *head)
+{
+    struct hlist_node *first = head->first;
+
+    tcp_sock->tcp_sock_node.next = first;
+    tcp_sock->tcp_sock_node.pprev = &head->first;
+    if (first != NULL) {
+        first->pprev = &tcp_sock->tcp_sock_node.next;
+    }
+    __atomic_store_n(&head->first, &tcp_sock->tcp_sock_node, __ATOMIC_RELEASE);
+}
+
+/* next is kept, so reader standing on the sock can go on walking the chain */
+static void tcp_sock_hlist_unlink(struct gazelle_tcp_sock *tcp_sock)
+{
+    struct hlist_node *next = tcp_sock->tcp_sock_node.next;
+    struct hlist_node **pprev = tcp_sock->tcp_sock_node.pprev;
+
+    __atomic_store_n(pprev, next, __ATOMIC_RELEASE);
+    if (next != NULL) {
+        next->pprev = pprev;
+    }
+    tcp_sock->tcp_sock_node.pprev = NULL;
+}
+
 static void recover_sock_info_from_conn(struct gazelle_tcp_sock *tcp_sock)
 {
     uint32_t count = 0;
+    uint32_t pos = 0;
     struct gazelle_tcp_conn *conn = NULL;
-    struct hlist_node *node = NULL;
-    struct hlist_head *head = NULL;
     struct gazelle_tcp_conn_htable *conn_htable = gazelle_get_tcp_conn_htable();
 
-    for (int32_t i = 0; i < GAZELLE_MAX_CONN_HTABLE_SIZE; i++) {
-        head = &conn_htable->array[i].chain;
-
-        hlist_for_each_entry(conn, node, head, conn_node) {
-            if ((conn->quintuple.dst_ip != tcp_sock->ip) || (conn->quintuple.dst_port != tcp_sock->port) ||
-                (conn->tid != tcp_sock->tid)) {
-                continue;
-            }
-            count++;
-            if (conn->sock == NULL) {
-                conn->sock = tcp_sock;
-            }
+    while ((conn = gazelle_conn_htable_next(conn_htable, &pos)) != NULL) {
+        if ((conn->quintuple.dst_ip != tcp_sock->ip) || (conn->quintuple.dst_port != tcp_sock->port) ||
+            (conn->tid != tcp_sock->tid)) {
+            continue;
+        }
+        count++;
+        if (conn->sock == NULL) {
+            conn->sock = tcp_sock;
         }
     }
     tcp_sock->tcp_con_num = count;
@@ -154,10 +206,14 @@ struct gazelle_tcp_sock *gazelle_sock_add_by_ipporttid(struct gazelle_tcp_sock_h
     tcp_sock->instance_reg_tick = INSTANCE_REG_TICK_INIT_VAL;
     tcp_sock->instance_cur_tick = instance_cur_tick_init_val();
 
-    hlist_add_head(&tcp_sock->tcp_sock_node, &tcp_sock_hbucket->chain);
+    init_list_node_null(&tcp_sock->retire_node);
+    recover_sock_info_from_conn(tcp_sock);
+
+    tcp_sock_hlist_publish(tcp_sock, &tcp_sock_hbucket->chain);
+    gazelle_timer_init(&tcp_sock->logout_timer);
+    gazelle_timer_add(&tcp_sock_htable->logout_wheel, &tcp_sock->logout_timer, gazelle_logout_scan_ticks());
     tcp_sock_htable->cur_tcp_sock_num++;
     tcp_sock_hbucket->chain_size++;
-    recover_sock_info_from_conn(tcp_sock);
 
     return tcp_sock;
 }
@@ -186,10 +242,68 @@ void gazelle_sock_del_by_ipporttid(struct gazelle_tcp_sock_htable *tcp_sock_htab
         return;
     }
 
-    hlist_del_init(&tcp_sock->tcp_sock_node);
-    free(tcp_sock);
+    gazelle_sock_del(tcp_sock_htable, tcp_sock);
+}
+
+void gazelle_sock_del(struct gazelle_tcp_sock_htable *tcp_sock_htable, struct gazelle_tcp_sock *tcp_sock)
+{
+    struct gazelle_tcp_sock_hbucket *tcp_sock_hbucket = gazelle_hbucket_get_by_ipport(tcp_sock_htable,
+        tcp_sock->ip, tcp_sock->port);
+
+    tcp_sock_hlist_unlink(tcp_sock);
+    gazelle_timer_del(&tcp_sock->logout_timer);
     tcp_sock_htable->cur_tcp_sock_num--;
     tcp_sock_hbucket->chain_size--;
+
+    /* readers entered from now on can't find the sock */
+    tcp_sock->retire_epoch = tcp_sock_htable->epoch;
+    __atomic_store_n(&tcp_sock_htable->epoch, tcp_sock->retire_epoch + 1, __ATOMIC_RELEASE);
+    list_add_node(&tcp_sock_htable->retire_list, &tcp_sock->retire_node);
+    gazelle_sock_htable_reclaim(tcp_sock_htable);
+}
+
+void gazelle_sock_htable_reclaim(struct gazelle_tcp_sock_htable *tcp_sock_htable)
+{
+    struct gazelle_tcp_sock *tcp_sock = NULL;
+    struct list_node *node = NULL;
+    struct list_node *temp = NULL;
+    uint64_t reader_epoch;
+
+    if (tcp_sock_htable->retire_list.next == &tcp_sock_htable->retire_list) {
+        return;
+    }
+
+    /* pairs with fence in gazelle_sock_htable_read_begin: either reader_epoch is seen here,
+     * or reader sees the unlink */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    reader_epoch = __atomic_load_n(&tcp_sock_htable->reader_epoch, __ATOMIC_ACQUIRE);
+
+    list_for_each_safe(node, temp, &tcp_sock_htable->retire_list) {
+        tcp_sock = container_of(node, struct gazelle_tcp_sock, retire_node);
+        if (reader_epoch != 0 && reader_epoch <= tcp_sock->retire_epoch) {
+            continue;
+        }
+        list_del_node_null(node);
+        free(tcp_sock);
+    }
+}
+
+int32_t gazelle_sock_htable_read_begin(struct gazelle_tcp_sock_htable *tcp_sock_htable)
+{
+    if (pthread_mutex_lock(&tcp_sock_htable->reader_lock) != 0) {
+        return -1;
+    }
+
+    __atomic_store_n(&tcp_sock_htable->reader_epoch, __atomic_load_n(&tcp_sock_htable->epoch, __ATOMIC_ACQUIRE),
+        __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return 0;
+}
+
+void gazelle_sock_htable_read_end(struct gazelle_tcp_sock_htable *tcp_sock_htable)
+{
+    __atomic_store_n(&tcp_sock_htable->reader_epoch, 0, __ATOMIC_RELEASE);
+    (void)pthread_mutex_unlock(&tcp_sock_htable->reader_lock);
 }
 
 struct gazelle_tcp_sock *gazelle_sock_get_by_min_conn(struct gazelle_tcp_sock_htable *tcp_sock_htable,
@@ -14,10 +14,12 @@
 #define __GAZELLE_TCP_SOCK_H__
 
 #include <lwip/hlist.h>
+#include <lwip/list.h>
 #include <pthread.h>
 #include <stdint.h>
 
 #include "gazelle_opt.h"
+#include "ltran_timer.h"
 
 struct gazelle_stack;
 struct gazelle_tcp_sock {
@@ -36,6 +38,12 @@ struct gazelle_tcp_sock {
 
     // list node in gazelle_tcp_sock_hbucket
     struct hlist_node tcp_sock_node;
+    /* instance logout check */
+    struct gazelle_timer logout_timer;
+
+    /* epoch the sock is unlinked in, it is freed after readers entered before that epoch leave */
+    uint64_t retire_epoch;
+    struct list_node retire_node;
 };
 
 struct gazelle_tcp_sock_hbucket {
@@ -43,22 +51,47 @@ struct gazelle_tcp_sock_hbucket {
     struct hlist_head chain;
 };
 
+/* forward core owns the htable and is the only writer, lookups on it never lock.
+ * readers of other threads are serialized by reader_lock and publish the epoch they entered in,
+ * socks deleted are kept in retire_list until no reader can hold them. */
 struct gazelle_tcp_sock_htable {
-    pthread_mutex_t mlock;
+    pthread_mutex_t reader_lock;
+    volatile uint64_t reader_epoch;
+    volatile uint64_t epoch;
+    struct list_node retire_list;
+
     uint32_t cur_tcp_sock_num;
     uint32_t max_tcp_sock_num;
     struct gazelle_tcp_sock_hbucket array[GAZELLE_MAX_TCP_SOCK_HTABLE_SIZE];
+    /* ticked by gazelle_detect_sock_logout */
+    struct gazelle_timer_wheel logout_wheel;
 };
 
 
+/* htable of the forward core current thread works for */
 void gazelle_set_tcp_sock_htable(struct gazelle_tcp_sock_htable *htable);
 struct gazelle_tcp_sock_htable *gazelle_get_tcp_sock_htable(void);
+void gazelle_set_tcp_sock_htable_by_core(uint32_t core_id, struct gazelle_tcp_sock_htable *htable);
+struct gazelle_tcp_sock_htable *gazelle_get_tcp_sock_htable_by_core(uint32_t core_id);
+/* destroy htables of all forward cores */
 void gazelle_tcp_sock_htable_destroy(void);
 struct gazelle_tcp_sock_htable *gazelle_tcp_sock_htable_create(uint32_t max_tcp_sock_num);
 struct gazelle_tcp_sock *gazelle_sock_get_by_min_conn(struct gazelle_tcp_sock_htable *tcp_sock_htable,
     uint32_t ip, uint16_t port);
+void gazelle_sock_del(struct gazelle_tcp_sock_htable *tcp_sock_htable, struct gazelle_tcp_sock *tcp_sock);
 void gazelle_sock_del_by_ipporttid(struct gazelle_tcp_sock_htable *tcp_sock_htable, uint32_t ip, uint16_t port,
     uint32_t tid);
 struct gazelle_tcp_sock *gazelle_sock_add_by_ipporttid(struct gazelle_tcp_sock_htable *tcp_sock_htable, uint32_t ip,
     uint16_t port, uint32_t tid);
+
+/* free retired socks no reader holds, called by forward core */
+void gazelle_sock_htable_reclaim(struct gazelle_tcp_sock_htable *tcp_sock_htable);
+/* read side of threads other than forward core, socks got between begin and end stay valid */
+int32_t gazelle_sock_htable_read_begin(struct gazelle_tcp_sock_htable *tcp_sock_htable);
+void gazelle_sock_htable_read_end(struct gazelle_tcp_sock_htable *tcp_sock_htable);
+
+#define gazelle_sock_hlist_for_each(tcp_sock, node, head) \
+    for ((node) = __atomic_load_n(&(head)->first, __ATOMIC_ACQUIRE); \
+        (node) != NULL && (((tcp_sock) = hlist_entry((node), struct gazelle_tcp_sock, tcp_sock_node)) != NULL); \
+        (node) = __atomic_load_n(&(node)->next, __ATOMIC_ACQUIRE))
 #endif
@@ -23,6 +23,8 @@
 #include "ltran_tcp_sock.h"
 #include "ltran_tcp_conn.h"
 #include "ltran_instance.h"
+#include "ltran_base.h"
+#include "gazelle_base_func.h"
 #include "ltran_timer.h"
 
 static uint64_t g_cycles_per_us = 0;
@@ -41,121 +43,171 @@ void calibrate_time(void)
     g_cycles_per_us = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S;
 }
 
-void gazelle_detect_sock_logout(struct gazelle_tcp_sock_htable *tcp_sock_htable)
+void gazelle_timer_wheel_init(struct gazelle_timer_wheel *wheel)
 {
-    uint32_t i;
-    struct gazelle_tcp_sock *tcp_sock = NULL;
-    struct hlist_node *node = NULL;
+    wheel->cur_tick = 0;
+    for (uint32_t level = 0; level < GAZELLE_TIMER_WHEEL_LEVELS; level++) {
+        for (uint32_t i = 0; i < GAZELLE_TIMER_WHEEL_SLOTS; i++) {
+            init_list_node(&wheel->slots[level][i]);
+        }
+    }
+}
 
-    if (tcp_sock_htable == NULL) {
-        return;
+void gazelle_timer_init(struct gazelle_timer *timer)
+{
+    init_list_node_null(&timer->node);
+    timer->expire = 0;
+}
+
+static void timer_wheel_insert(struct gazelle_timer_wheel *wheel, struct gazelle_timer *timer)
+{
+    uint32_t delta = timer->expire - wheel->cur_tick;
+    uint32_t level = 0;
+
+    while (level < GAZELLE_TIMER_WHEEL_LEVELS - 1 && delta >= (1U << (GAZELLE_TIMER_WHEEL_BITS * (level + 1)))) {
+        level++;
     }
 
-    if (pthread_mutex_trylock(&tcp_sock_htable->mlock) != 0) {
-        LTRAN_ERR("lock failed, errno %d.\n", errno);
-        return;
+    uint32_t idx = (timer->expire >> (GAZELLE_TIMER_WHEEL_BITS * level)) & GAZELLE_TIMER_WHEEL_MASK;
+    list_add_node(&wheel->slots[level][idx], &timer->node);
+}
+
+void gazelle_timer_add(struct gazelle_timer_wheel *wheel, struct gazelle_timer *timer, uint32_t ticks)
+{
+    ticks = (ticks == 0) ? 1 : ticks;
+    ticks = (ticks > GAZELLE_TIMER_WHEEL_MAX_TICKS) ? GAZELLE_TIMER_WHEEL_MAX_TICKS : ticks;
+
+    list_del_node_null(&timer->node);
+    timer->expire = wheel->cur_tick + ticks - 1;
+    timer_wheel_insert(wheel, timer);
+}
+
+void gazelle_timer_del(struct gazelle_timer *timer)
+{
+    list_del_node_null(&timer->node);
+}
+
+/* move timers of slot idx in level down, they all expire within the slot range of lower levels now */
+static uint32_t timer_wheel_cascade(struct gazelle_timer_wheel *wheel, uint32_t level)
+{
+    uint32_t idx = (wheel->cur_tick >> (GAZELLE_TIMER_WHEEL_BITS * level)) & GAZELLE_TIMER_WHEEL_MASK;
+    struct list_node *node = NULL;
+    struct list_node *temp = NULL;
+
+    list_for_each_safe(node, temp, &wheel->slots[level][idx]) {
+        struct gazelle_timer *timer = container_of(node, struct gazelle_timer, node);
+        list_del_node_null(node);
+        timer_wheel_insert(wheel, timer);
     }
 
-    for (i = 0; i < GAZELLE_MAX_TCP_SOCK_HTABLE_SIZE; i++) {
-        node = tcp_sock_htable->array[i].chain.first;
-        while (node != NULL) {
-            tcp_sock = hlist_entry(node, typeof(*tcp_sock), tcp_sock_node);
-            node = node->next;
-            if (!INSTANCE_IS_ON(tcp_sock)) {
-                hlist_del_init(&tcp_sock->tcp_sock_node);
-                tcp_sock_htable->cur_tcp_sock_num--;
-                tcp_sock_htable->array[i].chain_size--;
-                LTRAN_DEBUG("delete the tcp sock htable: tid %u ip %u port %u\n",
-                    tcp_sock->tid, tcp_sock->ip, (uint32_t)ntohs(tcp_sock->port));
-                free(tcp_sock);
+    return idx;
+}
+
+void gazelle_timer_wheel_tick(struct gazelle_timer_wheel *wheel, struct list_node *expired)
+{
+    uint32_t idx = wheel->cur_tick & GAZELLE_TIMER_WHEEL_MASK;
+    struct list_node *node = NULL;
+    struct list_node *temp = NULL;
+
+    /* level 0 wraps, refill it from upper levels */
+    if (idx == 0) {
+        for (uint32_t level = 1; level < GAZELLE_TIMER_WHEEL_LEVELS; level++) {
+            if (timer_wheel_cascade(wheel, level) != 0) {
+                break;
             }
         }
     }
 
-    if (pthread_mutex_unlock(&tcp_sock_htable->mlock) != 0) {
-        LTRAN_WARN("read tcp_sock_htable: unlock failed, errno %d.\n", errno);
+    list_for_each_safe(node, temp, &wheel->slots[0][idx]) {
+        list_del_node_null(node);
+        list_add_node(expired, node);
     }
+
+    wheel->cur_tick++;
 }
-void gazelle_detect_conn_logout(struct gazelle_tcp_conn_htable *conn_htable)
+
+uint32_t gazelle_logout_scan_ticks(void)
 {
-    struct gazelle_tcp_sock_htable *sock_htable = gazelle_get_tcp_sock_htable();
-    struct gazelle_tcp_conn *conn = NULL;
-    struct hlist_node *node = NULL;
-    uint32_t i;
+    unsigned long ticks = get_ltran_config()->tcp_conn.tcp_conn_scan_interval / GAZELLE_CONN_INTERVAL;
 
-    if (conn_htable == NULL) {
-        return;
+    if (ticks > GAZELLE_TIMER_WHEEL_MAX_TICKS) {
+        return GAZELLE_TIMER_WHEEL_MAX_TICKS;
     }
+    return (ticks == 0) ? 1 : (uint32_t)ticks;
+}
 
-    if (pthread_mutex_trylock(&sock_htable->mlock) != 0) {
-        LTRAN_ERR("lock failed, errno %d\n", errno);
+void gazelle_detect_sock_logout(struct gazelle_tcp_sock_htable *tcp_sock_htable)
+{
+    struct gazelle_tcp_sock *tcp_sock = NULL;
+    struct list_node expired;
+    struct list_node *node = NULL;
+    struct list_node *temp = NULL;
+
+    if (tcp_sock_htable == NULL) {
         return;
     }
 
-    for (i = 0; i < GAZELLE_MAX_CONN_HTABLE_SIZE; i++) {
-        node = conn_htable->array[i].chain.first;
-        while (node != NULL) {
-            conn = hlist_entry(node, typeof(*conn), conn_node);
-            node = node->next;
-            if (!INSTANCE_IS_ON(conn)) {
-                hlist_del_init(&conn->conn_node);
-                conn_htable->cur_conn_num--;
-                conn_htable->array[i].chain_size--;
-                LTRAN_DEBUG("delete the tcp conn htable: tid %u quintuple[%u %u %u %u %u]\n",
-                    conn->tid, conn->quintuple.protocol,
-                    conn->quintuple.src_ip, (uint32_t)ntohs(conn->quintuple.src_port),
-                    conn->quintuple.dst_ip, (uint32_t)ntohs(conn->quintuple.dst_port));
-                rte_free(conn);
-            }
+    init_list_node(&expired);
+    gazelle_timer_wheel_tick(&tcp_sock_htable->logout_wheel, &expired);
+
+    list_for_each_safe(node, temp, &expired) {
+        tcp_sock = container_of(node, struct gazelle_tcp_sock, logout_timer.node);
+        list_del_node_null(node);
+        if (INSTANCE_IS_ON(tcp_sock)) {
+            gazelle_timer_add(&tcp_sock_htable->logout_wheel, &tcp_sock->logout_timer, gazelle_logout_scan_ticks());
+            continue;
         }
-    }
 
-    if (pthread_mutex_unlock(&sock_htable->mlock) != 0) {
-        LTRAN_WARN("unlock failed, errno %d.\n", errno);
+        LTRAN_DEBUG("delete the tcp sock htable: tid %u ip %u port %u\n",
+            tcp_sock->tid, tcp_sock->ip, (uint32_t)ntohs(tcp_sock->port));
+        gazelle_sock_del(tcp_sock_htable, tcp_sock);
     }
+
+    /* socks held by a reader when deleted */
+    gazelle_sock_htable_reclaim(tcp_sock_htable);
 }
 
+/* one timer per conn: it ages conn not confirmed by lstack in GAZELLE_CONN_TIMEOUT ticks,
+ * then checks instance logout every gazelle_logout_scan_ticks. */
 void gazelle_delete_aging_conn(struct gazelle_tcp_conn_htable *conn_htable)
 {
-    struct gazelle_tcp_sock_htable *sock_htable = gazelle_get_tcp_sock_htable();
     struct gazelle_tcp_conn *conn = NULL;
-    struct hlist_node *node = NULL;
-    uint32_t i;
+    struct list_node expired;
+    struct list_node *node = NULL;
+    struct list_node *temp = NULL;
 
     if (conn_htable == NULL) {
         return;
     }
 
-    if (pthread_mutex_trylock(&sock_htable->mlock) != 0) {
-        LTRAN_ERR("lock failed, errno %d\n", errno);
-        return;
-    }
-
-    for (i = 0; i < GAZELLE_MAX_CONN_HTABLE_SIZE; i++) {
-        node = conn_htable->array[i].chain.first;
-        while (node != NULL) {
-            conn = hlist_entry(node, typeof(*conn), conn_node);
-            node = node->next;
-            if (conn->conn_timeout < 0) {
-                continue;
-            }
+    init_list_node(&expired);
+    gazelle_timer_wheel_tick(&conn_htable->aging_wheel, &expired);
+
+    list_for_each_safe(node, temp, &expired) {
+        conn = container_of(node, struct gazelle_tcp_conn, aging_timer.node);
+        list_del_node_null(node);
+
+        /* sock of a logout instance may be freed already, don't touch it */
+        if (!INSTANCE_IS_ON(conn)) {
+            LTRAN_DEBUG("delete the tcp conn htable: tid %u quintuple[%u %u %u %u %u]\n",
+                conn->tid, conn->quintuple.protocol,
+                conn->quintuple.src_ip, (uint32_t)ntohs(conn->quintuple.src_port),
+                conn->quintuple.dst_ip, (uint32_t)ntohs(conn->quintuple.dst_port));
+            gazelle_conn_del(conn_htable, conn);
+            continue;
+        }
 
-            conn->conn_timeout--;
-            if (conn->conn_timeout > 0) {
-                continue;
-            }
+        if (conn->conn_timeout < 0) {
+            gazelle_timer_add(&conn_htable->aging_wheel, &conn->aging_timer, gazelle_logout_scan_ticks());
+            continue;
+        }
 
-            hlist_del_init(&conn->conn_node);
-            conn_htable->cur_conn_num--;
-            conn_htable->array[i].chain_size--;
-            if (conn->sock) {
-                conn->sock->tcp_con_num--;
-            }
-            rte_free(conn);
+        if (conn->sock) {
+            conn->sock->tcp_con_num--;
         }
+        gazelle_conn_del(conn_htable, conn);
     }
 
-    if (pthread_mutex_unlock(&sock_htable->mlock) != 0) {
-        LTRAN_WARN("unlock failed, errno %d.\n", errno);
-    }
+    /* bucket arrays held by a reader when rehashed */
+    gazelle_conn_htable_reclaim(conn_htable);
 }
@@ -13,13 +13,46 @@
 #ifndef __GAZELLE_TIMER_H__
 #define __GAZELLE_TIMER_H__
 
+#include <stdint.h>
+#include <lwip/list.h>
+
+/* hierarchical timer wheel, level n slot covers 2^(n * GAZELLE_TIMER_WHEEL_BITS) ticks */
+#define GAZELLE_TIMER_WHEEL_BITS        6
+#define GAZELLE_TIMER_WHEEL_SLOTS       (1U << GAZELLE_TIMER_WHEEL_BITS)
+#define GAZELLE_TIMER_WHEEL_MASK        (GAZELLE_TIMER_WHEEL_SLOTS - 1)
+#define GAZELLE_TIMER_WHEEL_LEVELS      3
+/* longer timeout is clamped, it is enough for GAZELLE_TCP_CONN_SCAN_INTERVAL_MAX_S */
+#define GAZELLE_TIMER_WHEEL_MAX_TICKS   ((1U << (GAZELLE_TIMER_WHEEL_BITS * GAZELLE_TIMER_WHEEL_LEVELS)) - 1)
+
+struct gazelle_timer {
+    struct list_node node;
+    uint32_t expire;
+};
+
+struct gazelle_timer_wheel {
+    /* the tick handled by next gazelle_timer_wheel_tick */
+    uint32_t cur_tick;
+    struct list_node slots[GAZELLE_TIMER_WHEEL_LEVELS][GAZELLE_TIMER_WHEEL_SLOTS];
+};
+
 struct gazelle_tcp_conn_htable;
 struct gazelle_tcp_sock_htable;
 
-unsigned long get_current_time(void);
+uint64_t get_current_time(void);
 void calibrate_time(void);
-void gazelle_detect_conn_logout(struct gazelle_tcp_conn_htable *conn_htable);
+
+void gazelle_timer_wheel_init(struct gazelle_timer_wheel *wheel);
+void gazelle_timer_init(struct gazelle_timer *timer);
+/* timer expires in the ticks-th gazelle_timer_wheel_tick from now, ticks 0 is taken as 1 */
+void gazelle_timer_add(struct gazelle_timer_wheel *wheel, struct gazelle_timer *timer, uint32_t ticks);
+void gazelle_timer_del(struct gazelle_timer *timer);
+/* advance the wheel one tick, timers expired are moved to list expired */
+void gazelle_timer_wheel_tick(struct gazelle_timer_wheel *wheel, struct list_node *expired);
+/* ticks between two instance logout checks of one sock or conn */
+uint32_t gazelle_logout_scan_ticks(void);
+
+/* called every GAZELLE_CONN_INTERVAL, only sock and conn whose timer expired are visited */
 void gazelle_detect_sock_logout(struct gazelle_tcp_sock_htable *tcp_sock_htable);
 void gazelle_delete_aging_conn(struct gazelle_tcp_conn_htable *conn_htable);
 
-#endif
\ No newline at end of file
+#endif
@@ -126,8 +126,23 @@ static int32_t ltran_core_init(int32_t argc, char *argv[])
     }
     set_instance_mgr(mgr);
     gazelle_set_stack_htable(gazelle_stack_htable_create(GAZELLE_MAX_STACK_NUM));
-    gazelle_set_tcp_conn_htable(gazelle_tcp_conn_htable_create(GAZELLE_MAX_CONN_NUM));
-    gazelle_set_tcp_sock_htable(gazelle_tcp_sock_htable_create(GAZELLE_MAX_TCP_SOCK_NUM));
+    /* each forward core owns its conn and sock table */
+    for (uint32_t i = 0; i < get_ltran_config()->dpdk.forward_cores; i++) {
+        gazelle_set_tcp_conn_htable_by_core(i, gazelle_tcp_conn_htable_create(GAZELLE_MAX_CONN_NUM));
+        gazelle_set_tcp_sock_htable_by_core(i, gazelle_tcp_sock_htable_create(GAZELLE_MAX_TCP_SOCK_NUM));
+        if (gazelle_get_tcp_conn_htable_by_core(i) == NULL || gazelle_get_tcp_sock_htable_by_core(i) == NULL) {
+            syslog(LOG_ERR, "create tcp htable for forward core %u failed\n", i);
+            closelog();
+            return GAZELLE_ERR;
+        }
+    }
+
+    ret = forward_ctrl_ring_init();
+    if (ret != GAZELLE_OK) {
+        syslog(LOG_ERR, "forward ctrl ring init failed. ret=%d.\n", ret);
+        closelog();
+        return ret;
+    }
 
     signal_init();
     /* to prevent crash of ltran, just ignore SIGPIPE when socket is closed */
@@ -146,27 +161,38 @@ static void ltran_core_destroy(void)
     dpdk_kni_release();
 }
 
-static void wait_thread_finish(pthread_t ctrl_thread, uint32_t next_core)
+static void wait_thread_finish(pthread_t ctrl_thread)
 {
     int32_t ret = pthread_join(ctrl_thread, NULL);
     if (ret != 0) {
         LTRAN_ERR("pthread_join for ctrl_thead ret=%d.\n", ret);
     }
 
-    /* wait downstream_forward */
-    if (next_core < RTE_MAX_LCORE) {
-        ret = rte_eal_wait_lcore(next_core);
-        if (ret < 0) {
-            LTRAN_ERR("rte_eal_wait_lcore for downstream_forward ret=%d next_core=%u.\n", ret, next_core);
-        }
+    /* wait downstream_forward and upstream_forward of other forward cores */
+    rte_eal_mp_wait_lcore();
+}
+
+static int32_t forward_lcore_launch(lcore_function_t *func, const struct forward_arg *arg, uint32_t *next_core)
+{
+    *next_core = rte_get_next_lcore(*next_core, 1, 0);
+    if (*next_core == RTE_MAX_LCORE) {
+        LTRAN_ERR("there is no more core for forward core %u!\n", arg->core_id);
+        return GAZELLE_ERR;
+    }
+
+    int32_t ret = rte_eal_remote_launch(func, (void *)arg, *next_core);
+    if (ret != 0) {
+        LTRAN_ERR("rte_eal_remote_launch forward core %u error ret:%d.\n", arg->core_id, ret);
+        return GAZELLE_ERR;
     }
+    return GAZELLE_OK;
 }
 
 int32_t main(int32_t argc, char *argv[])
 {
+    static struct forward_arg forward_args[GAZELLE_MAX_FORWARD_CORES];
     pthread_t ctrl_thread;
-    uint32_t next_core;
-    uint16_t index;
+    uint32_t next_core = (uint32_t)-1;
 
     syslog(LOG_INFO, "start ltran.");
 
@@ -189,30 +215,31 @@ int32_t main(int32_t argc, char *argv[])
 
     LTRAN_INFO("Finished Process ctrl_thread_fn\n");
     do {
-        /* create one thread for bond port 0 send packet */
-        next_core = rte_get_next_lcore(-1, 1, 0);
-        if (next_core == RTE_MAX_LCORE) {
-            LTRAN_ERR("there is no more core!\n");
-            ret = GAZELLE_ERR;
-            break;
+        uint32_t core_num = get_ltran_config()->dpdk.forward_cores;
+        for (uint32_t i = 0; i < core_num; i++) {
+            forward_args[i].port_index = 0;
+            forward_args[i].core_id = i;
         }
 
-        index = 0;
-        ret = rte_eal_remote_launch((lcore_function_t *)downstream_forward, &index, next_core);
-        if (ret != 0) {
-            LTRAN_ERR("rte_eal_remote_launch  downstream_forwarding_by_port error ret:%d.\n", ret);
+        /* create one thread per forward core for bond port 0 send packet */
+        for (uint32_t i = 0; i < core_num && ret == GAZELLE_OK; i++) {
+            ret = forward_lcore_launch((lcore_function_t *)downstream_forward, &forward_args[i], &next_core);
+        }
+
+        /* forward core 0 receive packet in main thread, the others need their own lcore */
+        for (uint32_t i = 1; i < core_num && ret == GAZELLE_OK; i++) {
+            ret = forward_lcore_launch((lcore_function_t *)upstream_forward, &forward_args[i], &next_core);
+        }
+        if (ret != GAZELLE_OK) {
             break;
         }
 
-        /* create multi thread to receive and send packet for multi bond port */
         LTRAN_INFO("Runing Process forward\n");
-        /* main thread is for port 0 receive packet */
-        index = 0;
-        upstream_forward((const void *)&index);
+        upstream_forward(&forward_args[0]);
     } while (0);
 
     set_ltran_stop_flag(GAZELLE_TRUE);
-    wait_thread_finish(ctrl_thread, next_core);
+    wait_thread_finish(ctrl_thread);
 
     ltran_core_destroy();
     LTRAN_INFO("all done, all quit.\n");
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) Huawei Technologies Co., Ltd. 2020-2021. All rights reserved.
+ * gazelle is licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ */
+
+#include <stdlib.h>
+#include <CUnit/Basic.h>
+#include <CUnit/Automated.h>
+#include <CUnit/Console.h>
+#include <rte_ring.h>
+#include "dpdk_common.h"
+
+#define TEST_RING_SIZE      16
+#define TEST_RING_SIZE_MIN  32
+#define TEST_RING_SIZE_MAX  1024
+
+static struct rte_ring *test_ring_create(uint32_t count)
+{
+    struct rte_ring *r = malloc(rte_ring_get_memsize(count));
+    if (r == NULL) {
+        return NULL;
+    }
+
+    if (rte_ring_init(r, "test_ring", count, RING_F_SP_ENQ | RING_F_SC_DEQ) != 0) {
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+void test_lstack_ring_capacity(void)
+{
+    void *objs[TEST_RING_SIZE];
+    struct rte_ring *r = test_ring_create(TEST_RING_SIZE);
+    CU_ASSERT_FATAL(r != NULL);
+
+    for (uint32_t i = 0; i < TEST_RING_SIZE; i++) {
+        objs[i] = (void *)(uintptr_t)(i + 1);
+    }
+
+    /* full size ring keeps one slot empty */
+    CU_ASSERT(gazelle_ring_free_count(r) == TEST_RING_SIZE - 1);
+    CU_ASSERT(gazelle_ring_sp_enqueue(r, objs, 10) == 10); /* 10: objects queued */
+    CU_ASSERT(gazelle_ring_free_count(r) == 5); /* 5: 15 - 10 */
+
+    /* lowered below the objects queued, nothing fits and nothing is lost */
+    gazelle_ring_set_capacity(r, 8); /* 8: lower capacity */
+    CU_ASSERT(gazelle_ring_free_count(r) == 0);
+    CU_ASSERT(gazelle_ring_sp_enqueue(r, objs, 1) == 0);
+    CU_ASSERT(gazelle_ring_count(r) == 10); /* 10: objects queued */
+
+    /* consume 5, used 5 of capacity 8 */
+    CU_ASSERT(gazelle_ring_read(r, objs, 5) == 5); /* 5: objects read */
+    CU_ASSERT(objs[0] == (void *)1 && objs[4] == (void *)5); /* 1, 5: first and last read */
+    gazelle_ring_read_over(r);
+    CU_ASSERT(gazelle_ring_sc_dequeue(r, objs, 5) == 5); /* 5: objects read over */
+    CU_ASSERT(gazelle_ring_free_count(r) == 3); /* 3: 8 - 5 */
+    CU_ASSERT(gazelle_ring_sp_enqueue(r, objs, 4) == 0); /* 4: one over free */
+    CU_ASSERT(gazelle_ring_sp_enqueue(r, objs, 3) == 3); /* 3: exactly free */
+    CU_ASSERT(gazelle_ring_free_count(r) == 0);
+
+    /* capacity can't grow over the size ring created with */
+    gazelle_ring_set_capacity(r, TEST_RING_SIZE * 4); /* 4: far over size */
+    CU_ASSERT(r->capacity == TEST_RING_SIZE - 1);
+    CU_ASSERT(gazelle_ring_free_count(r) == 7); /* 7: 15 - 8 */
+
+    free(r);
+}
+
+void test_lstack_ring_bdp_size(void)
+{
+    /* nothing moved, and bdp under min */
+    CU_ASSERT(gazelle_ring_bdp_size(0, 1000, 1000, TEST_RING_SIZE_MIN, TEST_RING_SIZE_MAX) == TEST_RING_SIZE_MIN);
+    CU_ASSERT(gazelle_ring_bdp_size(MBUF_MAX_DATA_LEN * 1000, 1000, 1000, /* 1000: 1 mbuf per ms, 1s, 1ms rtt */
+        TEST_RING_SIZE_MIN, TEST_RING_SIZE_MAX) == TEST_RING_SIZE_MIN);
+
+    /* 100 mbufs per rtt, twice over and rounded up to power of 2 */
+    CU_ASSERT(gazelle_ring_bdp_size(MBUF_MAX_DATA_LEN * 10000, 1000, 10000, /* 10000: 10 mbufs per ms, 10ms rtt */
+        TEST_RING_SIZE_MIN, TEST_RING_SIZE_MAX) == 256); /* 256: align32pow2(200) */
+
+    /* bdp over max, no overflow of bytes * rtt */
+    CU_ASSERT(gazelle_ring_bdp_size(UINT32_MAX, 1, UINT32_MAX,
+        TEST_RING_SIZE_MIN, TEST_RING_SIZE_MAX) == TEST_RING_SIZE_MAX);
+    /* max not power of 2 is not rounded over */
+    CU_ASSERT(gazelle_ring_bdp_size(MBUF_MAX_DATA_LEN * 10000, 1000, 10000,
+        TEST_RING_SIZE_MIN, 250) == 250); /* 250: max under align32pow2(200) */
+}
+
+void test_lstack_ring_next_size(void)
+{
+    /* grow at once */
+    CU_ASSERT(gazelle_ring_next_size(256, 512) == 512); /* 256, 512: cur, bdp size */
+    CU_ASSERT(gazelle_ring_next_size(32, 1024) == 1024); /* 32, 1024: cur, bdp size */
+
+    /* hysteresis: stay unless bdp size falls to a quarter */
+    CU_ASSERT(gazelle_ring_next_size(256, 256) == 256); /* 256: cur and bdp size */
+    CU_ASSERT(gazelle_ring_next_size(256, 128) == 256); /* 256, 128: cur, bdp size */
+    CU_ASSERT(gazelle_ring_next_size(256, 65) == 256); /* 256, 65: just over a quarter */
+
+    /* shrink by half only, even when bdp size is far below */
+    CU_ASSERT(gazelle_ring_next_size(256, 64) == 128); /* 256, 64: cur, a quarter */
+    CU_ASSERT(gazelle_ring_next_size(256, 32) == 128); /* 256, 32: cur, an eighth */
+}
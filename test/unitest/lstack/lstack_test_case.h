@@ -20,5 +20,8 @@ void test_lstack_bad_params_mask_addr(void);
 void test_lstack_bad_params_host_addr(void);
 void test_lstack_bad_params_num_cpus(void);
 void test_lstack_bad_params_lowpower(void);
+void test_lstack_ring_capacity(void);
+void test_lstack_ring_bdp_size(void);
+void test_lstack_ring_next_size(void);
 
 #endif
@@ -49,6 +49,9 @@ int main(int argc, char **argv)
     (void)CU_ADD_TEST(suite, test_lstack_bad_params_host_addr);
     (void)CU_ADD_TEST(suite, test_lstack_bad_params_num_cpus);
     (void)CU_ADD_TEST(suite, test_lstack_bad_params_lowpower);
+    (void)CU_ADD_TEST(suite, test_lstack_ring_capacity);
+    (void)CU_ADD_TEST(suite, test_lstack_ring_bdp_size);
+    (void)CU_ADD_TEST(suite, test_lstack_ring_next_size);
 
     switch (g_cunit_mode) {
         case LSTACK_SCREEN:
@@ -22,6 +22,9 @@
 #include <securec.h>
 #include "ltran_tcp_sock.h"
 #include "ltran_tcp_conn.h"
+#include "ltran_timer.h"
+#include "ltran_base.h"
+#include "ltran_instance.h"
 
 #define MAX_CONN 10
 #define MAX_SOCK 10
@@ -78,6 +81,19 @@ void test_tcp_conn(void)
         }
     }
 
+    /* bulk lookup: src_port 23 ~ 23 + MAX_CONN - 1 exist, 23 + MAX_CONN not */
+    struct gazelle_quintuple quintuples[MAX_CONN + 1];
+    struct gazelle_tcp_conn *conns[MAX_CONN + 1];
+    for (int i = 0; i <= MAX_CONN; i++) {
+        quintuples[i] = quintuple;
+        quintuples[i].src_port = 23 + i; /* 23: first src port added above */
+    }
+    gazelle_conn_get_bulk(gazelle_get_tcp_conn_htable(), quintuples, MAX_CONN + 1, conns);
+    for (int i = 0; i < MAX_CONN; i++) {
+        CU_ASSERT(conns[i] != NULL);
+    }
+    CU_ASSERT(conns[MAX_CONN] == NULL);
+
     gazelle_tcp_conn_htable_destroy();
 }
 
@@ -131,3 +147,179 @@ void test_tcp_sock(void)
 
     gazelle_tcp_sock_htable_destroy();
 }
+
+void test_tcp_conn_aging(void)
+{
+    struct gazelle_tcp_conn *tcp_conn = NULL;
+    struct gazelle_quintuple quintuple;
+    /* 1: set instance on */
+    int32_t instance_cur_tick = 1;
+
+    gazelle_set_tcp_sock_htable(gazelle_tcp_sock_htable_create(MAX_SOCK));
+    gazelle_set_tcp_conn_htable(gazelle_tcp_conn_htable_create(MAX_CONN));
+
+    quintuple.src_ip = inet_addr("192.168.1.1");
+    quintuple.dst_ip = inet_addr("192.168.1.2");
+    quintuple.src_port = 22; /* 22:src port id */
+    quintuple.dst_port = 23; /* 23:dst port id */
+    quintuple.protocol = 0;
+
+    /* conn not confirmed by lstack is deleted after GAZELLE_CONN_TIMEOUT ticks */
+    tcp_conn = gazelle_conn_add_by_quintuple(gazelle_get_tcp_conn_htable(), &quintuple);
+    CU_ASSERT(tcp_conn != NULL);
+    tcp_conn->instance_cur_tick = &instance_cur_tick;
+    tcp_conn->instance_reg_tick = 1;
+    for (int i = 0; i < GAZELLE_CONN_TIMEOUT - 1; i++) {
+        gazelle_delete_aging_conn(gazelle_get_tcp_conn_htable());
+    }
+    CU_ASSERT(gazelle_conn_get_by_quintuple(gazelle_get_tcp_conn_htable(), &quintuple) != NULL);
+    gazelle_delete_aging_conn(gazelle_get_tcp_conn_htable());
+    CU_ASSERT(gazelle_get_tcp_conn_htable()->cur_conn_num == 0);
+
+    /* confirmed conn stays until its instance logout */
+    tcp_conn = gazelle_conn_add_by_quintuple(gazelle_get_tcp_conn_htable(), &quintuple);
+    CU_ASSERT(tcp_conn != NULL);
+    tcp_conn->instance_cur_tick = &instance_cur_tick;
+    tcp_conn->instance_reg_tick = 1;
+    tcp_conn->conn_timeout = -1;
+    uint32_t ticks = GAZELLE_CONN_TIMEOUT + gazelle_logout_scan_ticks();
+    for (uint32_t i = 0; i < ticks; i++) {
+        gazelle_delete_aging_conn(gazelle_get_tcp_conn_htable());
+    }
+    CU_ASSERT(gazelle_conn_get_by_quintuple(gazelle_get_tcp_conn_htable(), &quintuple) != NULL);
+
+    instance_cur_tick++;
+    for (uint32_t i = 0; i < gazelle_logout_scan_ticks(); i++) {
+        gazelle_delete_aging_conn(gazelle_get_tcp_conn_htable());
+    }
+    CU_ASSERT(gazelle_get_tcp_conn_htable()->cur_conn_num == 0);
+
+    gazelle_tcp_conn_htable_destroy();
+    gazelle_tcp_sock_htable_destroy();
+}
+
+void test_tcp_conn_forward_cores(void)
+{
+    struct gazelle_quintuple quintuple;
+    /* 1: set instance on */
+    int32_t instance_cur_tick = 1;
+
+    gazelle_set_tcp_conn_htable_by_core(0, gazelle_tcp_conn_htable_create(MAX_CONN));
+    gazelle_set_tcp_conn_htable_by_core(1, gazelle_tcp_conn_htable_create(MAX_CONN));
+    CU_ASSERT(gazelle_get_tcp_conn_htable_by_core(0) != NULL);
+    CU_ASSERT(gazelle_get_tcp_conn_htable_by_core(1) != NULL);
+
+    quintuple.src_ip = inet_addr("192.168.1.1");
+    quintuple.dst_ip = inet_addr("192.168.1.2");
+    quintuple.src_port = 22; /* 22:src port id */
+    quintuple.dst_port = 23; /* 23:dst port id */
+    quintuple.protocol = 0;
+
+    /* conn added by forward core 1 is only seen in its own htable */
+    set_forward_core_id(1);
+    CU_ASSERT(gazelle_get_tcp_conn_htable() == gazelle_get_tcp_conn_htable_by_core(1));
+    struct gazelle_tcp_conn *tcp_conn = gazelle_conn_add_by_quintuple(gazelle_get_tcp_conn_htable(), &quintuple);
+    CU_ASSERT(tcp_conn != NULL);
+    tcp_conn->instance_cur_tick = &instance_cur_tick;
+    /* 1: set instacn_cur_tick = instance_reg_tick indicate instance is on */
+    tcp_conn->instance_reg_tick = 1;
+    CU_ASSERT(gazelle_conn_get_by_quintuple(gazelle_get_tcp_conn_htable(), &quintuple) != NULL);
+
+    set_forward_core_id(0);
+    CU_ASSERT(gazelle_conn_get_by_quintuple(gazelle_get_tcp_conn_htable(), &quintuple) == NULL);
+    CU_ASSERT(gazelle_get_tcp_conn_htable()->cur_conn_num == 0);
+    CU_ASSERT(gazelle_get_tcp_conn_htable_by_core(1)->cur_conn_num == 1);
+
+    /* destroy frees htables of all forward cores */
+    gazelle_tcp_conn_htable_destroy();
+    CU_ASSERT(gazelle_get_tcp_conn_htable_by_core(0) == NULL);
+    CU_ASSERT(gazelle_get_tcp_conn_htable_by_core(1) == NULL);
+}
+
+#define EPOCH_TEST_MAX_CONN     4096
+/* load factor 3/4 of GAZELLE_CONN_HTABLE_INIT_SIZE buckets, then of twice as many */
+#define EPOCH_TEST_REHASH1_CONN (GAZELLE_CONN_HTABLE_INIT_SIZE * GAZELLE_CONN_BUCKET_ENTRIES * 3 / 4 + 1)
+#define EPOCH_TEST_REHASH2_CONN (GAZELLE_CONN_HTABLE_INIT_SIZE * GAZELLE_CONN_BUCKET_ENTRIES * 2 * 3 / 4 + 1)
+
+static void conn_htable_add_range(struct gazelle_tcp_conn_htable *conn_htable, uint32_t start, uint32_t end)
+{
+    struct gazelle_quintuple quintuple = {0};
+
+    quintuple.src_ip = inet_addr("192.168.1.1");
+    quintuple.dst_ip = inet_addr("192.168.1.2");
+    quintuple.dst_port = 23; /* 23:dst port id */
+    for (uint32_t i = start; i < end; i++) {
+        quintuple.src_port = (uint16_t)i;
+        CU_ASSERT(gazelle_conn_add_by_quintuple(conn_htable, &quintuple) != NULL);
+    }
+}
+
+static uint32_t conn_htable_iterate_count(const struct gazelle_tcp_conn_htable *conn_htable)
+{
+    uint32_t pos = 0;
+    uint32_t count = 0;
+
+    while (gazelle_conn_htable_next(conn_htable, &pos) != NULL) {
+        count++;
+    }
+    return count;
+}
+
+void test_tcp_conn_htable_epoch(void)
+{
+    struct gazelle_tcp_conn_htable *conn_htable = gazelle_tcp_conn_htable_create(EPOCH_TEST_MAX_CONN);
+    CU_ASSERT_FATAL(conn_htable != NULL);
+
+    /* reader entered before rehash keeps the old buckets alive */
+    const struct gazelle_tcp_conn_hbucket *old_buckets = conn_htable->buckets;
+    CU_ASSERT(gazelle_conn_htable_read_begin(conn_htable) == 0);
+    CU_ASSERT(conn_htable->reader_epoch == conn_htable->epoch);
+    conn_htable_add_range(conn_htable, 0, EPOCH_TEST_REHASH1_CONN);
+    CU_ASSERT(conn_htable->buckets != old_buckets);
+    CU_ASSERT(conn_htable->bucket_mask == GAZELLE_CONN_HTABLE_INIT_SIZE * 2 - 1);
+    CU_ASSERT(conn_htable->retire_list.next != &conn_htable->retire_list);
+    struct gazelle_tcp_conn_retired *retired =
+        container_of(conn_htable->retire_list.next, struct gazelle_tcp_conn_retired, node);
+    CU_ASSERT(retired->buckets == old_buckets);
+    CU_ASSERT(retired->retire_epoch == conn_htable->reader_epoch);
+    CU_ASSERT(conn_htable_iterate_count(conn_htable) == EPOCH_TEST_REHASH1_CONN);
+
+    gazelle_conn_htable_reclaim(conn_htable);
+    CU_ASSERT(conn_htable->retire_list.next != &conn_htable->retire_list);
+
+    /* reader left, retired buckets are freed */
+    gazelle_conn_htable_read_end(conn_htable);
+    CU_ASSERT(conn_htable->reader_epoch == 0);
+    gazelle_conn_htable_reclaim(conn_htable);
+    CU_ASSERT(conn_htable->retire_list.next == &conn_htable->retire_list);
+
+    /* reader entered after a rehash doesn't hold buckets retired before it, only the ones retired later */
+    CU_ASSERT(gazelle_conn_htable_read_begin(conn_htable) == 0);
+    uint64_t reader_epoch = conn_htable->reader_epoch;
+    conn_htable_add_range(conn_htable, EPOCH_TEST_REHASH1_CONN, EPOCH_TEST_REHASH2_CONN);
+    CU_ASSERT(conn_htable->bucket_mask == GAZELLE_CONN_HTABLE_INIT_SIZE * 4 - 1); /* 4: doubled twice */
+    CU_ASSERT(conn_htable->epoch == reader_epoch + 1);
+    CU_ASSERT(conn_htable->retire_list.next != &conn_htable->retire_list);
+    gazelle_conn_htable_read_end(conn_htable);
+
+    /* new reader can't see the retired buckets, it doesn't block reclaim */
+    CU_ASSERT(gazelle_conn_htable_read_begin(conn_htable) == 0);
+    gazelle_conn_htable_reclaim(conn_htable);
+    CU_ASSERT(conn_htable->retire_list.next == &conn_htable->retire_list);
+    CU_ASSERT(conn_htable_iterate_count(conn_htable) == EPOCH_TEST_REHASH2_CONN);
+    gazelle_conn_htable_read_end(conn_htable);
+
+    /* conns moved by rehash are all found */
+    struct gazelle_quintuple quintuple = {0};
+    quintuple.src_ip = inet_addr("192.168.1.1");
+    quintuple.dst_ip = inet_addr("192.168.1.2");
+    quintuple.dst_port = 23; /* 23:dst port id */
+    for (uint32_t i = 0; i < EPOCH_TEST_REHASH2_CONN; i++) {
+        quintuple.src_port = (uint16_t)i;
+        CU_ASSERT(gazelle_conn_get_by_quintuple(conn_htable, &quintuple) != NULL);
+    }
+    CU_ASSERT(conn_htable->cur_conn_num == EPOCH_TEST_REHASH2_CONN);
+
+    gazelle_set_tcp_conn_htable(conn_htable);
+    gazelle_tcp_conn_htable_destroy();
+}
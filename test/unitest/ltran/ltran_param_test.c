@@ -21,6 +21,7 @@
 #include <arpa/inet.h>
 #include <securec.h>
 #include "ltran_param.h"
+#include "ltran_base.h"
 
 #define MAX_CMD_LEN 1024
 
@@ -41,10 +42,9 @@ static void restore_tmp_config(void)
     execute_cmd("cp -f ../ltran/config/ltran.conf ../ltran/config/ltran_tmp.conf");
 }
 
-static int ltran_bad_param(const char *conf_file_filed)
+static int ltran_param_conf(const char *conf_file_filed, struct ltran_config *ltran_conf)
 {
     int ret;
-    struct ltran_config ltran_conf;
     const char *conf_file_path = "../ltran/config/ltran_tmp.conf";
     char cmd[MAX_CMD_LEN];
 
@@ -59,11 +59,18 @@ static int ltran_bad_param(const char *conf_file_filed)
 
     execute_cmd(cmd);
 
-    ret = parse_config_file_args(conf_file_path, &ltran_conf);
+    ret = parse_config_file_args(conf_file_path, ltran_conf);
 
     return ret;
 }
 
+static int ltran_bad_param(const char *conf_file_filed)
+{
+    struct ltran_config ltran_conf;
+
+    return ltran_param_conf(conf_file_filed, &ltran_conf);
+}
+
 void test_ltran_bad_params_clients(void)
 {
     /* ltran start negative client */
@@ -318,3 +325,27 @@ void test_ltran_normal_param(void)
     check_bond_param(&ltran_conf);
     free(subnet_str);
 }
+
+void test_ltran_bad_params_forward_cores(void)
+{
+    struct ltran_config ltran_conf;
+
+    /* ltran start zero forward cores */
+    CU_ASSERT(ltran_bad_param("$aforward_cores = 0") != 0);
+    CU_ASSERT(gazelle_get_errno() == GAZELLE_ERANGE);
+
+    /* ltran start exceed max forward cores */
+    CU_ASSERT(ltran_bad_param("$aforward_cores = 9") != 0);
+    CU_ASSERT(gazelle_get_errno() == GAZELLE_ERANGE);
+
+    /* ltran start none forward cores, one core polls all queues */
+    CU_ASSERT(ltran_param_conf("/forward_cores/d", &ltran_conf) == 0);
+    CU_ASSERT(ltran_conf.dpdk.forward_cores == GAZELLE_FORWARD_CORES_DEFAULT);
+
+    /* ltran start max forward cores, every core owns at least one rx and tx queue */
+    CU_ASSERT(ltran_param_conf("$aforward_cores = 8", &ltran_conf) == 0);
+    CU_ASSERT(gazelle_get_errno() == GAZELLE_SUCCESS);
+    CU_ASSERT(ltran_conf.dpdk.forward_cores == GAZELLE_MAX_FORWARD_CORES);
+    CU_ASSERT(ltran_conf.bond.rx_queue_num >= GAZELLE_MAX_FORWARD_CORES);
+    CU_ASSERT(ltran_conf.bond.tx_queue_num >= GAZELLE_MAX_FORWARD_CORES);
+}
@@ -23,7 +23,11 @@ void test_ltran_bad_params_bond_mode(void);
 void test_ltran_bad_params_bond_miimon(void);
 void test_ltran_bad_params_bond_mtu(void);
 void test_ltran_bad_params_macs(void);
+void test_ltran_bad_params_forward_cores(void);
 void test_tcp_conn(void);
 void test_tcp_sock(void);
+void test_tcp_conn_aging(void);
+void test_tcp_conn_forward_cores(void);
+void test_tcp_conn_htable_epoch(void);
 
 #endif
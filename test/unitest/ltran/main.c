@@ -52,8 +52,12 @@ int main(int argc, char **argv)
     (void)CU_ADD_TEST(suite, test_ltran_bad_params_bond_miimon);
     (void)CU_ADD_TEST(suite, test_ltran_bad_params_bond_mtu);
     (void)CU_ADD_TEST(suite, test_ltran_bad_params_macs);
+    (void)CU_ADD_TEST(suite, test_ltran_bad_params_forward_cores);
     (void)CU_ADD_TEST(suite, test_tcp_conn);
     (void)CU_ADD_TEST(suite, test_tcp_sock);
+    (void)CU_ADD_TEST(suite, test_tcp_conn_aging);
+    (void)CU_ADD_TEST(suite, test_tcp_conn_forward_cores);
+    (void)CU_ADD_TEST(suite, test_tcp_conn_htable_epoch);
 
     switch (g_cunit_mode) {
         case CUNIT_SCREEN: